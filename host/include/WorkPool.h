@@ -0,0 +1,150 @@
+/*
+  WorkPool.h - Work-stealing thread pool for the host tools
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Every worker has its own task deque. A worker takes tasks from the back of its
+  own deque and, when that runs empty, steals from the front of the others, so
+  uneven tasks (nodes with more frames, slow shards) even out by themselves.
+  Run() blocks until all tasks are done and returns the CPU time the workers
+  spent in tasks. A pool can be run again after adding new tasks.
+*/
+
+#ifndef WorkPool_h
+#define WorkPool_h
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+class WorkPool
+{
+  public:
+    typedef std::function<void(unsigned int Worker)> Task;
+
+    WorkPool(unsigned int Workers)
+      : _Queues(Workers ? Workers : 1)
+    {
+    }
+
+    unsigned int Get_Workers()
+    {
+      return _Queues.size();
+    }
+
+    // tasks are spread round robin, stealing balances them later
+    void Add(Task Work)
+    {
+      Queue &Q = _Queues[_Next++ % _Queues.size()];
+      std::lock_guard<std::mutex> Lock(Q.Lock);
+      Q.Tasks.push_back(Work);
+      _Pending++;
+    }
+
+    // returns CPU time of all workers in ns
+    uint64_t Run()
+    {
+      std::vector<std::thread> Threads;
+      std::atomic<uint64_t> Cpu_Time(0);
+      unsigned int i;
+
+      for(i = 0; i < _Queues.size(); i++)
+      {
+        Threads.push_back(std::thread([this, i, &Cpu_Time]()
+        {
+          uint64_t Busy = 0;
+          uint64_t Start;
+          Task Work;
+
+          while(_Pending.load() != 0)
+          {
+            if(Take(i, Work) || Steal(i, Work))
+            {
+              //Only time spent in tasks, not waiting for the last ones
+              Start = Thread_Time();
+              Work(i);
+              Busy += Thread_Time() - Start;
+              _Pending--;
+            }
+            else
+            {
+              std::this_thread::yield();
+            }
+          }
+          Cpu_Time += Busy;
+        }));
+      }
+
+      for(i = 0; i < Threads.size(); i++)
+      {
+        Threads[i].join();
+      }
+
+      return Cpu_Time.load();
+    }
+
+    unsigned long Get_Steals()
+    {
+      return _Steals.load();
+    }
+
+  private:
+    struct Queue
+    {
+      std::mutex Lock;
+      std::deque<Task> Tasks;
+    };
+
+    std::vector<Queue> _Queues;
+    std::atomic<unsigned long> _Pending{0};
+    std::atomic<unsigned long> _Steals{0};
+    unsigned int _Next = 0;
+
+    bool Take(unsigned int Worker, Task &Work)
+    {
+      Queue &Q = _Queues[Worker];
+      std::lock_guard<std::mutex> Lock(Q.Lock);
+
+      if(Q.Tasks.empty())
+      {
+        return false;
+      }
+      Work = Q.Tasks.back();
+      Q.Tasks.pop_back();
+      return true;
+    }
+
+    bool Steal(unsigned int Worker, Task &Work)
+    {
+      unsigned int i;
+
+      for(i = 1; i < _Queues.size(); i++)
+      {
+        Queue &Q = _Queues[(Worker + i) % _Queues.size()];
+        std::lock_guard<std::mutex> Lock(Q.Lock);
+
+        if(!Q.Tasks.empty())
+        {
+          Work = Q.Tasks.front();
+          Q.Tasks.pop_front();
+          _Steals++;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static uint64_t Thread_Time()
+    {
+      struct timespec Now;
+
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &Now);
+      return (uint64_t)Now.tv_sec * 1000000000ULL + Now.tv_nsec;
+    }
+};
+
+#endif
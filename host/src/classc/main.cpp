@@ -0,0 +1,202 @@
+/*
+  main.cpp - Class C downlinks on the simulated radio
+  Commands for the node come at random times. In class C they are delivered as soon
+  as they are sent on RX2, in class A they wait for the next uplink. Some are
+  corrupted, replayed or for another device, Receive() must drop those.
+  The uplinks are confirmed, the network acknowledges each with its next command on
+  RX2 and isAcked() must follow.
+
+  classc [commands] [uplink period s] [commands per hour]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+
+unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char AppSkey[16] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB, 0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+unsigned char Other_Addr[4] = { 0x26, 0x01, 0x1B, 0xDB };
+
+static bool Rx_Done;
+
+static void On_Receive()
+{
+  Rx_Done = true;
+}
+
+/*
+  Network side: builds a data down frame with FPort and FRMPayload
+*/
+static unsigned char Build_Downlink(unsigned char *Package, const unsigned char *Payload, unsigned char Length,
+  unsigned long Frame_Counter, unsigned char Port, bool Confirmed, bool Ack, unsigned char *Addr)
+{
+  LoRaWAN_Crypto Crypto;
+  unsigned char i;
+
+  Package[0] = Confirmed ? LORAWAN_CONFIRMED_DOWN : LORAWAN_UNCONFIRMED_DOWN;
+  for(i = 0; i < 4; i++)
+  {
+    Package[1 + i] = Addr[3 - i];
+  }
+  Package[5] = Ack ? 0x20 : 0x00;
+  Package[6] = Frame_Counter & 0xFF;
+  Package[7] = (Frame_Counter >> 8) & 0xFF;
+  Package[8] = Port;
+  memcpy(&Package[9], Payload, Length);
+
+  Crypto.Encrypt_Payload(&Package[9], Length, Frame_Counter, 0x01, Addr, AppSkey);
+  Crypto.Calculate_MIC(Package, &Package[9 + Length], 9 + Length, Frame_Counter, 0x01, Addr, NwkSkey);
+
+  return 13 + Length;
+}
+
+int main(int argc, char **argv)
+{
+  long Commands = argc > 1 ? atol(argv[1]) : 2000;
+  double Period = argc > 2 ? atof(argv[2]) : 60.0;
+  double Per_Hour = argc > 3 ? atof(argv[3]) : 30.0;
+  SimRadio radio;
+  LoRaWAN<SimRadio> lora(radio);
+  std::mt19937 Random(3);
+  std::exponential_distribution<double> Gap(Per_Hour / 3600.0);
+  std::uniform_int_distribution<int> Kind(0, 19);
+  unsigned char Uplink[6] = { 0, 1, 12, 13, 14, 15 };
+  unsigned char Command[8];
+  unsigned char Package[64];
+  unsigned char Data[LORAWAN_MAX_PAYLOAD];
+  unsigned char Data_Length;
+  unsigned char Port;
+  unsigned char Length;
+  unsigned long Frame_Counter = 0;
+  uint64_t Period_Us = (uint64_t)(Period * 1e6);
+  uint64_t Next_Uplink = 0;
+  uint64_t Arrival;
+  uint64_t Latency_C = 0;
+  uint64_t Latency_A = 0;
+  uint64_t Worst_C = 0;
+  long Accepted = 0;
+  long Wrong = 0;
+  long Rejected = 0;
+  long Forged = 0;
+  long Missed = 0;
+  long Acks = 0;
+  bool Ack_Expected = false;
+  long Uplinks_Acked = 0;
+  long Uplinks_Reported = 0;
+  bool Ack_Owed = false;
+  long n;
+  unsigned char i;
+
+  lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setClassC(true);
+  lora.setConfirmed(true);
+  radio.RFM_On_Receive(On_Receive);
+
+  Arrival = (uint64_t)(Gap(Random) * 1e6);
+
+  for(n = 0; n < Commands; n++)
+  {
+    int Type = Kind(Random);
+    bool Confirmed = (n & 3) == 0;
+    bool Ack_Sent = false;
+
+    //Uplinks up to the command, class A would deliver it after the next one
+    while(Next_Uplink <= Arrival)
+    {
+      radio.Set_Time(Next_Uplink);
+      lora.Send_Data(Uplink, sizeof(Uplink));
+      if(Ack_Expected)
+      {
+        Acks += (radio.Last_Package().Data[5] & 0x20) ? 1 : 0;
+        Ack_Expected = false;
+      }
+      for(i = 0; i < sizeof(Uplink); i++)
+      {
+        Uplink[i] = n + i;
+      }
+      Next_Uplink += Period_Us;
+      Ack_Owed = true;
+    }
+    Latency_A += Next_Uplink + SimRadio::Time_On_Air(2, 15) + 1000000 - Arrival;
+
+    for(i = 0; i < sizeof(Command); i++)
+    {
+      Command[i] = Random();
+    }
+
+    //Most commands are genuine, the rest must be dropped
+    if(Type == 0)
+    {
+      Length = Build_Downlink(Package, Command, sizeof(Command), Frame_Counter, 10, false, false, DevAddr);
+      Package[Length - 1] ^= 0x01;
+      Forged++;
+    }
+    else if(Type == 1)
+    {
+      Length = Build_Downlink(Package, Command, sizeof(Command), Frame_Counter, 10, false, false, Other_Addr);
+      Forged++;
+    }
+    else if(Type == 2 && Frame_Counter > 0)
+    {
+      Length = Build_Downlink(Package, Command, sizeof(Command), Frame_Counter - 1, 10, false, false, DevAddr);
+      Forged++;
+    }
+    else
+    {
+      Length = Build_Downlink(Package, Command, sizeof(Command), Frame_Counter++, 10, Confirmed, Ack_Owed, DevAddr);
+      Type = -1;
+      Ack_Sent = Ack_Owed;
+    }
+
+    //The package is on air on RX2, the interrupt comes at its end
+    radio.Set_Time(Arrival + SimRadio::Time_On_Air(radio.RFM_Get_Rx2_Datarate(), Length));
+    Rx_Done = false;
+    if(!radio.Deliver(Package, Length))
+    {
+      Missed++;
+      Arrival += (uint64_t)(Gap(Random) * 1e6);
+      continue;
+    }
+
+    if(!Rx_Done || !lora.Receive(Data, &Data_Length, &Port))
+    {
+      Rejected++;
+    }
+    else if(Type != -1 || Port != 10 || Data_Length != sizeof(Command) || memcmp(Data, Command, sizeof(Command)) != 0)
+    {
+      Wrong++;
+    }
+    else
+    {
+      Accepted++;
+      Ack_Expected = Confirmed;
+      if(Ack_Sent)
+      {
+        Uplinks_Acked++;
+        Uplinks_Reported += lora.isAcked() ? 1 : 0;
+        Ack_Owed = false;
+      }
+      Latency_C += radio.Get_Time() - Arrival;
+      if(radio.Get_Time() - Arrival > Worst_C)
+      {
+        Worst_C = radio.Get_Time() - Arrival;
+      }
+    }
+
+    Arrival += (uint64_t)(Gap(Random) * 1e6);
+  }
+
+  printf("%ld commands, %ld accepted, %ld of %ld forged rejected, %ld wrong, %ld missed, %ld acks, %u dropped\n",
+    Commands, Accepted, Rejected, Forged, Wrong, Missed, Acks, radio.RFM_Get_Rx_Dropped());
+  printf("%ld uplinks acked on RX2, %ld seen by isAcked()\n", Uplinks_Acked, Uplinks_Reported);
+  printf("latency class C %.3f s (worst %.3f s, RX2 DR%u), class A %.1f s with an uplink every %.0f s\n",
+    Accepted ? Latency_C / 1e6 / Accepted : 0.0, Worst_C / 1e6, radio.RFM_Get_Rx2_Datarate(),
+    Commands ? Latency_A / 1e6 / Commands : 0.0, Period);
+
+  return Wrong != 0 || Rejected != Forged || Uplinks_Reported != Uplinks_Acked;
+}
@@ -0,0 +1,283 @@
+/*
+  main.cpp - Checks the AES backends against each other and compares speed
+  Runs the FIPS-197 and RFC 4493 vectors and random keys, blocks and frames
+  through LoRaWAN_Crypto with and without hardware AES, the batches of frames
+  of different keys against one frame at a time, and the bitsliced AES against
+  the byte wise AES. Reports any difference in output and exits with 1
+  on a mismatch.
+
+  crypto [rounds]
+    rounds  random cases per function (100000)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "LoRaWAN_Crypto.h"
+
+static LoRaWAN_Crypto Crypto;
+static unsigned long Failed = 0;
+
+static uint32_t Next_Random(uint32_t &State)
+{
+  State ^= State << 13;
+  State ^= State >> 17;
+  State ^= State << 5;
+  return State;
+}
+
+static void Random_Bytes(uint32_t &State, unsigned char *Data, unsigned int Length)
+{
+  unsigned int i;
+
+  for(i = 0; i < Length; i++)
+  {
+    Data[i] = Next_Random(State);
+  }
+}
+
+static void Check(const char *Name, const unsigned char *Result, const unsigned char *Expected, unsigned int Length)
+{
+  if(memcmp(Result, Expected, Length) != 0)
+  {
+    printf("  %s differs\n", Name);
+    Failed++;
+  }
+}
+
+static void Known_Answers()
+{
+  unsigned char Key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F };
+  unsigned char Block[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF };
+  const unsigned char Cipher[16] = { 0x69, 0xC4, 0xE0, 0xD8, 0x6A, 0x7B, 0x04, 0x30, 0xD8, 0xCD, 0xB7, 0x80, 0x70, 0xB4, 0xC5, 0x5A };
+  unsigned char CMAC_Key[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+  unsigned char Message[40] = {
+    0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+    0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+    0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11
+  };
+  const unsigned char MIC_16[4] = { 0x07, 0x0A, 0x16, 0xB4 };
+  const unsigned char MIC_40[4] = { 0xDF, 0xA6, 0x67, 0x47 };
+  unsigned char MIC[4];
+
+  Crypto.AES_Encrypt(Block, Key);
+  Check("FIPS-197 C.1", Block, Cipher, 16);
+
+  Crypto.Calculate_CMAC(0, Message, MIC, 16, CMAC_Key);
+  Check("RFC 4493 16 bytes", MIC, MIC_16, 4);
+
+  Crypto.Calculate_CMAC(0, Message, MIC, 40, CMAC_Key);
+  Check("RFC 4493 40 bytes", MIC, MIC_40, 4);
+}
+
+/*
+  Random cases, every one is run with hardware AES and without and the output
+  compared
+*/
+static void Differential(unsigned long Rounds)
+{
+  uint32_t Random = 0x6C078965UL;
+  unsigned char Key[16];
+  unsigned char DevAddr[4];
+  unsigned char Data[2][255];
+  unsigned char MIC[2][4];
+  unsigned char Blocks;
+  unsigned char Length;
+  unsigned int Frame_Counter;
+  unsigned char Direction;
+  unsigned long n;
+  int Backend;
+
+  for(n = 0; n < Rounds; n++)
+  {
+    Random_Bytes(Random, Key, 16);
+    Random_Bytes(Random, DevAddr, 4);
+    Random_Bytes(Random, Data[0], sizeof(Data[0]));
+    memcpy(Data[1], Data[0], sizeof(Data[0]));
+    Frame_Counter = Next_Random(Random);
+    Direction = Next_Random(Random) & 1;
+    Length = Next_Random(Random) % sizeof(Data[0]) + 1;
+    Blocks = Next_Random(Random) % 15 + 1;
+
+    for(Backend = 0; Backend < 2; Backend++)
+    {
+      LoRaWAN_Crypto::Set_Accelerated(Backend == 1);
+      Crypto.AES_Encrypt_Blocks(Data[Backend], Blocks, Key);
+    }
+    Check("AES_Encrypt_Blocks", Data[1], Data[0], Blocks * 16);
+
+    for(Backend = 0; Backend < 2; Backend++)
+    {
+      LoRaWAN_Crypto::Set_Accelerated(Backend == 1);
+      Crypto.Encrypt_Payload(Data[Backend], Length, Frame_Counter, Direction, DevAddr, Key);
+    }
+    Check("Encrypt_Payload", Data[1], Data[0], Length);
+
+    for(Backend = 0; Backend < 2; Backend++)
+    {
+      LoRaWAN_Crypto::Set_Accelerated(Backend == 1);
+      Crypto.Calculate_MIC(Data[Backend], MIC[Backend], Length, Frame_Counter, Direction, DevAddr, Key);
+    }
+    Check("Calculate_MIC", MIC[1], MIC[0], 4);
+  }
+}
+
+/*
+  Frames with their own keys and lengths, Calculate_MIC_Batch and
+  Encrypt_Payload_Batch against Calculate_MIC and Encrypt_Payload of each.
+  Batches of up to 40 frames, more than one CRYPTO_BATCH_FRAMES chunk.
+*/
+static void Batch(unsigned long Rounds)
+{
+  uint32_t Random = 0x5BD1E995UL;
+  Crypto_Frame Frames[40];
+  unsigned char Keys[40][16];
+  unsigned char DevAddr[40][4];
+  unsigned char Data[2][40][255];
+  unsigned char MIC[4];
+  unsigned int Count;
+  unsigned int i;
+  unsigned long n;
+
+  for(n = 0; n < Rounds; n += Count)
+  {
+    Count = Next_Random(Random) % 40 + 1;
+    for(i = 0; i < Count; i++)
+    {
+      Random_Bytes(Random, Keys[i], 16);
+      Random_Bytes(Random, DevAddr[i], 4);
+      Random_Bytes(Random, Data[0][i], 255);
+      memcpy(Data[1][i], Data[0][i], 255);
+
+      Frames[i].Data = Data[1][i];
+      //Empty payloads and MICs over the header only happen too
+      Frames[i].Data_Length = Next_Random(Random) % 256;
+      Frames[i].Frame_Counter = Next_Random(Random);
+      Frames[i].Direction = Next_Random(Random) & 1;
+      Frames[i].DevAddr = DevAddr[i];
+      Frames[i].Key = Keys[i];
+    }
+
+    Crypto.Calculate_MIC_Batch(Frames, Count);
+    for(i = 0; i < Count; i++)
+    {
+      Crypto.Calculate_MIC(Data[0][i], MIC, Frames[i].Data_Length, Frames[i].Frame_Counter, Frames[i].Direction, DevAddr[i], Keys[i]);
+      Check("Calculate_MIC_Batch", Frames[i].MIC, MIC, 4);
+    }
+
+    Crypto.Encrypt_Payload_Batch(Frames, Count);
+    for(i = 0; i < Count; i++)
+    {
+      Crypto.Encrypt_Payload(Data[0][i], Frames[i].Data_Length, Frames[i].Frame_Counter, Frames[i].Direction, DevAddr[i], Keys[i]);
+      Check("Encrypt_Payload_Batch", Data[1][i], Data[0][i], 255);
+    }
+  }
+}
+
+/*
+  Bitsliced AES against the byte wise AES, single blocks and pairs
+*/
+static void Bitslice(unsigned long Rounds)
+{
+  uint32_t Random = 0x1B873593UL;
+  unsigned char Key[16];
+  unsigned char Data[2][32];
+  uint32_t Round_Keys[AES_BITSLICE_KEY_WORDS];
+  unsigned char Blocks;
+  unsigned long n;
+
+  LoRaWAN_Crypto::Set_Accelerated(false);
+
+  for(n = 0; n < Rounds; n++)
+  {
+    Random_Bytes(Random, Key, 16);
+    Random_Bytes(Random, Data[0], 32);
+    memcpy(Data[1], Data[0], 32);
+    Blocks = (n & 1) + 1;
+
+    AES_Bitslice_Expand_Key(Key, Round_Keys);
+    AES_Bitslice_Encrypt(Data[1], Blocks, Round_Keys);
+    Crypto.AES_Encrypt_Blocks(Data[0], Blocks, Key);
+    Check("AES_Bitslice_Encrypt", Data[1], Data[0], 32);
+  }
+}
+
+static void Benchmark(unsigned long Rounds)
+{
+  unsigned char Key[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+  unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+  unsigned char Data[255];
+  unsigned char MIC[4];
+  unsigned char Lengths[] = { 16, 32, 48, 64, 255 };
+  unsigned char Length;
+  unsigned long n;
+  unsigned char i;
+  double Time;
+
+  memset(Data, 0x5A, sizeof(Data));
+
+  auto Start = std::chrono::steady_clock::now();
+  for(n = 0; n < Rounds; n++)
+  {
+    Crypto.Encrypt_Payload(Data, 64, n, 0, DevAddr, Key);
+    Crypto.Calculate_MIC(Data, MIC, 64, n, 0, DevAddr, Key);
+  }
+  Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  printf("  %-14s %8.0f ns per 64 byte frame (encrypt + MIC)  %.0f frames/s\n",
+    LoRaWAN_Crypto::Get_Backend(), Time * 1e9 / Rounds, Rounds / Time);
+
+  //Keystream alone, the bitsliced AES takes over from CRYPTO_BITSLICE_BLOCKS on
+  printf("  %-14s", "");
+  for(i = 0; i < sizeof(Lengths); i++)
+  {
+    Length = Lengths[i];
+    Start = std::chrono::steady_clock::now();
+    for(n = 0; n < Rounds; n++)
+    {
+      Crypto.Encrypt_Payload(Data, Length, n, 0, DevAddr, Key);
+    }
+    Time = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+    printf(" %u bytes %.0f ns/block ", Length, Time * 1e9 / Rounds / ((Length + 15) / 16));
+  }
+  printf("\n");
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long Rounds = (argc > 1) ? strtoul(argv[1], 0, 0) : 100000;
+  bool Accelerated = LoRaWAN_Crypto::Set_Accelerated(true);
+
+  printf("backend %s\n", LoRaWAN_Crypto::Get_Backend());
+
+  printf("known answers\n");
+  LoRaWAN_Crypto::Set_Accelerated(false);
+  Known_Answers();
+  if(Accelerated)
+  {
+    LoRaWAN_Crypto::Set_Accelerated(true);
+    Known_Answers();
+
+    printf("differential, %lu rounds\n", Rounds);
+    Differential(Rounds);
+
+    printf("batches, %lu frames\n", Rounds);
+    Batch(Rounds);
+  }
+  printf("bitsliced, %lu rounds\n", Rounds);
+  Bitslice(Rounds);
+
+  printf("speed\n");
+  LoRaWAN_Crypto::Set_Accelerated(false);
+  Benchmark(Rounds / 10 + 1);
+  if(Accelerated)
+  {
+    LoRaWAN_Crypto::Set_Accelerated(true);
+    Benchmark(Rounds / 10 + 1);
+  }
+
+  printf("%s\n", Failed ? "FAILED" : "passed");
+  return Failed ? 1 : 0;
+}
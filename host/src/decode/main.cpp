@@ -0,0 +1,396 @@
+/*
+  main.cpp - Batch decoder and verifier for captured LoRaWAN traffic
+  Checks the MIC and decrypts every data frame of a capture with the session keys
+  of its DevAddr. Frames are split over worker threads by DevAddr, so the frames
+  of one session stay in order and its frame counter can be followed.
+
+  decode [-q] [-t threads] sessions capture
+  decode -g sessions capture [sessions count] [frames]
+    -q        statistics only, no frame listing
+    -t        worker threads (all cores)
+    -g        generate a test capture with LoRaWAN<SimRadio> nodes
+
+  sessions  text file, one session per line: DevAddr NwkSkey AppSkey in hex, msb first
+  capture   "LWCAP001" followed by records: time (uint32 ms, little endian),
+            length (uint8) and the PHYPayload
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "FrameDecoder.h"
+#include "WorkPool.h"
+
+#define CAPTURE_MAGIC "LWCAP001"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_RECORD_HEADER 5
+
+// partitions per worker thread, more partitions even out busy DevAddrs
+#define DECODE_PARTITIONS 4
+// frames handed to FrameDecoder::Decode_Batch at once
+#define DECODE_BATCH 64
+
+struct Decode_Result
+{
+  unsigned char Status;
+  Decoded_Frame Frame;
+};
+
+static const char *Status_Text[] = { "ok", "MIC", "unknown", "invalid" };
+
+static bool Parse_Hex(const char *Text, unsigned char *Data, unsigned char Length)
+{
+  unsigned char i;
+  unsigned int Byte;
+
+  if(strlen(Text) != (size_t)Length * 2)
+  {
+    return false;
+  }
+  for(i = 0; i < Length; i++)
+  {
+    if(sscanf(&Text[i * 2], "%2x", &Byte) != 1)
+    {
+      return false;
+    }
+    Data[i] = Byte;
+  }
+  return true;
+}
+
+static void Print_Hex(FILE *File, const unsigned char *Data, unsigned char Length)
+{
+  unsigned char i;
+
+  for(i = 0; i < Length; i++)
+  {
+    fprintf(File, "%02X", Data[i]);
+  }
+}
+
+static long Load_Sessions(const char *Name, FrameDecoder &Decoder)
+{
+  FILE *File = fopen(Name, "r");
+  char Line[256];
+  char Field[3][64];
+  unsigned char DevAddr[4];
+  unsigned char NwkSkey[16];
+  unsigned char AppSkey[16];
+  unsigned long Line_Number = 0;
+
+  if(File == 0)
+  {
+    perror(Name);
+    return -1;
+  }
+
+  while(fgets(Line, sizeof(Line), File))
+  {
+    Line_Number++;
+    if(Line[0] == '#' || sscanf(Line, "%63s %63s %63s", Field[0], Field[1], Field[2]) != 3)
+    {
+      continue;
+    }
+    if(!Parse_Hex(Field[0], DevAddr, 4) || !Parse_Hex(Field[1], NwkSkey, 16) || !Parse_Hex(Field[2], AppSkey, 16))
+    {
+      fprintf(stderr, "%s:%lu: bad session\n", Name, Line_Number);
+      continue;
+    }
+    Decoder.Add_Session(DevAddr, NwkSkey, AppSkey);
+  }
+  fclose(File);
+
+  Decoder.Build_Index();
+  return Decoder.Get_Session_Count();
+}
+
+static uint32_t Next_Random(uint32_t &State)
+{
+  State ^= State << 13;
+  State ^= State >> 17;
+  State ^= State << 5;
+  return State;
+}
+
+/*
+  Writes a session file and a capture with frames of all sessions interleaved.
+  Half of the sessions start just below a 16 bit frame counter rollover and one
+  frame in a hundred gets a flipped bit, to see the MIC fail.
+*/
+static int Generate(const char *Session_Name, const char *Capture_Name, unsigned long Sessions, unsigned long Frames)
+{
+  std::vector<std::unique_ptr<SimRadio> > Radios;
+  std::vector<std::unique_ptr<LoRaWAN<SimRadio> > > Nodes;
+  std::vector<unsigned int> Frame_Counter;
+  FILE *Session_File;
+  FILE *Capture_File;
+  uint32_t Random = 0x2545F491UL;
+  unsigned char Header[CAPTURE_RECORD_HEADER];
+  unsigned char Data[32];
+  unsigned char Length;
+  unsigned long i;
+  unsigned char j;
+
+  Session_File = fopen(Session_Name, "w");
+  Capture_File = fopen(Capture_Name, "wb");
+  if(Session_File == 0 || Capture_File == 0)
+  {
+    perror("generate");
+    return 1;
+  }
+
+  for(i = 0; i < Sessions; i++)
+  {
+    unsigned char DevAddr[4] = { 0x26, (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i };
+    unsigned char NwkSkey[16];
+    unsigned char AppSkey[16];
+
+    for(j = 0; j < 16; j++)
+    {
+      NwkSkey[j] = Next_Random(Random);
+      AppSkey[j] = Next_Random(Random);
+    }
+
+    Radios.push_back(std::unique_ptr<SimRadio>(new SimRadio));
+    Nodes.push_back(std::unique_ptr<LoRaWAN<SimRadio> >(new LoRaWAN<SimRadio>(*Radios[i])));
+    Nodes[i]->setKeys(NwkSkey, AppSkey, DevAddr);
+    Frame_Counter.push_back((i & 1) ? 0xFFF0 : 0);
+
+    Print_Hex(Session_File, DevAddr, 4);
+    fputc(' ', Session_File);
+    Print_Hex(Session_File, NwkSkey, 16);
+    fputc(' ', Session_File);
+    Print_Hex(Session_File, AppSkey, 16);
+    fputc('\n', Session_File);
+  }
+
+  fwrite(CAPTURE_MAGIC, 1, CAPTURE_MAGIC_SIZE, Capture_File);
+
+  for(i = 0; i < Frames; i++)
+  {
+    unsigned long n = Next_Random(Random) % Sessions;
+    uint32_t Time = i * 10;
+
+    Length = 1 + Next_Random(Random) % sizeof(Data);
+    for(j = 0; j < Length; j++)
+    {
+      Data[j] = Next_Random(Random);
+    }
+
+    Nodes[n]->Send_Data(Data, Length, Frame_Counter[n]++);
+    SimRadio_Package &Package = Radios[n]->Last_Package();
+
+    if(Next_Random(Random) % 100 == 0)
+    {
+      Package.Data[Package.Length - 1] ^= 0x01;
+    }
+
+    Header[0] = Time;
+    Header[1] = Time >> 8;
+    Header[2] = Time >> 16;
+    Header[3] = Time >> 24;
+    Header[4] = Package.Length;
+    fwrite(Header, 1, CAPTURE_RECORD_HEADER, Capture_File);
+    fwrite(Package.Data, 1, Package.Length, Capture_File);
+  }
+
+  fclose(Session_File);
+  fclose(Capture_File);
+
+  printf("%lu sessions, %lu frames\n", Sessions, Frames);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  unsigned int Threads = std::thread::hardware_concurrency();
+  bool Quiet = false;
+  int Argument = 1;
+  FrameDecoder Decoder;
+  const unsigned char *Capture;
+  size_t Capture_Size;
+  size_t Offset;
+  std::vector<size_t> Records;
+  std::vector<std::vector<unsigned long> > Partitions;
+  std::unique_ptr<Decode_Result[]> Results;
+  unsigned long Count[4] = { 0, 0, 0, 0 };
+  unsigned long i;
+  uint64_t Cpu;
+  double Wall;
+  struct stat Status;
+  int File;
+
+  if(argc > 3 && strcmp(argv[1], "-g") == 0)
+  {
+    return Generate(argv[2], argv[3], (argc > 4) ? strtoul(argv[4], 0, 0) : 1000, (argc > 5) ? strtoul(argv[5], 0, 0) : 100000);
+  }
+
+  while(Argument < argc && argv[Argument][0] == '-')
+  {
+    if(strcmp(argv[Argument], "-q") == 0)
+    {
+      Quiet = true;
+    }
+    else if(strcmp(argv[Argument], "-t") == 0 && Argument + 1 < argc)
+    {
+      Threads = strtoul(argv[++Argument], 0, 0);
+    }
+    Argument++;
+  }
+
+  if(argc - Argument != 2)
+  {
+    fprintf(stderr, "decode [-q] [-t threads] sessions capture\ndecode -g sessions capture [sessions count] [frames]\n");
+    return 2;
+  }
+
+  if(Load_Sessions(argv[Argument], Decoder) < 0)
+  {
+    return 1;
+  }
+
+  File = open(argv[Argument + 1], O_RDONLY);
+  if(File < 0 || fstat(File, &Status) != 0)
+  {
+    perror(argv[Argument + 1]);
+    return 1;
+  }
+  Capture_Size = Status.st_size;
+  if(Capture_Size < CAPTURE_MAGIC_SIZE)
+  {
+    fprintf(stderr, "%s: no capture\n", argv[Argument + 1]);
+    return 1;
+  }
+  Capture = (const unsigned char *)mmap(0, Capture_Size, PROT_READ, MAP_PRIVATE, File, 0);
+  close(File);
+  if(Capture == MAP_FAILED || memcmp(Capture, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0)
+  {
+    fprintf(stderr, "%s: no capture\n", argv[Argument + 1]);
+    return 1;
+  }
+  madvise((void *)Capture, Capture_Size, MADV_SEQUENTIAL);
+
+  auto Start = std::chrono::steady_clock::now();
+
+  //Record offsets first, records have no fixed size
+  for(Offset = CAPTURE_MAGIC_SIZE; Offset + CAPTURE_RECORD_HEADER <= Capture_Size; )
+  {
+    if(Offset + CAPTURE_RECORD_HEADER + Capture[Offset + 4] > Capture_Size)
+    {
+      fprintf(stderr, "capture truncated at %zu\n", Offset);
+      break;
+    }
+    Records.push_back(Offset);
+    Offset += CAPTURE_RECORD_HEADER + Capture[Offset + 4];
+  }
+
+  //All frames of a DevAddr go to the same partition, in capture order
+  WorkPool Pool(Threads);
+  Partitions.resize(Pool.Get_Workers() * DECODE_PARTITIONS);
+  for(i = 0; i < Records.size(); i++)
+  {
+    const unsigned char *Data = &Capture[Records[i] + CAPTURE_RECORD_HEADER];
+    uint32_t DevAddr = (Capture[Records[i] + 4] >= 5) ? (Data[1] | (Data[2] << 8) | (Data[3] << 16) | ((uint32_t)Data[4] << 24)) : 0;
+
+    Partitions[(DevAddr * 0x9E3779B1UL) % Partitions.size()].push_back(i);
+  }
+
+  Results.reset(new Decode_Result[Quiet ? 0 : Records.size()]);
+  std::vector<unsigned long> Partition_Count(Partitions.size() * 4, 0);
+
+  for(i = 0; i < Partitions.size(); i++)
+  {
+    Pool.Add([&, i](unsigned int)
+    {
+      std::unique_ptr<Decoded_Frame[]> Local(new Decoded_Frame[DECODE_BATCH]);
+      const unsigned char *Frames[DECODE_BATCH];
+      unsigned char Lengths[DECODE_BATCH];
+      unsigned char Status[DECODE_BATCH];
+      unsigned long *Counter = &Partition_Count[i * 4];
+      std::vector<unsigned long> &Partition = Partitions[i];
+      unsigned long First;
+      unsigned int Count;
+      unsigned int j;
+
+      //Frames of one session keep their order within a batch
+      for(First = 0; First < Partition.size(); First += Count)
+      {
+        Count = (Partition.size() - First < DECODE_BATCH) ? Partition.size() - First : DECODE_BATCH;
+        for(j = 0; j < Count; j++)
+        {
+          Frames[j] = &Capture[Records[Partition[First + j]] + CAPTURE_RECORD_HEADER];
+          Lengths[j] = Capture[Records[Partition[First + j]] + 4];
+        }
+
+        Decoder.Decode_Batch(Frames, Lengths, Count, Local.get(), Status);
+
+        for(j = 0; j < Count; j++)
+        {
+          Counter[Status[j]]++;
+          if(!Quiet)
+          {
+            Results[Partition[First + j]].Status = Status[j];
+            Results[Partition[First + j]].Frame = Local[j];
+          }
+        }
+      }
+    });
+  }
+  Cpu = Pool.Run();
+
+  Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  for(i = 0; i < Partition_Count.size(); i++)
+  {
+    Count[i % 4] += Partition_Count[i];
+  }
+
+  if(!Quiet)
+  {
+    for(i = 0; i < Records.size(); i++)
+    {
+      const unsigned char *Header = &Capture[Records[i]];
+      Decoded_Frame &Frame = Results[i].Frame;
+
+      printf("%10lu ", (unsigned long)(Header[0] | (Header[1] << 8) | (Header[2] << 16) | ((uint32_t)Header[3] << 24)));
+      if(Results[i].Status == DECODER_INVALID)
+      {
+        printf("invalid\n");
+        continue;
+      }
+      printf("%08lX %s %-7s FCnt %8lu", (unsigned long)Frame.DevAddr, Frame.Direction ? "down" : "up  ",
+        Status_Text[Results[i].Status], (unsigned long)Frame.Frame_Counter);
+      if(Frame.FOpts_Length)
+      {
+        printf(" FOpts ");
+        Print_Hex(stdout, Frame.FOpts, Frame.FOpts_Length);
+      }
+      if(Frame.FPort >= 0)
+      {
+        printf(" port %3d ", Frame.FPort);
+        Print_Hex(stdout, Frame.Payload, Frame.Payload_Length);
+      }
+      printf("\n");
+    }
+  }
+
+  fprintf(Quiet ? stdout : stderr, "frames %lu  ok %lu  MIC failed %lu  unknown DevAddr %lu  invalid %lu\n",
+    (unsigned long)Records.size(), Count[DECODER_OK], Count[DECODER_MIC_FAIL], Count[DECODER_UNKNOWN], Count[DECODER_INVALID]);
+  fprintf(Quiet ? stdout : stderr, "sessions %ld  threads %u  wall %.3f s  CPU %.3f s  %.0f frames/s  %.1f MB/s\n",
+    Decoder.Get_Session_Count(), Pool.Get_Workers(), Wall, Cpu / 1e9,
+    Wall > 0 ? Records.size() / Wall : 0.0, Wall > 0 ? Capture_Size / Wall / 1e6 : 0.0);
+
+  munmap((void *)Capture, Capture_Size);
+  return 0;
+}
@@ -0,0 +1,154 @@
+/*
+  Medium.cpp - Shared virtual-time radio medium for the fleet simulator
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <algorithm>
+
+#include "Medium.h"
+
+/*
+*****************************************************************************************
+* Description : Function puts an uplink on the medium, thread safe
+*
+* Arguments   : Node     number of the sending node
+*               Package  the package as sent by its SimRadio
+*               Rssi     received power at the gateway in dBm
+*****************************************************************************************
+*/
+void Medium::Add(unsigned long Node, SimRadio_Package &Package, float Rssi)
+{
+  Medium_Frame Frame;
+  Shard &S = _Shards[(Package.Channel % MEDIUM_CHANNELS) * MEDIUM_DATARATES + (Package.Datarate % MEDIUM_DATARATES)];
+
+  Frame.Node = Node;
+  Frame.Start = Package.Start;
+  Frame.End = Package.Start + Package.Time_On_Air;
+  Frame.Rssi = Rssi;
+  Frame.Lost = false;
+
+  std::lock_guard<std::mutex> Lock(S.Lock);
+  S.Frames.push_back(Frame);
+  S.Airtime += Package.Time_On_Air;
+}
+
+/*
+*****************************************************************************************
+* Description : Function decides which frames collided, one task per shard
+*
+* Returns     : CPU time spent in ns
+*****************************************************************************************
+*/
+uint64_t Medium::Resolve(WorkPool &Pool)
+{
+  unsigned int i;
+
+  for(i = 0; i < MEDIUM_CHANNELS * MEDIUM_DATARATES; i++)
+  {
+    Shard *S = &_Shards[i];
+    Pool.Add([S](unsigned int) { Resolve_Shard(*S); });
+  }
+  return Pool.Run();
+}
+
+/*
+*****************************************************************************************
+* Description : Function sweeps the frames of one shard in order of their start and
+*               checks every pair that overlaps in time
+*****************************************************************************************
+*/
+void Medium::Resolve_Shard(Shard &S)
+{
+  size_t i;
+  size_t j;
+
+  std::sort(S.Frames.begin(), S.Frames.end(),
+    [](const Medium_Frame &A, const Medium_Frame &B) { return A.Start < B.Start; });
+
+  for(i = 0; i < S.Frames.size(); i++)
+  {
+    Medium_Frame &A = S.Frames[i];
+
+    for(j = i + 1; j < S.Frames.size() && S.Frames[j].Start < A.End; j++)
+    {
+      Medium_Frame &B = S.Frames[j];
+
+      if(A.Rssi - B.Rssi >= MEDIUM_CAPTURE_DB)
+      {
+        B.Lost = true;
+      }
+      else if(B.Rssi - A.Rssi >= MEDIUM_CAPTURE_DB)
+      {
+        A.Lost = true;
+      }
+      else
+      {
+        A.Lost = true;
+        B.Lost = true;
+      }
+    }
+  }
+
+  S.Lost = 0;
+  for(i = 0; i < S.Frames.size(); i++)
+  {
+    if(S.Frames[i].Lost)
+    {
+      S.Lost++;
+    }
+  }
+}
+
+unsigned long Medium::Get_Frames()
+{
+  unsigned long Frames = 0;
+  unsigned char i;
+
+  for(i = 0; i < MEDIUM_DATARATES; i++)
+  {
+    Frames += Get_Frames(i);
+  }
+  return Frames;
+}
+
+unsigned long Medium::Get_Lost()
+{
+  unsigned long Lost = 0;
+  unsigned char i;
+
+  for(i = 0; i < MEDIUM_DATARATES; i++)
+  {
+    Lost += Get_Lost(i);
+  }
+  return Lost;
+}
+
+unsigned long Medium::Get_Frames(unsigned char Datarate)
+{
+  unsigned long Frames = 0;
+  unsigned char i;
+
+  for(i = 0; i < MEDIUM_CHANNELS; i++)
+  {
+    Frames += _Shards[i * MEDIUM_DATARATES + Datarate].Frames.size();
+  }
+  return Frames;
+}
+
+unsigned long Medium::Get_Lost(unsigned char Datarate)
+{
+  unsigned long Lost = 0;
+  unsigned char i;
+
+  for(i = 0; i < MEDIUM_CHANNELS; i++)
+  {
+    Lost += _Shards[i * MEDIUM_DATARATES + Datarate].Lost;
+  }
+  return Lost;
+}
+
+uint64_t Medium::Get_Airtime(unsigned char Channel, unsigned char Datarate)
+{
+  return _Shards[Channel * MEDIUM_DATARATES + Datarate].Airtime;
+}
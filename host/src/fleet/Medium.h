@@ -0,0 +1,61 @@
+/*
+  Medium.h - Shared virtual-time radio medium for the fleet simulator
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Collects the uplinks of all simulated nodes, sharded by channel and data rate
+  so worker threads rarely contend. Different spreading factors are treated as
+  orthogonal, on the same channel and data rate two overlapping frames collide
+  unless one is MEDIUM_CAPTURE_DB stronger at the gateway (capture effect).
+*/
+
+#ifndef Medium_h
+#define Medium_h
+
+#include <stdint.h>
+#include <mutex>
+#include <vector>
+
+#include "SimRadio.h"
+#include "WorkPool.h"
+
+#define MEDIUM_CHANNELS   8
+#define MEDIUM_DATARATES  8
+#define MEDIUM_CAPTURE_DB 6
+
+struct Medium_Frame
+{
+  unsigned long Node;
+  uint64_t Start;
+  uint64_t End;
+  float Rssi;
+  bool Lost;
+};
+
+class Medium
+{
+  public:
+    void Add(unsigned long Node, SimRadio_Package &Package, float Rssi);
+    uint64_t Resolve(WorkPool &Pool);
+
+    unsigned long Get_Frames();
+    unsigned long Get_Lost();
+    unsigned long Get_Frames(unsigned char Datarate);
+    unsigned long Get_Lost(unsigned char Datarate);
+    uint64_t Get_Airtime(unsigned char Channel, unsigned char Datarate);
+
+  private:
+    struct Shard
+    {
+      std::mutex Lock;
+      std::vector<Medium_Frame> Frames;
+      unsigned long Lost = 0;
+      uint64_t Airtime = 0;
+    };
+
+    Shard _Shards[MEDIUM_CHANNELS * MEDIUM_DATARATES];
+
+    static void Resolve_Shard(Shard &S);
+};
+
+#endif
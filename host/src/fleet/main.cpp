@@ -0,0 +1,166 @@
+/*
+  main.cpp - Virtual node fleet simulator
+  Runs many independent LoRaWAN<SimRadio> sessions on a work-stealing thread pool
+  and puts their uplinks on a shared virtual-time medium to estimate the capacity
+  of a gateway.
+
+  fleet [nodes] [period s] [duration s] [threads] [DR]
+    nodes     number of simulated nodes (1000)
+    period    uplink interval of each node, +-10% jitter (600)
+    duration  simulated time (3600)
+    threads   worker threads (all cores)
+    DR        data rate of all nodes, 0 .. 7 (2)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "Medium.h"
+#include "WorkPool.h"
+
+// nodes simulated by one task
+#define FLEET_CHUNK 64
+
+struct Fleet_Node
+{
+  SimRadio Radio;
+  LoRaWAN<SimRadio> Lora;
+  uint32_t Random;
+  float Path_Loss;
+
+  Fleet_Node() : Lora(Radio)
+  {
+  }
+};
+
+static uint32_t Next_Random(uint32_t &State)
+{
+  State ^= State << 13;
+  State ^= State >> 17;
+  State ^= State << 5;
+  return State;
+}
+
+static void Run_Node(Fleet_Node &Node, unsigned long Id, uint64_t Period, uint64_t Duration, Medium &Air)
+{
+  unsigned char Data[8];
+  uint64_t Time;
+  unsigned long Count = 0;
+
+  Time = Next_Random(Node.Random) % Period;
+
+  while(Time < Duration)
+  {
+    Data[0] = Id >> 24;
+    Data[1] = Id >> 16;
+    Data[2] = Id >> 8;
+    Data[3] = Id;
+    Data[4] = Count >> 24;
+    Data[5] = Count >> 16;
+    Data[6] = Count >> 8;
+    Data[7] = Count;
+
+    Node.Radio.Set_Time(Time);
+    if(Node.Lora.Send_Data(Data, sizeof(Data)))
+    {
+      SimRadio_Package &Package = Node.Radio.Last_Package();
+      Air.Add(Id, Package, Package.Tx_Power - Node.Path_Loss);
+    }
+    Count++;
+
+    //period +- 10%
+    Time += Period - Period / 10 + Next_Random(Node.Random) % (Period / 5 + 1);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long Nodes = (argc > 1) ? strtoul(argv[1], 0, 0) : 1000;
+  uint64_t Period = (argc > 2) ? strtoull(argv[2], 0, 0) * 1000000ULL : 600000000ULL;
+  uint64_t Duration = (argc > 3) ? strtoull(argv[3], 0, 0) * 1000000ULL : 3600000000ULL;
+  unsigned int Threads = (argc > 4) ? strtoul(argv[4], 0, 0) : std::thread::hardware_concurrency();
+  unsigned char Datarate = (argc > 5) ? strtoul(argv[5], 0, 0) : 2;
+
+  std::vector<std::unique_ptr<Fleet_Node> > Fleet;
+  Medium Air;
+  WorkPool Pool(Threads);
+  unsigned long i;
+  unsigned char j;
+  uint64_t Cpu_Nodes;
+  uint64_t Cpu_Medium;
+  unsigned long Frames;
+  unsigned long Lost;
+  double Wall;
+
+  for(i = 0; i < Nodes; i++)
+  {
+    unsigned char Key[16];
+    unsigned char DevAddr[4] = { 0x26, (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i };
+    Fleet_Node *Node = new Fleet_Node;
+
+    Node->Random = 0x9E3779B9UL * (i + 1);
+    for(j = 0; j < 16; j++)
+    {
+      Key[j] = Next_Random(Node->Random);
+    }
+
+    Node->Lora.setKeys(Key, Key, DevAddr);
+    Node->Lora.setDatarate(Datarate);
+    Node->Radio.RFM_Channels().Seed(Next_Random(Node->Random));
+
+    //gateway 100 m .. 5 km away, log-distance path loss exponent 2.7
+    Node->Path_Loss = 40.0f + 27.0f * log10f(100.0f + (Next_Random(Node->Random) % 4900));
+
+    Fleet.push_back(std::unique_ptr<Fleet_Node>(Node));
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+
+  for(i = 0; i < Nodes; i += FLEET_CHUNK)
+  {
+    unsigned long First = i;
+    unsigned long Last = (i + FLEET_CHUNK < Nodes) ? i + FLEET_CHUNK : Nodes;
+
+    Pool.Add([&, First, Last](unsigned int)
+    {
+      unsigned long n;
+
+      for(n = First; n < Last; n++)
+      {
+        Run_Node(*Fleet[n], n, Period, Duration, Air);
+      }
+    });
+  }
+  Cpu_Nodes = Pool.Run();
+  Cpu_Medium = Air.Resolve(Pool);
+
+  Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  Frames = Air.Get_Frames();
+  Lost = Air.Get_Lost();
+
+  printf("nodes %lu  period %llu s  duration %llu s  DR%u  threads %u\n",
+    Nodes, (unsigned long long)(Period / 1000000), (unsigned long long)(Duration / 1000000), Datarate, Pool.Get_Workers());
+  printf("frames %lu  delivered %lu  collided %lu  collision rate %.2f %%\n",
+    Frames, Frames - Lost, Lost, Frames ? 100.0 * Lost / Frames : 0.0);
+
+  for(j = 0; j < MEDIUM_CHANNELS; j++)
+  {
+    //pure ALOHA without capture for comparison, G = offered load of the channel
+    double G = (double)Air.Get_Airtime(j, Datarate) / Duration;
+    printf("  ch %u  load %.3f Erlang  ALOHA success %.1f %%\n", j, G, 100.0 * exp(-2.0 * G));
+  }
+
+  printf("wall %.3f s  CPU %.3f s  %.0f ns CPU per frame  %.0f frames/s  steals %lu\n",
+    Wall, (Cpu_Nodes + Cpu_Medium) / 1e9, Frames ? (double)(Cpu_Nodes + Cpu_Medium) / Frames : 0.0,
+    Wall > 0 ? Frames / Wall : 0.0, Pool.Get_Steals());
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+  main.cpp - Fragmented uplinks over a lossy link
+  Sends blobs as fragments through LoRaWAN<SimRadio>, drops frames at random, decodes
+  what is left with FrameDecoder and rebuilds the blobs with FragDecoder.
+
+  frag [blob bytes] [parity fragments] [loss %] [trials]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "FrameDecoder.h"
+#include "Fragmentation.h"
+
+unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char AppSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+
+int main(int argc, char **argv)
+{
+  unsigned short Length = argc > 1 ? atoi(argv[1]) : 500;
+  unsigned char Parity = argc > 2 ? atoi(argv[2]) : 3;
+  double Loss = argc > 3 ? atof(argv[3]) / 100.0 : 0.1;
+  long Trials = argc > 4 ? atol(argv[4]) : 1000;
+
+  SimRadio radio;
+  LoRaWAN<SimRadio> lora(radio);
+  FrameDecoder Decoder;
+  FragEncoder Encoder;
+  FragDecoder Reassembly;
+  Decoded_Frame Frame;
+  std::mt19937 Random(1);
+  std::bernoulli_distribution Lost(Loss);
+  unsigned char *Blob;
+  unsigned char Fragment[FRAG_HEADER_SIZE + FRAG_MAX_DATA];
+  unsigned char Fragment_Length;
+  unsigned char Index;
+  unsigned char Id = 0;
+  unsigned long Frames = 0;
+  unsigned long Dropped = 0;
+  long Rebuilt = 0;
+  long Corrupt = 0;
+  long Trial;
+  unsigned short i;
+
+  if(Length == 0)
+  {
+    fprintf(stderr, "usage: frag [blob bytes] [parity fragments] [loss %%] [trials]\n");
+    return 1;
+  }
+
+  lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setPort(FRAG_PORT);
+  Decoder.Add_Session(DevAddr, NwkSkey, AppSkey);
+  Decoder.Build_Index();
+
+  Blob = (unsigned char *)malloc(Length);
+
+  for(Trial = 0; Trial < Trials; Trial++)
+  {
+    for(i = 0; i < Length; i++)
+    {
+      Blob[i] = Random();
+    }
+
+    if(!Encoder.Begin(Blob, Length, FRAG_MAX_DATA, Parity))
+    {
+      fprintf(stderr, "frag: %u bytes with %u parity fragments is more than 255 fragments\n", Length, Parity);
+      return 1;
+    }
+
+    for(Index = 0; Index < Encoder.Get_Count(); Index++)
+    {
+      Fragment_Length = Encoder.Get_Fragment(Index, Fragment);
+      Id = Fragment[0];
+      lora.Send_Data(Fragment, Fragment_Length);
+      radio.Set_Time(radio.Get_Time() + 10000000);
+      Frames++;
+
+      if(Lost(Random))
+      {
+        Dropped++;
+        continue;
+      }
+
+      SimRadio_Package &Package = radio.Last_Package();
+      if(Decoder.Decode(Package.Data, Package.Length, &Frame) != DECODER_OK || Frame.FPort != FRAG_PORT)
+      {
+        continue;
+      }
+      Reassembly.Add(Frame.Payload, Frame.Payload_Length);
+    }
+
+    if(Reassembly.Get_Blob() != 0 && Reassembly.Get_Id() == Id)
+    {
+      Rebuilt++;
+      if(Reassembly.Get_Length() != Length || memcmp(Reassembly.Get_Blob(), Blob, Length) != 0)
+      {
+        Corrupt++;
+      }
+    }
+  }
+
+  printf("%u bytes, %u data + %u parity fragments, %.1f %% loss\n",
+    Length, Encoder.Get_Count() - Parity, Parity, Loss * 100.0);
+  printf("%lu frames, %lu lost, %ld of %ld blobs rebuilt (%.2f %%), %ld corrupt\n",
+    Frames, Dropped, Rebuilt, Trials, Trials ? 100.0 * Rebuilt / Trials : 0.0, Corrupt);
+
+  free(Blob);
+  return Corrupt != 0;
+}
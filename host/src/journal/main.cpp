@@ -0,0 +1,500 @@
+/*
+  main.cpp - Uplink journal through power cuts and coverage gaps
+  First random appends, flushes and deliveries with the power cut in the middle
+  of a Flush() or Pop() and a reboot (begin()) right after. Every record is
+  delivered in the end except those cut short in flash, at most JOURNAL_BATCH a
+  cut, and at most the one being popped comes twice. A final drain without cuts
+  checks the order: priority first, then oldest first.
+
+  Then a LoRaWAN<SimRadio> node sends a reading every period, confirmed, through
+  coverage gaps. Readings without ACK go to the journal and drain like
+  src/main.cpp does it: the backlog as fast as the 1% duty cycle allows once the
+  network answers, alarms (priority 1, every tenth reading) first. The network
+  side checks MIC and frame counter with FrameDecoder, compares the decrypted
+  payload with the reading and answers with an ACK in RX1. The node reboots in
+  the middle of every gap. Reported per gap: backlog, drain time after the gap,
+  records lost.
+
+  journal [period s] [gap minutes] [gaps] [cuts] [DR]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "UplinkJournal.h"
+#include "RxTiming.h"
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "FrameDecoder.h"
+
+// frame around the payload: MHDR, FHDR without FOpts, FPort, MIC
+#define JOURNAL_OVERHEAD 13
+#define JOURNAL_PORT 1
+#define JOURNAL_READING 13
+#define UPLINK_LOSS 0.05
+#define ACK_LOSS 0.03
+
+struct Journal_Record
+{
+  unsigned long Id;
+  unsigned char Priority;
+};
+
+unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char AppSkey[16] = { 0x3C, 0x4F, 0xCF, 0x09, 0x88, 0x15, 0xF7, 0xAB, 0xA6, 0xD2, 0xAE, 0x28, 0x16, 0x15, 0x7E, 0x2B };
+unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+
+// network side of the coverage gaps, times in ms
+struct Journal_Network
+{
+  FrameDecoder Decoder;
+  LoRaWAN_Crypto Crypto;
+  std::mt19937 Random;
+  std::uniform_real_distribution<double> Chance;
+  uint64_t Gap;
+  uint64_t Cycle;
+  uint32_t Frame_Counter_Down;
+  std::map<unsigned long, unsigned long> Received;
+  // MIC fine but not the reading that was sent
+  unsigned long Garbled;
+
+  Journal_Network() : Random(9), Chance(0.0, 1.0), Frame_Counter_Down(0), Garbled(0)
+  {
+  }
+};
+
+static void Make_Record(unsigned char *Data, unsigned char Length, uint32_t Id)
+{
+  unsigned char i;
+
+  memcpy(Data, &Id, 4);
+  for(i = 4; i < Length; i++)
+  {
+    Data[i] = Id * 31 + i;
+  }
+}
+
+static bool Check_Record(const unsigned char *Data, unsigned char Length, uint32_t *Id)
+{
+  unsigned char i;
+
+  if(Length < 4)
+  {
+    return false;
+  }
+  memcpy(Id, Data, 4);
+  for(i = 4; i < Length; i++)
+  {
+    if(Data[i] != (unsigned char)(*Id * 31 + i))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Uplink in coverage and not lost: decode it and answer a confirmed one with an
+  ACK in RX1, unless that is lost
+*/
+static void Network_Uplink(SimRadio &Radio, void *Context)
+{
+  Journal_Network &Network = *(Journal_Network *)Context;
+  SimRadio_Package &Package = Radio.Last_Package();
+  Decoded_Frame Frame;
+  unsigned char Ack[12];
+  unsigned char i;
+  uint32_t Id;
+
+  if(((Package.Start / 1000) % Network.Cycle) < Network.Gap || Network.Chance(Network.Random) < UPLINK_LOSS)
+  {
+    return;
+  }
+
+  if(Network.Decoder.Decode(Package.Data, Package.Length, &Frame) != DECODER_OK)
+  {
+    return;
+  }
+
+  if(Frame.FPort != JOURNAL_PORT || !Check_Record(Frame.Payload, Frame.Payload_Length, &Id))
+  {
+    Network.Garbled++;
+    return;
+  }
+  Network.Received[Id]++;
+
+  if(Frame.MType != (LORAWAN_CONFIRMED_UP >> 5) || Network.Chance(Network.Random) < ACK_LOSS)
+  {
+    return;
+  }
+
+  //Empty downlink with ACK
+  Ack[0] = LORAWAN_UNCONFIRMED_DOWN;
+  for(i = 0; i < 4; i++)
+  {
+    Ack[1 + i] = DevAddr[3 - i];
+  }
+  Ack[5] = 0x20;
+  Ack[6] = Network.Frame_Counter_Down & 0xFF;
+  Ack[7] = (Network.Frame_Counter_Down >> 8) & 0xFF;
+  Network.Crypto.Calculate_MIC(Ack, &Ack[8], 8, Network.Frame_Counter_Down, 0x01, DevAddr, NwkSkey);
+  Network.Frame_Counter_Down++;
+
+  Radio.Queue_Downlink(Ack, sizeof(Ack), 1);
+}
+
+static int Power_Cuts(unsigned long Cuts, std::mt19937 &Random)
+{
+  UplinkJournal Journal;
+  std::map<unsigned long, unsigned long> Delivered;
+  unsigned char Data[JOURNAL_MAX_DATA];
+  unsigned char Length;
+  unsigned char Port;
+  unsigned long Appended = 0;
+  unsigned long Corrupt = 0;
+  unsigned long Order = 0;
+  unsigned long Done = 0;
+  uint32_t Id = 0;
+  unsigned long Lost;
+  unsigned long Twice = 0;
+  unsigned char Last_Priority = JOURNAL_PRIORITIES;
+  unsigned long Last_Id = 0;
+  unsigned char Page;
+  unsigned long Erases = 0;
+  unsigned long Erases_Min = ~0UL;
+  unsigned long Erases_Max = 0;
+  int Result = 0;
+
+  Journal.begin();
+
+  while(Done < Cuts)
+  {
+    unsigned long Operation = Random() % 100;
+
+    if(Operation < 45)
+    {
+      Length = 4 + Random() % (JOURNAL_MAX_DATA - 3);
+      Make_Record(Data, Length, Appended);
+      Journal.Append(Data, Length, 1 + Random() % 223, (Random() % 8) == 0 ? 1 : 0);
+      Appended++;
+    }
+    else
+    {
+      bool Cut = (Random() % 20) == 0;
+
+      if(Cut)
+      {
+        Journal.Fail_After(Random() % 64);
+      }
+
+      if(Operation < 60)
+      {
+        Journal.Flush();
+      }
+      else if(Journal.Peek(Data, &Length, &Port))
+      {
+        if(Check_Record(Data, Length, &Id) && Id < Appended)
+        {
+          Delivered[Id]++;
+        }
+        else
+        {
+          Corrupt++;
+        }
+        Journal.Pop();
+      }
+
+      if(Cut)
+      {
+        Journal.begin();
+        Done++;
+      }
+    }
+  }
+
+  //Drain what is left, in order
+  Journal.Flush();
+  while(Journal.Peek(Data, &Length, &Port))
+  {
+    if(!Check_Record(Data, Length, &Id) || Id >= Appended)
+    {
+      Corrupt++;
+      Journal.Pop();
+      continue;
+    }
+    Delivered[Id]++;
+    Journal.Pop();
+  }
+
+  //Order of the final drain, replayed on a fresh journal without cuts
+  {
+    UplinkJournal Fresh;
+    std::vector<Journal_Record> Records;
+    unsigned long i;
+
+    Fresh.begin();
+    for(i = 0; i < Fresh.Get_Capacity(); i++)
+    {
+      Journal_Record Record = { i, (unsigned char)(Random() % JOURNAL_PRIORITIES) };
+
+      Length = 4 + Random() % (JOURNAL_MAX_DATA - 3);
+      Make_Record(Data, Length, i);
+      Fresh.Append(Data, Length, 1, Record.Priority);
+      Records.push_back(Record);
+      if((i % 3) == 0)
+      {
+        Fresh.Flush();
+      }
+    }
+
+    while(Fresh.Peek(Data, &Length, &Port))
+    {
+      if(!Check_Record(Data, Length, &Id) || Id >= Records.size())
+      {
+        Corrupt++;
+        Fresh.Pop();
+        continue;
+      }
+      if(Records[Id].Priority > Last_Priority ||
+         (Records[Id].Priority == Last_Priority && Id < Last_Id))
+      {
+        Order++;
+      }
+      Last_Priority = Records[Id].Priority;
+      Last_Id = Id;
+      Fresh.Pop();
+    }
+    if(Fresh.Get_Dropped() != 0 || Fresh.Get_Violations() != 0)
+    {
+      Order++;
+    }
+  }
+
+  for(auto &Entry : Delivered)
+  {
+    if(Entry.second > 1)
+    {
+      Twice += Entry.second - 1;
+    }
+  }
+  Lost = Appended - Delivered.size() - Journal.Get_Dropped();
+
+  for(Page = 0; Page < JOURNAL_PAGES; Page++)
+  {
+    Erases += Journal.Get_Erases(Page);
+    Erases_Min = Journal.Get_Erases(Page) < Erases_Min ? Journal.Get_Erases(Page) : Erases_Min;
+    Erases_Max = Journal.Get_Erases(Page) > Erases_Max ? Journal.Get_Erases(Page) : Erases_Max;
+  }
+
+  printf("power cuts %lu  records %lu\n", Cuts, Appended);
+  printf("  lost in flight %lu (limit %lu)  delivered twice %lu (limit %lu)  dropped full %lu\n",
+    Lost, Cuts * JOURNAL_BATCH, Twice, Cuts, Journal.Get_Dropped());
+  printf("  corrupt %lu  program violations %lu  out of order %lu\n", Corrupt, Journal.Get_Violations(), Order);
+  printf("  erases per page %lu .. %lu, %.1f records per erase\n\n", Erases_Min, Erases_Max,
+    Erases ? (double)Appended / Erases : 0.0);
+
+  if(Lost > Cuts * JOURNAL_BATCH || Twice > Cuts || Corrupt != 0 || Journal.Get_Violations() != 0 || Order != 0)
+  {
+    Result = 2;
+  }
+
+  return Result;
+}
+
+int main(int argc, char **argv)
+{
+  double Period = argc > 1 ? atof(argv[1]) : 60.0;
+  double Gap_Minutes = argc > 2 ? atof(argv[2]) : 90.0;
+  long Gaps = argc > 3 ? atol(argv[3]) : 4;
+  unsigned long Cuts = argc > 4 ? strtoul(argv[4], 0, 0) : 1000;
+  int Datarate = argc > 5 ? atoi(argv[5]) : 5;
+  std::mt19937 Random(5);
+  int Result;
+
+  if(Period <= 0 || Gap_Minutes < 0 || Gaps < 1 || Datarate < 0 || Datarate > 6)
+  {
+    fprintf(stderr, "journal: period above 0 s, at least one gap, DR0 .. DR6\n");
+    return 1;
+  }
+
+  Result = Power_Cuts(Cuts, Random);
+
+  //Coverage gaps, times in ms
+  UplinkJournal Journal;
+  SimRadio Radio;
+  LoRaWAN<SimRadio> Lora(Radio);
+  Journal_Network Network;
+  unsigned char SF = (Datarate < 6) ? 12 - Datarate : 7;
+  uint16_t Bandwidth = (Datarate == 6) ? 250 : 125;
+  uint64_t Step = (uint64_t)(Period * 1000);
+  uint64_t Gap = (uint64_t)(Gap_Minutes * 60000);
+  // a gap starts every Cycle, the node reaches a steady state before the next
+  uint64_t Cycle = Gap * 4 + 3600000;
+  uint64_t End = Cycle * Gaps;
+  uint64_t Next_Reading = 0;
+  uint64_t Next_Drain = UINT64_MAX;
+  uint64_t Last_Uplink = 0;
+  uint64_t Wait = 0;
+  std::vector<unsigned long> Backlog(Gaps, 0);
+  std::vector<unsigned long> Dropped(Gaps, 0);
+  std::vector<double> Drained(Gaps, -1.0);
+  unsigned long Readings = 0;
+  unsigned long Sent_Direct = 0;
+  unsigned long Journaled = 0;
+  unsigned long Uplinks = 0;
+  unsigned long Too_Early = 0;
+  unsigned char Data[JOURNAL_MAX_DATA];
+  unsigned char Length;
+  unsigned char Port;
+  long Rebooted = -1;
+  long i;
+
+  Network.Gap = Gap;
+  Network.Cycle = Cycle;
+  Network.Decoder.Add_Session(DevAddr, NwkSkey, AppSkey);
+  Network.Decoder.Build_Index();
+  Radio.On_Uplink(Network_Uplink, &Network);
+
+  Lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  Lora.setDatarate(Datarate);
+  Lora.setReceiveWindows(true);
+  Lora.setConfirmed(true);
+
+  Journal.begin();
+
+  //Like sendConfirmed(), false without ACK
+  auto Send = [&](uint64_t Time, unsigned char *Frame, unsigned char Frame_Length, unsigned char Frame_Port) -> bool
+  {
+    bool Acked;
+
+    if(Uplinks > 0 && Time - Last_Uplink < Wait)
+    {
+      Too_Early++;
+    }
+    Uplinks++;
+
+    Radio.Set_Time(Time * 1000);
+    Lora.setPort(Frame_Port);
+    Acked = Lora.Send_Data(Frame, Frame_Length) && Lora.isAcked();
+    Last_Uplink = Time;
+    Wait = (RxTiming::Airtime(Frame_Length + JOURNAL_OVERHEAD, SF, Bandwidth, true) * 99 + 999) / 1000;
+
+    return Acked;
+  };
+
+  while(true)
+  {
+    uint64_t Time = Next_Reading < Next_Drain ? Next_Reading : Next_Drain;
+    long Index = Time / Cycle;
+
+    if(Time >= End)
+    {
+      break;
+    }
+
+    //Reset in the middle of the gap, the RAM index is rebuilt
+    if(Rebooted != Index && (Time % Cycle) >= Gap / 2)
+    {
+      Dropped[Index] -= Journal.Get_Dropped();
+      Journal.begin();
+      Dropped[Index] += Journal.Get_Dropped();
+      Rebooted = Index;
+    }
+
+    if(Time == Next_Drain)
+    {
+      //Like drainTask
+      Next_Drain = UINT64_MAX;
+
+      if(Time - Last_Uplink < Wait)
+      {
+        Next_Drain = Last_Uplink + Wait;
+        continue;
+      }
+      if(!Journal.Peek(Data, &Length, &Port) || !Send(Time, Data, Length, Port))
+      {
+        continue;
+      }
+      Journal.Pop();
+      if(Journal.Get_Count() > 0)
+      {
+        Next_Drain = Time + Wait;
+      }
+      else if((Time % Cycle) >= Gap && Drained[Index] < 0)
+      {
+        Drained[Index] = ((Time % Cycle) - Gap) / 1000.0;
+      }
+      continue;
+    }
+
+    //Reading, like sendTask and forward()
+    unsigned char Priority = (Readings % 10) == 9 ? 1 : 0;
+    unsigned long Before = Journal.Get_Dropped();
+
+    Next_Reading += Step;
+    Make_Record(Data, JOURNAL_READING, Readings);
+    Readings++;
+
+    if(Journal.Get_Count() > 0 || Time - Last_Uplink < Wait)
+    {
+      Journal.Append(Data, JOURNAL_READING, JOURNAL_PORT, Priority);
+      Journal.Flush();
+      Journaled++;
+      if(Next_Drain == UINT64_MAX)
+      {
+        Next_Drain = Time;
+      }
+    }
+    else if(Send(Time, Data, JOURNAL_READING, JOURNAL_PORT))
+    {
+      Sent_Direct++;
+    }
+    else
+    {
+      Journal.Append(Data, JOURNAL_READING, JOURNAL_PORT, Priority);
+      Journal.Flush();
+      Journaled++;
+    }
+
+    Dropped[Index] += Journal.Get_Dropped() - Before;
+    Backlog[Index] = Journal.Get_Count() > Backlog[Index] ? Journal.Get_Count() : Backlog[Index];
+  }
+
+  printf("coverage gaps of %.0f min, reading every %.0f s, DR%d\n\n", Gap_Minutes, Period, Datarate);
+  printf("gap  backlog  dropped  drained after s\n");
+  for(i = 0; i < Gaps; i++)
+  {
+    printf("%3ld  %7lu  %7lu  ", i + 1, Backlog[i], Dropped[i]);
+    if(Drained[i] < 0)
+    {
+      printf("%15s\n", "not");
+    }
+    else
+    {
+      printf("%15.0f\n", Drained[i]);
+    }
+  }
+
+  unsigned long Twice = 0;
+
+  for(auto &Entry : Network.Received)
+  {
+    Twice += Entry.second - 1;
+  }
+
+  printf("\nreadings %lu  sent at once %lu  journaled %lu  uplinks %lu\n", Readings, Sent_Direct, Journaled, Uplinks);
+  printf("received %lu  twice %lu (ACK lost)  garbled %lu  dropped full %lu  still in journal %u\n",
+    (unsigned long)Network.Received.size(), Twice, Network.Garbled, Journal.Get_Dropped(), Journal.Get_Count());
+  printf("duty cycle violations %lu\n", Too_Early);
+
+  if(Too_Early != 0 || Network.Garbled != 0 || Journal.Get_Violations() != 0)
+  {
+    Result = 2;
+  }
+
+  return Result;
+}
@@ -0,0 +1,456 @@
+/*
+  NetServer.cpp - Network server stand-in for host runs of the LoRaWAN stack
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "LoRaWAN.h"
+#include "NetServer.h"
+
+void NetServer_Latency::Add(double Value)
+{
+  _Values.push_back(Value);
+  _Sorted = false;
+}
+
+unsigned long NetServer_Latency::Get_Count()
+{
+  return _Values.size();
+}
+
+double NetServer_Latency::Percentile(double Fraction)
+{
+  if(_Values.empty())
+  {
+    return 0;
+  }
+  if(!_Sorted)
+  {
+    std::sort(_Values.begin(), _Values.end());
+    _Sorted = true;
+  }
+  return _Values[(size_t)(Fraction * (_Values.size() - 1) + 0.5)];
+}
+
+void NetServer_Latency::Print(FILE *Out, const char *Name)
+{
+  fprintf(Out, "  %-16s %7lu %9.1f %9.1f %9.1f %9.1f\n", Name, Get_Count(),
+    Percentile(0.5), Percentile(0.9), Percentile(0.99), Percentile(1.0));
+}
+
+// constructor
+NetServer::NetServer(const NetServer_Config &Config, uint32_t Seed) : _Random(Seed)
+{
+  _Config = Config;
+  if(_Config.Gateways > NETSERVER_MAX_GATEWAYS)
+  {
+    _Config.Gateways = NETSERVER_MAX_GATEWAYS;
+  }
+  _Index_Built = false;
+}
+
+/*
+*****************************************************************************************
+* Description : Function registers an ABP device and puts the server behind its radio
+*
+* Arguments   : Radio    the SimRadio of the device
+*               DevAddr, NwkSkey, AppSkey  session, msb left like on the node
+*               Snr      SNR of its uplinks at the gateways at full power, dB
+*
+* Returns     : device number
+*****************************************************************************************
+*/
+long NetServer::Add_Device(SimRadio &Radio, unsigned char DevAddr[], unsigned char NwkSkey[], unsigned char AppSkey[], float Snr)
+{
+  Device *D = new Device;
+
+  D->Server = this;
+  D->Radio = &Radio;
+  D->Session = _Decoder.Add_Session(DevAddr, NwkSkey, AppSkey);
+  D->Snr = Snr;
+  D->Frame_Counter_Up = -1;
+  D->Frame_Counter_Down = 0;
+  D->History_Count = 0;
+  D->ADR_Age = 0;
+  D->ADR_Pending = false;
+  _Devices.push_back(std::unique_ptr<Device>(D));
+  _Index_Built = false;
+
+  Radio.On_Uplink(Uplink, D);
+
+  return _Devices.size() - 1;
+}
+
+/*
+*****************************************************************************************
+* Description : Function queues application data for a device, it goes out with the
+*               first downlink after Time
+*****************************************************************************************
+*/
+void NetServer::Queue_Data(long Device, uint64_t Time, const unsigned char *Data, unsigned char Length, unsigned char Port)
+{
+  Pending P;
+
+  P.Time = Time;
+  P.Length = (Length < NETSERVER_MAX_DATA) ? Length : NETSERVER_MAX_DATA;
+  P.Port = Port;
+  memcpy(P.Data, Data, P.Length);
+
+  _Devices[Device]->Data.push_back(P);
+  _Stats.Data_Queued++;
+}
+
+/*
+*****************************************************************************************
+* Description : Function records application data the device received at Time, queued
+*               at Queued
+*****************************************************************************************
+*/
+void NetServer::Delivered(long Device, uint64_t Time, uint64_t Queued)
+{
+  (void)Device;
+
+  _Stats.Data_Delivered++;
+  _Stats.Downlink.Add((Time - Queued) / 1e6);
+}
+
+NetServer_Stats &NetServer::Get_Stats()
+{
+  return _Stats;
+}
+
+void NetServer::Uplink(SimRadio &Radio, void *Context)
+{
+  Device *D = (Device *)Context;
+
+  D->Server->Process(*D, Radio.Last_Package());
+}
+
+/*
+*****************************************************************************************
+* Description : Function takes an uplink through gateways, backhaul and server and
+*               queues the downlink for it in the radio
+*****************************************************************************************
+*/
+void NetServer::Process(Device &D, SimRadio_Package &Package)
+{
+  std::normal_distribution<double> Fading(0.0, 2.0);
+  std::uniform_real_distribution<double> Chance(0.0, 1.0);
+  uint64_t Tx_Done = Package.Start + Package.Time_On_Air;
+  uint64_t First = UINT64_MAX;
+  uint64_t Forward;
+  uint64_t Ready;
+  uint64_t Lead = (uint64_t)(_Config.Gateway_Lead * 1000);
+  unsigned char Copies = 0;
+  float Best_Snr = -100;
+  signed char Power_Index = (LORAWAN_MAX_EIRP - Package.Tx_Power) / 2;
+  Decoded_Frame Frame;
+  unsigned char Command[5];
+  unsigned char Command_Length = 0;
+  unsigned char Downlink[64];
+  unsigned char Downlink_Length;
+  unsigned char Window;
+  const Pending *Data = 0;
+  bool Confirmed;
+  unsigned char i;
+
+  _Stats.Uplinks++;
+
+  if(!_Index_Built)
+  {
+    _Decoder.Build_Index();
+    _Index_Built = true;
+  }
+
+  //Every gateway on its own, SNR below the floor is not demodulated
+  for(i = 0; i < _Config.Gateways; i++)
+  {
+    float Snr = D.Snr - (LORAWAN_MAX_EIRP - Package.Tx_Power) + Fading(_Random);
+    uint64_t Arrival;
+
+    if(Snr < Demodulation_Floor(Package.Datarate) || Chance(_Random) < _Config.Uplink_Loss)
+    {
+      continue;
+    }
+
+    Arrival = Tx_Done + Backhaul();
+    First = (Arrival < First) ? Arrival : First;
+    Best_Snr = (Snr > Best_Snr) ? Snr : Best_Snr;
+    Copies++;
+  }
+
+  if(Copies == 0)
+  {
+    _Stats.Uplinks_Lost++;
+    return;
+  }
+
+  //Deduplication, copies within the window are dropped, later ones fail the frame
+  //counter check just the same
+  _Stats.Duplicates += Copies - 1;
+  Forward = First + (uint64_t)(_Config.Dedup_Window * 1000);
+
+  if(_Decoder.Decode(Package.Data, Package.Length, &Frame) != DECODER_OK || Frame.Session != D.Session)
+  {
+    _Stats.MIC_Fail++;
+    return;
+  }
+  if(D.Frame_Counter_Up >= 0 && Frame.Frame_Counter <= D.Frame_Counter_Up)
+  {
+    _Stats.Replays++;
+    return;
+  }
+  D.Frame_Counter_Up = Frame.Frame_Counter;
+
+  _Stats.Uplink.Add((Forward - Package.Start) / 1000.0);
+
+  //LinkADRAns
+  for(i = 0; i + 1 < Frame.FOpts_Length; i += 2)
+  {
+    if(Frame.FOpts[i] != LORAWAN_LINK_ADR_ANS)
+    {
+      break;
+    }
+    if(D.ADR_Pending)
+    {
+      if(Frame.FOpts[i + 1] == 0x07)
+      {
+        _Stats.ADR_Accepted++;
+      }
+      else
+      {
+        _Stats.ADR_Rejected++;
+      }
+      D.ADR_Pending = false;
+      D.History_Count = 0;
+    }
+  }
+
+  if(D.ADR_Pending && ++D.ADR_Age >= NETSERVER_ADR_TIMEOUT)
+  {
+    D.ADR_Pending = false;
+  }
+
+  //ADR history, SNR of the best gateway at full power
+  Best_Snr += LORAWAN_MAX_EIRP - Package.Tx_Power;
+  if(D.History_Count < NETSERVER_ADR_HISTORY)
+  {
+    D.History[D.History_Count++] = Best_Snr;
+  }
+  else
+  {
+    memmove(D.History, &D.History[1], (NETSERVER_ADR_HISTORY - 1) * sizeof(float));
+    D.History[NETSERVER_ADR_HISTORY - 1] = Best_Snr;
+  }
+
+  //What goes down
+  Confirmed = (Package.Data[0] & 0xE0) == LORAWAN_CONFIRMED_UP;
+  if(_Config.ADR && !D.ADR_Pending)
+  {
+    Command_Length = ADR(D, Package.Datarate, Power_Index, Command);
+  }
+  if(!D.Data.empty() && D.Data.front().Time <= Forward)
+  {
+    Data = &D.Data.front();
+  }
+  if(!Confirmed && Command_Length == 0 && Data == 0)
+  {
+    return;
+  }
+
+  //RX1 or RX2, whichever the downlink can still make
+  Ready = Forward + (uint64_t)(_Config.Processing * 1000) + Backhaul();
+  if(Ready + Lead <= Tx_Done + LORAWAN_RECEIVE_DELAY1 * 1000ULL && Package.Datarate != 7)
+  {
+    Window = 1;
+    _Stats.Downlinks_Rx1++;
+  }
+  else if(Ready + Lead <= Tx_Done + LORAWAN_RECEIVE_DELAY2 * 1000ULL)
+  {
+    Window = 2;
+    _Stats.Downlinks_Rx2++;
+  }
+  else
+  {
+    _Stats.Downlinks_Late++;
+    return;
+  }
+
+  Downlink_Length = Build_Downlink(D, Downlink, Confirmed, Command, Command_Length, Data);
+  _Stats.Downlinks++;
+  if(Command_Length != 0)
+  {
+    _Stats.ADR_Requests++;
+    D.ADR_Pending = true;
+    D.ADR_Age = 0;
+  }
+  if(Data != 0)
+  {
+    D.Data.pop_front();
+  }
+
+  if(Chance(_Random) < _Config.Downlink_Loss)
+  {
+    _Stats.Downlinks_Lost++;
+    return;
+  }
+
+  //The node hears the gateway about as well as the gateways hear it at full power
+  D.Radio->Set_Snr((signed char)lround(D.Snr + Fading(_Random)));
+  D.Radio->Queue_Downlink(Downlink, Downlink_Length, Window);
+}
+
+/*
+*****************************************************************************************
+* Description : Function decides on a LinkADRReq from the SNR history
+*
+* Returns     : length of the command, 0 when nothing changes
+*****************************************************************************************
+*/
+unsigned char NetServer::ADR(Device &D, unsigned char Datarate, signed char Tx_Power, unsigned char *Command)
+{
+  float Max_Snr = -100;
+  int Steps;
+  unsigned char DR = Datarate;
+  signed char Power = 0;
+  unsigned char i;
+
+  //LoRa data rates of BW125 only, a full history
+  if(Datarate > 5 || D.History_Count < NETSERVER_ADR_HISTORY)
+  {
+    return 0;
+  }
+
+  for(i = 0; i < D.History_Count; i++)
+  {
+    Max_Snr = (D.History[i] > Max_Snr) ? D.History[i] : Max_Snr;
+  }
+
+  //From full power, data rate goes before power whatever the node chose itself
+  Steps = (int)floorf((Max_Snr - Demodulation_Floor(Datarate) - NETSERVER_ADR_MARGIN) / 3);
+
+  while(Steps > 0 && DR < 5)
+  {
+    DR++;
+    Steps--;
+  }
+  while(Steps > 0 && Power < LORAWAN_TX_POWER_MAX_IDX)
+  {
+    Power++;
+    Steps--;
+  }
+  while(Steps < 0 && Power > 0)
+  {
+    Power--;
+    Steps++;
+  }
+
+  if(DR == Datarate && Power == Tx_Power)
+  {
+    return 0;
+  }
+
+  //All channels of the plan, NbTrans 1
+  Command[0] = LORAWAN_LINK_ADR_REQ;
+  Command[1] = (DR << 4) | Power;
+  Command[2] = 0xFF;
+  Command[3] = 0x00;
+  Command[4] = 0x01;
+  return 5;
+}
+
+/*
+*****************************************************************************************
+* Description : Function builds a data down frame, unconfirmed
+*
+*               MHDR | DevAddr | FCtrl | FCnt | FOpts | FPort | FRMPayload | MIC
+*
+* Returns     : length of the frame
+*****************************************************************************************
+*/
+unsigned char NetServer::Build_Downlink(Device &D, unsigned char *Package, bool Ack, const unsigned char *FOpts,
+  unsigned char FOpts_Length, const Pending *Data)
+{
+  Decoder_Session &S = _Decoder.Get_Session(D.Session);
+  uint32_t Frame_Counter = D.Frame_Counter_Down++;
+  unsigned char Length;
+  unsigned char i;
+
+  Package[0] = LORAWAN_UNCONFIRMED_DOWN;
+  for(i = 0; i < 4; i++)
+  {
+    Package[1 + i] = S.DevAddr[3 - i];
+  }
+  Package[5] = (Ack ? 0x20 : 0x00) | FOpts_Length;
+  Package[6] = Frame_Counter & 0xFF;
+  Package[7] = (Frame_Counter >> 8) & 0xFF;
+  memcpy(&Package[8], FOpts, FOpts_Length);
+  Length = 8 + FOpts_Length;
+
+  if(Data != 0)
+  {
+    Package[Length] = Data->Port;
+    memcpy(&Package[Length + 1], Data->Data, Data->Length);
+    _Crypto.Encrypt_Payload(&Package[Length + 1], Data->Length, Frame_Counter, 0x01, S.DevAddr, S.AppSkey);
+    Length += 1 + Data->Length;
+  }
+
+  _Crypto.Calculate_MIC(Package, &Package[Length], Length, Frame_Counter, 0x01, S.DevAddr, S.NwkSkey);
+
+  return Length + 4;
+}
+
+/*
+*****************************************************************************************
+* Description : Function draws one backhaul delay in us
+*****************************************************************************************
+*/
+uint64_t NetServer::Backhaul()
+{
+  std::lognormal_distribution<double> Delay(log(_Config.Backhaul), _Config.Backhaul_Spread);
+
+  return (uint64_t)(Delay(_Random) * 1000);
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the lowest SNR a data rate demodulates at, dB
+*****************************************************************************************
+*/
+float NetServer::Demodulation_Floor(unsigned char Datarate)
+{
+  static const float Floor[8] = { -20.0f, -17.5f, -15.0f, -12.5f, -10.0f, -7.5f, -7.5f, 5.0f };
+
+  return Floor[Datarate & 7];
+}
+
+/*
+*****************************************************************************************
+* Description : Function prints frame success rates and latency distributions
+*****************************************************************************************
+*/
+void NetServer::Report(FILE *Out)
+{
+  NetServer_Stats &S = _Stats;
+  unsigned long Received = S.Uplinks - S.Uplinks_Lost - S.MIC_Fail - S.Replays;
+
+  fprintf(Out, "uplinks    %lu sent, %lu received (%.1f %%), %lu duplicates dropped, %lu MIC fail, %lu replays\n",
+    S.Uplinks, Received, S.Uplinks ? 100.0 * Received / S.Uplinks : 0.0, S.Duplicates, S.MIC_Fail, S.Replays);
+  fprintf(Out, "confirmed  %lu sent, %lu acked (%.1f %%)\n",
+    S.Confirmed, S.Acked, S.Confirmed ? 100.0 * S.Acked / S.Confirmed : 0.0);
+  fprintf(Out, "downlinks  %lu sent, %lu RX1, %lu RX2, %lu too late for RX2, %lu lost on air\n",
+    S.Downlinks, S.Downlinks_Rx1, S.Downlinks_Rx2, S.Downlinks_Late, S.Downlinks_Lost);
+  fprintf(Out, "data       %lu queued, %lu delivered (%.1f %%)\n",
+    S.Data_Queued, S.Data_Delivered, S.Data_Queued ? 100.0 * S.Data_Delivered / S.Data_Queued : 0.0);
+  fprintf(Out, "ADR        %lu LinkADRReq, %lu accepted, %lu rejected\n\n",
+    S.ADR_Requests, S.ADR_Accepted, S.ADR_Rejected);
+
+  fprintf(Out, "  latency            count       p50       p90       p99       max\n");
+  S.Uplink.Print(Out, "uplink ms");
+  S.Ack.Print(Out, "ack ms");
+  S.Downlink.Print(Out, "downlink data s");
+}
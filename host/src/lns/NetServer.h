@@ -0,0 +1,164 @@
+/*
+  NetServer.h - Network server stand-in for host runs of the LoRaWAN stack
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Sits behind the SimRadio of every device (SimRadio::On_Uplink). An uplink is
+  heard by each of the gateways unless it is lost or below the demodulation
+  floor, every copy reaches the server after its own backhaul delay. The server
+  takes the first copy, waits NetServer_Config.Dedup_Window for more and drops
+  those, checks the MIC and frame counter with FrameDecoder and hands the frame
+  to the application.
+
+  When there is something to send (ACK of a confirmed uplink, LinkADRReq,
+  application data queued with Queue_Data) the downlink is built like a network
+  server does and queued in the radio for RX1, or RX2 when the server plus
+  backhaul is too slow for RX1. Too slow for RX2 as well, it waits for the next
+  uplink.
+
+  ADR follows the usual scheme: the best SNR of the last NETSERVER_ADR_HISTORY
+  uplinks above the floor of the data rate less NETSERVER_ADR_MARGIN, every
+  3 dB left is one data rate up and then one power step down. The SNRs count as
+  at full power, nodes adapt their power to the downlink SNR until ADR takes
+  over. Downlinks reach the node with the SNR of its uplinks at full power.
+
+  Times are the virtual us of the SimRadios.
+*/
+
+#ifndef NetServer_h
+#define NetServer_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "SimRadio.h"
+#include "FrameDecoder.h"
+
+#define NETSERVER_MAX_GATEWAYS 16
+#define NETSERVER_ADR_HISTORY  20
+#define NETSERVER_ADR_MARGIN   10
+// uplinks a LinkADRReq waits for its answer before it is sent again
+#define NETSERVER_ADR_TIMEOUT  8
+// application data per downlink: the 64 byte frame buffer of the node less
+// header, a LinkADRReq, FPort and MIC
+#define NETSERVER_MAX_DATA     46
+
+struct NetServer_Config
+{
+  // gateways in range of every device
+  unsigned char Gateways;
+  // chance that one gateway misses an uplink, that the downlink is lost
+  double Uplink_Loss;
+  double Downlink_Loss;
+  // gateway to server one way, lognormal: median ms and sigma of its log
+  double Backhaul;
+  double Backhaul_Spread;
+  // ms the server waits for copies from more gateways
+  double Dedup_Window;
+  // ms from the deduplicated uplink to a downlink on its way to the gateway
+  double Processing;
+  // ms before the window the gateway needs the downlink
+  double Gateway_Lead;
+  bool ADR;
+};
+
+// distribution of a latency
+class NetServer_Latency
+{
+  public:
+    void Add(double Value);
+    unsigned long Get_Count();
+    double Percentile(double Fraction);
+    void Print(FILE *Out, const char *Name);
+
+  private:
+    std::vector<double> _Values;
+    bool _Sorted = true;
+};
+
+struct NetServer_Stats
+{
+  unsigned long Uplinks = 0;
+  unsigned long Uplinks_Lost = 0;
+  unsigned long Duplicates = 0;
+  unsigned long MIC_Fail = 0;
+  unsigned long Replays = 0;
+  unsigned long Confirmed = 0;
+  unsigned long Acked = 0;
+  unsigned long Downlinks = 0;
+  unsigned long Downlinks_Rx1 = 0;
+  unsigned long Downlinks_Rx2 = 0;
+  unsigned long Downlinks_Late = 0;
+  unsigned long Downlinks_Lost = 0;
+  unsigned long Data_Queued = 0;
+  unsigned long Data_Delivered = 0;
+  unsigned long ADR_Requests = 0;
+  unsigned long ADR_Accepted = 0;
+  unsigned long ADR_Rejected = 0;
+  // application sends until the server hands the uplink on, ms
+  NetServer_Latency Uplink;
+  // confirmed uplink sent until the node has the ACK, ms
+  NetServer_Latency Ack;
+  // application data queued until the node has it, s
+  NetServer_Latency Downlink;
+};
+
+class NetServer
+{
+  public:
+    NetServer(const NetServer_Config &Config, uint32_t Seed);
+
+    long Add_Device(SimRadio &Radio, unsigned char DevAddr[], unsigned char NwkSkey[], unsigned char AppSkey[], float Snr);
+    void Queue_Data(long Device, uint64_t Time, const unsigned char *Data, unsigned char Length, unsigned char Port);
+    void Delivered(long Device, uint64_t Time, uint64_t Queued);
+    NetServer_Stats &Get_Stats();
+    void Report(FILE *Out);
+
+  private:
+    struct Pending
+    {
+      uint64_t Time;
+      unsigned char Data[NETSERVER_MAX_DATA];
+      unsigned char Length;
+      unsigned char Port;
+    };
+
+    struct Device
+    {
+      NetServer *Server;
+      SimRadio *Radio;
+      long Session;
+      // SNR at the gateways at full power
+      float Snr;
+      int64_t Frame_Counter_Up;
+      uint32_t Frame_Counter_Down;
+      std::deque<Pending> Data;
+      // ADR, SNRs as at full power, the node may have adapted its power itself
+      float History[NETSERVER_ADR_HISTORY];
+      unsigned char History_Count;
+      unsigned char ADR_Age;
+      bool ADR_Pending;
+    };
+
+    NetServer_Config _Config;
+    FrameDecoder _Decoder;
+    bool _Index_Built;
+    LoRaWAN_Crypto _Crypto;
+    std::vector<std::unique_ptr<Device> > _Devices;
+    NetServer_Stats _Stats;
+    std::mt19937 _Random;
+
+    static void Uplink(SimRadio &Radio, void *Context);
+    void Process(Device &D, SimRadio_Package &Package);
+    unsigned char ADR(Device &D, unsigned char Datarate, signed char Tx_Power, unsigned char *Command);
+    unsigned char Build_Downlink(Device &D, unsigned char *Package, bool Ack, const unsigned char *FOpts,
+      unsigned char FOpts_Length, const Pending *Data);
+    uint64_t Backhaul();
+    static float Demodulation_Floor(unsigned char Datarate);
+};
+
+#endif
@@ -0,0 +1,185 @@
+/*
+  main.cpp - End to end runs against the network server stand-in
+  Every node is a LoRaWAN<SimRadio> in class A with receive windows, starting at
+  DR0 and full power so ADR has work to do. A share of the nodes sends confirmed
+  uplinks, the application queues data for the nodes at random times. Reports
+  frame success rates and latency distributions, and the CPU time per uplink of
+  the whole pipeline as a benchmark of the LoRaWAN class.
+
+  lns [nodes] [uplinks per node] [backhaul ms] [confirmed %] [downlinks per hour]
+    nodes       devices behind the server (200)
+    uplinks     per node, one every 300 s +-10% (100)
+    backhaul    median gateway <-> server delay, lognormal sigma 0.5 (80)
+    confirmed   share of nodes with confirmed uplinks (30)
+    downlinks   application data per node and hour (2)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "NetServer.h"
+
+#define LNS_PERIOD 300000000ULL
+#define LNS_PORT 10
+
+struct Lns_Node
+{
+  SimRadio Radio;
+  LoRaWAN<SimRadio> Lora;
+  long Device;
+  bool Confirmed;
+
+  Lns_Node() : Lora(Radio)
+  {
+  }
+};
+
+int main(int argc, char **argv)
+{
+  unsigned long Nodes = (argc > 1) ? strtoul(argv[1], 0, 0) : 200;
+  unsigned long Uplinks = (argc > 2) ? strtoul(argv[2], 0, 0) : 100;
+  double Backhaul = (argc > 3) ? atof(argv[3]) : 80.0;
+  double Confirmed_Share = (argc > 4) ? atof(argv[4]) / 100.0 : 0.3;
+  double Per_Hour = (argc > 5) ? atof(argv[5]) : 2.0;
+  NetServer_Config Config;
+  std::mt19937 Random(11);
+  std::uniform_real_distribution<double> Chance(0.0, 1.0);
+  std::uniform_real_distribution<double> Snr(-12.0, 12.0);
+  std::vector<std::unique_ptr<Lns_Node> > Fleet;
+  unsigned long Datarates[8] = { 0 };
+  unsigned long i;
+  unsigned long n;
+  unsigned char j;
+
+  if(Backhaul <= 0)
+  {
+    fprintf(stderr, "lns: backhaul must be above 0 ms\n");
+    return 1;
+  }
+
+  Config.Gateways = 3;
+  Config.Uplink_Loss = 0.1;
+  Config.Downlink_Loss = 0.05;
+  Config.Backhaul = Backhaul;
+  Config.Backhaul_Spread = 0.5;
+  Config.Dedup_Window = 200;
+  Config.Processing = 20;
+  Config.Gateway_Lead = 50;
+  Config.ADR = true;
+
+  NetServer Server(Config, 13);
+  NetServer_Stats &Stats = Server.Get_Stats();
+
+  for(i = 0; i < Nodes; i++)
+  {
+    unsigned char Key[16];
+    unsigned char DevAddr[4] = { 0x26, (unsigned char)(i >> 16), (unsigned char)(i >> 8), (unsigned char)i };
+    Lns_Node *Node = new Lns_Node;
+
+    for(j = 0; j < 16; j++)
+    {
+      Key[j] = Random();
+    }
+
+    Node->Lora.setKeys(Key, Key, DevAddr);
+    Node->Lora.setDatarate(0);
+    Node->Lora.setReceiveWindows(true);
+    Node->Confirmed = Chance(Random) < Confirmed_Share;
+    Node->Lora.setConfirmed(Node->Confirmed);
+    Node->Radio.RFM_Channels().Seed(Random());
+    Node->Device = Server.Add_Device(Node->Radio, DevAddr, Key, Key, Snr(Random));
+
+    Fleet.push_back(std::unique_ptr<Lns_Node>(Node));
+  }
+
+  auto Start = std::chrono::steady_clock::now();
+
+  //Nodes do not share the air here, one after the other
+  for(i = 0; i < Nodes; i++)
+  {
+    Lns_Node &Node = *Fleet[i];
+    std::exponential_distribution<double> Gap(Per_Hour / 3600e6);
+    uint64_t Time = Random() % LNS_PERIOD;
+    uint64_t Next_Data = Per_Hour > 0 ? (uint64_t)Gap(Random) : UINT64_MAX;
+
+    for(n = 0; n < Uplinks; n++)
+    {
+      unsigned char Data[12];
+      unsigned char Received[LORAWAN_MAX_PAYLOAD];
+      unsigned char Length;
+      unsigned char Port;
+      uint64_t Queued;
+
+      //Application data until the server handles this uplink
+      while(Next_Data < Time + 3000000)
+      {
+        unsigned char Payload[8];
+
+        for(j = 0; j < 8; j++)
+        {
+          Payload[j] = Next_Data >> (8 * j);
+        }
+        Server.Queue_Data(Node.Device, Next_Data, Payload, sizeof(Payload), LNS_PORT);
+        Next_Data += (uint64_t)Gap(Random) + 1;
+      }
+
+      for(j = 0; j < sizeof(Data); j++)
+      {
+        Data[j] = n + j;
+      }
+
+      Node.Radio.Set_Time(Time);
+      Node.Lora.Send_Data(Data, sizeof(Data));
+
+      if(Node.Confirmed)
+      {
+        Stats.Confirmed++;
+        if(Node.Lora.isAcked())
+        {
+          Stats.Acked++;
+          Stats.Ack.Add((Node.Radio.Get_Time() - Time) / 1000.0);
+        }
+      }
+
+      while(Node.Lora.Receive(Received, &Length, &Port))
+      {
+        if(Port != LNS_PORT || Length != 8)
+        {
+          continue;
+        }
+        Queued = 0;
+        for(j = 0; j < 8; j++)
+        {
+          Queued |= (uint64_t)Received[j] << (8 * j);
+        }
+        Server.Delivered(Node.Device, Node.Radio.Get_Time(), Queued);
+      }
+
+      //period +- 10%
+      Time += LNS_PERIOD - LNS_PERIOD / 10 + Random() % (LNS_PERIOD / 5 + 1);
+    }
+
+    Datarates[Node.Radio.RFM_Get_Datarate() & 7]++;
+  }
+
+  double Wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+  printf("nodes %lu  uplinks %lu each  gateways %u  backhaul %.0f ms median  confirmed %.0f %%  data %.1f per hour\n\n",
+    Nodes, Uplinks, Config.Gateways, Backhaul, 100.0 * Confirmed_Share, Per_Hour);
+  Server.Report(stdout);
+
+  printf("\ndata rate after ADR:");
+  for(j = 0; j < 8; j++)
+  {
+    printf("  DR%u %lu", j, Datarates[j]);
+  }
+  printf("\nwall %.3f s  %.0f ns per uplink\n", Wall, Stats.Uplinks ? Wall * 1e9 / Stats.Uplinks : 0.0);
+
+  return 0;
+}
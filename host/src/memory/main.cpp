@@ -0,0 +1,119 @@
+/*
+  main.cpp - Stack depth of the LoRaWAN stack on the host
+  Runs each operation on a thread whose stack was painted by MemoryMonitor, the
+  same way the firmware measures its stack, and prints the deepest stack use.
+  Each operation runs once before, so lazy symbol binding is not counted.
+  The crypto runs without hardware AES like on the node. Frames are larger on a
+  64 bit host than on the Cortex-M3, take the numbers as relative.
+
+  memory
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "FrameDecoder.h"
+#include "MemoryMonitor.h"
+
+// stack of the measuring thread, the C library puts its thread data at the top
+#define MEMORY_THREAD_STACK (256 * 1024)
+
+static unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+static unsigned char AppSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+static unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+static unsigned char AppEUI[8] = { 0x70, 0xB3, 0xD5, 0x7E, 0xD0, 0x00, 0x00, 0x01 };
+static unsigned char DevEUI[8] = { 0x00, 0x04, 0xA3, 0x0B, 0x00, 0x1A, 0x2B, 0x3C };
+
+static SimRadio Radio;
+static LoRaWAN<SimRadio> Lora(Radio);
+static LoRaWAN_Crypto Crypto;
+static FrameDecoder Decoder;
+static unsigned char Data[64];
+static unsigned char MIC[4];
+
+static void *Run(void *Operation)
+{
+  ((void (*)())Operation)();
+  return 0;
+}
+
+static unsigned long Measure(void (*Operation)(), Memory_Map *Map)
+{
+  MemoryMonitor Monitor;
+  pthread_attr_t Attributes;
+  pthread_t Thread;
+  unsigned char *Stack;
+
+  if(posix_memalign((void **)&Stack, 4096, MEMORY_THREAD_STACK) != 0)
+  {
+    return 0;
+  }
+
+  //The first call of a library function goes through the dynamic linker, which is
+  //not part of the operation. Once on the main stack binds them all.
+  Operation();
+
+  Monitor.Paint(Stack, Stack + MEMORY_THREAD_STACK);
+
+  pthread_attr_init(&Attributes);
+  pthread_attr_setstack(&Attributes, Stack, MEMORY_THREAD_STACK);
+  pthread_create(&Thread, &Attributes, Run, (void *)Operation);
+  pthread_join(Thread, 0);
+  pthread_attr_destroy(&Attributes);
+
+  Monitor.Get_Map(Map);
+  free(Stack);
+  return Map->Stack;
+}
+
+int main()
+{
+  struct
+  {
+    const char *Name;
+    void (*Operation)();
+  } Operations[] = {
+    { "Send_Data 51 bytes", []() { Lora.Send_Data(Data, 51); } },
+    { "Join", []() { Lora.Join(); } },
+    { "Calculate_MIC 64 bytes", []() { Crypto.Calculate_MIC(Data, MIC, 64, 1, 0, DevAddr, NwkSkey); } },
+    { "Calculate_CMAC 23 bytes", []() { Crypto.Calculate_CMAC(0, Data, MIC, 23, NwkSkey); } },
+    { "Encrypt_Payload 16 bytes", []() { Crypto.Encrypt_Payload(Data, 16, 1, 0, DevAddr, AppSkey); } },
+    { "Encrypt_Payload 51 bytes", []() { Crypto.Encrypt_Payload(Data, 51, 1, 0, DevAddr, AppSkey); } },
+    { "AES_Encrypt", []() { Crypto.AES_Encrypt(Data, AppSkey); } },
+    { "FrameDecoder::Decode", []() { Decoded_Frame Frame; Decoder.Decode(Radio.Last_Package().Data, Radio.Last_Package().Length, &Frame); } },
+  };
+  Memory_Map Map;
+  unsigned long Baseline;
+  unsigned long Used;
+  unsigned int i;
+
+  LoRaWAN_Crypto::Set_Accelerated(false);
+  Lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  Lora.setJoinKeys(AppEUI, DevEUI, AppSkey);
+  Decoder.Add_Session(DevAddr, NwkSkey, AppSkey);
+  Decoder.Build_Index();
+  memset(Data, 0x5A, sizeof(Data));
+
+  //Thread start and C library, taken off every operation
+  Baseline = Measure([]() { }, &Map);
+  printf("thread baseline %lu bytes, not included below\n\n", Baseline);
+
+  printf("%-26s %8s\n", "operation", "stack");
+  for(i = 0; i < sizeof(Operations) / sizeof(Operations[0]); i++)
+  {
+    Used = Measure(Operations[i].Operation, &Map);
+    printf("%-26s %8lu\n", Operations[i].Name, Used > Baseline ? Used - Baseline : 0);
+  }
+
+  printf("\n%-26s %8s\n", "object", "RAM");
+  printf("%-26s %8lu\n", "LoRaWAN<SimRadio>", (unsigned long)sizeof(LoRaWAN<SimRadio>));
+  printf("%-26s %8lu\n", "SessionStore", (unsigned long)sizeof(SessionStore));
+  printf("%-26s %8lu\n", "ChannelSelector", (unsigned long)sizeof(ChannelSelector));
+  printf("%-26s %8lu\n", "LoRaWAN_Session", (unsigned long)sizeof(LoRaWAN_Session));
+
+  return 0;
+}
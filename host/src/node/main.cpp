@@ -0,0 +1,51 @@
+/*
+  main.cpp - Single node on the simulated radio
+  Sends a few frames through LoRaWAN<SimRadio> and prints them with timing, a quick
+  check of the stack without hardware.
+*/
+
+#include <stdio.h>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+
+unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char AppSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+
+int main()
+{
+  SimRadio radio;
+  LoRaWAN<SimRadio> lora(radio);
+  unsigned char Data[6];
+  unsigned char i;
+  unsigned char n;
+
+  lora.setKeys(NwkSkey, AppSkey, DevAddr);
+
+  for(n = 0; n < 4; n++)
+  {
+    for(i = 0; i < sizeof(Data); i++)
+    {
+      Data[i] = n + i;
+    }
+
+    //every other frame at DR7 (FSK)
+    lora.setDatarate((n & 1) ? 7 : 2);
+    lora.Send_Data(Data, sizeof(Data));
+
+    SimRadio_Package &Package = radio.Last_Package();
+    printf("t=%10llu us  ch %u  DR%u  %2d dBm  %6llu us  ",
+      (unsigned long long)Package.Start, Package.Channel, Package.Datarate, Package.Tx_Power,
+      (unsigned long long)Package.Time_On_Air);
+    for(i = 0; i < Package.Length; i++)
+    {
+      printf("%02X", Package.Data[i]);
+    }
+    printf("\n");
+
+    radio.Set_Time(radio.Get_Time() + 20000000);
+  }
+
+  return 0;
+}
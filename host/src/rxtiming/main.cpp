@@ -0,0 +1,106 @@
+/*
+  main.cpp - Receive windows of RxTiming against a drifting node clock
+  The node clock runs off by a drift that wanders with temperature, TxDone and
+  RxDone timestamps carry the capture jitter. The gateway starts every downlink
+  exactly on time. A window catches the downlink when at least 4 preamble symbols
+  fall inside it, the SX1276 needs that many to detect the preamble.
+
+  Every fourth downlink comes in RX2 (DR0, 2 s), the others in RX1 at the data
+  rate given. Reported per block of downlinks: windows missed and the receiver on
+  time of a window without downlink, against the fixed 37 symbols opened 10 ms
+  early the driver used before.
+
+  rxtiming [drift ppm] [downlinks] [DR]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+#include "RxTiming.h"
+
+#define BLOCK 10
+#define DETECT_SYMBOLS 4
+#define OLD_SYMBOLS 37
+#define OLD_EARLY 10000
+
+int main(int argc, char **argv)
+{
+  double Drift = argc > 1 ? atof(argv[1]) : 40.0;
+  long Downlinks = argc > 2 ? atol(argv[2]) : 50;
+  int Datarate = argc > 3 ? atoi(argv[3]) : 5;
+  std::mt19937 Random(7);
+  std::normal_distribution<double> Wander(0.0, 0.5);
+  std::uniform_real_distribution<double> Jitter(-RX_TIMING_CAPTURE_JITTER / 2.0, RX_TIMING_CAPTURE_JITTER / 2.0);
+  std::uniform_int_distribution<int> Length(13, 30);
+  RxTiming Timing;
+  long Missed = 0;
+  long Missed_Total = 0;
+  double On_Time = 0;
+  double Old_On_Time = 0;
+  long n;
+
+  if(Datarate < 0 || Datarate > 6)
+  {
+    fprintf(stderr, "rxtiming: DR0 .. DR6\n");
+    return 1;
+  }
+
+  Timing.Set_Jitter(RX_TIMING_CAPTURE_JITTER);
+
+  printf("drift %.1f ppm, DR%d RX1, DR0 RX2\n\n", Drift, Datarate);
+  printf("downlinks  missed  on time us  before us  drift ppm  error ppm\n");
+
+  for(n = 1; n <= Downlinks; n++)
+  {
+    bool Rx2 = (n % 4) == 0;
+    int DR = Rx2 ? 0 : Datarate;
+    unsigned char SF = (DR < 6) ? 12 - DR : 7;
+    uint16_t Bandwidth = (DR == 6) ? 250 : 125;
+    uint32_t Delay = Rx2 ? 2000 : 1000;
+    double Symbol = (double)(1 << SF) * 1000.0 / Bandwidth;
+    unsigned char Downlink_Length = Length(Random);
+    Rx_Window Window = Timing.Window(Delay, SF, Bandwidth);
+    double Scale = 1.0 + Drift * 1e-6;
+    // true times in us after TxDone, the local timestamp of TxDone has jitter
+    double Tx_Jitter = Jitter(Random);
+    double Open = (Window.Offset + RX_TIMING_WAKEUP - Tx_Jitter) / Scale;
+    double Close = Open + Window.Symbols * Symbol;
+    double Preamble = Delay * 1000.0;
+    double Overlap_Start = Open > Preamble ? Open : Preamble;
+    double Overlap_End = Close < Preamble + 8 * Symbol ? Close : Preamble + 8 * Symbol;
+    double Rx_Done;
+
+    On_Time += RX_TIMING_WAKEUP + Window.Symbols * Symbol;
+    Old_On_Time += OLD_EARLY + OLD_SYMBOLS * Symbol;
+
+    if(Overlap_End - Overlap_Start >= DETECT_SYMBOLS * Symbol)
+    {
+      Rx_Done = Preamble + RxTiming::Airtime(Downlink_Length, SF, Bandwidth, false);
+      Timing.Calibrate(Delay * 1000 + RxTiming::Airtime(Downlink_Length, SF, Bandwidth, false),
+        (uint32_t)(Rx_Done * Scale + Jitter(Random) - Tx_Jitter + 0.5));
+    }
+    else
+    {
+      Missed++;
+    }
+
+    Drift += Wander(Random);
+
+    if(n % BLOCK == 0 || n == Downlinks)
+    {
+      long Count = (n % BLOCK) ? n % BLOCK : BLOCK;
+
+      printf("%4ld-%-4ld  %6ld  %10.0f  %9.0f  %9.1f  %9lu\n", n - Count + 1, n, Missed,
+        On_Time / Count, Old_On_Time / Count, Timing.Get_Drift() / 16.0, (unsigned long)Timing.Get_Error());
+      Missed_Total += Missed;
+      Missed = 0;
+      On_Time = 0;
+      Old_On_Time = 0;
+    }
+  }
+
+  printf("\n%ld of %ld downlinks missed, true drift now %.1f ppm\n", Missed_Total, Downlinks, Drift);
+
+  return Missed_Total ? 2 : 0;
+}
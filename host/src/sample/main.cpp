@@ -0,0 +1,143 @@
+/*
+  main.cpp - Aggregate against a reference and what it saves on air
+  Feeds a synthetic sensor signal (slow sine, noise, a few spikes) through
+  Aggregate in DMA sized blocks, compares the summary with a double precision
+  reference and compares one summary uplink with sending the raw samples.
+
+  sample [rate Hz] [seconds per uplink] [uplinks]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "Aggregate.h"
+#include "Sampler.h"
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+
+#define ALARM_HIGH 3000
+#define ALARM_LOW 2800
+
+int main(int argc, char **argv)
+{
+  double Rate = argc > 1 ? atof(argv[1]) : 1000.0;
+  double Seconds = argc > 2 ? atof(argv[2]) : 20.0;
+  long Uplinks = argc > 3 ? atol(argv[3]) : 50;
+  std::mt19937 Random(5);
+  std::normal_distribution<double> Noise(0.0, 40.0);
+  std::uniform_real_distribution<double> Spike(0.0, 1.0);
+  std::vector<unsigned short> Samples;
+  Aggregate Summary;
+  unsigned char Payload[AGGREGATE_PAYLOAD];
+  unsigned long Count = (unsigned long)(Rate * Seconds);
+  unsigned long Errors = 0;
+  double Worst_Mean = 0;
+  double Worst_Variance = 0;
+  double Nanoseconds = 0;
+  long Uplink;
+  unsigned long i;
+
+  if(Count == 0 || Count > AGGREGATE_MAX_COUNT)
+  {
+    fprintf(stderr, "sample: 1 .. %lu samples per uplink\n", AGGREGATE_MAX_COUNT);
+    return 1;
+  }
+
+  Summary.Set_Threshold(ALARM_HIGH, ALARM_LOW);
+  Samples.resize(Count);
+
+  for(Uplink = 0; Uplink < Uplinks; Uplink++)
+  {
+    double Sum = 0;
+    double Sum_Squares = 0;
+    unsigned short Min = 0xFFFF;
+    unsigned short Max = 0;
+    unsigned short Crossings = 0;
+    bool Above = false;
+    double Mean;
+    double Variance;
+
+    for(i = 0; i < Count; i++)
+    {
+      double Value = 2048 + 900 * sin(2 * M_PI * (Uplink * Count + i) / (Rate * 7.3)) + Noise(Random);
+
+      if(Spike(Random) < 0.0005)
+      {
+        Value += 1500;
+      }
+      Value = Value < 0 ? 0 : (Value > 4095 ? 4095 : Value);
+      Samples[i] = (unsigned short)Value;
+
+      Sum += Samples[i];
+      Sum_Squares += (double)Samples[i] * Samples[i];
+      Min = Samples[i] < Min ? Samples[i] : Min;
+      Max = Samples[i] > Max ? Samples[i] : Max;
+      if(Above)
+      {
+        Above = Samples[i] > ALARM_LOW;
+      }
+      else if(Samples[i] >= ALARM_HIGH)
+      {
+        Above = true;
+        Crossings++;
+      }
+    }
+
+    //As the DMA hands them over
+    auto Start = std::chrono::steady_clock::now();
+    for(i = 0; i < Count; i += SAMPLER_BLOCK)
+    {
+      Summary.Add_Block(&Samples[i], (Count - i < SAMPLER_BLOCK) ? Count - i : SAMPLER_BLOCK);
+    }
+    Summary.Pack(Payload);
+    Nanoseconds += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - Start).count();
+
+    Mean = Sum / Count;
+    Variance = Sum_Squares / Count - Mean * Mean;
+    if(fabs(Summary.Get_Mean16() / 16.0 - Mean) > Worst_Mean)
+    {
+      Worst_Mean = fabs(Summary.Get_Mean16() / 16.0 - Mean);
+    }
+    if(fabs(Summary.Get_Variance() - Variance) > Worst_Variance)
+    {
+      Worst_Variance = fabs(Summary.Get_Variance() - Variance);
+    }
+    if(Summary.Get_Count() != Count || Summary.Get_Min() != Min || Summary.Get_Max() != Max ||
+       Summary.Get_Crossings() != Crossings || fabs(Summary.Get_Mean16() / 16.0 - Mean) > 1.0 / 32 ||
+       fabs(Summary.Get_Variance() - Variance) > 1.0)
+    {
+      Errors++;
+    }
+
+    if(Uplink == 0)
+    {
+      printf("first summary: n %lu min %u max %u mean %.2f var %lu crossings %u, payload ",
+        Summary.Get_Count(), Summary.Get_Min(), Summary.Get_Max(), Summary.Get_Mean16() / 16.0,
+        Summary.Get_Variance(), Summary.Get_Crossings());
+      for(i = 0; i < AGGREGATE_PAYLOAD; i++)
+      {
+        printf("%02X", Payload[i]);
+      }
+      printf("\n");
+    }
+    Summary.Reset();
+  }
+
+  //Raw 12 bit samples packed two in three bytes, in full frames
+  unsigned long Raw_Bytes = (Count * 3 + 1) / 2;
+  unsigned long Raw_Frames = (Raw_Bytes + LORAWAN_MAX_PAYLOAD - 1) / LORAWAN_MAX_PAYLOAD;
+  double Raw_Air = Raw_Frames * SimRadio::Time_On_Air(2, 13 + LORAWAN_MAX_PAYLOAD) / 1e6;
+  double Summary_Air = SimRadio::Time_On_Air(2, 13 + AGGREGATE_PAYLOAD) / 1e6;
+
+  printf("%ld uplinks of %lu samples, %lu mismatches, worst mean error %.4f, worst variance error %.3f\n",
+    Uplinks, Count, Errors, Worst_Mean, Worst_Variance);
+  printf("%.2f ns per sample on this host\n", Nanoseconds / ((double)Count * Uplinks));
+  printf("per uplink at DR2: summary %u bytes %.3f s on air, raw %lu bytes in %lu frames %.1f s on air\n",
+    AGGREGATE_PAYLOAD, Summary_Air, Raw_Bytes, Raw_Frames, Raw_Air);
+
+  return Errors != 0;
+}
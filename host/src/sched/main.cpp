@@ -0,0 +1,285 @@
+/*
+  main.cpp - Scheduler on a virtual clock
+  Runs the tasks of the node (uplinks, sampling, interrupt events) through
+  Scheduler<SimClock> for a simulated time and shows how long it ran, idled and
+  slept deep, how late timed tasks were and what that means for the current.
+  Uplinks go in steps like on the node: the MCU sleeps through the time on air
+  and up to RX1 and RX2, the network answers every third uplink in one of them.
+
+  sched [hours] [events per hour]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <random>
+
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "Scheduler.h"
+
+// STM32F103 at 72 MHz from the datasheet, typical: run, sleep (WFI), stop, in mA
+#define CURRENT_RUN 36.0
+#define CURRENT_IDLE 14.4
+#define CURRENT_DEEP_SLEEP 0.014
+
+#define SEND_PERIOD 20000
+#define SAMPLE_PERIOD 1000
+// ms a sample takes, the ADC keeps the scheduler out of stop mode meanwhile
+#define SAMPLE_TIME 3
+// every this many uplinks the network sends a downlink, alternating RX1 and RX2
+#define DOWNLINK_EVERY 3
+
+unsigned char NwkSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char AppSkey[16] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+unsigned char DevAddr[4] = { 0x26, 0x01, 0x1B, 0xDA };
+
+/*
+  Virtual clock on the time of the simulated radio, so the time on air of an
+  uplink counts. Interrupts come at random times and end a sleep early.
+*/
+class SimClock
+{
+  public:
+    SimClock(SimRadio &radio, double Per_Hour) : _Radio(&radio), _Random(7), _Gap(Per_Hour / 3600000.0)
+    {
+      _Interrupt = 0;
+      _Context = 0;
+      _Next_Interrupt = Per_Hour > 0 ? Now() + (unsigned long)_Gap(_Random) + 1 : SCHEDULER_FOREVER;
+    }
+
+    void On_Interrupt(void (*Interrupt)(void *), void *Context)
+    {
+      _Interrupt = Interrupt;
+      _Context = Context;
+    }
+
+    unsigned long Now()
+    {
+      return _Radio->Get_Time() / 1000;
+    }
+
+    void Advance(unsigned long Delay)
+    {
+      _Radio->Set_Time(_Radio->Get_Time() + (uint64_t)Delay * 1000);
+    }
+
+    void Sleep(unsigned long Delay, unsigned char Mode)
+    {
+      unsigned long Now_Ms = Now();
+
+      //Idle wakes on the next SysTick
+      if(Mode == SCHEDULER_IDLE && Delay > 1)
+      {
+        Delay = 1;
+      }
+
+      if(_Next_Interrupt != SCHEDULER_FOREVER && (long)(_Next_Interrupt - (Now_Ms + Delay)) <= 0)
+      {
+        Advance(_Next_Interrupt > Now_Ms ? _Next_Interrupt - Now_Ms : 0);
+        _Next_Interrupt = Now() + (unsigned long)_Gap(_Random) + 1;
+        if(_Interrupt != 0)
+        {
+          _Interrupt(_Context);
+        }
+        return;
+      }
+
+      Advance(Delay);
+    }
+
+  private:
+    SimRadio *_Radio;
+    std::mt19937 _Random;
+    std::exponential_distribution<double> _Gap;
+    void (*_Interrupt)(void *);
+    void *_Context;
+    unsigned long _Next_Interrupt;
+};
+
+struct Node
+{
+  SimRadio *Radio;
+  SimClock *Clock;
+  LoRaWAN<SimRadio> *Lora;
+  Scheduler<SimClock> *Tasks;
+  signed char Send_Id;
+  signed char Radio_Id;
+  signed char Sample_Id;
+  signed char Release_Id;
+  signed char Event_Id;
+  unsigned long Sent;
+  unsigned long Samples;
+  unsigned long Events;
+  unsigned long Posted;
+  // ms from the start of an uplink to the end of its receive windows
+  unsigned long Uplink_Start;
+  unsigned long Uplink_Time;
+  // network side
+  unsigned long Uplinks;
+  unsigned long Downlinks_Sent;
+  unsigned long Downlinks;
+};
+
+/*
+  Network side: answers every DOWNLINK_EVERY uplink with a data down frame in RX1 or
+  RX2, the node must take it out of the window it is in
+*/
+static void Network(SimRadio &Radio, void *Context)
+{
+  Node *node = (Node *)Context;
+  LoRaWAN_Crypto Crypto;
+  unsigned char Package[16];
+  unsigned char i;
+
+  if(++node->Uplinks % DOWNLINK_EVERY != 0)
+  {
+    return;
+  }
+
+  Package[0] = LORAWAN_UNCONFIRMED_DOWN;
+  for(i = 0; i < 4; i++)
+  {
+    Package[1 + i] = DevAddr[3 - i];
+  }
+  Package[5] = 0x00;
+  Package[6] = node->Downlinks_Sent & 0xFF;
+  Package[7] = (node->Downlinks_Sent >> 8) & 0xFF;
+  Package[8] = 1;
+  Package[9] = 0xA5;
+  Package[10] = 0x5A;
+
+  Crypto.Encrypt_Payload(&Package[9], 2, node->Downlinks_Sent, 0x01, DevAddr, AppSkey);
+  Crypto.Calculate_MIC(Package, &Package[11], 11, node->Downlinks_Sent, 0x01, DevAddr, NwkSkey);
+
+  Radio.Queue_Downlink(Package, 15, (node->Downlinks_Sent & 1) ? 2 : 1);
+  node->Downlinks_Sent++;
+}
+
+static void Send_Task(void *Context)
+{
+  Node *node = (Node *)Context;
+  unsigned char Data[6] = { 0, 1, 12, 13, 14, 15 };
+
+  //The receive windows of the last uplink are not over
+  if(node->Lora->isBusy())
+  {
+    return;
+  }
+
+  if(node->Lora->Start_Data(Data, sizeof(Data)))
+  {
+    node->Sent++;
+    node->Uplink_Start = node->Clock->Now();
+
+    //Stop mode can not wake up in time for the receive windows
+    node->Tasks->Hold_Deep_Sleep();
+    node->Tasks->Post(node->Radio_Id);
+  }
+}
+
+//Posted by the radio interrupt on the node, here the timer is exact
+static void Radio_Task(void *Context)
+{
+  Node *node = (Node *)Context;
+  unsigned long Wait = node->Lora->Run_Data();
+  unsigned char Data[LORAWAN_MAX_PAYLOAD];
+  unsigned char Data_Length;
+  unsigned char Port;
+
+  if(Wait != LORAWAN_STEP_DONE)
+  {
+    node->Tasks->Run_After(node->Radio_Id, Wait);
+    return;
+  }
+
+  node->Tasks->Release_Deep_Sleep();
+  node->Uplink_Time += node->Clock->Now() - node->Uplink_Start;
+  while(node->Lora->Receive(Data, &Data_Length, &Port))
+  {
+    if(Port == 1 && Data_Length == 2 && Data[0] == 0xA5 && Data[1] == 0x5A)
+    {
+      node->Downlinks++;
+    }
+  }
+}
+
+static void Sample_Task(void *Context)
+{
+  Node *node = (Node *)Context;
+
+  //Start the conversion, the release task ends it
+  node->Tasks->Hold_Deep_Sleep();
+  node->Tasks->Run_After(node->Release_Id, SAMPLE_TIME);
+  node->Samples++;
+}
+
+static void Release_Task(void *Context)
+{
+  ((Node *)Context)->Tasks->Release_Deep_Sleep();
+}
+
+static void Event_Task(void *Context)
+{
+  ((Node *)Context)->Events++;
+}
+
+static void Interrupt(void *Context)
+{
+  Node *node = (Node *)Context;
+
+  node->Posted++;
+  node->Tasks->Post(node->Event_Id);
+}
+
+int main(int argc, char **argv)
+{
+  double Hours = argc > 1 ? atof(argv[1]) : 24.0;
+  double Per_Hour = argc > 2 ? atof(argv[2]) : 60.0;
+  SimRadio radio;
+  SimClock clock(radio, Per_Hour);
+  LoRaWAN<SimRadio> lora(radio);
+  Scheduler<SimClock> tasks(clock);
+  Node node = { &radio, &clock, &lora, &tasks, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+  unsigned long End = clock.Now() + (unsigned long)(Hours * 3600000.0);
+  unsigned long Runs = 0;
+  double Total;
+  double Current;
+
+  lora.setKeys(NwkSkey, AppSkey, DevAddr);
+  lora.setReceiveWindows(true);
+  radio.On_Uplink(Network, &node);
+  clock.On_Interrupt(Interrupt, &node);
+
+  node.Send_Id = tasks.Add(Send_Task, &node);
+  node.Radio_Id = tasks.Add(Radio_Task, &node);
+  node.Sample_Id = tasks.Add(Sample_Task, &node);
+  node.Release_Id = tasks.Add(Release_Task, &node);
+  node.Event_Id = tasks.Add(Event_Task, &node);
+  tasks.Run_Every(node.Send_Id, SEND_PERIOD);
+  tasks.Run_Every(node.Sample_Id, SAMPLE_PERIOD, 500);
+
+  while((long)(clock.Now() - End) < 0)
+  {
+    tasks.Run();
+    Runs++;
+  }
+
+  Total = tasks.Get_Time(SCHEDULER_RUN) + tasks.Get_Time(SCHEDULER_IDLE) + tasks.Get_Time(SCHEDULER_DEEP_SLEEP);
+  Current = (tasks.Get_Time(SCHEDULER_RUN) * CURRENT_RUN + tasks.Get_Time(SCHEDULER_IDLE) * CURRENT_IDLE +
+    tasks.Get_Time(SCHEDULER_DEEP_SLEEP) * CURRENT_DEEP_SLEEP) / Total;
+
+  printf("%.1f h simulated in %lu passes\n", Total / 3600000.0, Runs);
+  printf("uplinks %lu, samples %lu, events %lu of %lu posted\n", node.Sent, node.Samples, node.Events, node.Posted);
+  printf("downlinks %lu of %lu received in RX1 and RX2\n", node.Downlinks, node.Downlinks_Sent);
+  printf("run %lu ms (%.3f %%), idle %lu ms (%.3f %%), deep sleep %lu ms (%.3f %%)\n",
+    tasks.Get_Time(SCHEDULER_RUN), 100.0 * tasks.Get_Time(SCHEDULER_RUN) / Total,
+    tasks.Get_Time(SCHEDULER_IDLE), 100.0 * tasks.Get_Time(SCHEDULER_IDLE) / Total,
+    tasks.Get_Time(SCHEDULER_DEEP_SLEEP), 100.0 * tasks.Get_Time(SCHEDULER_DEEP_SLEEP) / Total);
+  printf("latest timed task %lu ms after its deadline\n", tasks.Get_Max_Late());
+  printf("MCU average %.3f mA (radio not included)\n", Current);
+  //Send_Data polls the radio through the same time on air and windows
+  printf("%.1f s per uplink on air and in the receive windows, %.3f mA when Send_Data polls through them\n",
+    node.Sent ? node.Uplink_Time / 1000.0 / node.Sent : 0.0, Current + node.Uplink_Time * (CURRENT_RUN - CURRENT_IDLE) / Total);
+
+  return node.Downlinks != node.Downlinks_Sent;
+}
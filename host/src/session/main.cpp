@@ -0,0 +1,302 @@
+/*
+  main.cpp - Session store round trips
+  Saves a session and loads it again: the exact frame counter while the backup
+  registers keep it, the flash checkpoint plus SESSION_FCNT_FLASH_INTERVAL after
+  the backup domain lost its supply, nothing but DevNonce after Erase(). Then a
+  LoRaWAN<SimRadio> restores the session and sends, FrameDecoder checks MIC and
+  frame counter of that uplink. A join accept with RxDelay 5 s and RX1DROffset 2
+  has to move the receive windows, before and after the session was restored.
+
+  Last a node out of coverage tries to join a day long with the backoff of
+  src/main.cpp. DevNonce has to go up with every request, after a reset and after
+  a power loss, while flash sees a checkpoint every SESSION_NONCE_FLASH_INTERVAL
+  requests only.
+
+  session
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SessionStore.h"
+#include "SimRadio.h"
+#include "LoRaWAN.h"
+#include "FrameDecoder.h"
+
+static int Failed = 0;
+
+static void Check(const char *Name, bool Passed)
+{
+  printf("%-44s %s\n", Name, Passed ? "ok" : "FAILED");
+  if(!Passed)
+  {
+    Failed++;
+  }
+}
+
+static unsigned char Mul(unsigned char a, unsigned char b)
+{
+  unsigned char Product = 0;
+
+  while(b != 0)
+  {
+    if(b & 1)
+    {
+      Product ^= a;
+    }
+    a = (a << 1) ^ ((a & 0x80) ? 0x1B : 0x00);
+    b >>= 1;
+  }
+
+  return Product;
+}
+
+/*
+  The network encrypts a join accept with AES decrypt, the stack has no use for
+  it. Straight from FIPS-197, speed does not matter here.
+*/
+static void AES_Decrypt(unsigned char *Data, const unsigned char *Key)
+{
+  unsigned char Round_Keys[11][16];
+  unsigned char Inverse[256];
+  unsigned char State[16];
+  unsigned char Rcon = 0x01;
+  unsigned char Round;
+  unsigned char i;
+  unsigned char c;
+
+  for(i = 0; ; i++)
+  {
+    Inverse[S_Table[i >> 4][i & 0x0F]] = i;
+    if(i == 255)
+    {
+      break;
+    }
+  }
+
+  memcpy(Round_Keys[0], Key, 16);
+  for(Round = 1; Round <= 10; Round++)
+  {
+    unsigned char *Last = Round_Keys[Round - 1];
+    unsigned char *Next = Round_Keys[Round];
+
+    for(i = 0; i < 4; i++)
+    {
+      Next[i] = Last[i] ^ S_Table[Last[12 + ((i + 1) & 3)] >> 4][Last[12 + ((i + 1) & 3)] & 0x0F];
+    }
+    Next[0] ^= Rcon;
+    for(i = 4; i < 16; i++)
+    {
+      Next[i] = Last[i] ^ Next[i - 4];
+    }
+    Rcon = Mul(Rcon, 2);
+  }
+
+  for(i = 0; i < 16; i++)
+  {
+    Data[i] ^= Round_Keys[10][i];
+  }
+
+  for(Round = 10; Round > 0; Round--)
+  {
+    //InvShiftRows and InvSubBytes, State is column by column
+    for(i = 0; i < 16; i++)
+    {
+      State[i] = Inverse[Data[(i + 16 - 4 * (i & 3)) & 0x0F]];
+    }
+    for(i = 0; i < 16; i++)
+    {
+      Data[i] = State[i] ^ Round_Keys[Round - 1][i];
+    }
+
+    if(Round == 1)
+    {
+      break;
+    }
+
+    //InvMixColumns
+    for(c = 0; c < 16; c += 4)
+    {
+      for(i = 0; i < 4; i++)
+      {
+        State[c + i] = Mul(Data[c + i], 0x0E) ^ Mul(Data[c + ((i + 1) & 3)], 0x0B) ^
+          Mul(Data[c + ((i + 2) & 3)], 0x0D) ^ Mul(Data[c + ((i + 3) & 3)], 0x09);
+      }
+    }
+    memcpy(Data, State, 16);
+  }
+}
+
+static void Fill(LoRaWAN_Session *Session)
+{
+  unsigned char i;
+
+  memset(Session, 0, sizeof(LoRaWAN_Session));
+  for(i = 0; i < 4; i++)
+  {
+    Session->DevAddr[i] = 0x26 + i;
+  }
+  for(i = 0; i < 16; i++)
+  {
+    Session->NwkSkey[i] = 0x10 + i;
+    Session->AppSkey[i] = 0xA0 + i;
+  }
+  Session->DevNonce = 0x1234;
+  Session->Rx1_Offset = 1;
+  Session->Rx2_Datarate = 3;
+  Session->Rx_Delay = 2;
+  Session->Joined = 1;
+  Session->Frame_Counter_Tx = 5000;
+}
+
+static bool Same(const LoRaWAN_Session &A, const LoRaWAN_Session &B)
+{
+  return memcmp(A.DevAddr, B.DevAddr, 4) == 0 && memcmp(A.NwkSkey, B.NwkSkey, 16) == 0 &&
+    memcmp(A.AppSkey, B.AppSkey, 16) == 0 && A.DevNonce == B.DevNonce && A.Rx2_Datarate == B.Rx2_Datarate &&
+    A.Rx1_Offset == B.Rx1_Offset && A.Rx_Delay == B.Rx_Delay && A.Joined == B.Joined;
+}
+
+int main(int argc, char **argv)
+{
+  LoRaWAN_Session Saved;
+  LoRaWAN_Session Loaded;
+
+  //Store alone
+  {
+    SessionStore Store;
+
+    Check("blank store has no session", !Store.Load(&Loaded) && Loaded.DevNonce == 0);
+
+    Fill(&Saved);
+    Store.Save(&Saved);
+    Check("Save, Load", Store.Load(&Loaded) && Same(Saved, Loaded) &&
+      Loaded.Frame_Counter_Tx == Saved.Frame_Counter_Tx);
+
+    Store.Save_Frame_Counter(5017);
+    Check("frame counter from the backup registers", Store.Load(&Loaded) && Loaded.Frame_Counter_Tx == 5017);
+
+    Store.Power_Loss();
+    Check("frame counter skips ahead after a power loss",
+      Store.Load(&Loaded) && Loaded.Frame_Counter_Tx == 5000 + SESSION_FCNT_FLASH_INTERVAL);
+
+    Store.Erase();
+    Check("Erase keeps DevNonce only", !Store.Load(&Loaded) && Loaded.DevNonce >= Saved.DevNonce);
+  }
+
+  //Restored by the MAC, checked on the network side
+  {
+    SessionStore Store;
+    SimRadio Radio;
+    LoRaWAN<SimRadio> Lora(Radio);
+    FrameDecoder Decoder;
+    Decoded_Frame Frame;
+    unsigned char Data[4] = { 1, 2, 3, 4 };
+
+    Fill(&Saved);
+    Store.Save(&Saved);
+    Store.Save_Frame_Counter(Saved.Frame_Counter_Tx + 3);
+
+    Lora.setSessionStore(Store);
+    Check("Restore_Session", Lora.Restore_Session() && Lora.isJoined() && Radio.RFM_Get_Rx2_Datarate() == 3);
+
+    Decoder.Add_Session(Saved.DevAddr, Saved.NwkSkey, Saved.AppSkey);
+    Decoder.Build_Index();
+    Lora.Send_Data(Data, sizeof(Data));
+    Check("uplink of the restored session", Decoder.Decode(Radio.Last_Package().Data, Radio.Last_Package().Length,
+      &Frame) == DECODER_OK && Frame.Frame_Counter == Saved.Frame_Counter_Tx + 3 &&
+      memcmp(Frame.Payload, Data, sizeof(Data)) == 0);
+    Check("frame counter stored after the uplink", Store.Load(&Loaded) &&
+      Loaded.Frame_Counter_Tx == Saved.Frame_Counter_Tx + 4);
+  }
+
+  //Join accept with RxDelay 5 s, RX1DROffset 2 and RX2 at DR3
+  {
+    SessionStore Store;
+    SimRadio Radio;
+    SimRadio Restored_Radio;
+    LoRaWAN<SimRadio> Lora(Radio);
+    LoRaWAN<SimRadio> Restored(Restored_Radio);
+    LoRaWAN_Crypto Crypto;
+    unsigned char AppKey[16];
+    unsigned char EUI[8] = { 0 };
+    unsigned char Accept[17] = { 0x20, 0x01, 0x02, 0x03, 0x13, 0x00, 0x00, 0x2A, 0x00, 0x00, 0x26, 0x23, 0x05 };
+    unsigned char Data[4] = { 1, 2, 3, 4 };
+    unsigned char i;
+
+    for(i = 0; i < 16; i++)
+    {
+      AppKey[i] = 0x2B + i;
+    }
+    Crypto.Calculate_CMAC(0, Accept, &Accept[13], 13, AppKey);
+    AES_Decrypt(&Accept[1], AppKey);
+
+    Lora.setJoinKeys(EUI, EUI, AppKey);
+    Lora.setSessionStore(Store);
+    Lora.setReceiveWindows(true);
+    Radio.Queue_Downlink(Accept, sizeof(Accept), 1);
+    Check("join accept", Lora.Join() && Radio.RFM_Get_Rx1_Offset() == 2 && Radio.RFM_Get_Rx2_Datarate() == 3);
+
+    //Nothing for the node, RX2 ends 8 symbols after RxDelay + 1 s
+    Lora.Send_Data(Data, sizeof(Data));
+    Check("receive windows after RxDelay", Radio.Get_Time() == Radio.Last_Package().Start +
+      Radio.Last_Package().Time_On_Air + 6000000 + 8 * SimRadio::Symbol_Time(3));
+
+    Restored.setSessionStore(Store);
+    Restored.setReceiveWindows(true);
+    Restored.Restore_Session();
+    Restored.Send_Data(Data, sizeof(Data));
+    Check("receive windows of the restored session", Restored_Radio.RFM_Get_Rx1_Offset() == 2 &&
+      Restored_Radio.Get_Time() == Restored_Radio.Last_Package().Start +
+      Restored_Radio.Last_Package().Time_On_Air + 6000000 + 8 * SimRadio::Symbol_Time(3));
+  }
+
+  //Joins without coverage
+  {
+    SessionStore Store;
+    SimRadio Radio;
+    LoRaWAN<SimRadio> Lora(Radio);
+    unsigned char Key[16] = { 0 };
+    unsigned char EUI[8] = { 0 };
+    unsigned short Last = 0;
+    unsigned long Period = 60000;
+    unsigned long Elapsed = 0;
+    unsigned long Requests = 0;
+    bool Increasing = true;
+
+    Lora.setJoinKeys(EUI, EUI, Key);
+    Lora.setSessionStore(Store);
+    Lora.Restore_Session();
+
+    while(Elapsed < 86400000UL)
+    {
+      Lora.Join();
+      Requests++;
+      Increasing = Increasing && Radio.Last_Package().Data[17] + (Radio.Last_Package().Data[18] << 8) > Last;
+      Last = Radio.Last_Package().Data[17] + (Radio.Last_Package().Data[18] << 8);
+
+      //Reset every 7th request, power loss every 11th
+      if((Requests % 11) == 0)
+      {
+        Store.Power_Loss();
+      }
+      if((Requests % 7) == 0 || (Requests % 11) == 0)
+      {
+        Lora.Restore_Session();
+      }
+
+      Elapsed += Period;
+      Period = (Period < 3600000 / 2) ? Period * 2 : 3600000;
+      Radio.Set_Time((uint64_t)Elapsed * 1000);
+    }
+
+    printf("%lu join requests a day, %lu flash writes\n", Requests, Store.Get_Flash_Writes());
+    Check("DevNonce goes up through resets and power loss", Increasing);
+    Check("flash written every few requests only",
+      Store.Get_Flash_Writes() <= Requests / SESSION_NONCE_FLASH_INTERVAL + Requests / 11 + 1);
+  }
+
+  printf("\n%s\n", Failed ? "FAILED" : "all passed");
+
+  return Failed ? 2 : 0;
+}
@@ -0,0 +1,221 @@
+/*
+  ChannelSelector.cpp - Adaptive channel selection for the EU863-870 uplink channels
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include "ChannelSelector.h"
+
+// constructor
+ChannelSelector::ChannelSelector()
+{
+  unsigned char i;
+
+  for(i = 0; i < CHANNEL_COUNT; i++)
+  {
+    _Score[i] = CHANNEL_INITIAL_SCORE;
+    _Blacklist[i] = 0;
+  }
+
+  _Mask = (1 << CHANNEL_COUNT) - 1;
+  _Random = 0x2545F491;
+}
+
+/*
+*****************************************************************************************
+* Description : Function seeds the random generator used for the weighted selection.
+*               Nodes should use different seeds, e.g. noise from the radio.
+*****************************************************************************************
+*/
+void ChannelSelector::Seed(uint32_t Seed)
+{
+  // xorshift must not start at zero
+  _Random = Seed ? Seed : 0x2545F491;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the channels allowed by the regional plan or the network
+*               (ChMask of a LinkADRReq). Bits above CHANNEL_COUNT are ignored.
+*****************************************************************************************
+*/
+void ChannelSelector::Set_Channel_Mask(uint16_t Mask)
+{
+  Mask &= (1 << CHANNEL_COUNT) - 1;
+
+  // a mask without any channel is invalid, keep the current one
+  if(Mask != 0)
+  {
+    _Mask = Mask;
+  }
+}
+
+uint16_t ChannelSelector::Get_Channel_Mask()
+{
+  return _Mask;
+}
+
+/*
+*****************************************************************************************
+* Description : Function picks the channel for the next uplink. Channels are drawn
+*               with a probability proportional to their score. Blacklisted channels
+*               are skipped as long as there is any other channel left.
+*
+* Arguments   : Exclude  mask of channels not to use, e.g. ones that were busy already
+*
+* Returns     : Channel number 0 .. CHANNEL_COUNT - 1
+*****************************************************************************************
+*/
+unsigned char ChannelSelector::Select(uint16_t Exclude)
+{
+  unsigned char i;
+  uint16_t Candidates = 0;
+  uint16_t Usable;
+  uint32_t Total = 0;
+  uint32_t Pick;
+
+  //Age the blacklist, a channel gets a fresh start when it runs out
+  for(i = 0; i < CHANNEL_COUNT; i++)
+  {
+    if(_Blacklist[i] != 0)
+    {
+      if(--_Blacklist[i] == 0)
+      {
+        _Score[i] = CHANNEL_INITIAL_SCORE;
+      }
+    }
+  }
+
+  Usable = _Mask & ~Exclude;
+  if(Usable == 0)
+  {
+    Usable = _Mask;
+  }
+
+  for(i = 0; i < CHANNEL_COUNT; i++)
+  {
+    if((Usable & (1 << i)) && _Blacklist[i] == 0)
+    {
+      Candidates |= (1 << i);
+    }
+  }
+  if(Candidates == 0)
+  {
+    Candidates = Usable;
+  }
+
+  //Weight is score + 1 so a channel at zero can still be drawn
+  for(i = 0; i < CHANNEL_COUNT; i++)
+  {
+    if(Candidates & (1 << i))
+    {
+      Total += _Score[i] + 1;
+    }
+  }
+
+  Pick = Next_Random() % Total;
+  for(i = 0; i < CHANNEL_COUNT; i++)
+  {
+    if(Candidates & (1 << i))
+    {
+      if(Pick < (uint32_t)_Score[i] + 1)
+      {
+        break;
+      }
+      Pick -= _Score[i] + 1;
+    }
+  }
+
+  return i;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions that feed observations into the channel scores
+*
+* Arguments   : Channel  Channel the observation belongs to
+*               Acked    true when the network acknowledged the uplink
+*               RSSI     RSSI of a downlink in dBm
+*               SNR      SNR of a downlink in dB
+*****************************************************************************************
+*/
+void ChannelSelector::Report_Ack(unsigned char Channel, bool Acked)
+{
+  Update(Channel, Acked ? 255 : 0);
+}
+
+void ChannelSelector::Report_Busy(unsigned char Channel)
+{
+  Update(Channel, 0);
+}
+
+void ChannelSelector::Report_Downlink(unsigned char Channel, signed short RSSI, signed char SNR)
+{
+  signed short Sample;
+
+  //SNR -20 dB (SF12 floor) .. +10 dB maps to 0 .. 240, weak RSSI pulls it down
+  Sample = (SNR + 20) * 8;
+  if(RSSI < -120)
+  {
+    Sample -= (-120 - RSSI) * 4;
+  }
+
+  if(Sample < 0)
+  {
+    Sample = 0;
+  }
+  if(Sample > 255)
+  {
+    Sample = 255;
+  }
+
+  Update(Channel, Sample);
+}
+
+unsigned char ChannelSelector::Get_Score(unsigned char Channel)
+{
+  return _Score[Channel % CHANNEL_COUNT];
+}
+
+bool ChannelSelector::Is_Blacklisted(unsigned char Channel)
+{
+  return _Blacklist[Channel % CHANNEL_COUNT] != 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function moves the score 1/8 of the way towards the new sample and
+*               blacklists the channel when it falls below CHANNEL_BLACKLIST_SCORE
+*****************************************************************************************
+*/
+void ChannelSelector::Update(unsigned char Channel, unsigned char Sample)
+{
+  signed short Score;
+
+  if(Channel >= CHANNEL_COUNT)
+  {
+    return;
+  }
+
+  Score = _Score[Channel];
+  Score += (Sample - Score) / 8;
+  _Score[Channel] = Score;
+
+  if(Score < CHANNEL_BLACKLIST_SCORE && _Blacklist[Channel] == 0)
+  {
+    _Blacklist[Channel] = CHANNEL_BLACKLIST_TIME;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : xorshift32, good enough to spread the channel choice
+*****************************************************************************************
+*/
+uint32_t ChannelSelector::Next_Random()
+{
+  _Random ^= _Random << 13;
+  _Random ^= _Random >> 17;
+  _Random ^= _Random << 5;
+  return _Random;
+}
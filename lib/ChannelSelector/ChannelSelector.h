@@ -0,0 +1,54 @@
+/*
+  ChannelSelector.h - Adaptive channel selection for the EU863-870 uplink channels
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Every channel carries a score of 0..255 that follows the outcome of the frames
+  sent on it (ACK / no ACK), CAD busy results and the quality of downlinks. A
+  channel is picked at random, weighted by its score, so healthy channels are
+  preferred without all nodes piling onto the same one. Channels whose score drops
+  below CHANNEL_BLACKLIST_SCORE are left out for CHANNEL_BLACKLIST_TIME selections.
+
+  Does not depend on Arduino, so it can be used in host builds as well.
+*/
+
+#ifndef ChannelSelector_h
+#define ChannelSelector_h
+
+#include <stdint.h>
+
+#define CHANNEL_COUNT             8
+// 868.8 MHz of DR7 (FSK), not one of the scored channels, reports on it are ignored
+#define CHANNEL_FSK               CHANNEL_COUNT
+#define CHANNEL_INITIAL_SCORE     128
+#define CHANNEL_BLACKLIST_SCORE   40
+#define CHANNEL_BLACKLIST_TIME    32
+
+class ChannelSelector
+{
+  public:
+    ChannelSelector();
+    void Seed(uint32_t Seed);
+    void Set_Channel_Mask(uint16_t Mask);
+    uint16_t Get_Channel_Mask();
+    unsigned char Select(uint16_t Exclude = 0);
+
+    void Report_Ack(unsigned char Channel, bool Acked);
+    void Report_Busy(unsigned char Channel);
+    void Report_Downlink(unsigned char Channel, signed short RSSI, signed char SNR);
+
+    unsigned char Get_Score(unsigned char Channel);
+    bool Is_Blacklisted(unsigned char Channel);
+
+  private:
+    unsigned char _Score[CHANNEL_COUNT];
+    // number of selections the channel stays blacklisted
+    unsigned char _Blacklist[CHANNEL_COUNT];
+    uint16_t _Mask;
+    uint32_t _Random;
+
+    void Update(unsigned char Channel, unsigned char Sample);
+    uint32_t Next_Random();
+};
+
+#endif
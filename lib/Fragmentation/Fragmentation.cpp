@@ -0,0 +1,407 @@
+/*
+  Fragmentation.cpp - Uplink fragmentation with erasure coding for large blobs
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Fragmentation.h"
+
+/*
+*****************************************************************************************
+* Description : GF(256) with the Reed-Solomon polynomial x^8 + x^4 + x^3 + x^2 + 1,
+*               computed without tables to keep flash free
+*****************************************************************************************
+*/
+static unsigned char GF_Mul(unsigned char a, unsigned char b)
+{
+  unsigned char Product = 0;
+
+  while(b != 0)
+  {
+    if(b & 1)
+    {
+      Product ^= a;
+    }
+    a = (a << 1) ^ ((a & 0x80) ? 0x1D : 0x00);
+    b >>= 1;
+  }
+  return Product;
+}
+
+//a^254 is the inverse of a
+static unsigned char GF_Inv(unsigned char a)
+{
+  unsigned char Result = 1;
+  unsigned char Exponent = 254;
+
+  while(Exponent != 0)
+  {
+    if(Exponent & 1)
+    {
+      Result = GF_Mul(Result, a);
+    }
+    a = GF_Mul(a, a);
+    Exponent >>= 1;
+  }
+  return Result;
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the coefficient of data fragment Data in parity
+*               fragment Parity. Cauchy matrix 1 / (x_j + y_i) with x_j = Data_Count + j
+*               and y_i = i, every column scaled so the first row is all ones.
+*****************************************************************************************
+*/
+unsigned char Frag_Coefficient(unsigned char Parity, unsigned char Data, unsigned char Data_Count)
+{
+  return GF_Mul(GF_Inv((unsigned char)(Data_Count + Parity) ^ Data), Data_Count ^ Data);
+}
+
+// constructor
+FragEncoder::FragEncoder()
+{
+  _Blob = 0;
+  _Length = 0;
+  _Fragment_Size = 0;
+  _Data_Count = 0;
+  _Parity_Count = 0;
+  _Id = 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function starts a new blob
+*
+* Arguments   : *Blob          data, read by Get_Fragment
+*               Length         length of the blob
+*               Fragment_Size  data bytes per fragment, at most FRAG_MAX_DATA
+*               Parity_Count   parity fragments, lost fragments that can be repaired
+*
+* Returns     : false if the blob needs more than 255 fragments
+*****************************************************************************************
+*/
+bool FragEncoder::Begin(const unsigned char *Blob, unsigned short Length, unsigned char Fragment_Size, unsigned char Parity_Count)
+{
+  unsigned short Data_Count;
+
+  if(Length == 0 || Fragment_Size == 0 || Fragment_Size > FRAG_MAX_DATA)
+  {
+    return false;
+  }
+
+  Data_Count = (Length + Fragment_Size - 1) / Fragment_Size;
+  if(Data_Count + Parity_Count > 255)
+  {
+    return false;
+  }
+
+  _Blob = Blob;
+  _Length = Length;
+  _Fragment_Size = Fragment_Size;
+  _Data_Count = Data_Count;
+  _Parity_Count = Parity_Count;
+  _Id++;
+
+  return true;
+}
+
+unsigned char FragEncoder::Get_Count()
+{
+  return _Data_Count + _Parity_Count;
+}
+
+/*
+*****************************************************************************************
+* Description : Function builds a fragment with its header. Parity fragments are
+*               computed here, one pass over the blob each.
+*
+* Arguments   : Index      0 .. Get_Count() - 1
+*               *Fragment  FRAG_HEADER_SIZE + Fragment_Size bytes
+*
+* Returns     : length of the fragment, 0 for an invalid index
+*****************************************************************************************
+*/
+unsigned char FragEncoder::Get_Fragment(unsigned char Index, unsigned char *Fragment)
+{
+  unsigned char *Data = &Fragment[FRAG_HEADER_SIZE];
+  unsigned short Offset;
+  unsigned char Coefficient;
+  unsigned char i;
+  unsigned char k;
+
+  if(Index >= _Data_Count + _Parity_Count)
+  {
+    return 0;
+  }
+
+  Fragment[0] = _Id;
+  Fragment[1] = Index;
+  Fragment[2] = _Data_Count;
+  Fragment[3] = _Parity_Count;
+  Fragment[4] = _Length & 0xFF;
+  Fragment[5] = _Length >> 8;
+
+  memset(Data, 0, _Fragment_Size);
+
+  for(i = 0; i < _Data_Count; i++)
+  {
+    if(Index < _Data_Count && i != Index)
+    {
+      continue;
+    }
+
+    Coefficient = (Index < _Data_Count) ? 1 : Frag_Coefficient(Index - _Data_Count, i, _Data_Count);
+    Offset = (unsigned short)i * _Fragment_Size;
+
+    //The last data fragment is padded with zeros
+    for(k = 0; k < _Fragment_Size && Offset + k < _Length; k++)
+    {
+      Data[k] ^= GF_Mul(Coefficient, _Blob[Offset + k]);
+    }
+  }
+
+  return FRAG_HEADER_SIZE + _Fragment_Size;
+}
+
+// constructor
+FragDecoder::FragDecoder()
+{
+  _Fragments = 0;
+  _Id = 0;
+  _Length = 0;
+  _Fragment_Size = 0;
+  _Data_Count = 0;
+  _Parity_Count = 0;
+  _Received = 0;
+  _Complete = false;
+}
+
+FragDecoder::~FragDecoder()
+{
+  free(_Fragments);
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a received fragment (FRMPayload of FRAG_PORT). A
+*               fragment of another blob drops what was collected so far.
+*
+* Returns     : FRAG_COMPLETE once the blob is rebuilt, also for later fragments of
+*               the same blob, FRAG_INCOMPLETE or FRAG_INVALID
+*****************************************************************************************
+*/
+unsigned char FragDecoder::Add(const unsigned char *Fragment, unsigned char Length)
+{
+  unsigned char Index;
+
+  if(Length <= FRAG_HEADER_SIZE || Fragment[2] == 0 || Fragment[1] >= Fragment[2] + Fragment[3])
+  {
+    return FRAG_INVALID;
+  }
+
+  if(_Fragments == 0 || Fragment[0] != _Id || Fragment[2] != _Data_Count || Fragment[3] != _Parity_Count ||
+     (Fragment[4] | (Fragment[5] << 8)) != _Length || Length - FRAG_HEADER_SIZE != _Fragment_Size)
+  {
+    Start(Fragment, Length);
+    if(_Fragments == 0)
+    {
+      return FRAG_INVALID;
+    }
+  }
+
+  if(_Complete)
+  {
+    return FRAG_COMPLETE;
+  }
+
+  Index = Fragment[1];
+  if(!Has(Index))
+  {
+    memcpy(&_Fragments[(unsigned short)Index * _Fragment_Size], &Fragment[FRAG_HEADER_SIZE], _Fragment_Size);
+    _Have[Index >> 3] |= 1 << (Index & 7);
+    _Received++;
+  }
+
+  if(_Received >= _Data_Count)
+  {
+    _Complete = Solve();
+  }
+
+  return _Complete ? FRAG_COMPLETE : FRAG_INCOMPLETE;
+}
+
+const unsigned char *FragDecoder::Get_Blob()
+{
+  return _Complete ? _Fragments : 0;
+}
+
+unsigned short FragDecoder::Get_Length()
+{
+  return _Length;
+}
+
+unsigned char FragDecoder::Get_Id()
+{
+  return _Id;
+}
+
+unsigned char FragDecoder::Get_Received()
+{
+  return _Received;
+}
+
+unsigned char FragDecoder::Get_Data_Count()
+{
+  return _Data_Count;
+}
+
+void FragDecoder::Start(const unsigned char *Fragment, unsigned char Length)
+{
+  _Id = Fragment[0];
+  _Data_Count = Fragment[2];
+  _Parity_Count = Fragment[3];
+  _Length = Fragment[4] | (Fragment[5] << 8);
+  _Fragment_Size = Length - FRAG_HEADER_SIZE;
+  _Received = 0;
+  _Complete = false;
+  memset(_Have, 0, sizeof(_Have));
+
+  free(_Fragments);
+  _Fragments = 0;
+
+  //The blob has to fit the data fragments
+  if((unsigned long)_Data_Count * _Fragment_Size < _Length)
+  {
+    return;
+  }
+  _Fragments = (unsigned char *)calloc((unsigned short)(_Data_Count + _Parity_Count), _Fragment_Size);
+}
+
+bool FragDecoder::Has(unsigned char Index)
+{
+  return (_Have[Index >> 3] >> (Index & 7)) & 1;
+}
+
+/*
+*****************************************************************************************
+* Description : Function rebuilds the missing data fragments from as many parity
+*               fragments. The contribution of the data fragments that arrived is
+*               taken off the parity fragments first, what is left is solved by
+*               Gauss-Jordan elimination over GF(256).
+*****************************************************************************************
+*/
+bool FragDecoder::Solve()
+{
+  unsigned char Missing[255];
+  unsigned char Parity[255];
+  unsigned char Erasures = 0;
+  unsigned char Parities = 0;
+  unsigned char *Matrix;
+  unsigned char *Rows;
+  unsigned char *Row;
+  unsigned char Factor;
+  unsigned short i, j, k, r;
+
+  for(i = 0; i < _Data_Count; i++)
+  {
+    if(!Has(i))
+    {
+      Missing[Erasures++] = i;
+    }
+  }
+  if(Erasures == 0)
+  {
+    return true;
+  }
+
+  for(i = 0; i < _Parity_Count && Parities < Erasures; i++)
+  {
+    if(Has(_Data_Count + i))
+    {
+      Parity[Parities++] = i;
+    }
+  }
+  if(Parities < Erasures)
+  {
+    return false;
+  }
+
+  Matrix = (unsigned char *)malloc(Erasures * Erasures);
+  Rows = (unsigned char *)malloc(Erasures * _Fragment_Size);
+  if(Matrix == 0 || Rows == 0)
+  {
+    free(Matrix);
+    free(Rows);
+    return false;
+  }
+
+  for(r = 0; r < Erasures; r++)
+  {
+    Row = &Rows[r * _Fragment_Size];
+    memcpy(Row, &_Fragments[(unsigned short)(_Data_Count + Parity[r]) * _Fragment_Size], _Fragment_Size);
+
+    //Take off the data fragments that arrived
+    for(i = 0; i < _Data_Count; i++)
+    {
+      if(!Has(i))
+      {
+        continue;
+      }
+      Factor = Frag_Coefficient(Parity[r], i, _Data_Count);
+      for(k = 0; k < _Fragment_Size; k++)
+      {
+        Row[k] ^= GF_Mul(Factor, _Fragments[i * _Fragment_Size + k]);
+      }
+    }
+
+    for(j = 0; j < Erasures; j++)
+    {
+      Matrix[r * Erasures + j] = Frag_Coefficient(Parity[r], Missing[j], _Data_Count);
+    }
+  }
+
+  //Every square part of a Cauchy matrix can be inverted, no pivot is ever 0
+  for(j = 0; j < Erasures; j++)
+  {
+    Factor = GF_Inv(Matrix[j * Erasures + j]);
+    for(k = 0; k < Erasures; k++)
+    {
+      Matrix[j * Erasures + k] = GF_Mul(Matrix[j * Erasures + k], Factor);
+    }
+    for(k = 0; k < _Fragment_Size; k++)
+    {
+      Rows[j * _Fragment_Size + k] = GF_Mul(Rows[j * _Fragment_Size + k], Factor);
+    }
+
+    for(r = 0; r < Erasures; r++)
+    {
+      if(r == j || Matrix[r * Erasures + j] == 0)
+      {
+        continue;
+      }
+      Factor = Matrix[r * Erasures + j];
+      for(k = 0; k < Erasures; k++)
+      {
+        Matrix[r * Erasures + k] ^= GF_Mul(Factor, Matrix[j * Erasures + k]);
+      }
+      for(k = 0; k < _Fragment_Size; k++)
+      {
+        Rows[r * _Fragment_Size + k] ^= GF_Mul(Factor, Rows[j * _Fragment_Size + k]);
+      }
+    }
+  }
+
+  for(j = 0; j < Erasures; j++)
+  {
+    memcpy(&_Fragments[Missing[j] * _Fragment_Size], &Rows[j * _Fragment_Size], _Fragment_Size);
+    _Have[Missing[j] >> 3] |= 1 << (Missing[j] & 7);
+  }
+
+  free(Matrix);
+  free(Rows);
+  return true;
+}
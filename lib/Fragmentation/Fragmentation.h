@@ -0,0 +1,86 @@
+/*
+  Fragmentation.h - Uplink fragmentation with erasure coding for large blobs
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  FragEncoder splits a blob into Data_Count fragments of the same size and adds
+  Parity_Count parity fragments. Parity fragment j is a GF(256) combination of
+  all data fragments with the coefficients of a Cauchy matrix, scaled so the
+  first parity fragment is the plain XOR of the data fragments. Any Data_Count
+  of the fragments rebuild the blob, so as many lost frames as there are parity
+  fragments do not need a retransmission.
+
+  Every fragment is sent as one uplink on FRAG_PORT with this header:
+
+    Id | Index | Data_Count | Parity_Count | Blob length (2, lsb first) | data
+
+  Id changes with every blob, data fragments have Index 0 .. Data_Count - 1,
+  parity fragments follow. FragDecoder collects the fragments of a device on the
+  receiving side (host tools) and rebuilds the blob.
+*/
+
+#ifndef Fragmentation_h
+#define Fragmentation_h
+
+#include <stdint.h>
+
+#define FRAG_PORT 200
+#define FRAG_HEADER_SIZE 6
+// largest fragment data with LORAWAN_MAX_PAYLOAD (51)
+#define FRAG_MAX_DATA 45
+
+// results of FragDecoder::Add
+#define FRAG_INCOMPLETE 0
+#define FRAG_COMPLETE 1
+#define FRAG_INVALID 2
+
+class FragEncoder
+{
+  public:
+    FragEncoder();
+    bool Begin(const unsigned char *Blob, unsigned short Length, unsigned char Fragment_Size, unsigned char Parity_Count);
+    unsigned char Get_Count();
+    unsigned char Get_Fragment(unsigned char Index, unsigned char *Fragment);
+
+  private:
+    // the blob is read while the fragments are made, it must not change until then
+    const unsigned char *_Blob;
+    unsigned short _Length;
+    unsigned char _Fragment_Size;
+    unsigned char _Data_Count;
+    unsigned char _Parity_Count;
+    unsigned char _Id;
+};
+
+class FragDecoder
+{
+  public:
+    FragDecoder();
+    ~FragDecoder();
+    unsigned char Add(const unsigned char *Fragment, unsigned char Length);
+    const unsigned char *Get_Blob();
+    unsigned short Get_Length();
+    unsigned char Get_Id();
+    unsigned char Get_Received();
+    unsigned char Get_Data_Count();
+
+  private:
+    unsigned char _Id;
+    unsigned short _Length;
+    unsigned char _Fragment_Size;
+    unsigned char _Data_Count;
+    unsigned char _Parity_Count;
+    // Data_Count + Parity_Count fragments, the data ones are rebuilt in place
+    unsigned char *_Fragments;
+    unsigned char _Have[32];
+    unsigned char _Received;
+    bool _Complete;
+
+    void Start(const unsigned char *Fragment, unsigned char Length);
+    bool Has(unsigned char Index);
+    bool Solve();
+};
+
+unsigned char Frag_Coefficient(unsigned char Parity, unsigned char Data, unsigned char Data_Count);
+
+#endif
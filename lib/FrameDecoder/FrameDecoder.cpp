@@ -0,0 +1,437 @@
+/*
+  FrameDecoder.cpp - Decodes and verifies LoRaWAN data frames of many sessions
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "FrameDecoder.h"
+
+// constructor
+FrameDecoder::FrameDecoder()
+{
+  _Sessions = 0;
+  _Session_Count = 0;
+  _Session_Size = 0;
+  _Index = 0;
+  _Index_Size = 0;
+}
+
+FrameDecoder::~FrameDecoder()
+{
+  free(_Sessions);
+  free(_Index);
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a session, Build_Index has to be called afterwards
+*
+* Arguments   : DevAddr  4 bytes, msb left
+*               NwkSkey, AppSkey  16 bytes
+*
+* Returns     : number of the session, -1 when out of memory
+*****************************************************************************************
+*/
+long FrameDecoder::Add_Session(unsigned char DevAddr[], unsigned char NwkSkey[], unsigned char AppSkey[])
+{
+  Decoder_Session *Session;
+
+  if(_Session_Count == _Session_Size)
+  {
+    long Size = _Session_Size ? _Session_Size * 2 : 64;
+    Decoder_Session *Sessions = (Decoder_Session *)realloc(_Sessions, Size * sizeof(Decoder_Session));
+
+    if(Sessions == 0)
+    {
+      return -1;
+    }
+    _Sessions = Sessions;
+    _Session_Size = Size;
+  }
+
+  Session = &_Sessions[_Session_Count];
+  memcpy(Session->DevAddr, DevAddr, 4);
+  memcpy(Session->NwkSkey, NwkSkey, 16);
+  memcpy(Session->AppSkey, AppSkey, 16);
+  Session->Frame_Counter[0] = -1;
+  Session->Frame_Counter[1] = -1;
+  Session->Next = -1;
+
+  return _Session_Count++;
+}
+
+/*
+*****************************************************************************************
+* Description : Function builds the DevAddr hash index, linear probing at a load of
+*               at most 50%. Sessions with the same DevAddr are chained.
+*****************************************************************************************
+*/
+void FrameDecoder::Build_Index()
+{
+  long i;
+  unsigned long Slot;
+  uint32_t DevAddr;
+
+  _Index_Size = 16;
+  while(_Index_Size < (unsigned long)_Session_Count * 2)
+  {
+    _Index_Size *= 2;
+  }
+
+  free(_Index);
+  _Index = (long *)malloc(_Index_Size * sizeof(long));
+  for(Slot = 0; Slot < _Index_Size; Slot++)
+  {
+    _Index[Slot] = -1;
+  }
+
+  //Backwards, so the chains keep the order the sessions were added in
+  for(i = _Session_Count - 1; i >= 0; i--)
+  {
+    Decoder_Session &Session = _Sessions[i];
+
+    DevAddr = ((uint32_t)Session.DevAddr[0] << 24) | ((uint32_t)Session.DevAddr[1] << 16) |
+              ((uint32_t)Session.DevAddr[2] << 8) | Session.DevAddr[3];
+    Session.Next = -1;
+
+    for(Slot = Hash(DevAddr) & (_Index_Size - 1); _Index[Slot] != -1; Slot = (Slot + 1) & (_Index_Size - 1))
+    {
+      Decoder_Session &Other = _Sessions[_Index[Slot]];
+
+      if(memcmp(Other.DevAddr, Session.DevAddr, 4) == 0)
+      {
+        break;
+      }
+    }
+
+    if(_Index[Slot] != -1)
+    {
+      Session.Next = _Index[Slot];
+    }
+    _Index[Slot] = i;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the first session with this DevAddr, -1 if none
+*****************************************************************************************
+*/
+long FrameDecoder::Find_Session(uint32_t DevAddr)
+{
+  unsigned long Slot;
+  unsigned char Key[4];
+
+  if(_Index_Size == 0)
+  {
+    return -1;
+  }
+
+  Key[0] = DevAddr >> 24;
+  Key[1] = DevAddr >> 16;
+  Key[2] = DevAddr >> 8;
+  Key[3] = DevAddr;
+
+  for(Slot = Hash(DevAddr) & (_Index_Size - 1); _Index[Slot] != -1; Slot = (Slot + 1) & (_Index_Size - 1))
+  {
+    if(memcmp(_Sessions[_Index[Slot]].DevAddr, Key, 4) == 0)
+    {
+      return _Index[Slot];
+    }
+  }
+  return -1;
+}
+
+long FrameDecoder::Get_Session_Count()
+{
+  return _Session_Count;
+}
+
+Decoder_Session &FrameDecoder::Get_Session(long Session)
+{
+  return _Sessions[Session];
+}
+
+/*
+*****************************************************************************************
+* Description : Function decodes a data frame (MType 2 .. 5), checks the MIC with every
+*               session of its DevAddr and decrypts FRMPayload with the session that
+*               matched. The frame counter of that session is moved on.
+*
+*               MHDR | DevAddr(4) FCtrl FCnt(2) FOpts(0..15) | [FPort FRMPayload] | MIC(4)
+*
+* Arguments   : *PHYPayload  frame as received
+*               Length       length of the frame
+*               *Frame       decoded fields
+*
+* Returns     : DECODER_OK, DECODER_INVALID for frames that are no data frames or too
+*               short, DECODER_UNKNOWN when no session has the DevAddr and
+*               DECODER_MIC_FAIL when none of them matched the MIC. Frame is filled
+*               as far as it could be decoded.
+*****************************************************************************************
+*/
+unsigned char FrameDecoder::Decode(const unsigned char *PHYPayload, unsigned char Length, Decoded_Frame *Frame)
+{
+  unsigned char Header_Length;
+  unsigned char MIC[4];
+  unsigned char Data[256];
+  uint32_t Frame_Counter;
+  long Session;
+
+  if(Parse_Header(PHYPayload, Length, Frame) != DECODER_OK)
+  {
+    return DECODER_INVALID;
+  }
+  Header_Length = 8 + Frame->FOpts_Length;
+
+  //Crypto functions take non const buffers
+  memcpy(Data, PHYPayload, Length);
+
+  for(Session = Find_Session(Frame->DevAddr); Session != -1; Session = _Sessions[Session].Next)
+  {
+    Decoder_Session &S = _Sessions[Session];
+
+    Frame_Counter = Full_Frame_Counter(S.Frame_Counter[Frame->Direction], PHYPayload[6] | (PHYPayload[7] << 8));
+
+    _Crypto.Calculate_MIC(Data, MIC, Length - 4, Frame_Counter, Frame->Direction, S.DevAddr, S.NwkSkey);
+    if(memcmp(MIC, &PHYPayload[Length - 4], 4) != 0)
+    {
+      continue;
+    }
+
+    Frame->Session = Session;
+    Frame->MIC_OK = true;
+    Frame->Frame_Counter = Frame_Counter;
+    S.Frame_Counter[Frame->Direction] = Frame_Counter;
+
+    if(Length > Header_Length + 4)
+    {
+      Frame->FPort = PHYPayload[Header_Length];
+      Frame->Payload_Length = Length - Header_Length - 5;
+      memcpy(Frame->Payload, &PHYPayload[Header_Length + 1], Frame->Payload_Length);
+
+      _Crypto.Encrypt_Payload(Frame->Payload, Frame->Payload_Length, Frame_Counter, Frame->Direction,
+        S.DevAddr, Frame->FPort == 0 ? S.NwkSkey : S.AppSkey);
+    }
+    return DECODER_OK;
+  }
+
+  Frame->Frame_Counter = PHYPayload[6] | (PHYPayload[7] << 8);
+  return (Find_Session(Frame->DevAddr) == -1) ? DECODER_UNKNOWN : DECODER_MIC_FAIL;
+}
+
+/*
+*****************************************************************************************
+* Description : Function decodes many frames like Decode, the MICs and payloads of
+*               frames of different sessions are calculated together (see
+*               LoRaWAN_Crypto::Calculate_MIC_Batch). A session that comes again
+*               within DECODER_BATCH frames waits for the frames before it, DevAddrs
+*               shared by several sessions are decoded one by one. Frames of a session
+*               are decoded in the order given.
+*
+* Arguments   : *PHYPayloads  Count frames as received
+*               *Lengths      their lengths
+*               Count         number of frames
+*               *Frames       Count decoded frames
+*               *Results      Count results, as returned by Decode
+*****************************************************************************************
+*/
+void FrameDecoder::Decode_Batch(const unsigned char *const *PHYPayloads, const unsigned char *Lengths, unsigned int Count, Decoded_Frame *Frames, unsigned char *Results)
+{
+  unsigned int Numbers[DECODER_BATCH];
+  long Sessions[DECODER_BATCH];
+  unsigned int Pending = 0;
+  unsigned int n;
+  unsigned int i;
+  long Session;
+
+  for(n = 0; n < Count; n++)
+  {
+    Results[n] = Parse_Header(PHYPayloads[n], Lengths[n], &Frames[n]);
+    if(Results[n] != DECODER_OK)
+    {
+      continue;
+    }
+
+    Session = Find_Session(Frames[n].DevAddr);
+    if(Session == -1 || _Sessions[Session].Next != -1)
+    {
+      Results[n] = Decode(PHYPayloads[n], Lengths[n], &Frames[n]);
+      continue;
+    }
+
+    //The frame counter of the session moves with the frame before
+    for(i = 0; i < Pending && Sessions[i] != Session; i++)
+    {
+    }
+    if(i < Pending || Pending == DECODER_BATCH)
+    {
+      Decode_Sessions(PHYPayloads, Lengths, Numbers, Sessions, Pending, Frames, Results);
+      Pending = 0;
+    }
+
+    Numbers[Pending] = n;
+    Sessions[Pending] = Session;
+    Pending++;
+  }
+
+  Decode_Sessions(PHYPayloads, Lengths, Numbers, Sessions, Pending, Frames, Results);
+}
+
+/*
+*****************************************************************************************
+* Description : Function parses MHDR and FHDR of a data frame (MType 2 .. 5)
+*
+*               MHDR | DevAddr(4) FCtrl FCnt(2) FOpts(0..15) | [FPort FRMPayload] | MIC(4)
+*
+* Returns     : DECODER_OK or DECODER_INVALID for frames that are no data frames or too
+*               short
+*****************************************************************************************
+*/
+unsigned char FrameDecoder::Parse_Header(const unsigned char *PHYPayload, unsigned char Length, Decoded_Frame *Frame)
+{
+  Frame->Session = -1;
+  Frame->MIC_OK = false;
+  Frame->FPort = -1;
+  Frame->Payload_Length = 0;
+  Frame->FOpts_Length = 0;
+
+  if(Length < 12)
+  {
+    return DECODER_INVALID;
+  }
+
+  Frame->MType = PHYPayload[0] >> 5;
+  if(Frame->MType < 2 || Frame->MType > 5)
+  {
+    return DECODER_INVALID;
+  }
+  //Unconfirmed / confirmed data up are 2 and 4
+  Frame->Direction = (Frame->MType & 1) ? 1 : 0;
+
+  Frame->DevAddr = PHYPayload[1] | ((uint32_t)PHYPayload[2] << 8) | ((uint32_t)PHYPayload[3] << 16) | ((uint32_t)PHYPayload[4] << 24);
+  Frame->FCtrl = PHYPayload[5];
+  Frame->FOpts_Length = Frame->FCtrl & 0x0F;
+
+  if(Length < 8 + Frame->FOpts_Length + 4)
+  {
+    return DECODER_INVALID;
+  }
+  memcpy(Frame->FOpts, &PHYPayload[8], Frame->FOpts_Length);
+
+  return DECODER_OK;
+}
+
+/*
+*****************************************************************************************
+* Description : Function checks the MICs and decrypts the payloads of frames whose
+*               headers were parsed, one frame per session
+*
+* Arguments   : *Numbers   Count frame numbers in PHYPayloads, Lengths, Frames, Results
+*               *Sessions  the session of each, the only one of its DevAddr
+*****************************************************************************************
+*/
+void FrameDecoder::Decode_Sessions(const unsigned char *const *PHYPayloads, const unsigned char *Lengths, const unsigned int *Numbers, const long *Sessions, unsigned int Count, Decoded_Frame *Frames, unsigned char *Results)
+{
+  Crypto_Frame Crypto[DECODER_BATCH];
+  unsigned char Data[DECODER_BATCH][256];
+  unsigned int Payloads = 0;
+  unsigned char Header_Length;
+  unsigned int i;
+
+  for(i = 0; i < Count; i++)
+  {
+    const unsigned char *PHYPayload = PHYPayloads[Numbers[i]];
+    Decoded_Frame &Frame = Frames[Numbers[i]];
+    Decoder_Session &S = _Sessions[Sessions[i]];
+
+    //Crypto functions take non const buffers
+    memcpy(Data[i], PHYPayload, Lengths[Numbers[i]]);
+
+    Crypto[i].Data = Data[i];
+    Crypto[i].Data_Length = Lengths[Numbers[i]] - 4;
+    Crypto[i].Frame_Counter = Full_Frame_Counter(S.Frame_Counter[Frame.Direction], PHYPayload[6] | (PHYPayload[7] << 8));
+    Crypto[i].Direction = Frame.Direction;
+    Crypto[i].DevAddr = S.DevAddr;
+    Crypto[i].Key = S.NwkSkey;
+  }
+  _Crypto.Calculate_MIC_Batch(Crypto, Count);
+
+  for(i = 0; i < Count; i++)
+  {
+    const unsigned char *PHYPayload = PHYPayloads[Numbers[i]];
+    unsigned char Length = Lengths[Numbers[i]];
+    Decoded_Frame &Frame = Frames[Numbers[i]];
+    Decoder_Session &S = _Sessions[Sessions[i]];
+
+    if(memcmp(Crypto[i].MIC, &PHYPayload[Length - 4], 4) != 0)
+    {
+      Frame.Frame_Counter = PHYPayload[6] | (PHYPayload[7] << 8);
+      Results[Numbers[i]] = DECODER_MIC_FAIL;
+      continue;
+    }
+
+    Frame.Session = Sessions[i];
+    Frame.MIC_OK = true;
+    Frame.Frame_Counter = Crypto[i].Frame_Counter;
+    S.Frame_Counter[Frame.Direction] = Frame.Frame_Counter;
+    Results[Numbers[i]] = DECODER_OK;
+
+    Header_Length = 8 + Frame.FOpts_Length;
+    if(Length > Header_Length + 4)
+    {
+      Frame.FPort = PHYPayload[Header_Length];
+      Frame.Payload_Length = Length - Header_Length - 5;
+      memcpy(Frame.Payload, &PHYPayload[Header_Length + 1], Frame.Payload_Length);
+
+      Crypto[Payloads] = Crypto[i];
+      Crypto[Payloads].Data = Frame.Payload;
+      Crypto[Payloads].Data_Length = Frame.Payload_Length;
+      Crypto[Payloads].Key = Frame.FPort == 0 ? S.NwkSkey : S.AppSkey;
+      Payloads++;
+    }
+  }
+  _Crypto.Encrypt_Payload_Batch(Crypto, Payloads);
+}
+
+/*
+*****************************************************************************************
+* Description : Murmur3 finalizer, DevAddrs of one network share their upper bits
+*****************************************************************************************
+*/
+uint32_t FrameDecoder::Hash(uint32_t DevAddr)
+{
+  DevAddr ^= DevAddr >> 16;
+  DevAddr *= 0x85EBCA6BUL;
+  DevAddr ^= DevAddr >> 13;
+  DevAddr *= 0xC2B2AE35UL;
+  DevAddr ^= DevAddr >> 16;
+  return DevAddr;
+}
+
+/*
+*****************************************************************************************
+* Description : Function extends the 16 bit frame counter of a frame with the upper
+*               bits of the last frame counter of the session, rolling over when the
+*               lower bits went backwards
+*****************************************************************************************
+*/
+uint32_t FrameDecoder::Full_Frame_Counter(int64_t Last, unsigned short Frame_Counter)
+{
+  uint32_t Full;
+
+  if(Last < 0)
+  {
+    return Frame_Counter;
+  }
+
+  Full = ((uint32_t)Last & 0xFFFF0000UL) | Frame_Counter;
+  if(Full < (uint32_t)Last)
+  {
+    Full += 0x10000;
+  }
+  return Full;
+}
@@ -0,0 +1,94 @@
+/*
+  FrameDecoder.h - Decodes and verifies LoRaWAN data frames of many sessions
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Uses LoRaWAN_Crypto, the code that runs on the node, to check the MIC and
+  decrypt FRMPayload of captured PHYPayloads. Sessions are found by DevAddr in an
+  open addressing hash index, sessions sharing a DevAddr are told apart by the MIC.
+
+  Decode_Batch takes many frames at once and checks the MICs of frames of
+  different sessions together, which pays with hardware AES.
+
+  The frame only carries the lower 16 bits of FCnt, the upper bits are tracked
+  per session and direction. Frames of one session have to be decoded in order
+  and by one thread at a time, different sessions can be decoded in parallel.
+*/
+
+#ifndef FrameDecoder_h
+#define FrameDecoder_h
+
+#include <stdint.h>
+#include "LoRaWAN_Crypto.h"
+
+#define DECODER_MAX_PAYLOAD 255
+// frames of Decode_Batch whose crypto runs together
+#define DECODER_BATCH CRYPTO_BATCH_FRAMES
+
+// results of Decode
+#define DECODER_OK 0
+#define DECODER_MIC_FAIL 1
+#define DECODER_UNKNOWN 2
+#define DECODER_INVALID 3
+
+struct Decoder_Session
+{
+  // msb left like the keys on the node
+  unsigned char DevAddr[4];
+  unsigned char NwkSkey[16];
+  unsigned char AppSkey[16];
+  // last full frame counter up and down, -1 before the first frame
+  int64_t Frame_Counter[2];
+  // next session with the same DevAddr, -1 at the end
+  long Next;
+};
+
+struct Decoded_Frame
+{
+  unsigned char MType;
+  unsigned char Direction;
+  uint32_t DevAddr;
+  unsigned char FCtrl;
+  uint32_t Frame_Counter;
+  // -1 without FPort
+  short FPort;
+  unsigned char FOpts[15];
+  unsigned char FOpts_Length;
+  unsigned char Payload[DECODER_MAX_PAYLOAD];
+  unsigned char Payload_Length;
+  // session that matched, -1 if none
+  long Session;
+  bool MIC_OK;
+};
+
+class FrameDecoder
+{
+  public:
+    FrameDecoder();
+    ~FrameDecoder();
+
+    long Add_Session(unsigned char DevAddr[], unsigned char NwkSkey[], unsigned char AppSkey[]);
+    void Build_Index();
+    long Find_Session(uint32_t DevAddr);
+    long Get_Session_Count();
+    Decoder_Session &Get_Session(long Session);
+
+    unsigned char Decode(const unsigned char *PHYPayload, unsigned char Length, Decoded_Frame *Frame);
+    void Decode_Batch(const unsigned char *const *PHYPayloads, const unsigned char *Lengths, unsigned int Count, Decoded_Frame *Frames, unsigned char *Results);
+
+  private:
+    LoRaWAN_Crypto _Crypto;
+    Decoder_Session *_Sessions;
+    long _Session_Count;
+    long _Session_Size;
+    // hash index, session numbers, -1 for empty slots
+    long *_Index;
+    unsigned long _Index_Size;
+
+    unsigned char Parse_Header(const unsigned char *PHYPayload, unsigned char Length, Decoded_Frame *Frame);
+    void Decode_Sessions(const unsigned char *const *PHYPayloads, const unsigned char *Lengths, const unsigned int *Numbers, const long *Sessions, unsigned int Count, Decoded_Frame *Frames, unsigned char *Results);
+    static uint32_t Hash(uint32_t DevAddr);
+    static uint32_t Full_Frame_Counter(int64_t Last, unsigned short Frame_Counter);
+};
+
+#endif
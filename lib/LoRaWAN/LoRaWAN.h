@@ -7,64 +7,1463 @@
 
 */
 
-#include "RFM95.h"
-#include "Arduino.h"
+#include "LoRaWAN_Crypto.h"
+#include "LoRaWAN_Radio.h"
+#include "SessionStore.h"
 
 #ifndef LoRaWAN_h
 #define LoRaWAN_h
 
-
-// for AES encryption
-static const unsigned char PROGMEM S_Table[16][16] = {
-  {0x63,0x7C,0x77,0x7B,0xF2,0x6B,0x6F,0xC5,0x30,0x01,0x67,0x2B,0xFE,0xD7,0xAB,0x76},
-  {0xCA,0x82,0xC9,0x7D,0xFA,0x59,0x47,0xF0,0xAD,0xD4,0xA2,0xAF,0x9C,0xA4,0x72,0xC0},
-  {0xB7,0xFD,0x93,0x26,0x36,0x3F,0xF7,0xCC,0x34,0xA5,0xE5,0xF1,0x71,0xD8,0x31,0x15},
-  {0x04,0xC7,0x23,0xC3,0x18,0x96,0x05,0x9A,0x07,0x12,0x80,0xE2,0xEB,0x27,0xB2,0x75},
-  {0x09,0x83,0x2C,0x1A,0x1B,0x6E,0x5A,0xA0,0x52,0x3B,0xD6,0xB3,0x29,0xE3,0x2F,0x84},
-  {0x53,0xD1,0x00,0xED,0x20,0xFC,0xB1,0x5B,0x6A,0xCB,0xBE,0x39,0x4A,0x4C,0x58,0xCF},
-  {0xD0,0xEF,0xAA,0xFB,0x43,0x4D,0x33,0x85,0x45,0xF9,0x02,0x7F,0x50,0x3C,0x9F,0xA8},
-  {0x51,0xA3,0x40,0x8F,0x92,0x9D,0x38,0xF5,0xBC,0xB6,0xDA,0x21,0x10,0xFF,0xF3,0xD2},
-  {0xCD,0x0C,0x13,0xEC,0x5F,0x97,0x44,0x17,0xC4,0xA7,0x7E,0x3D,0x64,0x5D,0x19,0x73},
-  {0x60,0x81,0x4F,0xDC,0x22,0x2A,0x90,0x88,0x46,0xEE,0xB8,0x14,0xDE,0x5E,0x0B,0xDB},
-  {0xE0,0x32,0x3A,0x0A,0x49,0x06,0x24,0x5C,0xC2,0xD3,0xAC,0x62,0x91,0x95,0xE4,0x79},
-  {0xE7,0xC8,0x37,0x6D,0x8D,0xD5,0x4E,0xA9,0x6C,0x56,0xF4,0xEA,0x65,0x7A,0xAE,0x08},
-  {0xBA,0x78,0x25,0x2E,0x1C,0xA6,0xB4,0xC6,0xE8,0xDD,0x74,0x1F,0x4B,0xBD,0x8B,0x8A},
-  {0x70,0x3E,0xB5,0x66,0x48,0x03,0xF6,0x0E,0x61,0x35,0x57,0xB9,0x86,0xC1,0x1D,0x9E},
-  {0xE1,0xF8,0x98,0x11,0x69,0xD9,0x8E,0x94,0x9B,0x1E,0x87,0xE9,0xCE,0x55,0x28,0xDF},
-  {0x8C,0xA1,0x89,0x0D,0xBF,0xE6,0x42,0x68,0x41,0x99,0x2D,0x0F,0xB0,0x54,0xBB,0x16}
-};
+// EU863-870 TXPower: max EIRP 16 dBm, steps of 2 dB down to index 7
+#define LORAWAN_MAX_EIRP          16
+#define LORAWAN_TX_POWER_MAX_IDX  7
+// wanted margin above the demodulation floor, in dB
+#define LORAWAN_TARGET_MARGIN     10
+// uplinks without margin report after which the power is raised one step
+#define LORAWAN_MARGIN_TIMEOUT    16
+// receive windows of the join accept, ms after the join request
+#define LORAWAN_JOIN_ACCEPT_DELAY1 5000
+#define LORAWAN_JOIN_ACCEPT_DELAY2 6000
+// largest FRMPayload: 64 byte frame buffer less header, FPort and MIC, also the
+// EU868 limit of DR0 .. DR2
+#define LORAWAN_MAX_PAYLOAD       51
+// receive windows of data frames, ms after the uplink, RX1 moves with the RxDelay
+// of the join accept and RX2 follows 1 s later
+#define LORAWAN_RECEIVE_DELAY1    1000
+#define LORAWAN_RECEIVE_DELAY2    2000
+// MType of uplinks and downlinks
+#define LORAWAN_UNCONFIRMED_UP    0x40
+#define LORAWAN_CONFIRMED_UP      0x80
+#define LORAWAN_UNCONFIRMED_DOWN  0x60
+#define LORAWAN_CONFIRMED_DOWN    0xA0
+// MAC commands, CID
+#define LORAWAN_LINK_CHECK_ANS    0x02
+#define LORAWAN_LINK_ADR_REQ      0x03
+#define LORAWAN_LINK_ADR_ANS      0x03
+// FOpts field
+#define LORAWAN_MAX_FOPTS         15
+// results of Process_Downlink
+#define LORAWAN_DOWNLINK_NONE     0
+#define LORAWAN_DOWNLINK_MAC      1
+#define LORAWAN_DOWNLINK_DATA     2
+// Run_Data is through with the uplink and its receive windows
+#define LORAWAN_STEP_DONE         0xFFFFFFFFUL
+// ms Run_Data wants to run before a receive window, the radio waits out the rest
+#define LORAWAN_STEP_EARLY        3
+// steps of an uplink started with Start_Data
+#define LORAWAN_STATE_IDLE        0
+#define LORAWAN_STATE_TX          1
+#define LORAWAN_STATE_RX1_WAIT    2
+#define LORAWAN_STATE_RX1         3
+#define LORAWAN_STATE_RX2_WAIT    4
+#define LORAWAN_STATE_RX2         5
 
 
-class LoRaWAN
+/*
+  The MAC is a template on the radio driver, see LoRaWAN_Radio.h for what a
+  radio has to provide. The calls into the driver are resolved at compile time
+  and can be inlined into the frame path, e.g. LoRaWAN<RFM95> on the node and
+  LoRaWAN<SimRadio> in host builds.
+*/
+template <class Radio>
+class LoRaWAN : private LoRaWAN_Crypto
 {
+  static_assert(LoRaWAN_Is_Radio<Radio>::value, "Radio does not model the LoRaWAN radio concept, see LoRaWAN_Radio.h");
+
   public:
-    LoRaWAN(RFM95 &rfm95);
+    LoRaWAN(Radio &radio);
     void setKeys(unsigned char NwkSkey[], unsigned char AppSkey[], unsigned char DevAddr[]);
-    void Send_Data(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx);
+    bool Send_Data(const unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx);
+    bool Send_Data(const unsigned char *Data, unsigned char Data_Length);
+    // the same in steps for a scheduler, the radio has to support it
+    bool Start_Data(const unsigned char *Data, unsigned char Data_Length);
+    unsigned long Run_Data();
+    bool isBusy();
+    // over the air activation
+    void setJoinKeys(unsigned char AppEUI[], unsigned char DevEUI[], unsigned char AppKey[]);
+    void setSessionStore(SessionStore &Store);
+    bool Restore_Session();
+    bool Join();
+    bool isJoined();
+    // transmit power control
+    void setTxPower(unsigned char TXPower);
+    void setLinkMargin(unsigned char Margin);
+    unsigned char getTxPower();
+    // data rate, DR7 is FSK
+    void setDatarate(unsigned char DR);
+    // channel quality feedback
+    void setChannelMask(unsigned short ChMask);
+    void Report_Ack(bool Acked);
+    // FPort of the uplinks, 1 .. 223
+    void setPort(unsigned char Port);
+    // class C, the radio has to support continuous receive
+    void setClassC(bool Enable);
+    bool Receive(unsigned char *Data, unsigned char *Data_Length, unsigned char *Port);
+    // class A receive windows after every uplink, confirmed uplinks
+    void setReceiveWindows(bool Enable);
+    void setConfirmed(bool Enable);
+    bool isAcked();
 
   private:
-    RFM95 *_rfm95;
-    // remember arrays are pointers!
-    unsigned char *_NwkSkey;
-    unsigned char *_AppSkey;
-    unsigned char *_DevAddr;
-
-    void RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
-    // security stuff:
-    void Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction);
-    void Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction);
-    void Generate_Keys(unsigned char *K1, unsigned char *K2);
-    void Shift_Left(unsigned char *Data);
-    void XOR(unsigned char *New_Data,unsigned char *Old_Data);
-    void AES_Encrypt(unsigned char *Data, unsigned char *Key);
-    void AES_Add_Round_Key(unsigned char *Round_Key, unsigned char (*State)[4]);
-    unsigned char AES_Sub_Byte(unsigned char Byte);
-    void AES_Shift_Rows(unsigned char (*State)[4]);
-    void AES_Mix_Collums(unsigned char (*State)[4]);
-    void AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key);
+    Radio *_Radio;
+    // TXPower index as used by LinkADRReq, 0 is max EIRP
+    unsigned char _Tx_Power;
+    // set when the network dictates the power via LinkADRReq
+    bool _Tx_Power_Network;
+    // uplinks since the last link margin report
+    unsigned char _Margin_Age;
+    // the downlink carried a LinkCheckAns, its margin beats the downlink SNR
+    bool _Link_Checked;
+    // session, copied from setKeys or derived by Join
+    unsigned char _NwkSkey[16];
+    unsigned char _AppSkey[16];
+    unsigned char _DevAddr[4];
+    unsigned int _Frame_Counter_Tx;
+    bool _Joined;
+    // OTAA, EUIs msb left like the keys
+    unsigned char _AppEUI[8];
+    unsigned char _DevEUI[8];
+    unsigned char _AppKey[16];
+    unsigned short _DevNonce;
+    // RxDelay of the join accept, s from the end of the uplink to RX1
+    unsigned char _Rx_Delay;
+    SessionStore *_Store;
+    unsigned char _Frame_Port;
+    bool _Class_C;
+    // next downlink frame counter that is accepted
+    unsigned long _Frame_Counter_Rx;
+    // a confirmed downlink is acknowledged with the next uplink
+    bool _Ack_Pending;
+    bool _Rx_Windows;
+    bool _Confirmed;
+    // the network acknowledged the last confirmed uplink
+    bool _Acked;
+    // class C: the ACK of the last confirmed uplink may still come on RX2
+    bool _Ack_Open;
+    // downlink of the last receive windows, until taken with Receive()
+    bool _Rx_Ready;
+    unsigned char _Rx_Data[LORAWAN_MAX_PAYLOAD];
+    unsigned char _Rx_Data_Length;
+    unsigned char _Rx_Port;
+    // MAC command answers, sent in FOpts of the next uplink
+    unsigned char _Mac_Answer[LORAWAN_MAX_FOPTS];
+    unsigned char _Mac_Answer_Length;
+    // answers in FOpts of the frame being sent
+    unsigned char _Mac_Answer_Sent;
+    // step of the uplink started with Start_Data
+    unsigned char _State;
 
+    bool Process_Join_Accept(unsigned char *Data, unsigned char Data_Length);
+    unsigned char Process_Downlink(unsigned char *Package, unsigned char Length, unsigned char *Data, unsigned char *Data_Length, unsigned char *Port);
+    unsigned char Build_Data(unsigned char *RFM_Data, const unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx);
+    void Data_Sent();
+    void Receive_Windows(bool Rx2);
+    unsigned char Window_Downlink(unsigned char *Package, unsigned char Length, unsigned char Window);
+    void Finish_Data(bool Received);
+    void Next_Frame_Counter();
+    void Downlink_Margin(unsigned char Datarate);
+    void Process_Mac(const unsigned char *Commands, unsigned char Length);
+    unsigned char Link_ADR(unsigned char DataRate_TXPower, unsigned short ChMask, unsigned char Redundancy);
+    void Save_Session();
 
 };
 
 
+// constructor
+template <class Radio>
+LoRaWAN<Radio>::LoRaWAN(Radio &radio)
+{
+   _Radio = &radio;
+
+   _Tx_Power = 0;
+   _Tx_Power_Network = false;
+   _Margin_Age = 0;
+   _Link_Checked = false;
+
+   _Frame_Counter_Tx = 0;
+   _Joined = false;
+   _DevNonce = 0;
+   _Rx_Delay = LORAWAN_RECEIVE_DELAY1 / 1000;
+   _Store = 0;
+   _Frame_Port = 0x01;
+   _Class_C = false;
+   _Frame_Counter_Rx = 0;
+   _Ack_Pending = false;
+   _Rx_Windows = false;
+   _Confirmed = false;
+   _Acked = false;
+   _Ack_Open = false;
+   _Rx_Ready = false;
+   _Rx_Data_Length = 0;
+   _Rx_Port = 0;
+   _Mac_Answer_Length = 0;
+   _Mac_Answer_Sent = 0;
+   _State = LORAWAN_STATE_IDLE;
+}
+
+
+template <class Radio>
+void LoRaWAN<Radio>::setKeys(unsigned char NwkSkey[], unsigned char AppSkey[], unsigned char DevAddr[])
+{
+  memcpy(_NwkSkey, NwkSkey, 16);
+  memcpy(_AppSkey, AppSkey, 16);
+  memcpy(_DevAddr, DevAddr, 4);
+  _Frame_Counter_Rx = 0;
+  _Ack_Pending = false;
+  _Rx_Ready = false;
+  _Mac_Answer_Length = 0;
+  _Joined = true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the keys for over the air activation
+*
+* Arguments   : AppEUI, DevEUI  8 bytes, msb left as shown by the network server
+*               AppKey          16 bytes
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setJoinKeys(unsigned char AppEUI[], unsigned char DevEUI[], unsigned char AppKey[])
+{
+  memcpy(_AppEUI, AppEUI, 8);
+  memcpy(_DevEUI, DevEUI, 8);
+  memcpy(_AppKey, AppKey, 16);
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the storage the joined session and DevNonce are kept in
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setSessionStore(SessionStore &Store)
+{
+  _Store = &Store;
+}
+
+/*
+*****************************************************************************************
+* Description : Function restores the session of an earlier join from the session
+*               store, so a reboot does not cost another join
+*
+* Returns     : true when a joined session was restored, Join() is needed otherwise
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Restore_Session()
+{
+  LoRaWAN_Session Session;
+  bool Restored;
+
+  if(_Store == 0)
+  {
+    return false;
+  }
+
+  Restored = _Store->Load(&Session);
+
+  //Keep counting DevNonce from the stored one, restored or not
+  _DevNonce = Session.DevNonce;
+
+  if(!Restored)
+  {
+    return false;
+  }
+
+  memcpy(_DevAddr, Session.DevAddr, 4);
+  memcpy(_NwkSkey, Session.NwkSkey, 16);
+  memcpy(_AppSkey, Session.AppSkey, 16);
+  _Frame_Counter_Tx = Session.Frame_Counter_Tx;
+  _Radio->RFM_Set_Rx1_Offset(Session.Rx1_Offset);
+  _Radio->RFM_Set_Rx2_Datarate(Session.Rx2_Datarate);
+  _Rx_Delay = Session.Rx_Delay;
+  _Joined = true;
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function joins the network with a join request and waits for the join
+*               accept in both receive windows. DevNonce is a counter that is stored
+*               before the join request goes out, so it is never used twice: in the
+*               backup registers, in flash every SESSION_NONCE_FLASH_INTERVAL requests.
+*
+* Returns     : true when the join accept was received and the session derived
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Join()
+{
+  unsigned char i;
+  unsigned char RFM_Data[33];
+  unsigned char RFM_Package_Length;
+
+  _Joined = false;
+  _DevNonce++;
+
+  if(_Store != 0)
+  {
+    _Store->Save_DevNonce(_DevNonce);
+  }
+
+  //Join request
+  RFM_Data[0] = 0x00;
+
+  //EUIs are sent lsb first
+  for(i = 0; i < 8; i++)
+  {
+    RFM_Data[1 + i] = _AppEUI[7 - i];
+    RFM_Data[9 + i] = _DevEUI[7 - i];
+  }
+
+  RFM_Data[17] = (_DevNonce & 0x00FF);
+  RFM_Data[18] = ((_DevNonce >> 8) & 0x00FF);
+
+  Calculate_CMAC(0, RFM_Data, &RFM_Data[19], 19, _AppKey);
+
+  if(!_Radio->RFM_Send_Package(RFM_Data, 23))
+  {
+    return false;
+  }
+
+  RFM_Package_Length = _Radio->RFM_Receive_Window(RFM_Data, sizeof(RFM_Data), LORAWAN_JOIN_ACCEPT_DELAY1, 1);
+  if(RFM_Package_Length == 0)
+  {
+    RFM_Package_Length = _Radio->RFM_Receive_Window(RFM_Data, sizeof(RFM_Data), LORAWAN_JOIN_ACCEPT_DELAY2, 2);
+  }
+
+  if(!Process_Join_Accept(RFM_Data, RFM_Package_Length))
+  {
+    return false;
+  }
+
+  _Frame_Counter_Tx = 0;
+  _Frame_Counter_Rx = 0;
+  _Ack_Pending = false;
+  _Joined = true;
+  Save_Session();
+
+  if(_Class_C)
+  {
+    _Radio->RFM_Start_Continuous_Rx();
+  }
+
+  return true;
+}
+
+template <class Radio>
+bool LoRaWAN<Radio>::isJoined()
+{
+  return _Joined;
+}
+
+/*
+*****************************************************************************************
+* Description : Function decrypts and checks a join accept and derives the session keys
+*
+*               MHDR | AppNonce(3) NetID(3) DevAddr(4) DLSettings RxDelay [CFList(16)] MIC
+*
+*               The network encrypts with AES decrypt, so AES encrypt decrypts it.
+*               NwkSKey = aes128_encrypt(AppKey, 0x01 | AppNonce | NetID | DevNonce | pad)
+*               AppSKey = aes128_encrypt(AppKey, 0x02 | AppNonce | NetID | DevNonce | pad)
+*               The CFList is not used, the channels are fixed in RFM95.
+*
+* Returns     : true when the MIC is valid
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Process_Join_Accept(unsigned char *Data, unsigned char Data_Length)
+{
+  unsigned char i;
+  unsigned char MIC[4];
+
+  //Join accept with or without CFList
+  if((Data_Length != 17 && Data_Length != 33) || Data[0] != 0x20)
+  {
+    return false;
+  }
+
+  for(i = 1; i < Data_Length; i += 16)
+  {
+    AES_Encrypt(&Data[i], _AppKey);
+  }
+
+  Calculate_CMAC(0, Data, MIC, Data_Length - 4, _AppKey);
+  for(i = 0; i < 4; i++)
+  {
+    if(MIC[i] != Data[Data_Length - 4 + i])
+    {
+      return false;
+    }
+  }
+
+  //Derive session keys
+  for(i = 0; i < 16; i++)
+  {
+    _NwkSkey[i] = 0x00;
+  }
+  _NwkSkey[0] = 0x01;
+  for(i = 0; i < 6; i++)
+  {
+    _NwkSkey[1 + i] = Data[1 + i];
+  }
+  _NwkSkey[7] = (_DevNonce & 0x00FF);
+  _NwkSkey[8] = ((_DevNonce >> 8) & 0x00FF);
+
+  memcpy(_AppSkey, _NwkSkey, 16);
+  _AppSkey[0] = 0x02;
+
+  AES_Encrypt(_NwkSkey, _AppKey);
+  AES_Encrypt(_AppSkey, _AppKey);
+
+  //DevAddr is sent lsb first
+  _DevAddr[3] = Data[7];
+  _DevAddr[2] = Data[8];
+  _DevAddr[1] = Data[9];
+  _DevAddr[0] = Data[10];
+
+  //DLSettings: RX1DROffset, RX2 data rate
+  _Radio->RFM_Set_Rx1_Offset((Data[11] >> 4) & 0x07);
+  _Radio->RFM_Set_Rx2_Datarate(Data[11] & 0x0F);
+
+  //RxDelay in s, 0 means 1 s as well
+  _Rx_Delay = Data[12] & 0x0F;
+  if(_Rx_Delay == 0)
+  {
+    _Rx_Delay = 1;
+  }
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function writes session and DevNonce to the session store
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Save_Session()
+{
+  LoRaWAN_Session Session;
+
+  if(_Store == 0)
+  {
+    return;
+  }
+
+  memcpy(Session.DevAddr, _DevAddr, 4);
+  memcpy(Session.NwkSkey, _NwkSkey, 16);
+  memcpy(Session.AppSkey, _AppSkey, 16);
+  Session.DevNonce = _DevNonce;
+  Session.Rx1_Offset = _Radio->RFM_Get_Rx1_Offset();
+  Session.Rx2_Datarate = _Radio->RFM_Get_Rx2_Datarate();
+  Session.Rx_Delay = _Rx_Delay;
+  Session.Joined = _Joined ? 1 : 0;
+  Session.Frame_Counter_Tx = _Frame_Counter_Tx;
+
+  _Store->Save(&Session);
+}
+
+/*
+*****************************************************************************************
+* Description : Function sends data with the frame counter of the session, which is
+*               kept in the session store after each uplink
+*
+* Arguments   : *Data pointer to the array of data that will be transmitted
+*               Data_Length nuber of bytes to be transmitted
+*
+* Returns     : false when not joined or the frame was not transmitted
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Send_Data(const unsigned char *Data, unsigned char Data_Length)
+{
+  bool Sent;
+
+  if(!_Joined)
+  {
+    return false;
+  }
+
+  Sent = Send_Data(Data, Data_Length, _Frame_Counter_Tx);
+  Next_Frame_Counter();
+
+  return Sent;
+}
+
+/*
+*****************************************************************************************
+* Description : Function moves on to the next frame counter and keeps it in the
+*               session store. The frame counter is used up even if LBT held the
+*               frame back.
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Next_Frame_Counter()
+{
+  _Frame_Counter_Tx++;
+
+  if(_Store != 0)
+  {
+    if((_Frame_Counter_Tx % SESSION_FCNT_FLASH_INTERVAL) == 0)
+    {
+      //Checkpoint in flash
+      Save_Session();
+    }
+    else
+    {
+      _Store->Save_Frame_Counter(_Frame_Counter_Tx);
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function starts the same uplink as Send_Data and returns while it is on
+*               air. Run_Data takes it through TxDone, RX1 and RX2 as far as it can
+*               without waiting and returns how long to sleep until the next step, the
+*               radio interrupt may end that sleep early. The MCU sleeps through the
+*               time on air and up to the receive windows instead of polling the radio.
+*
+*               while((Wait = lora.Run_Data()) != LORAWAN_STEP_DONE)
+*                 sleep for Wait ms or until the radio interrupt
+*
+* Arguments   : *Data pointer to the array of data that will be transmitted
+*               Data_Length nuber of bytes to be transmitted
+*
+* Returns     : false when not joined, still busy with the last uplink or the frame was
+*               not transmitted
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Start_Data(const unsigned char *Data, unsigned char Data_Length)
+{
+  unsigned char RFM_Data[64];
+  unsigned char RFM_Package_Length;
+  bool Sent;
+
+  if(!_Joined || _State != LORAWAN_STATE_IDLE)
+  {
+    return false;
+  }
+
+  RFM_Package_Length = Build_Data(RFM_Data, Data, Data_Length, _Frame_Counter_Tx);
+  if(RFM_Package_Length == 0)
+  {
+    Next_Frame_Counter();
+    return false;
+  }
+
+  Sent = _Radio->RFM_Start_Package(RFM_Data, RFM_Package_Length);
+  Next_Frame_Counter();
+
+  if(!Sent)
+  {
+    Finish_Data(false);
+    return false;
+  }
+
+  _State = LORAWAN_STATE_TX;
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function takes an uplink started with Start_Data to its next step
+*
+* Returns     : ms until it has to run again, LORAWAN_STEP_DONE when the uplink and its
+*               receive windows are over
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned long LoRaWAN<Radio>::Run_Data()
+{
+  unsigned char Package[64];
+  unsigned char Length;
+  unsigned char Window;
+  unsigned char Result;
+  unsigned long Delay;
+  unsigned long Wait;
+  signed long Start;
+
+  for(;;)
+  {
+    switch(_State)
+    {
+      case LORAWAN_STATE_TX:
+        Wait = _Radio->RFM_Tx_Wait();
+        if(Wait != 0)
+        {
+          return Wait;
+        }
+        Data_Sent();
+
+        //Class C opens RX1 as well, continuous reception on RX2 covers receive window 2
+        if(!_Class_C && !_Rx_Windows)
+        {
+          _State = LORAWAN_STATE_IDLE;
+          Finish_Data(false);
+          return LORAWAN_STEP_DONE;
+        }
+        _State = LORAWAN_STATE_RX1_WAIT;
+        break;
+
+      case LORAWAN_STATE_RX1_WAIT:
+      case LORAWAN_STATE_RX2_WAIT:
+        Window = (_State == LORAWAN_STATE_RX1_WAIT) ? 1 : 2;
+        Delay = _Rx_Delay * 1000UL + ((Window == 2) ? LORAWAN_RECEIVE_DELAY2 - LORAWAN_RECEIVE_DELAY1 : 0);
+
+        //Sleep up to shortly before the window
+        Start = _Radio->RFM_Window_Wait(Delay, Window);
+        if(Start > (LORAWAN_STEP_EARLY + 1) * 1000L)
+        {
+          return Start / 1000 - LORAWAN_STEP_EARLY;
+        }
+
+        Wait = _Radio->RFM_Open_Window(Delay, Window);
+        _State++;
+        if(Wait != 0)
+        {
+          return Wait;
+        }
+        break;
+
+      case LORAWAN_STATE_RX1:
+      case LORAWAN_STATE_RX2:
+        Window = (_State == LORAWAN_STATE_RX1) ? 1 : 2;
+        Wait = _Radio->RFM_Rx_Wait(Package, sizeof(Package), &Length);
+        if(Wait != 0)
+        {
+          return Wait;
+        }
+
+        Result = (Length != 0) ? Window_Downlink(Package, Length, Window) : LORAWAN_DOWNLINK_NONE;
+        if(Result == LORAWAN_DOWNLINK_NONE && Window == 1 && !_Class_C)
+        {
+          _State = LORAWAN_STATE_RX2_WAIT;
+          break;
+        }
+
+        _State = LORAWAN_STATE_IDLE;
+        Finish_Data(true);
+        return LORAWAN_STEP_DONE;
+
+      default:
+        return LORAWAN_STEP_DONE;
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns whether an uplink started with Start_Data is not
+*               through its receive windows yet, the radio must not be used meanwhile
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::isBusy()
+{
+  return _State != LORAWAN_STATE_IDLE;
+}
+
+/*
+*****************************************************************************************
+* Description : Function contstructs a LoRaWAN package and sends it
+*
+* Arguments   : *Data pointer to the array of data that will be transmitted
+*               Data_Length nuber of bytes to be transmitted
+*               Frame_Counter_Up  Frame counter of upstream frames
+*
+* Returns     : false when the frame was not transmitted (all channels busy)
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Send_Data(const unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx)
+{
+  unsigned char RFM_Data[64];
+  unsigned char RFM_Package_Length;
+  bool Sent;
+
+  RFM_Package_Length = Build_Data(RFM_Data, Data, Data_Length, Frame_Counter_Tx);
+  if(RFM_Package_Length == 0)
+  {
+    return false;
+  }
+
+  //Send Package
+  Sent = _Radio->RFM_Send_Package(RFM_Data, RFM_Package_Length);
+  if(Sent)
+  {
+    Data_Sent();
+  }
+
+  //Class C opens RX1 as well, continuous reception on RX2 covers receive window 2
+  if(Sent && (_Class_C || _Rx_Windows))
+  {
+    Receive_Windows(!_Class_C);
+  }
+  Finish_Data(Sent && (_Class_C || _Rx_Windows));
+
+  return Sent;
+}
+
+/*
+*****************************************************************************************
+* Description : Function contstructs a LoRaWAN package in RFM_Data and gets the radio
+*               ready for it
+*
+* Arguments   : *RFM_Data  64 bytes for the package
+*               *Data pointer to the array of data that will be transmitted
+*               Data_Length nuber of bytes to be transmitted
+*               Frame_Counter_Up  Frame counter of upstream frames
+*
+* Returns     : length of the package, 0 when the data does not fit
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned char LoRaWAN<Radio>::Build_Data(unsigned char *RFM_Data, const unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter_Tx)
+{
+  //Define variables
+  unsigned char i;
+
+  //Direction of frame is up
+  unsigned char Direction = 0x00;
+
+  unsigned char RFM_Package_Length;
+
+  unsigned char MIC[4];
+
+  /*
+    @leo:
+    https://hackmd.io/s/S1kg6Ymo-
+
+    7…5 bits	4…2 bits	1…0 bits
+    MType	    RFU	      Major
+
+    MType	Description
+    000	(0x00) Join Request
+    001	(0x20) Join Accept
+    010	(0x40) Unconfirmed Data Up
+    011	(0x60) Unconfirmed Data Down
+    100	(0x80) Confirmed Data Up
+    101	(0xA0) Confirmed Data Down
+    110	(0xC0) RFU
+    111	(0xE0) Proprietary
+  */
+
+
+  // Unconfirmed or confirmed data up
+  unsigned char Mac_Header = _Confirmed ? LORAWAN_CONFIRMED_UP : LORAWAN_UNCONFIRMED_UP;
+
+  unsigned char Frame_Control = 0x00;
+  unsigned char Frame_Port = _Frame_Port;
+  unsigned char Frame_Options_Length;
+
+  if(Data_Length > LORAWAN_MAX_PAYLOAD)
+  {
+    return 0;
+  }
+
+  //MAC command answers in FOpts when they fit next to the data
+  Frame_Options_Length = (Data_Length + _Mac_Answer_Length <= LORAWAN_MAX_PAYLOAD) ? _Mac_Answer_Length : 0;
+  Frame_Control |= Frame_Options_Length;
+  _Mac_Answer_Sent = Frame_Options_Length;
+
+  //Class C: no ACK on RX2 up to the next uplink, the last one was not acknowledged
+  if(_Ack_Open)
+  {
+    Report_Ack(false);
+    _Ack_Open = false;
+  }
+  _Acked = false;
+
+  //Acknowledge a confirmed downlink
+  if(_Ack_Pending)
+  {
+    Frame_Control |= 0x20;
+    _Ack_Pending = false;
+  }
+
+  //Class C: the receive interrupt must not use SPI while the uplink is set up
+  if(_Class_C)
+  {
+    _Radio->RFM_Stop_Continuous_Rx();
+  }
+
+  //Build the Radio Package
+  RFM_Data[0] = Mac_Header;
+
+  RFM_Data[1] = _DevAddr[3];
+  RFM_Data[2] = _DevAddr[2];
+  RFM_Data[3] = _DevAddr[1];
+  RFM_Data[4] = _DevAddr[0];
+
+  RFM_Data[5] = Frame_Control;
+
+  RFM_Data[6] = (Frame_Counter_Tx & 0x00FF);
+  RFM_Data[7] = ((Frame_Counter_Tx >> 8) & 0x00FF);
+
+  for(i = 0; i < Frame_Options_Length; i++)
+  {
+    RFM_Data[8 + i] = _Mac_Answer[i];
+  }
+
+  RFM_Data[8 + Frame_Options_Length] = Frame_Port;
+
+  //Set Current package length
+  RFM_Package_Length = 9 + Frame_Options_Length;
+
+  //Load Data and encrypt it in the package, the caller keeps the plain data for a
+  //retransmission under the next frame counter
+  for(i = 0; i < Data_Length; i++)
+  {
+    RFM_Data[RFM_Package_Length + i] = Data[i];
+  }
+  Encrypt_Payload(&RFM_Data[RFM_Package_Length], Data_Length, Frame_Counter_Tx, Direction, _DevAddr, _AppSkey);
+
+  //Add data Lenth to package length
+  RFM_Package_Length = RFM_Package_Length + Data_Length;
+
+  //Calculate MIC
+  Calculate_MIC(RFM_Data, MIC, RFM_Package_Length, Frame_Counter_Tx, Direction, _DevAddr, _NwkSkey);
+
+  //Load MIC in package
+  for(i = 0; i < 4; i++)
+  {
+    RFM_Data[i + RFM_Package_Length] = MIC[i];
+  }
+
+  //Add MIC length to RFM package length
+  RFM_Package_Length = RFM_Package_Length + 4;
+
+  //Without feedback the link may have degraded, walk the power back up
+  if(!_Tx_Power_Network && _Tx_Power > 0)
+  {
+    if(++_Margin_Age >= LORAWAN_MARGIN_TIMEOUT)
+    {
+      _Tx_Power--;
+      _Margin_Age = 0;
+    }
+  }
+
+  //Only touches the PA registers when the power changed
+  if(_Radio->RFM_Get_Tx_Power() != LORAWAN_MAX_EIRP - 2 * _Tx_Power)
+  {
+    _Radio->RFM_Set_Tx_Power(LORAWAN_MAX_EIRP - 2 * _Tx_Power);
+  }
+
+  return RFM_Package_Length;
+}
+
+//The MAC command answers went out in FOpts
+template <class Radio>
+void LoRaWAN<Radio>::Data_Sent()
+{
+  _Mac_Answer_Length -= _Mac_Answer_Sent;
+  memmove(_Mac_Answer, &_Mac_Answer[_Mac_Answer_Sent], _Mac_Answer_Length);
+  _Mac_Answer_Sent = 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function ends an uplink: the ACK of a confirmed one is reported and
+*               class C goes back to continuous reception on RX2
+*
+* Arguments   : Received  the receive windows were open
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Finish_Data(bool Received)
+{
+  if(Received && _Confirmed)
+  {
+    //Class C can still get the ACK on RX2, Receive() reports it then
+    if(_Class_C && !_Acked)
+    {
+      _Ack_Open = true;
+    }
+    else
+    {
+      Report_Ack(_Acked);
+    }
+  }
+
+  if(_Class_C)
+  {
+    _Radio->RFM_Start_Continuous_Rx();
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function opens the class A receive windows after an uplink: RX1 on the
+*               uplink channel RxDelay after the uplink, RX2 a second later when RX1
+*               brought nothing for this device. ACK and MAC commands take effect right away, data waits for
+*               Receive().
+*
+* Arguments   : Rx2  false in class C, continuous reception takes over after RX1
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Receive_Windows(bool Rx2)
+{
+  unsigned char Package[64];
+  unsigned char Length;
+  unsigned char Result = LORAWAN_DOWNLINK_NONE;
+  unsigned long Delay = _Rx_Delay * 1000UL;
+
+  Length = _Radio->RFM_Receive_Window(Package, sizeof(Package), Delay, 1);
+  if(Length != 0)
+  {
+    Result = Window_Downlink(Package, Length, 1);
+  }
+
+  if(Result == LORAWAN_DOWNLINK_NONE && Rx2)
+  {
+    Length = _Radio->RFM_Receive_Window(Package, sizeof(Package), Delay + LORAWAN_RECEIVE_DELAY2 - LORAWAN_RECEIVE_DELAY1, 2);
+    if(Length != 0)
+    {
+      Window_Downlink(Package, Length, 2);
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function takes a package of a receive window: the SNR margin sets the
+*               power when it is a downlink for this device, data waits for Receive()
+*
+* Returns     : result of Process_Downlink
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned char LoRaWAN<Radio>::Window_Downlink(unsigned char *Package, unsigned char Length, unsigned char Window)
+{
+  unsigned char Datarate = _Radio->RFM_Get_Datarate();
+  unsigned char Result;
+
+  //Data rate of the window, before a LinkADRReq in it changes the uplink one
+  if(Window == 2)
+  {
+    Datarate = _Radio->RFM_Get_Rx2_Datarate();
+  }
+  else
+  {
+    Datarate = (Datarate > _Radio->RFM_Get_Rx1_Offset()) ? Datarate - _Radio->RFM_Get_Rx1_Offset() : 0;
+  }
+
+  Result = Process_Downlink(Package, Length, _Rx_Data, &_Rx_Data_Length, &_Rx_Port);
+  if(Result != LORAWAN_DOWNLINK_NONE)
+  {
+    Downlink_Margin(Datarate);
+  }
+  if(Result == LORAWAN_DOWNLINK_DATA)
+  {
+    _Rx_Ready = true;
+  }
+
+  return Result;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Function sets the transmit power as requested by the network with the
+*               TXPower field of a LinkADRReq. Local adaption is switched off from then
+*               on, the network is in control.
+*
+* Arguments   : TXPower  0 = max EIRP (16 dBm), every step is 2 dB less, 7 = 2 dBm
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setTxPower(unsigned char TXPower)
+{
+  // 0xF means keep the current setting
+  if(TXPower > LORAWAN_TX_POWER_MAX_IDX)
+  {
+    return;
+  }
+
+  _Tx_Power = TXPower;
+  _Tx_Power_Network = true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function adapts the transmit power to a link margin estimate, e.g. the
+*               Margin of a LinkCheckAns or the SNR of a downlink above the
+*               demodulation floor. Every 2 dB above the target margin lowers the
+*               power one step, a margin below the target raises it again.
+*
+* Arguments   : Margin  link margin in dB above the demodulation floor
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setLinkMargin(unsigned char Margin)
+{
+  signed char Steps;
+  signed char Index;
+
+  _Margin_Age = 0;
+
+  if(_Tx_Power_Network)
+  {
+    return;
+  }
+
+  //LinkCheckAns goes up to 254 dB, more than enough for the lowest power
+  if(Margin > LORAWAN_TARGET_MARGIN + 2 * LORAWAN_TX_POWER_MAX_IDX)
+  {
+    Margin = LORAWAN_TARGET_MARGIN + 2 * LORAWAN_TX_POWER_MAX_IDX;
+  }
+
+  Steps = ((signed char)Margin - LORAWAN_TARGET_MARGIN) / 2;
+  Index = _Tx_Power + Steps;
+
+  if(Index < 0)
+  {
+    Index = 0;
+  }
+  if(Index > LORAWAN_TX_POWER_MAX_IDX)
+  {
+    Index = LORAWAN_TX_POWER_MAX_IDX;
+  }
+
+  _Tx_Power = Index;
+}
+
+/*
+*****************************************************************************************
+* Description : Function adapts the transmit power to the SNR of the downlink just
+*               received, as margin above the demodulation floor of its data rate:
+*               -20 dB at SF12, 2.5 dB less per step up to -7.5 dB at SF7. The
+*               gateway sends at its own fixed power, so the margin stands for an
+*               uplink at max EIRP and sets the power index instead of stepping it.
+*               FSK has no SNR, a LinkCheckAns in the same downlink goes first.
+*
+* Arguments   : Datarate  data rate the downlink was received with
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Downlink_Margin(unsigned char Datarate)
+{
+  signed char Floor;
+  int Index;
+
+  if(_Link_Checked || Datarate > 6)
+  {
+    _Link_Checked = false;
+    return;
+  }
+
+  _Margin_Age = 0;
+
+  if(_Tx_Power_Network)
+  {
+    return;
+  }
+
+  //In half dB, DR6 is SF7 at 250 kHz
+  Floor = (Datarate < 6) ? -40 + 5 * Datarate : -15;
+  Index = (2 * _Radio->RFM_Get_Snr() - Floor - 2 * LORAWAN_TARGET_MARGIN) / 4;
+
+  if(Index < 0)
+  {
+    Index = 0;
+  }
+  if(Index > LORAWAN_TX_POWER_MAX_IDX)
+  {
+    Index = LORAWAN_TX_POWER_MAX_IDX;
+  }
+
+  _Tx_Power = Index;
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the TXPower index currently in use
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned char LoRaWAN<Radio>::getTxPower()
+{
+  return _Tx_Power;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the data rate of the following uplinks, e.g. DR7 (FSK)
+*               for a single frame when the link is strong
+*
+* Arguments   : DR  EU863-870 data rate, DR0 (SF12) .. DR5 (SF7), DR6 (SF7 BW250),
+*                   DR7 (FSK 50 kbps)
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setDatarate(unsigned char DR)
+{
+  _Radio->RFM_Set_Datarate(DR);
+}
+
+/*
+*****************************************************************************************
+* Description : Function restricts the uplink channels to the ChMask of a LinkADRReq or
+*               the regional plan
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setChannelMask(unsigned short ChMask)
+{
+  _Radio->RFM_Channels().Set_Channel_Mask(ChMask);
+}
+
+/*
+*****************************************************************************************
+* Description : Function reports whether the last confirmed uplink was acknowledged,
+*               so the channel it went out on is scored accordingly
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Report_Ack(bool Acked)
+{
+  _Radio->RFM_Channels().Report_Ack(_Radio->RFM_Get_Channel(), Acked);
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the FPort of the following uplinks. Port 0 is for MAC
+*               commands and 224 .. 255 are reserved, those are ignored.
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setPort(unsigned char Port)
+{
+  if(Port == 0 || Port > 223)
+  {
+    return;
+  }
+
+  _Frame_Port = Port;
+}
+
+/*
+*****************************************************************************************
+* Description : Function switches class C on or off. In class C the radio receives on
+*               RX2 whenever it does not transmit, after RX1 of an uplink, downlinks are
+*               taken with Receive().
+*               Only for nodes on mains power, the receiver draws about 11 mA.
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setClassC(bool Enable)
+{
+  _Class_C = Enable;
+
+  if(!Enable)
+  {
+    _Radio->RFM_Stop_Continuous_Rx();
+  }
+  else if(_Joined)
+  {
+    _Radio->RFM_Start_Continuous_Rx();
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the next valid downlink, from the last class A
+*               receive windows or received in class C. Class C packages were queued by
+*               the receive interrupt, the MIC, frame counter and decryption are done
+*               here. Packages of other devices, with a bad MIC or an old frame counter
+*               are dropped, MAC commands (no FPort or FPort 0) are carried out and not
+*               returned.
+*
+* Arguments   : *Data         FRMPayload, LORAWAN_MAX_PAYLOAD bytes
+*               *Data_Length  length of the FRMPayload
+*               *Port         FPort, 1 .. 223
+*
+* Returns     : false when no downlink is waiting
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::Receive(unsigned char *Data, unsigned char *Data_Length, unsigned char *Port)
+{
+  unsigned char Package[64];
+  unsigned char Length;
+  unsigned char Result;
+
+  if(_Rx_Ready)
+  {
+    memcpy(Data, _Rx_Data, _Rx_Data_Length);
+    *Data_Length = _Rx_Data_Length;
+    *Port = _Rx_Port;
+    _Rx_Ready = false;
+    return true;
+  }
+
+  while((Length = _Radio->RFM_Get_Package(Package, sizeof(Package))) != 0)
+  {
+    Result = Process_Downlink(Package, Length, Data, Data_Length, Port);
+    if(Result != LORAWAN_DOWNLINK_NONE)
+    {
+      //Continuous reception is on RX2
+      Downlink_Margin(_Radio->RFM_Get_Rx2_Datarate());
+    }
+    if(_Ack_Open && _Acked)
+    {
+      Report_Ack(true);
+      _Ack_Open = false;
+    }
+    if(Result == LORAWAN_DOWNLINK_DATA)
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+*****************************************************************************************
+* Description : Function switches the class A receive windows on or off. Off the node
+*               only transmits, like before, and can not be acknowledged or controlled
+*               by the network except in class C.
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setReceiveWindows(bool Enable)
+{
+  _Rx_Windows = Enable;
+}
+
+/*
+*****************************************************************************************
+* Description : Function makes the following uplinks confirmed, the network answers
+*               each with an ACK. Retransmission is left to the application, see
+*               isAcked().
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::setConfirmed(bool Enable)
+{
+  _Confirmed = Enable;
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns whether the last uplink was acknowledged, known after
+*               the receive windows or in class C after Receive(). A class C uplink
+*               that got no ACK up to the next one is scored as not acknowledged.
+*****************************************************************************************
+*/
+template <class Radio>
+bool LoRaWAN<Radio>::isAcked()
+{
+  return _Acked;
+}
+
+/*
+*****************************************************************************************
+* Description : Function carries out MAC commands from FOpts or a FPort 0 payload, the
+*               answers go out with the next uplink. Parsing stops at the first unknown
+*               command, its length is unknown.
+*
+*               LinkCheckAns  Margin | GwCnt                         link margin
+*               LinkADRReq    DataRate_TXPower | ChMask | Redundancy  LinkADRAns
+*****************************************************************************************
+*/
+template <class Radio>
+void LoRaWAN<Radio>::Process_Mac(const unsigned char *Commands, unsigned char Length)
+{
+  unsigned char i = 0;
+  unsigned char Status;
+
+  while(i < Length)
+  {
+    switch(Commands[i])
+    {
+      case LORAWAN_LINK_CHECK_ANS:
+        if(i + 3 > Length)
+        {
+          return;
+        }
+        setLinkMargin(Commands[i + 1]);
+        _Link_Checked = true;
+        i += 3;
+        break;
+
+      case LORAWAN_LINK_ADR_REQ:
+        if(i + 5 > Length)
+        {
+          return;
+        }
+        Status = Link_ADR(Commands[i + 1], Commands[i + 2] | (Commands[i + 3] << 8), Commands[i + 4]);
+        if(_Mac_Answer_Length + 2 <= LORAWAN_MAX_FOPTS)
+        {
+          _Mac_Answer[_Mac_Answer_Length++] = LORAWAN_LINK_ADR_ANS;
+          _Mac_Answer[_Mac_Answer_Length++] = Status;
+        }
+        i += 5;
+        break;
+
+      default:
+        return;
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function applies a LinkADRReq, all of it or nothing
+*
+* Arguments   : DataRate_TXPower  data rate and TXPower index, 0xF keeps the current
+*               ChMask            uplink channels
+*               Redundancy        ChMaskCntl, 6 switches all channels on. NbTrans is
+*                                 left to the application.
+*
+* Returns     : LinkADRAns status, bit 2 power, bit 1 data rate, bit 0 channel mask ACK
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned char LoRaWAN<Radio>::Link_ADR(unsigned char DataRate_TXPower, unsigned short ChMask, unsigned char Redundancy)
+{
+  unsigned char DR = DataRate_TXPower >> 4;
+  unsigned char TXPower = DataRate_TXPower & 0x0F;
+  unsigned char ChMaskCntl = (Redundancy >> 4) & 0x07;
+  unsigned char Status = 0x07;
+
+  if(DR != 0x0F && DR > 7)
+  {
+    Status &= ~0x02;
+  }
+  if(TXPower != 0x0F && TXPower > LORAWAN_TX_POWER_MAX_IDX)
+  {
+    Status &= ~0x04;
+  }
+
+  if(ChMaskCntl == 6)
+  {
+    ChMask = (1 << CHANNEL_COUNT) - 1;
+  }
+  else if(ChMaskCntl != 0 || (ChMask & ((1 << CHANNEL_COUNT) - 1)) == 0 || (ChMask >> CHANNEL_COUNT) != 0)
+  {
+    //Other banks, no channel at all or channels that are not defined
+    Status &= ~0x01;
+  }
+
+  if(Status != 0x07)
+  {
+    return Status;
+  }
+
+  if(DR != 0x0F)
+  {
+    setDatarate(DR);
+  }
+  if(TXPower != 0x0F)
+  {
+    setTxPower(TXPower);
+  }
+  setChannelMask(ChMask);
+
+  return Status;
+}
+
+/*
+*****************************************************************************************
+* Description : Function checks a downlink for this device and decrypts its payload
+*
+*               MHDR | DevAddr | FCtrl | FCnt | FOpts | FPort | FRMPayload | MIC
+*                 1       4        1      2     0..15     1      0..N         4
+*
+*               The 16 bit FCnt is extended with the upper bits of the last one,
+*               a counter that does not move forward counts as rolled over, the MIC
+*               then fails for a replay.
+*
+*               The ACK bit and MAC commands are handled here.
+*
+* Returns     : LORAWAN_DOWNLINK_DATA for a new downlink with application data,
+*               LORAWAN_DOWNLINK_MAC for one with MAC commands or an ACK only,
+*               LORAWAN_DOWNLINK_NONE when it is not a valid downlink for this device
+*****************************************************************************************
+*/
+template <class Radio>
+unsigned char LoRaWAN<Radio>::Process_Downlink(unsigned char *Package, unsigned char Length, unsigned char *Data, unsigned char *Data_Length, unsigned char *Port)
+{
+  unsigned char i;
+  unsigned char MIC[4];
+  unsigned char Header_Length;
+  unsigned long Frame_Counter;
+  unsigned char MType = Package[0] & 0xE0;
+
+  if(!_Joined || Length < 12 || (MType != LORAWAN_UNCONFIRMED_DOWN && MType != LORAWAN_CONFIRMED_DOWN))
+  {
+    return LORAWAN_DOWNLINK_NONE;
+  }
+
+  for(i = 0; i < 4; i++)
+  {
+    if(Package[1 + i] != _DevAddr[3 - i])
+    {
+      return LORAWAN_DOWNLINK_NONE;
+    }
+  }
+
+  //MHDR, DevAddr, FCtrl, FCnt and FOpts
+  Header_Length = 8 + (Package[5] & 0x0F);
+  Length -= 4;
+  if(Length < Header_Length)
+  {
+    return LORAWAN_DOWNLINK_NONE;
+  }
+
+  Frame_Counter = (_Frame_Counter_Rx & 0xFFFF0000UL) | Package[6] | (Package[7] << 8);
+  if(Frame_Counter < _Frame_Counter_Rx)
+  {
+    Frame_Counter += 0x10000UL;
+  }
+
+  Calculate_MIC(Package, MIC, Length, Frame_Counter, 0x01, _DevAddr, _NwkSkey);
+  if(memcmp(MIC, &Package[Length], 4) != 0)
+  {
+    return LORAWAN_DOWNLINK_NONE;
+  }
+
+  _Frame_Counter_Rx = Frame_Counter + 1;
+  if(MType == LORAWAN_CONFIRMED_DOWN)
+  {
+    _Ack_Pending = true;
+  }
+  if(Package[5] & 0x20)
+  {
+    _Acked = true;
+  }
+
+  Process_Mac(&Package[8], Header_Length - 8);
+
+  //No FPort, only MAC commands in FOpts or an ACK
+  if(Length == Header_Length)
+  {
+    return LORAWAN_DOWNLINK_MAC;
+  }
+
+  *Port = Package[Header_Length];
+  *Data_Length = Length - Header_Length - 1;
+  memcpy(Data, &Package[Header_Length + 1], *Data_Length);
+
+  //FPort 0 carries MAC commands, encrypted with the network key
+  Encrypt_Payload(Data, *Data_Length, Frame_Counter, 0x01, _DevAddr, (*Port == 0) ? _NwkSkey : _AppSkey);
+
+  if(*Port == 0)
+  {
+    Process_Mac(Data, *Data_Length);
+    return LORAWAN_DOWNLINK_MAC;
+  }
+
+  return LORAWAN_DOWNLINK_DATA;
+}
+
+
 #endif
@@ -0,0 +1,324 @@
+/*
+  LoRaWAN_AES_Accel.cpp - Hardware AES-128 for host builds
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include "LoRaWAN_AES_Accel.h"
+
+#ifdef LORAWAN_AES_ACCEL
+
+#include "LoRaWAN_Crypto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <wmmintrin.h>
+#else
+#include <arm_neon.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+
+bool AES_Accel_Available()
+{
+  unsigned int a, b, c, d;
+
+  if(!__get_cpuid(1, &a, &b, &c, &d))
+  {
+    return false;
+  }
+  return (c & bit_AES) != 0;
+}
+
+const char *AES_Accel_Name()
+{
+  return "AES-NI";
+}
+
+__attribute__((target("aes,sse2")))
+static inline __m128i Expand_Step(__m128i Key, __m128i Assist)
+{
+  //Each word is XORed with all words before it and SubWord(RotWord) ^ Rcon of the last
+  Key = _mm_xor_si128(Key, _mm_slli_si128(Key, 4));
+  Key = _mm_xor_si128(Key, _mm_slli_si128(Key, 4));
+  Key = _mm_xor_si128(Key, _mm_slli_si128(Key, 4));
+  return _mm_xor_si128(Key, _mm_shuffle_epi32(Assist, 0xFF));
+}
+
+/*
+*****************************************************************************************
+* Description : Key expansion with AESKEYGENASSIST, the Rcon has to be an immediate
+*****************************************************************************************
+*/
+__attribute__((target("aes,sse2")))
+static void Expand_Key_Lanes(const unsigned char *Key, unsigned char *Round_Keys)
+{
+  __m128i Round_Key[11];
+  unsigned char Round;
+
+  Round_Key[0] = _mm_loadu_si128((const __m128i *)Key);
+  Round_Key[1] = Expand_Step(Round_Key[0], _mm_aeskeygenassist_si128(Round_Key[0], 0x01));
+  Round_Key[2] = Expand_Step(Round_Key[1], _mm_aeskeygenassist_si128(Round_Key[1], 0x02));
+  Round_Key[3] = Expand_Step(Round_Key[2], _mm_aeskeygenassist_si128(Round_Key[2], 0x04));
+  Round_Key[4] = Expand_Step(Round_Key[3], _mm_aeskeygenassist_si128(Round_Key[3], 0x08));
+  Round_Key[5] = Expand_Step(Round_Key[4], _mm_aeskeygenassist_si128(Round_Key[4], 0x10));
+  Round_Key[6] = Expand_Step(Round_Key[5], _mm_aeskeygenassist_si128(Round_Key[5], 0x20));
+  Round_Key[7] = Expand_Step(Round_Key[6], _mm_aeskeygenassist_si128(Round_Key[6], 0x40));
+  Round_Key[8] = Expand_Step(Round_Key[7], _mm_aeskeygenassist_si128(Round_Key[7], 0x80));
+  Round_Key[9] = Expand_Step(Round_Key[8], _mm_aeskeygenassist_si128(Round_Key[8], 0x1B));
+  Round_Key[10] = Expand_Step(Round_Key[9], _mm_aeskeygenassist_si128(Round_Key[9], 0x36));
+
+  for(Round = 0; Round < 11; Round++)
+  {
+    _mm_storeu_si128((__m128i *)&Round_Keys[Round * 16], Round_Key[Round]);
+  }
+}
+
+__attribute__((target("aes,sse2")))
+static void Encrypt_Lanes(unsigned char *Data, unsigned int Blocks, const unsigned char *Round_Keys)
+{
+  __m128i Key[11];
+  __m128i State[AES_ACCEL_LANES];
+  unsigned char Round;
+  unsigned int i;
+
+  for(Round = 0; Round < 11; Round++)
+  {
+    Key[Round] = _mm_loadu_si128((const __m128i *)&Round_Keys[Round * 16]);
+  }
+
+  while(Blocks != 0)
+  {
+    unsigned int Lanes = (Blocks < AES_ACCEL_LANES) ? Blocks : AES_ACCEL_LANES;
+
+    for(i = 0; i < Lanes; i++)
+    {
+      State[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&Data[i * 16]), Key[0]);
+    }
+    for(Round = 1; Round < 10; Round++)
+    {
+      for(i = 0; i < Lanes; i++)
+      {
+        State[i] = _mm_aesenc_si128(State[i], Key[Round]);
+      }
+    }
+    for(i = 0; i < Lanes; i++)
+    {
+      _mm_storeu_si128((__m128i *)&Data[i * 16], _mm_aesenclast_si128(State[i], Key[10]));
+    }
+
+    Data += Lanes * 16;
+    Blocks -= Lanes;
+  }
+}
+
+__attribute__((target("aes,sse2")))
+static void Encrypt_Lanes_Keys(unsigned char *const *Blocks, const unsigned char *const *Round_Keys, unsigned int Count)
+{
+  __m128i State[AES_ACCEL_LANES];
+  unsigned char Round;
+  unsigned int i;
+
+  while(Count != 0)
+  {
+    unsigned int Lanes = (Count < AES_ACCEL_LANES) ? Count : AES_ACCEL_LANES;
+
+    for(i = 0; i < Lanes; i++)
+    {
+      State[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)Blocks[i]), _mm_loadu_si128((const __m128i *)Round_Keys[i]));
+    }
+    //The round keys come from L1, loads issue next to AESENC
+    for(Round = 1; Round < 10; Round++)
+    {
+      for(i = 0; i < Lanes; i++)
+      {
+        State[i] = _mm_aesenc_si128(State[i], _mm_loadu_si128((const __m128i *)&Round_Keys[i][Round * 16]));
+      }
+    }
+    for(i = 0; i < Lanes; i++)
+    {
+      _mm_storeu_si128((__m128i *)Blocks[i], _mm_aesenclast_si128(State[i], _mm_loadu_si128((const __m128i *)&Round_Keys[i][160])));
+    }
+
+    Blocks += Lanes;
+    Round_Keys += Lanes;
+    Count -= Lanes;
+  }
+}
+
+#else
+
+bool AES_Accel_Available()
+{
+  return true;
+}
+
+const char *AES_Accel_Name()
+{
+  return "ARMv8 crypto";
+}
+
+static void Encrypt_Lanes(unsigned char *Data, unsigned int Blocks, const unsigned char *Round_Keys)
+{
+  uint8x16_t Key[11];
+  uint8x16_t State[AES_ACCEL_LANES];
+  unsigned char Round;
+  unsigned int i;
+
+  for(Round = 0; Round < 11; Round++)
+  {
+    Key[Round] = vld1q_u8(&Round_Keys[Round * 16]);
+  }
+
+  while(Blocks != 0)
+  {
+    unsigned int Lanes = (Blocks < AES_ACCEL_LANES) ? Blocks : AES_ACCEL_LANES;
+
+    for(i = 0; i < Lanes; i++)
+    {
+      State[i] = vld1q_u8(&Data[i * 16]);
+    }
+    //AESE is AddRoundKey, SubBytes and ShiftRows, AESMC is MixColumns
+    for(Round = 0; Round < 9; Round++)
+    {
+      for(i = 0; i < Lanes; i++)
+      {
+        State[i] = vaesmcq_u8(vaeseq_u8(State[i], Key[Round]));
+      }
+    }
+    for(i = 0; i < Lanes; i++)
+    {
+      vst1q_u8(&Data[i * 16], veorq_u8(vaeseq_u8(State[i], Key[9]), Key[10]));
+    }
+
+    Data += Lanes * 16;
+    Blocks -= Lanes;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : AES-128 key expansion, the 11 round keys one after the other. ARMv8
+*               has no instruction for it, byte wise.
+*****************************************************************************************
+*/
+static void Expand_Key_Lanes(const unsigned char *Key, unsigned char *Round_Keys)
+{
+  unsigned char i;
+  unsigned char Rcon = 0x01;
+  unsigned char Temp[4];
+
+  memcpy(Round_Keys, Key, 16);
+
+  for(i = 16; i < 176; i += 4)
+  {
+    memcpy(Temp, &Round_Keys[i - 4], 4);
+
+    if((i & 15) == 0)
+    {
+      //RotWord, SubWord and Rcon
+      unsigned char First = Temp[0];
+
+      Temp[0] = pgm_read_byte(&S_Table[Temp[1] >> 4][Temp[1] & 0x0F]) ^ Rcon;
+      Temp[1] = pgm_read_byte(&S_Table[Temp[2] >> 4][Temp[2] & 0x0F]);
+      Temp[2] = pgm_read_byte(&S_Table[Temp[3] >> 4][Temp[3] & 0x0F]);
+      Temp[3] = pgm_read_byte(&S_Table[First >> 4][First & 0x0F]);
+
+      Rcon = (Rcon << 1) ^ ((Rcon & 0x80) ? 0x1B : 0x00);
+    }
+
+    Round_Keys[i + 0] = Round_Keys[i - 16] ^ Temp[0];
+    Round_Keys[i + 1] = Round_Keys[i - 15] ^ Temp[1];
+    Round_Keys[i + 2] = Round_Keys[i - 14] ^ Temp[2];
+    Round_Keys[i + 3] = Round_Keys[i - 13] ^ Temp[3];
+  }
+}
+
+static void Encrypt_Lanes_Keys(unsigned char *const *Blocks, const unsigned char *const *Round_Keys, unsigned int Count)
+{
+  uint8x16_t State[AES_ACCEL_LANES];
+  unsigned char Round;
+  unsigned int i;
+
+  while(Count != 0)
+  {
+    unsigned int Lanes = (Count < AES_ACCEL_LANES) ? Count : AES_ACCEL_LANES;
+
+    for(i = 0; i < Lanes; i++)
+    {
+      State[i] = vld1q_u8(Blocks[i]);
+    }
+    for(Round = 0; Round < 9; Round++)
+    {
+      for(i = 0; i < Lanes; i++)
+      {
+        State[i] = vaesmcq_u8(vaeseq_u8(State[i], vld1q_u8(&Round_Keys[i][Round * 16])));
+      }
+    }
+    for(i = 0; i < Lanes; i++)
+    {
+      vst1q_u8(Blocks[i], veorq_u8(vaeseq_u8(State[i], vld1q_u8(&Round_Keys[i][144])), vld1q_u8(&Round_Keys[i][160])));
+    }
+
+    Blocks += Lanes;
+    Round_Keys += Lanes;
+    Count -= Lanes;
+  }
+}
+
+#endif
+
+/*
+*****************************************************************************************
+* Description : Function encrypts blocks in place, all with the same key
+*
+* Arguments   : *Data   Blocks * 16 bytes
+*               Blocks  number of blocks
+*               *Key    16 byte key
+*****************************************************************************************
+*/
+void AES_Accel_Encrypt(unsigned char *Data, unsigned int Blocks, const unsigned char *Key)
+{
+  //A frame uses the same key for all its blocks, keep the last expansion per thread
+  static thread_local unsigned char Last_Key[16];
+  static thread_local unsigned char Round_Keys[176];
+  static thread_local bool Valid = false;
+
+  if(!Valid || memcmp(Last_Key, Key, 16) != 0)
+  {
+    Expand_Key_Lanes(Key, Round_Keys);
+    memcpy(Last_Key, Key, 16);
+    Valid = true;
+  }
+  Encrypt_Lanes(Data, Blocks, Round_Keys);
+}
+
+/*
+*****************************************************************************************
+* Description : Function expands a key for AES_Accel_Encrypt_Keys
+*
+* Arguments   : *Key          16 byte key
+*               *Round_Keys   AES_ACCEL_ROUND_KEYS bytes
+*****************************************************************************************
+*/
+void AES_Accel_Expand_Key(const unsigned char *Key, unsigned char *Round_Keys)
+{
+  Expand_Key_Lanes(Key, Round_Keys);
+}
+
+/*
+*****************************************************************************************
+* Description : Function encrypts blocks in place, each with its own key, e.g. the
+*               blocks of frames of different sessions
+*
+* Arguments   : *Blocks       Count pointers to 16 byte blocks
+*               *Round_Keys   Count key schedules of AES_Accel_Expand_Key, one per block
+*               Count         number of blocks
+*****************************************************************************************
+*/
+void AES_Accel_Encrypt_Keys(unsigned char *const *Blocks, const unsigned char *const *Round_Keys, unsigned int Count)
+{
+  Encrypt_Lanes_Keys(Blocks, Round_Keys, Count);
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+  LoRaWAN_AES_Accel.h - Hardware AES-128 for host builds
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Uses AES-NI on x86 (checked with CPUID at run time) or the ARMv8 crypto
+  extension on AArch64 (when compiled with +crypto). Several blocks are
+  encrypted interleaved, so the latency of one block is hidden behind the
+  others: blocks of one frame with the same key, or blocks of many frames each
+  with the key schedule of its session. On x86 the key schedule comes from
+  AESKEYGENASSIST, with a new session per frame it costs more than the frame.
+
+  Only used by LoRaWAN_Crypto, the firmware and builds with LORAWAN_AES_PORTABLE
+  keep the byte wise AES.
+*/
+
+#ifndef LoRaWAN_AES_Accel_h
+#define LoRaWAN_AES_Accel_h
+
+#if !defined(ARDUINO) && !defined(LORAWAN_AES_PORTABLE) && \
+    (defined(__x86_64__) || defined(__i386__) || (defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO)))
+#define LORAWAN_AES_ACCEL
+#endif
+
+#ifdef LORAWAN_AES_ACCEL
+
+// blocks encrypted at once
+#define AES_ACCEL_LANES 4
+
+bool AES_Accel_Available();
+const char *AES_Accel_Name();
+void AES_Accel_Encrypt(unsigned char *Data, unsigned int Blocks, const unsigned char *Key);
+
+// bytes of the key schedule of AES_Accel_Expand_Key
+#define AES_ACCEL_ROUND_KEYS 176
+
+void AES_Accel_Expand_Key(const unsigned char *Key, unsigned char *Round_Keys);
+void AES_Accel_Encrypt_Keys(unsigned char *const *Blocks, const unsigned char *const *Round_Keys, unsigned int Count);
+
+#endif
+
+#endif
@@ -0,0 +1,404 @@
+/*
+  LoRaWAN_AES_Bitslice.cpp - Constant time bitsliced AES-128
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Follows the 32 bit constant time AES of BearSSL (aes_ct) by Thomas Pornin.
+*/
+
+#include <string.h>
+
+#include "LoRaWAN_AES_Bitslice.h"
+
+static uint32_t Load_Word(const unsigned char *Data)
+{
+  return (uint32_t)Data[0] | ((uint32_t)Data[1] << 8) | ((uint32_t)Data[2] << 16) | ((uint32_t)Data[3] << 24);
+}
+
+static void Store_Word(unsigned char *Data, uint32_t Word)
+{
+  Data[0] = Word;
+  Data[1] = Word >> 8;
+  Data[2] = Word >> 16;
+  Data[3] = Word >> 24;
+}
+
+/*
+*****************************************************************************************
+* Description : S-box on all 32 bytes of the eight words at once
+*****************************************************************************************
+*/
+static void Sub_Bytes(uint32_t *q)
+{
+  uint32_t x0, x1, x2, x3, x4, x5, x6, x7;
+  uint32_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+  uint32_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+  uint32_t y20, y21;
+  uint32_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+  uint32_t z10, z11, z12, z13, z14, z15, z16, z17;
+  uint32_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+  uint32_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+  uint32_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+  uint32_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+  uint32_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+  uint32_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+  uint32_t t60, t61, t62, t63, t64, t65, t66, t67;
+  uint32_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+  x0 = q[7];
+  x1 = q[6];
+  x2 = q[5];
+  x3 = q[4];
+  x4 = q[3];
+  x5 = q[2];
+  x6 = q[1];
+  x7 = q[0];
+
+  //Top linear transformation
+  y14 = x3 ^ x5;
+  y13 = x0 ^ x6;
+  y9 = x0 ^ x3;
+  y8 = x0 ^ x5;
+  t0 = x1 ^ x2;
+  y1 = t0 ^ x7;
+  y4 = y1 ^ x3;
+  y12 = y13 ^ y14;
+  y2 = y1 ^ x0;
+  y5 = y1 ^ x6;
+  y3 = y5 ^ y8;
+  t1 = x4 ^ y12;
+  y15 = t1 ^ x5;
+  y20 = t1 ^ x1;
+  y6 = y15 ^ x7;
+  y10 = y15 ^ t0;
+  y11 = y20 ^ y9;
+  y7 = x7 ^ y11;
+  y17 = y10 ^ y11;
+  y19 = y10 ^ y8;
+  y16 = t0 ^ y11;
+  y21 = y13 ^ y16;
+  y18 = x0 ^ y16;
+
+  //Non-linear section
+  t2 = y12 & y15;
+  t3 = y3 & y6;
+  t4 = t3 ^ t2;
+  t5 = y4 & x7;
+  t6 = t5 ^ t2;
+  t7 = y13 & y16;
+  t8 = y5 & y1;
+  t9 = t8 ^ t7;
+  t10 = y2 & y7;
+  t11 = t10 ^ t7;
+  t12 = y9 & y11;
+  t13 = y14 & y17;
+  t14 = t13 ^ t12;
+  t15 = y8 & y10;
+  t16 = t15 ^ t12;
+  t17 = t4 ^ t14;
+  t18 = t6 ^ t16;
+  t19 = t9 ^ t14;
+  t20 = t11 ^ t16;
+  t21 = t17 ^ y20;
+  t22 = t18 ^ y19;
+  t23 = t19 ^ y21;
+  t24 = t20 ^ y18;
+
+  t25 = t21 ^ t22;
+  t26 = t21 & t23;
+  t27 = t24 ^ t26;
+  t28 = t25 & t27;
+  t29 = t28 ^ t22;
+  t30 = t23 ^ t24;
+  t31 = t22 ^ t26;
+  t32 = t31 & t30;
+  t33 = t32 ^ t24;
+  t34 = t23 ^ t33;
+  t35 = t27 ^ t33;
+  t36 = t24 & t35;
+  t37 = t36 ^ t34;
+  t38 = t27 ^ t36;
+  t39 = t29 & t38;
+  t40 = t25 ^ t39;
+
+  t41 = t40 ^ t37;
+  t42 = t29 ^ t33;
+  t43 = t29 ^ t40;
+  t44 = t33 ^ t37;
+  t45 = t42 ^ t41;
+  z0 = t44 & y15;
+  z1 = t37 & y6;
+  z2 = t33 & x7;
+  z3 = t43 & y16;
+  z4 = t40 & y1;
+  z5 = t29 & y7;
+  z6 = t42 & y11;
+  z7 = t45 & y17;
+  z8 = t41 & y10;
+  z9 = t44 & y12;
+  z10 = t37 & y3;
+  z11 = t33 & y4;
+  z12 = t43 & y13;
+  z13 = t40 & y5;
+  z14 = t29 & y2;
+  z15 = t42 & y9;
+  z16 = t45 & y14;
+  z17 = t41 & y8;
+
+  //Bottom linear transformation
+  t46 = z15 ^ z16;
+  t47 = z10 ^ z11;
+  t48 = z5 ^ z13;
+  t49 = z9 ^ z10;
+  t50 = z2 ^ z12;
+  t51 = z2 ^ z5;
+  t52 = z7 ^ z8;
+  t53 = z0 ^ z3;
+  t54 = z6 ^ z7;
+  t55 = z16 ^ z17;
+  t56 = z12 ^ t48;
+  t57 = t50 ^ t53;
+  t58 = z4 ^ t46;
+  t59 = z3 ^ t54;
+  t60 = t46 ^ t57;
+  t61 = z14 ^ t57;
+  t62 = t52 ^ t58;
+  t63 = t49 ^ t58;
+  t64 = z4 ^ t59;
+  t65 = t61 ^ t62;
+  t66 = z1 ^ t63;
+  s0 = t59 ^ t63;
+  s6 = t56 ^ ~t62;
+  s7 = t48 ^ ~t60;
+  t67 = t64 ^ t65;
+  s3 = t53 ^ t66;
+  s4 = t51 ^ t66;
+  s5 = t47 ^ t65;
+  s1 = t64 ^ ~s3;
+  s2 = t55 ^ ~t67;
+
+  q[7] = s0;
+  q[6] = s1;
+  q[5] = s2;
+  q[4] = s3;
+  q[3] = s4;
+  q[2] = s5;
+  q[1] = s6;
+  q[0] = s7;
+}
+
+/*
+*****************************************************************************************
+* Description : Function moves between normal and bitsliced order, it is its own
+*               inverse. Block one is in the even words, block two in the odd words.
+*****************************************************************************************
+*/
+static void Swap_Bits(uint32_t &x, uint32_t &y, uint32_t Low, uint32_t High, unsigned char Shift)
+{
+  uint32_t a = x;
+  uint32_t b = y;
+
+  x = (a & Low) | ((b & Low) << Shift);
+  y = ((a & High) >> Shift) | (b & High);
+}
+
+static void Ortho(uint32_t *q)
+{
+  Swap_Bits(q[0], q[1], 0x55555555UL, 0xAAAAAAAAUL, 1);
+  Swap_Bits(q[2], q[3], 0x55555555UL, 0xAAAAAAAAUL, 1);
+  Swap_Bits(q[4], q[5], 0x55555555UL, 0xAAAAAAAAUL, 1);
+  Swap_Bits(q[6], q[7], 0x55555555UL, 0xAAAAAAAAUL, 1);
+
+  Swap_Bits(q[0], q[2], 0x33333333UL, 0xCCCCCCCCUL, 2);
+  Swap_Bits(q[1], q[3], 0x33333333UL, 0xCCCCCCCCUL, 2);
+  Swap_Bits(q[4], q[6], 0x33333333UL, 0xCCCCCCCCUL, 2);
+  Swap_Bits(q[5], q[7], 0x33333333UL, 0xCCCCCCCCUL, 2);
+
+  Swap_Bits(q[0], q[4], 0x0F0F0F0FUL, 0xF0F0F0F0UL, 4);
+  Swap_Bits(q[1], q[5], 0x0F0F0F0FUL, 0xF0F0F0F0UL, 4);
+  Swap_Bits(q[2], q[6], 0x0F0F0F0FUL, 0xF0F0F0F0UL, 4);
+  Swap_Bits(q[3], q[7], 0x0F0F0F0FUL, 0xF0F0F0F0UL, 4);
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a round key, kept compressed to 4 words: the even bits
+*               belong to the even word, the odd bits to the odd word
+*****************************************************************************************
+*/
+static void Add_Round_Key(uint32_t *q, const uint32_t *Round_Key)
+{
+  unsigned char i;
+  uint32_t x;
+  uint32_t y;
+
+  for(i = 0; i < 4; i++)
+  {
+    x = Round_Key[i] & 0x55555555UL;
+    y = Round_Key[i] & 0xAAAAAAAAUL;
+    q[i * 2] ^= x | (x << 1);
+    q[i * 2 + 1] ^= y | (y >> 1);
+  }
+}
+
+static void Shift_Rows(uint32_t *q)
+{
+  unsigned char i;
+  uint32_t x;
+
+  for(i = 0; i < 8; i++)
+  {
+    x = q[i];
+    q[i] = (x & 0x000000FFUL)
+      | ((x & 0x0000FC00UL) >> 2) | ((x & 0x00000300UL) << 6)
+      | ((x & 0x00F00000UL) >> 4) | ((x & 0x000F0000UL) << 4)
+      | ((x & 0xC0000000UL) >> 6) | ((x & 0x3F000000UL) << 2);
+  }
+}
+
+static uint32_t Rotate_16(uint32_t x)
+{
+  return (x << 16) | (x >> 16);
+}
+
+static void Mix_Columns(uint32_t *q)
+{
+  uint32_t q0, q1, q2, q3, q4, q5, q6, q7;
+  uint32_t r0, r1, r2, r3, r4, r5, r6, r7;
+
+  q0 = q[0];
+  q1 = q[1];
+  q2 = q[2];
+  q3 = q[3];
+  q4 = q[4];
+  q5 = q[5];
+  q6 = q[6];
+  q7 = q[7];
+  r0 = (q0 >> 8) | (q0 << 24);
+  r1 = (q1 >> 8) | (q1 << 24);
+  r2 = (q2 >> 8) | (q2 << 24);
+  r3 = (q3 >> 8) | (q3 << 24);
+  r4 = (q4 >> 8) | (q4 << 24);
+  r5 = (q5 >> 8) | (q5 << 24);
+  r6 = (q6 >> 8) | (q6 << 24);
+  r7 = (q7 >> 8) | (q7 << 24);
+
+  q[0] = q7 ^ r7 ^ r0 ^ Rotate_16(q0 ^ r0);
+  q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ Rotate_16(q1 ^ r1);
+  q[2] = q1 ^ r1 ^ r2 ^ Rotate_16(q2 ^ r2);
+  q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ Rotate_16(q3 ^ r3);
+  q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ Rotate_16(q4 ^ r4);
+  q[5] = q4 ^ r4 ^ r5 ^ Rotate_16(q5 ^ r5);
+  q[6] = q5 ^ r5 ^ r6 ^ Rotate_16(q6 ^ r6);
+  q[7] = q6 ^ r6 ^ r7 ^ Rotate_16(q7 ^ r7);
+}
+
+/*
+*****************************************************************************************
+* Description : S-box on the four bytes of a key schedule word
+*****************************************************************************************
+*/
+static uint32_t Sub_Word(uint32_t Word)
+{
+  uint32_t q[8];
+
+  memset(q, 0, sizeof(q));
+  q[0] = Word;
+  Ortho(q);
+  Sub_Bytes(q);
+  Ortho(q);
+  return q[0];
+}
+
+/*
+*****************************************************************************************
+* Description : Function expands a key into compressed bitsliced round keys
+*
+* Arguments   : *Key          16 byte key
+*               *Round_Keys   AES_BITSLICE_KEY_WORDS words
+*****************************************************************************************
+*/
+void AES_Bitslice_Expand_Key(const unsigned char *Key, uint32_t *Round_Keys)
+{
+  unsigned char i;
+  unsigned char Round;
+  uint32_t Word[4];
+  uint32_t q[8];
+  uint32_t Rcon = 0x01;
+
+  for(i = 0; i < 4; i++)
+  {
+    Word[i] = Load_Word(&Key[i * 4]);
+  }
+
+  for(Round = 0; Round < 11; Round++)
+  {
+    if(Round != 0)
+    {
+      //RotWord, SubWord and Rcon on the last word of the previous round key
+      Word[0] ^= Sub_Word((Word[3] << 24) | (Word[3] >> 8)) ^ Rcon;
+      Word[1] ^= Word[0];
+      Word[2] ^= Word[1];
+      Word[3] ^= Word[2];
+      Rcon = ((Rcon << 1) ^ ((Rcon >> 7) * 0x1B)) & 0xFF;
+    }
+
+    //Every word twice, for both blocks
+    for(i = 0; i < 4; i++)
+    {
+      q[i * 2] = Word[i];
+      q[i * 2 + 1] = Word[i];
+    }
+    Ortho(q);
+
+    for(i = 0; i < 4; i++)
+    {
+      Round_Keys[Round * 4 + i] = (q[i * 2] & 0x55555555UL) | (q[i * 2 + 1] & 0xAAAAAAAAUL);
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function encrypts one or two blocks in place
+*
+* Arguments   : *Data         Blocks * 16 bytes
+*               Blocks        1 or 2, one block costs as much as two
+*               *Round_Keys   from AES_Bitslice_Expand_Key
+*****************************************************************************************
+*/
+void AES_Bitslice_Encrypt(unsigned char *Data, unsigned char Blocks, const uint32_t *Round_Keys)
+{
+  uint32_t q[8];
+  unsigned char i;
+  unsigned char Round;
+
+  for(i = 0; i < 4; i++)
+  {
+    q[i * 2] = Load_Word(&Data[i * 4]);
+    q[i * 2 + 1] = (Blocks > 1) ? Load_Word(&Data[16 + i * 4]) : 0;
+  }
+  Ortho(q);
+
+  Add_Round_Key(q, Round_Keys);
+  for(Round = 1; Round < 10; Round++)
+  {
+    Sub_Bytes(q);
+    Shift_Rows(q);
+    Mix_Columns(q);
+    Add_Round_Key(q, &Round_Keys[Round * 4]);
+  }
+  Sub_Bytes(q);
+  Shift_Rows(q);
+  Add_Round_Key(q, &Round_Keys[40]);
+
+  Ortho(q);
+  for(i = 0; i < 4; i++)
+  {
+    Store_Word(&Data[i * 4], q[i * 2]);
+    if(Blocks > 1)
+    {
+      Store_Word(&Data[16 + i * 4], q[i * 2 + 1]);
+    }
+  }
+}
@@ -0,0 +1,28 @@
+/*
+  LoRaWAN_AES_Bitslice.h - Constant time bitsliced AES-128
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Two blocks are spread bit by bit over eight 32 bit words, the S-box is the
+  Boyar-Peralta circuit of 113 logic operations. There are no table lookups or
+  branches that depend on key or data, and only 32 bit operations, so it runs
+  the same on the Cortex-M3 and the host.
+
+  The key schedule costs about as much as two blocks, it pays off when a key
+  encrypts several blocks, like the keystream of a longer payload.
+*/
+
+#ifndef LoRaWAN_AES_Bitslice_h
+#define LoRaWAN_AES_Bitslice_h
+
+#include <stdint.h>
+
+// compressed bitsliced round keys, 11 rounds of 4 words
+#define AES_BITSLICE_KEY_WORDS 44
+// blocks encrypted at once
+#define AES_BITSLICE_LANES 2
+
+void AES_Bitslice_Expand_Key(const unsigned char *Key, uint32_t *Round_Keys);
+void AES_Bitslice_Encrypt(unsigned char *Data, unsigned char Blocks, const uint32_t *Round_Keys);
+
+#endif
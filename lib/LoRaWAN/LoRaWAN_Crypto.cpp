@@ -0,0 +1,811 @@
+/*
+  LoRaWAN_Crypto.cpp - AES-128, AES-CMAC and LoRaWAN payload encryption
+  Created by Leo Korbee, March 31, 2018.
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+  Thanks to all the folks who contributed on the base of this code.
+  (Gerben den Hartog, et al - Ideetron.nl)
+*/
+
+#include "LoRaWAN_Crypto.h"
+
+// for AES encryption, const data stays in flash
+const unsigned char PROGMEM S_Table[16][16] = {
+  {0x63,0x7C,0x77,0x7B,0xF2,0x6B,0x6F,0xC5,0x30,0x01,0x67,0x2B,0xFE,0xD7,0xAB,0x76},
+  {0xCA,0x82,0xC9,0x7D,0xFA,0x59,0x47,0xF0,0xAD,0xD4,0xA2,0xAF,0x9C,0xA4,0x72,0xC0},
+  {0xB7,0xFD,0x93,0x26,0x36,0x3F,0xF7,0xCC,0x34,0xA5,0xE5,0xF1,0x71,0xD8,0x31,0x15},
+  {0x04,0xC7,0x23,0xC3,0x18,0x96,0x05,0x9A,0x07,0x12,0x80,0xE2,0xEB,0x27,0xB2,0x75},
+  {0x09,0x83,0x2C,0x1A,0x1B,0x6E,0x5A,0xA0,0x52,0x3B,0xD6,0xB3,0x29,0xE3,0x2F,0x84},
+  {0x53,0xD1,0x00,0xED,0x20,0xFC,0xB1,0x5B,0x6A,0xCB,0xBE,0x39,0x4A,0x4C,0x58,0xCF},
+  {0xD0,0xEF,0xAA,0xFB,0x43,0x4D,0x33,0x85,0x45,0xF9,0x02,0x7F,0x50,0x3C,0x9F,0xA8},
+  {0x51,0xA3,0x40,0x8F,0x92,0x9D,0x38,0xF5,0xBC,0xB6,0xDA,0x21,0x10,0xFF,0xF3,0xD2},
+  {0xCD,0x0C,0x13,0xEC,0x5F,0x97,0x44,0x17,0xC4,0xA7,0x7E,0x3D,0x64,0x5D,0x19,0x73},
+  {0x60,0x81,0x4F,0xDC,0x22,0x2A,0x90,0x88,0x46,0xEE,0xB8,0x14,0xDE,0x5E,0x0B,0xDB},
+  {0xE0,0x32,0x3A,0x0A,0x49,0x06,0x24,0x5C,0xC2,0xD3,0xAC,0x62,0x91,0x95,0xE4,0x79},
+  {0xE7,0xC8,0x37,0x6D,0x8D,0xD5,0x4E,0xA9,0x6C,0x56,0xF4,0xEA,0x65,0x7A,0xAE,0x08},
+  {0xBA,0x78,0x25,0x2E,0x1C,0xA6,0xB4,0xC6,0xE8,0xDD,0x74,0x1F,0x4B,0xBD,0x8B,0x8A},
+  {0x70,0x3E,0xB5,0x66,0x48,0x03,0xF6,0x0E,0x61,0x35,0x57,0xB9,0x86,0xC1,0x1D,0x9E},
+  {0xE1,0xF8,0x98,0x11,0x69,0xD9,0x8E,0x94,0x9B,0x1E,0x87,0xE9,0xCE,0x55,0x28,0xDF},
+  {0x8C,0xA1,0x89,0x0D,0xBF,0xE6,0x42,0x68,0x41,0x99,0x2D,0x0F,0xB0,0x54,0xBB,0x16}
+};
+
+#ifdef LORAWAN_AES_ACCEL
+bool LoRaWAN_Crypto::_Accelerated = AES_Accel_Available();
+#else
+bool LoRaWAN_Crypto::_Accelerated = false;
+#endif
+
+
+/*
+*****************************************************************************************
+* Description : Function encrypts or decrypts FRMPayload with the A blocks keystream
+*
+* Arguments   : *Data           payload, encrypted in place
+*               Data_Length     length of the payload
+*               Frame_Counter   full 32 bit frame counter
+*               Direction       0 uplink, 1 downlink
+*               *DevAddr        4 bytes, msb left
+*               *Key            AppSkey, or NwkSkey for FPort 0
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr, unsigned char *Key)
+{
+  unsigned char Block_A[16];
+
+  //Block counter, first block is 1
+  Frame_Block(Block_A, 0x01, 0x00, Frame_Counter, Direction, DevAddr);
+
+  XOR_Keystream(Data, Data_Length, Block_A, Key);
+}
+
+/*
+*****************************************************************************************
+* Description : Function XORs data with the encrypted blocks Block_A[15] = 1, 2, ..
+*               Hardware AES takes several blocks at once, without it the bitsliced
+*               AES is used when there are enough blocks to pay for its key schedule,
+*               or always with CRYPTO_CONSTANT_TIME.
+*
+* Arguments   : *Data         data, changed in place
+*               Data_Length   length of the data
+*               *Block_A      A block with the block counter byte at 0
+*               *Key          16 byte key
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::XOR_Keystream(unsigned char *Data, unsigned char Data_Length, unsigned char *Block_A, unsigned char *Key)
+{
+  //Flat, the blocks are encrypted and XORed as one run of bytes
+  unsigned char Keystream[CRYPTO_BATCH_BLOCKS * 16];
+  unsigned char Number_of_Blocks;
+  unsigned char Batch;
+  unsigned char Bytes;
+  unsigned char i;
+  unsigned char j;
+
+  Number_of_Blocks = (Data_Length + 15) / 16;
+
+#ifdef CRYPTO_CONSTANT_TIME
+  if(!_Accelerated)
+#else
+  if(!_Accelerated && Number_of_Blocks >= CRYPTO_BITSLICE_BLOCKS)
+#endif
+  {
+    XOR_Keystream_Bitslice(Data, Data_Length, Block_A, Key);
+    return;
+  }
+
+  for(i = 1; i <= Number_of_Blocks; i += Batch)
+  {
+    Batch = Number_of_Blocks - i + 1;
+    if(Batch > CRYPTO_BATCH_BLOCKS)
+    {
+      Batch = CRYPTO_BATCH_BLOCKS;
+    }
+
+    for(j = 0; j < Batch; j++)
+    {
+      memcpy(&Keystream[16 * j], Block_A, 15);
+      Keystream[16 * j + 15] = i + j;
+    }
+
+    //Calculate S
+    AES_Encrypt_Blocks(Keystream, Batch, Key);
+
+    //The last block may be incomplete
+    Bytes = Batch * 16;
+    if(Bytes > Data_Length)
+    {
+      Bytes = Data_Length;
+    }
+    Data_Length -= Bytes;
+
+    for(j = 0; j < Bytes; j++)
+    {
+      *Data = *Data ^ Keystream[j];
+      Data++;
+    }
+  }
+}
+
+void LoRaWAN_Crypto::XOR_Keystream_Bitslice(unsigned char *Data, unsigned char Data_Length, unsigned char *Block_A, unsigned char *Key)
+{
+  uint32_t Round_Keys[AES_BITSLICE_KEY_WORDS];
+  unsigned char Keystream[AES_BITSLICE_LANES * 16];
+  unsigned char Counter = 1;
+  unsigned char Bytes;
+  unsigned char j;
+
+  AES_Bitslice_Expand_Key(Key, Round_Keys);
+
+  while(Data_Length != 0)
+  {
+    memcpy(&Keystream[0], Block_A, 15);
+    memcpy(&Keystream[16], Block_A, 15);
+    Keystream[15] = Counter;
+    Keystream[31] = Counter + 1;
+
+    Bytes = (Data_Length > 32) ? 32 : Data_Length;
+    AES_Bitslice_Encrypt(Keystream, (Bytes > 16) ? 2 : 1, Round_Keys);
+
+    for(j = 0; j < Bytes; j++)
+    {
+      *Data = *Data ^ Keystream[j];
+      Data++;
+    }
+
+    Data_Length -= Bytes;
+    Counter += AES_BITSLICE_LANES;
+  }
+}
+
+void LoRaWAN_Crypto::Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr, unsigned char *Key)
+{
+  unsigned char Block_B[16];
+
+  Frame_Block(Block_B, 0x49, Data_Length, Frame_Counter, Direction, DevAddr);
+
+  Calculate_CMAC(Block_B, Data, Final_MIC, Data_Length, Key);
+}
+
+/*
+*****************************************************************************************
+* Description : Function fills the A block of the payload encryption (First 0x01) or
+*               the B0 block of the MIC (First 0x49)
+*
+* Arguments   : *Block          16 bytes
+*               First           first byte
+*               Last            last byte, block counter or message length
+*               Frame_Counter   full 32 bit frame counter
+*               Direction       0 uplink, 1 downlink
+*               *DevAddr        4 bytes, msb left
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Frame_Block(unsigned char *Block, unsigned char First, unsigned char Last, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr)
+{
+  Block[0] = First;
+  Block[1] = 0x00;
+  Block[2] = 0x00;
+  Block[3] = 0x00;
+  Block[4] = 0x00;
+
+  Block[5] = Direction;
+
+  Block[6] = DevAddr[3];
+  Block[7] = DevAddr[2];
+  Block[8] = DevAddr[1];
+  Block[9] = DevAddr[0];
+
+  Block[10] = (Frame_Counter & 0x00FF);
+  Block[11] = ((Frame_Counter >> 8) & 0x00FF);
+
+  Block[12] = ((Frame_Counter >> 16) & 0x00FF); //Frame counter upper bytes
+  Block[13] = ((Frame_Counter >> 24) & 0x00FF);
+
+  Block[14] = 0x00;
+  Block[15] = Last;
+}
+
+/*
+*****************************************************************************************
+* Description : AES-CMAC, returns the first 4 bytes as MIC. The data MIC prepends
+*               Block B0, join request and join accept use the plain CMAC.
+*               The chaining value is kept in Block_B0 when there is one, the
+*               stack holds the subkey and one chaining block besides AES_Encrypt.
+*
+* Arguments   : *Block_B0   16 byte block processed before Data, 0 if none.
+*                           Overwritten.
+*               *Data       message
+*               *Final_MIC  4 bytes MIC
+*               Data_Length length of the message
+*               *Key        NwkSkey or AppKey
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Calculate_CMAC(unsigned char *Block_B0, unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned char *Key)
+{
+  unsigned char i;
+  unsigned char Subkey[16];
+  unsigned char Chain[16];
+  unsigned char *X;
+
+  unsigned char Number_of_Blocks = 0x00;
+  unsigned char Last_Block_Size = 0x00;
+  unsigned char Block_Counter = 0x01;
+  unsigned char Byte;
+
+  //Calculate number of Blocks and blocksize of last block, an empty message is one incomplete block
+  Number_of_Blocks = (Data_Length + 15) / 16;
+  if(Number_of_Blocks == 0)
+  {
+    Number_of_Blocks = 1;
+  }
+  Last_Block_Size = Data_Length - (Number_of_Blocks - 1) * 16;
+
+  //Plain CMAC starts with the first block of Data on zeros
+  if(Block_B0 != 0)
+  {
+    AES_Encrypt(Block_B0, Key);
+    X = Block_B0;
+  }
+  else
+  {
+    memset(Chain, 0, 16);
+    X = Chain;
+  }
+
+  //Preform full calculating until n-1 messsage blocks
+  while(Block_Counter < Number_of_Blocks)
+  {
+    for(i = 0; i < 16; i++)
+    {
+      X[i] ^= *Data;
+      Data++;
+    }
+
+    AES_Encrypt(X, Key);
+
+    Block_Counter++;
+  }
+
+  //Last block with K1 when complete, else padded with 0x80 0x00 .. and K2
+  Generate_Subkey(Subkey, (Last_Block_Size == 16) ? 1 : 2, Key);
+
+  for(i = 0; i < 16; i++)
+  {
+    if(i < Last_Block_Size)
+    {
+      Byte = *Data;
+      Data++;
+    }
+    else if(i == Last_Block_Size)
+    {
+      Byte = 0x80;
+    }
+    else
+    {
+      Byte = 0x00;
+    }
+
+    X[i] ^= Byte ^ Subkey[i];
+  }
+
+  //Preform last AES routine
+  AES_Encrypt(X, Key);
+
+  Final_MIC[0] = X[0];
+  Final_MIC[1] = X[1];
+  Final_MIC[2] = X[2];
+  Final_MIC[3] = X[3];
+}
+
+/*
+*****************************************************************************************
+* Description : Function generates CMAC subkey K1 (Number 1) or K2 (Number 2)
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Generate_Subkey(unsigned char *Subkey, unsigned char Number, unsigned char *Key)
+{
+  //Encrypt zeros with the key
+  memset(Subkey, 0, 16);
+  AES_Encrypt(Subkey, Key);
+
+  Derive_Subkey(Subkey, Number);
+}
+
+/*
+*****************************************************************************************
+* Description : Function turns the encrypted zero block into K1 or K2
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Derive_Subkey(unsigned char *Subkey, unsigned char Number)
+{
+  unsigned char MSB_Key;
+
+  //K1 is the shifted block, K2 the shifted K1
+  while(Number != 0)
+  {
+    MSB_Key = Subkey[0] & 0x80;
+
+    Shift_Left(Subkey);
+
+    //if MSB was 1
+    if(MSB_Key == 0x80)
+    {
+      Subkey[15] = Subkey[15] ^ 0x87;
+    }
+    Number--;
+  }
+}
+
+
+void LoRaWAN_Crypto::Shift_Left(unsigned char *Data)
+{
+  unsigned char i;
+
+  for(i = 0; i < 15; i++)
+  {
+    Data[i] = (Data[i] << 1) | (Data[i + 1] >> 7);
+  }
+  Data[15] = Data[15] << 1;
+}
+
+/*
+*****************************************************************************************
+* Title         : AES_Encrypt
+* Description  : Encrypts Data in place, the state is Data itself in column order
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Encrypt(unsigned char *Data, unsigned char *Key)
+{
+#ifdef CRYPTO_CONSTANT_TIME
+  //No S-box table with the key, hardware or bitsliced AES
+  AES_Encrypt_Blocks(Data, 1, Key);
+#else
+  unsigned char i, Round;
+  unsigned char Round_Key[16];
+
+#ifdef LORAWAN_AES_ACCEL
+  if(_Accelerated)
+  {
+    AES_Accel_Encrypt(Data, 1, Key);
+    return;
+  }
+#endif
+
+  //  Copy key to round key
+  memcpy( &Round_Key[0], &Key[0], 16 );
+
+  //  Add round key
+  AES_Add_Round_Key( Round_Key, Data );
+
+  //  Preform 9 full rounds with mixed collums and the last one without
+  for( Round = 1 ; Round <= 10 ; Round++ )
+  {
+    //  Perform Byte substitution with S table
+    for( i = 0 ; i < 16 ; i++ )
+    {
+      Data[i] = AES_Sub_Byte( Data[i] );
+    }
+
+    //  Perform Row Shift
+    AES_Shift_Rows(Data);
+
+    //  Mix Collums
+    if( Round != 10 )
+    {
+      AES_Mix_Collums(Data);
+    }
+
+    //  Calculate new round key
+    AES_Calculate_Round_Key(Round, Round_Key);
+
+    //  Add the round key to the Round_key
+    AES_Add_Round_Key(Round_Key, Data);
+  }
+#endif
+} // AES_Encrypt
+
+
+/*
+*****************************************************************************************
+* Description : Function encrypts several blocks with the same key, interleaved when
+*               hardware AES is used
+*
+* Arguments   : *Data   Blocks * 16 bytes, encrypted in place
+*               Blocks  number of blocks
+*               *Key    16 byte key
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Encrypt_Blocks(unsigned char *Data, unsigned char Blocks, unsigned char *Key)
+{
+  unsigned char i;
+
+#ifdef LORAWAN_AES_ACCEL
+  if(_Accelerated)
+  {
+    AES_Accel_Encrypt(Data, Blocks, Key);
+    return;
+  }
+#endif
+
+#ifdef CRYPTO_CONSTANT_TIME
+  uint32_t Round_Keys[AES_BITSLICE_KEY_WORDS];
+
+  //The key schedule is the same for every block, the bitsliced AES takes two at once
+  AES_Bitslice_Expand_Key(Key, Round_Keys);
+  for(i = 0; i < Blocks; i += AES_BITSLICE_LANES)
+  {
+    AES_Bitslice_Encrypt(&Data[i * 16], (Blocks - i < AES_BITSLICE_LANES) ? Blocks - i : AES_BITSLICE_LANES, Round_Keys);
+  }
+#else
+  for(i = 0; i < Blocks; i++)
+  {
+    AES_Encrypt(&Data[i * 16], Key);
+  }
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function calculates the MIC of many frames, e.g. of different sessions
+*               in a network server. With hardware AES the CMAC chains of up to
+*               CRYPTO_BATCH_FRAMES frames run interleaved, block n of every frame at
+*               once. Same result as Calculate_MIC for each frame.
+*
+* Arguments   : *Frames  Data, Data_Length, Frame_Counter, Direction, DevAddr and the
+*                        NwkSkey in Key, the MIC is written to MIC
+*               Count    number of frames
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Calculate_MIC_Batch(Crypto_Frame *Frames, unsigned int Count)
+{
+  unsigned int n;
+
+#ifdef LORAWAN_AES_ACCEL
+  unsigned char Round_Keys[CRYPTO_BATCH_FRAMES][AES_ACCEL_ROUND_KEYS];
+  unsigned char X[CRYPTO_BATCH_FRAMES][16];
+  unsigned char Subkey[CRYPTO_BATCH_FRAMES][16];
+  unsigned char Number_of_Blocks[CRYPTO_BATCH_FRAMES];
+  unsigned char *Blocks[CRYPTO_BATCH_FRAMES * 2];
+  const unsigned char *Keys[CRYPTO_BATCH_FRAMES * 2];
+  unsigned char Batch;
+  unsigned char Most;
+  unsigned char Block;
+  unsigned char Active;
+  unsigned char Last_Block_Size;
+  unsigned char *Data;
+  unsigned char i;
+  unsigned char j;
+
+  if(_Accelerated)
+  {
+    for(n = 0; n < Count; n += Batch)
+    {
+      Batch = (Count - n < CRYPTO_BATCH_FRAMES) ? Count - n : CRYPTO_BATCH_FRAMES;
+      Most = 0;
+
+      //B0 and the zero block of the subkeys
+      for(i = 0; i < Batch; i++)
+      {
+        Crypto_Frame &Frame = Frames[n + i];
+
+        AES_Accel_Expand_Key(Frame.Key, Round_Keys[i]);
+        Frame_Block(X[i], 0x49, Frame.Data_Length, Frame.Frame_Counter, Frame.Direction, Frame.DevAddr);
+        memset(Subkey[i], 0, 16);
+
+        Blocks[i * 2] = X[i];
+        Blocks[i * 2 + 1] = Subkey[i];
+        Keys[i * 2] = Round_Keys[i];
+        Keys[i * 2 + 1] = Round_Keys[i];
+
+        Number_of_Blocks[i] = (Frame.Data_Length + 15) / 16;
+        if(Number_of_Blocks[i] == 0)
+        {
+          Number_of_Blocks[i] = 1;
+        }
+        if(Number_of_Blocks[i] > Most)
+        {
+          Most = Number_of_Blocks[i];
+        }
+      }
+      AES_Accel_Encrypt_Keys(Blocks, Keys, Batch * 2);
+
+      for(i = 0; i < Batch; i++)
+      {
+        Derive_Subkey(Subkey[i], (Frames[n + i].Data_Length == Number_of_Blocks[i] * 16) ? 1 : 2);
+      }
+
+      //Block n of every frame that has one, the last block with subkey and padding
+      for(Block = 0; Block < Most; Block++)
+      {
+        Active = 0;
+        for(i = 0; i < Batch; i++)
+        {
+          if(Block >= Number_of_Blocks[i])
+          {
+            continue;
+          }
+
+          Data = &Frames[n + i].Data[Block * 16];
+          if(Block + 1 < Number_of_Blocks[i])
+          {
+            for(j = 0; j < 16; j++)
+            {
+              X[i][j] ^= Data[j];
+            }
+          }
+          else
+          {
+            Last_Block_Size = Frames[n + i].Data_Length - Block * 16;
+            for(j = 0; j < 16; j++)
+            {
+              X[i][j] ^= Subkey[i][j] ^ ((j < Last_Block_Size) ? Data[j] : (j == Last_Block_Size) ? 0x80 : 0x00);
+            }
+          }
+
+          Blocks[Active] = X[i];
+          Keys[Active] = Round_Keys[i];
+          Active++;
+        }
+        AES_Accel_Encrypt_Keys(Blocks, Keys, Active);
+      }
+
+      for(i = 0; i < Batch; i++)
+      {
+        memcpy(Frames[n + i].MIC, X[i], 4);
+      }
+    }
+    return;
+  }
+#endif
+
+  for(n = 0; n < Count; n++)
+  {
+    Crypto_Frame &Frame = Frames[n];
+
+    Calculate_MIC(Frame.Data, Frame.MIC, Frame.Data_Length, Frame.Frame_Counter, Frame.Direction, Frame.DevAddr, Frame.Key);
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function encrypts or decrypts FRMPayload of many frames. With hardware
+*               AES the A blocks of up to CRYPTO_BATCH_FRAMES frames are encrypted in
+*               one go, each with the key of its frame.
+*
+* Arguments   : *Frames  Data, Data_Length, Frame_Counter, Direction, DevAddr and the
+*                        AppSkey (NwkSkey for FPort 0) in Key, Data changed in place
+*               Count    number of frames
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::Encrypt_Payload_Batch(Crypto_Frame *Frames, unsigned int Count)
+{
+  unsigned int n;
+
+#ifdef LORAWAN_AES_ACCEL
+  unsigned char Round_Keys[CRYPTO_BATCH_FRAMES][AES_ACCEL_ROUND_KEYS];
+  unsigned char Keystream[CRYPTO_BATCH_FRAMES][16][16];
+  unsigned char *Blocks[CRYPTO_BATCH_FRAMES * 16];
+  const unsigned char *Keys[CRYPTO_BATCH_FRAMES * 16];
+  unsigned int Active;
+  unsigned char Batch;
+  unsigned char Number_of_Blocks;
+  unsigned char i;
+  unsigned char j;
+
+  if(_Accelerated)
+  {
+    for(n = 0; n < Count; n += Batch)
+    {
+      Batch = (Count - n < CRYPTO_BATCH_FRAMES) ? Count - n : CRYPTO_BATCH_FRAMES;
+      Active = 0;
+
+      for(i = 0; i < Batch; i++)
+      {
+        Crypto_Frame &Frame = Frames[n + i];
+
+        Number_of_Blocks = (Frame.Data_Length + 15) / 16;
+        if(Number_of_Blocks == 0)
+        {
+          continue;
+        }
+
+        AES_Accel_Expand_Key(Frame.Key, Round_Keys[i]);
+        for(j = 0; j < Number_of_Blocks; j++)
+        {
+          Frame_Block(Keystream[i][j], 0x01, j + 1, Frame.Frame_Counter, Frame.Direction, Frame.DevAddr);
+          Blocks[Active] = Keystream[i][j];
+          Keys[Active] = Round_Keys[i];
+          Active++;
+        }
+      }
+      AES_Accel_Encrypt_Keys(Blocks, Keys, Active);
+
+      for(i = 0; i < Batch; i++)
+      {
+        Crypto_Frame &Frame = Frames[n + i];
+
+        for(j = 0; j < Frame.Data_Length; j++)
+        {
+          Frame.Data[j] ^= Keystream[i][j >> 4][j & 0x0F];
+        }
+      }
+    }
+    return;
+  }
+#endif
+
+  for(n = 0; n < Count; n++)
+  {
+    Crypto_Frame &Frame = Frames[n];
+
+    Encrypt_Payload(Frame.Data, Frame.Data_Length, Frame.Frame_Counter, Frame.Direction, Frame.DevAddr, Frame.Key);
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function switches hardware AES on or off, for comparing the two
+*
+* Returns     : true if hardware AES is used now
+*****************************************************************************************
+*/
+bool LoRaWAN_Crypto::Set_Accelerated(bool Enable)
+{
+#ifdef LORAWAN_AES_ACCEL
+  _Accelerated = Enable && AES_Accel_Available();
+#endif
+  return _Accelerated;
+}
+
+const char *LoRaWAN_Crypto::Get_Backend()
+{
+#ifdef LORAWAN_AES_ACCEL
+  if(_Accelerated)
+  {
+    return AES_Accel_Name();
+  }
+#endif
+  return "portable";
+}
+
+/*
+*****************************************************************************************
+* Title         : AES_Add_Round_Key
+* Description :
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Add_Round_Key(unsigned char *Round_Key, unsigned char *State)
+{
+  unsigned char i;
+
+  for(i = 0; i < 16; i++)
+  {
+    State[i] ^= Round_Key[i];
+  }
+} // AES_Add_Round_Key
+
+
+/*
+*****************************************************************************************
+* Title         : AES_Sub_Byte
+* Description :
+*****************************************************************************************
+*/
+unsigned char LoRaWAN_Crypto::AES_Sub_Byte(unsigned char Byte)
+{
+  return pgm_read_byte(&(S_Table [((Byte >> 4) & 0x0F)] [((Byte >> 0) & 0x0F)]));
+} //    AES_Sub_Byte
+
+
+/*
+*****************************************************************************************
+* Title         : AES_Shift_Rows
+* Description : Row r of the state is State[r], State[r + 4], State[r + 8], State[r + 12]
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Shift_Rows(unsigned char *State)
+{
+  unsigned char Buffer;
+
+  //Store firt byte in buffer
+  Buffer    = State[1];
+  //Shift all bytes
+  State[1]  = State[5];
+  State[5]  = State[9];
+  State[9]  = State[13];
+  State[13] = Buffer;
+
+  Buffer    = State[2];
+  State[2]  = State[10];
+  State[10] = Buffer;
+  Buffer    = State[6];
+  State[6]  = State[14];
+  State[14] = Buffer;
+
+  Buffer    = State[15];
+  State[15] = State[11];
+  State[11] = State[7];
+  State[7]  = State[3];
+  State[3]  = Buffer;
+}   //  AES_Shift_Rows
+
+
+/*
+*****************************************************************************************
+* Title         : AES_Mix_Collums
+* Description :
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Mix_Collums(unsigned char *State)
+{
+  unsigned char Row,Collum;
+  unsigned char a[4], b[4];
+
+
+  for(Collum = 0; Collum < 16; Collum += 4)
+  {
+    for(Row = 0; Row < 4; Row++)
+    {
+      a[Row] =  State[Collum + Row];
+      b[Row] = (State[Collum + Row] << 1);
+
+      if((State[Collum + Row] & 0x80) == 0x80)
+      {
+        b[Row] ^= 0x1B;
+      }
+    }
+
+    State[Collum + 0] = b[0] ^ a[1] ^ b[1] ^ a[2] ^ a[3];
+    State[Collum + 1] = a[0] ^ b[1] ^ a[2] ^ b[2] ^ a[3];
+    State[Collum + 2] = a[0] ^ a[1] ^ b[2] ^ a[3] ^ b[3];
+    State[Collum + 3] = a[0] ^ b[0] ^ a[1] ^ a[2] ^ b[3];
+  }
+}   //  AES_Mix_Collums
+
+
+
+/*
+*****************************************************************************************
+* Title         : AES_Calculate_Round_Key
+* Description :
+*****************************************************************************************
+*/
+void LoRaWAN_Crypto::AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key)
+{
+  unsigned char i, j, b, Rcon;
+  unsigned char Temp[4];
+
+
+    //Calculate Rcon
+  Rcon = 0x01;
+  while(Round != 1)
+  {
+    b = Rcon & 0x80;
+    Rcon = Rcon << 1;
+
+    if(b == 0x80)
+    {
+      Rcon ^= 0x1b;
+    }
+    Round--;
+  }
+
+  //  Calculate first Temp
+  //  Copy laste byte from previous key and subsitute the byte, but shift the array contents around by 1.
+    Temp[0] = AES_Sub_Byte( Round_Key[12 + 1] );
+    Temp[1] = AES_Sub_Byte( Round_Key[12 + 2] );
+    Temp[2] = AES_Sub_Byte( Round_Key[12 + 3] );
+    Temp[3] = AES_Sub_Byte( Round_Key[12 + 0] );
+
+  //  XOR with Rcon
+  Temp[0] ^= Rcon;
+
+  //  Calculate new key
+  for(i = 0; i < 4; i++)
+  {
+    for(j = 0; j < 4; j++)
+    {
+      Round_Key[j + (i << 2)]  ^= Temp[j];
+      Temp[j]                   = Round_Key[j + (i << 2)];
+    }
+  }
+}   //  AES_Calculate_Round_Key
@@ -0,0 +1,107 @@
+/*
+  LoRaWAN_Crypto.h - AES-128, AES-CMAC and LoRaWAN payload encryption
+  Created by Leo Korbee, March 31, 2018.
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+  Thanks to all the folks who contributed before me on this code.
+
+  Keys and DevAddr are passed in, so the same code serves the node as well as
+  host tools working on many sessions. The output is the same with every AES:
+
+    node (CRYPTO_CONSTANT_TIME)  every keyed AES is the constant time bitsliced
+                                 AES (LoRaWAN_AES_Bitslice.h): payloads, MIC,
+                                 join accept and session keys
+    host with hardware AES       AES-NI / ARMv8 crypto (LoRaWAN_AES_Accel.h)
+    host without it              bitsliced AES for payloads of
+                                 CRYPTO_BITSLICE_BLOCKS blocks or more, the byte
+                                 wise AES with its S-box table for the rest. Not
+                                 constant time.
+*/
+
+#ifndef LoRaWAN_Crypto_h
+#define LoRaWAN_Crypto_h
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#else
+#include <string.h>
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+#endif
+
+#include <stdint.h>
+#include "LoRaWAN_AES_Accel.h"
+#include "LoRaWAN_AES_Bitslice.h"
+
+// A blocks of Encrypt_Payload encrypted at once
+#ifdef LORAWAN_AES_ACCEL
+#define CRYPTO_BATCH_BLOCKS AES_ACCEL_LANES
+#else
+#define CRYPTO_BATCH_BLOCKS 1
+#endif
+
+// the node never uses the S-box table with a key, host builds may ask for it too
+#if defined(ARDUINO) && !defined(CRYPTO_CONSTANT_TIME)
+#define CRYPTO_CONSTANT_TIME
+#endif
+
+// payloads of this many blocks or more use the bitsliced AES without hardware AES,
+// tuned on an x86 host. CRYPTO_CONSTANT_TIME uses it for every block.
+#ifndef CRYPTO_BITSLICE_BLOCKS
+#define CRYPTO_BITSLICE_BLOCKS 3
+#endif
+
+
+// frames of a batch processed together, larger batches are split
+#define CRYPTO_BATCH_FRAMES 16
+
+// one frame of Calculate_MIC_Batch and Encrypt_Payload_Batch
+struct Crypto_Frame
+{
+  unsigned char *Data;
+  unsigned char Data_Length;
+  unsigned int Frame_Counter;
+  unsigned char Direction;
+  unsigned char *DevAddr;
+  unsigned char *Key;
+  // result of Calculate_MIC_Batch
+  unsigned char MIC[4];
+};
+
+// AES S-box, defined once in LoRaWAN_Crypto.cpp and kept in flash
+extern const unsigned char PROGMEM S_Table[16][16];
+
+
+class LoRaWAN_Crypto
+{
+  public:
+    void Encrypt_Payload(unsigned char *Data, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr, unsigned char *Key);
+    void Calculate_MIC(unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr, unsigned char *Key);
+    void Calculate_CMAC(unsigned char *Block_B0, unsigned char *Data, unsigned char *Final_MIC, unsigned char Data_Length, unsigned char *Key);
+    void AES_Encrypt(unsigned char *Data, unsigned char *Key);
+    void AES_Encrypt_Blocks(unsigned char *Data, unsigned char Blocks, unsigned char *Key);
+    // frames of different sessions, interleaved with hardware AES
+    void Calculate_MIC_Batch(Crypto_Frame *Frames, unsigned int Count);
+    void Encrypt_Payload_Batch(Crypto_Frame *Frames, unsigned int Count);
+    // hardware AES on the host, returns false if there is none
+    static bool Set_Accelerated(bool Enable);
+    static const char *Get_Backend();
+
+  private:
+    static bool _Accelerated;
+
+    void XOR_Keystream(unsigned char *Data, unsigned char Data_Length, unsigned char *Block_A, unsigned char *Key);
+    void XOR_Keystream_Bitslice(unsigned char *Data, unsigned char Data_Length, unsigned char *Block_A, unsigned char *Key);
+    static void Frame_Block(unsigned char *Block, unsigned char First, unsigned char Last, unsigned int Frame_Counter, unsigned char Direction, unsigned char *DevAddr);
+    void Generate_Subkey(unsigned char *Subkey, unsigned char Number, unsigned char *Key);
+    void Derive_Subkey(unsigned char *Subkey, unsigned char Number);
+    void Shift_Left(unsigned char *Data);
+    void AES_Add_Round_Key(unsigned char *Round_Key, unsigned char *State);
+    unsigned char AES_Sub_Byte(unsigned char Byte);
+    void AES_Shift_Rows(unsigned char *State);
+    void AES_Mix_Collums(unsigned char *State);
+    void AES_Calculate_Round_Key(unsigned char Round, unsigned char *Round_Key);
+};
+
+
+#endif
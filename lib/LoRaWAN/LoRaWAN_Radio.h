@@ -0,0 +1,92 @@
+/*
+  LoRaWAN_Radio.h - What the LoRaWAN MAC needs from a radio driver
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  LoRaWAN<Radio> calls the driver directly, there is no virtual base class. Any
+  class with these members can be used, RFM95 (SX1276) is the reference:
+
+    configure
+      void RFM_Set_Tx_Power(signed char Power)        output power in dBm
+      signed char RFM_Get_Tx_Power()
+      void RFM_Set_Datarate(unsigned char Datarate)   EU863-870 DR0 .. DR7
+      unsigned char RFM_Get_Datarate()
+      void RFM_Set_Rx2_Datarate(unsigned char Datarate)
+      unsigned char RFM_Get_Rx2_Datarate()
+      void RFM_Set_Rx1_Offset(unsigned char Offset)   RX1 data rate = uplink DR - Offset
+      unsigned char RFM_Get_Rx1_Offset()
+      ChannelSelector &RFM_Channels()                 uplink channel selection
+      unsigned char RFM_Get_Channel()                 channel of the last uplink
+
+    load FIFO, transmit and go to sleep
+      bool RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+        returns false when the package was not sent (e.g. listen before talk)
+
+    receive and go to sleep
+      unsigned char RFM_Receive_Window(unsigned char *RFM_Rx_Package, unsigned char Max_Length,
+                                       unsigned long Delay, unsigned char Window)
+        Delay is in ms after the end of the last uplink, Window is 1 or 2,
+        returns the length received or 0
+      signed char RFM_Get_Snr()                       SNR in dB of the last package received
+
+    class C, only needed when setClassC is used
+      void RFM_Start_Continuous_Rx()                  receive on RX2 until the next uplink
+      void RFM_Stop_Continuous_Rx()
+      unsigned char RFM_Get_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length)
+        oldest package received meanwhile, 0 when there is none
+
+    scheduled uplinks, only needed when Start_Data is used
+      bool RFM_Start_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+        like RFM_Send_Package, returns while the package is on air
+      unsigned long RFM_Tx_Wait()                     ms until TxDone, 0 when sent
+      signed long RFM_Window_Wait(unsigned long Delay, unsigned char Window)
+        us until the receiver has to be started for the window
+      unsigned long RFM_Open_Window(unsigned long Delay, unsigned char Window)
+        starts the receiver, returns the ms until it times out
+      unsigned long RFM_Rx_Wait(unsigned char *RFM_Rx_Package, unsigned char Max_Length,
+                                unsigned char *Length)
+        ms until the window is over, 0 when closed and *Length is known
+
+  Reset, init and resume stay with the application, they differ too much
+  between chips (SX127x registers vs. SX126x commands).
+*/
+
+#ifndef LoRaWAN_Radio_h
+#define LoRaWAN_Radio_h
+
+#include <type_traits>
+#include <utility>
+#include "ChannelSelector.h"
+
+template <class...> struct LoRaWAN_Void
+{
+  typedef void type;
+};
+
+template <class Radio, class = void>
+struct LoRaWAN_Is_Radio : std::false_type
+{
+};
+
+template <class Radio>
+struct LoRaWAN_Is_Radio<Radio, typename LoRaWAN_Void<
+  decltype(std::declval<Radio &>().RFM_Set_Tx_Power((signed char)0)),
+  decltype(std::declval<Radio &>().RFM_Get_Tx_Power()),
+  decltype(std::declval<Radio &>().RFM_Set_Datarate((unsigned char)0)),
+  decltype(std::declval<Radio &>().RFM_Get_Datarate()),
+  decltype(std::declval<Radio &>().RFM_Set_Rx2_Datarate((unsigned char)0)),
+  decltype(std::declval<Radio &>().RFM_Get_Rx2_Datarate()),
+  decltype(std::declval<Radio &>().RFM_Set_Rx1_Offset((unsigned char)0)),
+  decltype(std::declval<Radio &>().RFM_Get_Rx1_Offset()),
+  decltype(std::declval<Radio &>().RFM_Get_Channel()),
+  decltype(std::declval<Radio &>().RFM_Receive_Window((unsigned char *)0, (unsigned char)0, 0UL, (unsigned char)0)),
+  decltype(std::declval<Radio &>().RFM_Get_Snr()),
+  decltype(std::declval<Radio &>().RFM_Send_Package((unsigned char *)0, (unsigned char)0)),
+  decltype(std::declval<Radio &>().RFM_Channels())
+  >::type> : std::integral_constant<bool,
+    std::is_same<decltype(std::declval<Radio &>().RFM_Send_Package((unsigned char *)0, (unsigned char)0)), bool>::value &&
+    std::is_same<decltype(std::declval<Radio &>().RFM_Channels()), ChannelSelector &>::value>
+{
+};
+
+#endif
@@ -0,0 +1,130 @@
+/*
+  MemoryMonitor.cpp - Stack high water mark and RAM map
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include <unistd.h>
+#endif
+
+#include <string.h>
+
+#include "MemoryMonitor.h"
+
+#ifdef ARDUINO
+// linker symbols of the STM32 core (ldscript.ld)
+extern "C" char _sdata, _edata, _sbss, _ebss, _estack;
+// start of RAM, the F103 has it at 0x20000000
+#define MEMORY_RAM_START ((unsigned char *)0x20000000UL)
+#endif
+
+// constructor
+MemoryMonitor::MemoryMonitor()
+{
+  _Low = 0;
+  _High = 0;
+  _Stack_Top = 0;
+}
+
+#ifdef ARDUINO
+/*
+*****************************************************************************************
+* Description : Function paints the free RAM between heap and stack, call it first
+*               thing in setup()
+*****************************************************************************************
+*/
+void MemoryMonitor::Paint()
+{
+  unsigned char Marker;
+
+  Paint((unsigned char *)sbrk(0) + MEMORY_HEAP_RESERVE, &Marker - MEMORY_STACK_RESERVE);
+  _Stack_Top = (unsigned char *)&_estack;
+}
+#endif
+
+/*
+*****************************************************************************************
+* Description : Function paints a region the stack will grow down into
+*
+* Arguments   : *Low    lowest address to paint
+*               *High   end of the region, also the top of the stack when it was not
+*                       set by Paint() on the STM32
+*****************************************************************************************
+*/
+void MemoryMonitor::Paint(unsigned char *Low, unsigned char *High)
+{
+  _Low = Low;
+  _High = High;
+  _Stack_Top = High;
+
+  if(High > Low)
+  {
+    memset(Low, MEMORY_PAINT, High - Low);
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the deepest stack use since Paint() in bytes
+*****************************************************************************************
+*/
+unsigned long MemoryMonitor::Get_Stack_High_Water()
+{
+  if(_High <= _Low)
+  {
+    return 0;
+  }
+  return _Stack_Top - Lowest_Used();
+}
+
+/*
+*****************************************************************************************
+* Description : Function fills in the RAM map. Data, bss, heap and total are 0 on the
+*               host.
+*****************************************************************************************
+*/
+void MemoryMonitor::Get_Map(Memory_Map *Map)
+{
+  memset(Map, 0, sizeof(Memory_Map));
+
+#ifdef ARDUINO
+  Map->Data = &_edata - &_sdata;
+  Map->Bss = &_ebss - &_sbss;
+  Map->Heap = (unsigned char *)sbrk(0) - (unsigned char *)&_ebss;
+  Map->Total = (unsigned char *)&_estack - MEMORY_RAM_START;
+#endif
+
+  if(_High > _Low)
+  {
+    Map->Stack = Get_Stack_High_Water();
+    Map->Stack_Free = Lowest_Used() - _Low;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function scans up from the bottom of the painted region for the first
+*               byte that lost the pattern
+*****************************************************************************************
+*/
+unsigned char *MemoryMonitor::Lowest_Used()
+{
+  unsigned char *Address = _Low;
+
+#ifdef ARDUINO
+  //The heap may have grown into the paint
+  unsigned char *Heap_End = (unsigned char *)sbrk(0);
+  if(Heap_End > Address)
+  {
+    Address = Heap_End;
+  }
+#endif
+
+  while(Address < _High && *Address == MEMORY_PAINT)
+  {
+    Address++;
+  }
+  return Address;
+}
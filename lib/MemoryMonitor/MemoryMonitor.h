@@ -0,0 +1,59 @@
+/*
+  MemoryMonitor.h - Stack high water mark and RAM map
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Paint() fills the unused RAM between heap and stack with a pattern early at
+  boot. The stack grows down into it, the lowest address that lost the pattern is
+  the deepest the stack has been since. MEMORY_HEAP_RESERVE bytes above the heap
+  are left unpainted, so a growing heap is not mistaken for stack.
+
+  On the STM32 the RAM map comes from the linker symbols of the Arduino core.
+  Host builds paint a buffer passed in, used as the stack of a thread, see
+  host/src/memory.
+*/
+
+#ifndef MemoryMonitor_h
+#define MemoryMonitor_h
+
+#include <stdint.h>
+
+#define MEMORY_PAINT 0xA5
+// unpainted room for the heap to grow into
+#define MEMORY_HEAP_RESERVE 256
+// unpainted room below the stack pointer of Paint()
+#define MEMORY_STACK_RESERVE 64
+
+struct Memory_Map
+{
+  // sizes in bytes
+  unsigned long Data;
+  unsigned long Bss;
+  unsigned long Heap;
+  // deepest stack since Paint()
+  unsigned long Stack;
+  // painted RAM the stack never reached
+  unsigned long Stack_Free;
+  unsigned long Total;
+};
+
+class MemoryMonitor
+{
+  public:
+    MemoryMonitor();
+#ifdef ARDUINO
+    void Paint();
+#endif
+    void Paint(unsigned char *Low, unsigned char *High);
+    unsigned long Get_Stack_High_Water();
+    void Get_Map(Memory_Map *Map);
+
+  private:
+    unsigned char *_Low;
+    unsigned char *_High;
+    unsigned char *_Stack_Top;
+
+    unsigned char *Lowest_Used();
+};
+
+#endif
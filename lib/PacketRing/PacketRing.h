@@ -0,0 +1,85 @@
+/*
+  PacketRing.h - Single producer, single consumer ring of received packages
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  The receive interrupt is the producer: it takes a free slot, reads the FIFO
+  straight into it and commits it. The main loop is the consumer. Each index is
+  written by one side only, so neither side has to lock out the other; the
+  barrier keeps the slot contents ahead of the index that publishes them.
+*/
+
+#ifndef PacketRing_h
+#define PacketRing_h
+
+// power of two
+#define PACKET_RING_SLOTS 4
+#define PACKET_RING_SIZE 64
+
+struct Rx_Package
+{
+  unsigned char Data[PACKET_RING_SIZE];
+  unsigned char Length;
+  signed short Rssi;
+  signed char Snr;
+};
+
+class PacketRing
+{
+  public:
+    PacketRing()
+    {
+      _Head = 0;
+      _Tail = 0;
+      _Dropped = 0;
+    }
+
+    // producer: free slot or 0 when full, the package is counted as dropped
+    Rx_Package *Slot()
+    {
+      if((unsigned char)(_Head - _Tail) >= PACKET_RING_SLOTS)
+      {
+        _Dropped++;
+        return 0;
+      }
+      return &_Slots[_Head & (PACKET_RING_SLOTS - 1)];
+    }
+
+    // producer: publish the slot returned by Slot()
+    void Push()
+    {
+      __sync_synchronize();
+      _Head = _Head + 1;
+    }
+
+    // consumer: oldest package or 0
+    Rx_Package *Front()
+    {
+      if(_Head == _Tail)
+      {
+        return 0;
+      }
+      __sync_synchronize();
+      return &_Slots[_Tail & (PACKET_RING_SLOTS - 1)];
+    }
+
+    // consumer: release the package returned by Front()
+    void Pop()
+    {
+      __sync_synchronize();
+      _Tail = _Tail + 1;
+    }
+
+    unsigned int Get_Dropped()
+    {
+      return _Dropped;
+    }
+
+  private:
+    Rx_Package _Slots[PACKET_RING_SLOTS];
+    volatile unsigned char _Head;
+    volatile unsigned char _Tail;
+    volatile unsigned int _Dropped;
+};
+
+#endif
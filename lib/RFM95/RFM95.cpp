@@ -9,14 +9,220 @@
 
 #include "Arduino.h"
 #include "RFM95.h"
+#include "SX1276.h"
 #include <SPI.h>
 
+// Registers that keep their value from init() on, everything else is written
+// again for each package. Mirrored in RAM so a warm resume can check them.
+static constexpr unsigned char RFM_Config_Address[RFM_CONFIG_SIZE] = {
+  0x09, 0x4D, 0x0B, // PA config, PA DAC, OCP
+  0x1F, 0x20, 0x21, // Rx timeout, preamble length
+  0x39,             // sync word
+  0x0E, 0x0F        // FIFO TX and RX base address
+};
+
+#define RFM_FRF_BYTES(Frequency) { (unsigned char)(SX1276_Frf(Frequency) >> 16), \
+  (unsigned char)(SX1276_Frf(Frequency) >> 8), (unsigned char)SX1276_Frf(Frequency) }
+
+// EU863-870 uplink channels 0 .. 7, RegFrf msb first
+static const unsigned char RFM_Channel_Frf[8][3] = {
+  RFM_FRF_BYTES(868100000), RFM_FRF_BYTES(868300000), RFM_FRF_BYTES(868500000),
+  RFM_FRF_BYTES(867100000), RFM_FRF_BYTES(867300000), RFM_FRF_BYTES(867500000),
+  RFM_FRF_BYTES(867700000), RFM_FRF_BYTES(867900000)
+};
+// RX2 downlinks
+static const unsigned char RFM_Rx2_Frf[3] = RFM_FRF_BYTES(869525000);
+
+// Configuration written by init(): channel 0 at DR2 (SF10 BW125), coding rate 4/5,
+// explicit header, payload CRC, Rx timeout 37 symbols, preamble 8 symbols, LoRaWAN
+// sync word, normal IQ, TX FIFO in the upper half
+static constexpr SX1276_Setting RFM_Init_Settings[] = {
+  { SX1276_Frf_Msb, (unsigned char)(SX1276_Frf(868100000) >> 16) },
+  { SX1276_Frf_Mid, (unsigned char)(SX1276_Frf(868100000) >> 8) },
+  { SX1276_Frf_Lsb, (unsigned char)SX1276_Frf(868100000) },
+  { SX1276_Bandwidth, SX1276_BW_125 },
+  { SX1276_Coding_Rate, 1 },
+  { SX1276_Implicit_Header, 0 },
+  { SX1276_Spreading_Factor, 10 },
+  { SX1276_Rx_Payload_Crc, 1 },
+  { SX1276_Symb_Timeout_Msb, 0 },
+  { SX1276_Symb_Timeout_Lsb, 37 },
+  { SX1276_Preamble_Msb, 0 },
+  { SX1276_Preamble_Lsb, 8 },
+  { SX1276_Low_Data_Rate_Optimize, 0 },
+  { SX1276_Agc_Auto_On, 1 },
+  { SX1276_Sync_Word, 0x34 },
+  { SX1276_Invert_IQ_Rx, 0 },
+  { SX1276_Invert_IQ_Tx_Off, 1 },
+  { SX1276_Invert_IQ2, 0x1D },
+  { SX1276_Fifo_Tx_Base, 0x80 },
+  { SX1276_Fifo_Rx_Base, 0x00 }
+};
+static constexpr SX1276_Image RFM_Init_Image = SX1276_Build(RFM_Init_Settings);
+static_assert(SX1276_LoRa_Valid(RFM_Init_Image), "RFM_Init_Settings is not a valid LoRa configuration");
+static const SX1276_Sequence<SX1276_Sequence_Size(RFM_Init_Image)> RFM_Init_Sequence =
+  SX1276_Encode<SX1276_Sequence_Size(RFM_Init_Image)>(RFM_Init_Image);
+
+// RAM copy of the configuration registers after init(), PA registers follow with the power
+static const unsigned char RFM_Init_Config[RFM_CONFIG_SIZE] = {
+  RFM_Init_Image.Value[RFM_Config_Address[0]], RFM_Init_Image.Value[RFM_Config_Address[1]],
+  RFM_Init_Image.Value[RFM_Config_Address[2]], RFM_Init_Image.Value[RFM_Config_Address[3]],
+  RFM_Init_Image.Value[RFM_Config_Address[4]], RFM_Init_Image.Value[RFM_Config_Address[5]],
+  RFM_Init_Image.Value[RFM_Config_Address[6]], RFM_Init_Image.Value[RFM_Config_Address[7]],
+  RFM_Init_Image.Value[RFM_Config_Address[8]]
+};
+
+// LoRa modem of a data rate, coding rate 4/5, explicit header, payload CRC
+constexpr SX1276_Image RFM_Modem(unsigned char SF, unsigned char Bandwidth, unsigned char Low_Data_Rate)
+{
+  const SX1276_Setting Settings[] = {
+    { SX1276_Bandwidth, Bandwidth },
+    { SX1276_Coding_Rate, 1 },
+    { SX1276_Implicit_Header, 0 },
+    { SX1276_Spreading_Factor, SF },
+    { SX1276_Rx_Payload_Crc, 1 },
+    { SX1276_Symb_Timeout_Msb, 0 },
+    { SX1276_Low_Data_Rate_Optimize, Low_Data_Rate },
+    { SX1276_Agc_Auto_On, 1 }
+  };
+  return SX1276_Build(Settings);
+}
+
+// EU863-870 DR0 .. DR5 = SF12 .. SF7 BW125, DR6 = SF7 BW250
+static constexpr SX1276_Image RFM_DR0 = RFM_Modem(12, SX1276_BW_125, 1);
+static constexpr SX1276_Image RFM_DR1 = RFM_Modem(11, SX1276_BW_125, 1);
+static constexpr SX1276_Image RFM_DR2 = RFM_Modem(10, SX1276_BW_125, 0);
+static constexpr SX1276_Image RFM_DR3 = RFM_Modem(9, SX1276_BW_125, 0);
+static constexpr SX1276_Image RFM_DR4 = RFM_Modem(8, SX1276_BW_125, 0);
+static constexpr SX1276_Image RFM_DR5 = RFM_Modem(7, SX1276_BW_125, 0);
+static constexpr SX1276_Image RFM_DR6 = RFM_Modem(7, SX1276_BW_250, 0);
+static_assert(SX1276_LoRa_Valid(RFM_DR0) && SX1276_LoRa_Valid(RFM_DR1) && SX1276_LoRa_Valid(RFM_DR2) &&
+  SX1276_LoRa_Valid(RFM_DR3) && SX1276_LoRa_Valid(RFM_DR4) && SX1276_LoRa_Valid(RFM_DR5) &&
+  SX1276_LoRa_Valid(RFM_DR6), "LoRa data rate table is not a valid modem configuration");
+
+#define RFM_MODEM_BYTES(Image) { Image.Value[0x1D], Image.Value[0x1E], Image.Value[0x26] }
+
+// RegModemConfig1, 2 and 3 of DR0 .. DR6
+static const unsigned char RFM_Modem_Config[7][3] = {
+  RFM_MODEM_BYTES(RFM_DR0), RFM_MODEM_BYTES(RFM_DR1), RFM_MODEM_BYTES(RFM_DR2), RFM_MODEM_BYTES(RFM_DR3),
+  RFM_MODEM_BYTES(RFM_DR4), RFM_MODEM_BYTES(RFM_DR5), RFM_MODEM_BYTES(RFM_DR6)
+};
+
+// Uplink: normal IQ, DIO0 on TxDone
+static constexpr SX1276_Setting RFM_Tx_Settings[] = {
+  { SX1276_Invert_IQ_Rx, 0 },
+  { SX1276_Invert_IQ_Tx_Off, 1 },
+  { SX1276_Invert_IQ2, 0x1D },
+  { SX1276_Dio0_Mapping, SX1276_DIO0_TX_DONE }
+};
+static constexpr SX1276_Image RFM_Tx_Image = SX1276_Build(RFM_Tx_Settings);
+static_assert(RFM_Tx_Image.Valid, "RFM_Tx_Settings");
+static const SX1276_Sequence<SX1276_Sequence_Size(RFM_Tx_Image)> RFM_Tx_Sequence =
+  SX1276_Encode<SX1276_Sequence_Size(RFM_Tx_Image)>(RFM_Tx_Image);
+
+// Downlink: inverted IQ on the receiver, DIO0 on RxDone
+static constexpr SX1276_Setting RFM_Rx_Settings[] = {
+  { SX1276_Invert_IQ_Rx, 1 },
+  { SX1276_Invert_IQ_Tx_Off, 1 },
+  { SX1276_Invert_IQ2, 0x19 },
+  { SX1276_Dio0_Mapping, SX1276_DIO0_RX_DONE }
+};
+static constexpr SX1276_Image RFM_Rx_Image = SX1276_Build(RFM_Rx_Settings);
+static_assert(RFM_Rx_Image.Valid, "RFM_Rx_Settings");
+static const SX1276_Sequence<SX1276_Sequence_Size(RFM_Rx_Image)> RFM_Rx_Sequence =
+  SX1276_Encode<SX1276_Sequence_Size(RFM_Rx_Image)>(RFM_Rx_Image);
+
+// CAD: DIO0 on CadDone, DIO1 on CadDetected
+static constexpr SX1276_Setting RFM_Cad_Settings[] = {
+  { SX1276_Dio0_Mapping, SX1276_DIO0_CAD_DONE },
+  { SX1276_Dio1_Mapping, SX1276_DIO1_CAD_DETECTED }
+};
+static constexpr SX1276_Image RFM_Cad_Image = SX1276_Build(RFM_Cad_Settings);
+static_assert(RFM_Cad_Image.Valid, "RFM_Cad_Settings");
+
+// DR7, written in the FSK bank: channel 868.800 MHz, 50 kbps, deviation 25 kHz, GFSK
+// BT 1.0, PA ramp 40 us, 5 byte preamble, sync word C1 94 C1, variable length packet
+// with whitening and CRC-16, sent as soon as the FIFO is not empty, DIO0 on PacketSent
+static constexpr SX1276_Setting RFM_FSK_Settings[] = {
+  { SX1276_Fsk_Bitrate_Msb, (unsigned char)((SX1276_FXOSC / 50000) >> 8) },
+  { SX1276_Fsk_Bitrate_Lsb, (unsigned char)(SX1276_FXOSC / 50000) },
+  //Same 61 Hz step as the carrier
+  { SX1276_Fsk_Fdev_Msb, (unsigned char)(SX1276_Frf(25000) >> 8) },
+  { SX1276_Fsk_Fdev_Lsb, (unsigned char)SX1276_Frf(25000) },
+  { SX1276_Frf_Msb, (unsigned char)(SX1276_Frf(868800000) >> 16) },
+  { SX1276_Frf_Mid, (unsigned char)(SX1276_Frf(868800000) >> 8) },
+  { SX1276_Frf_Lsb, (unsigned char)SX1276_Frf(868800000) },
+  { SX1276_Fsk_Modulation_Shaping, SX1276_FSK_BT_1_0 },
+  { SX1276_Fsk_Pa_Ramp, SX1276_FSK_RAMP_40_US },
+  { SX1276_Fsk_Preamble_Msb, 0 },
+  { SX1276_Fsk_Preamble_Lsb, 5 },
+  { SX1276_Fsk_Sync_On, 1 },
+  { SX1276_Fsk_Sync_Size, 3 - 1 },
+  { SX1276_Fsk_Sync_Value1, 0xC1 },
+  { SX1276_Fsk_Sync_Value2, 0x94 },
+  { SX1276_Fsk_Sync_Value3, 0xC1 },
+  { SX1276_Fsk_Variable_Length, 1 },
+  { SX1276_Fsk_Dc_Free, SX1276_FSK_WHITENING },
+  { SX1276_Fsk_Crc_On, 1 },
+  { SX1276_Fsk_Packet_Mode, 1 },
+  { SX1276_Fsk_Payload_Length, 64 },
+  { SX1276_Fsk_Tx_Start_Condition, 1 },
+  { SX1276_Fsk_Fifo_Threshold, 0x3F },
+  { SX1276_Dio0_Mapping, SX1276_DIO0_PACKET_SENT }
+};
+static constexpr SX1276_Image RFM_FSK_Image = SX1276_Build(RFM_FSK_Settings);
+static_assert(RFM_FSK_Image.Valid, "RFM_FSK_Settings");
+static const SX1276_Sequence<SX1276_Sequence_Size(RFM_FSK_Image)> RFM_FSK_Sequence =
+  SX1276_Encode<SX1276_Sequence_Size(RFM_FSK_Image)>(RFM_FSK_Image);
+
+// radio in continuous receive or waiting for DIO0 of an uplink, for the interrupt handlers
+RFM95 *RFM95::_Rx_Radio = 0;
+
+#ifdef ARDUINO_ARCH_STM32
+// free running at 1 MHz, channel 2 captures the rising edges of DIO0 on PA1
+static TIM_HandleTypeDef RFM_Capture_Tim;
+#endif
+
 // constructor
 RFM95::RFM95(int DIO0, int NSS)
 {
   _DIO0 = DIO0;
   _NSS = NSS;
 
+  // RFM95W only has PA_BOOST connected, start at maximum power like before
+  _Tx_Power = 17;
+  _PA_Boost = true;
+
+  _Current_Channel = 0;
+  // SF10 BW125
+  _Datarate = 2;
+  _Rx2_Datarate = 0;
+  _Rx1_Offset = 0;
+  _Tx_Done_Time = 0;
+  _Tx_Busy = false;
+  _Tx_Start = 0;
+  _Tx_Airtime = 0;
+  _Rx_Window = 0;
+  _Rx_Delay = 0;
+  _Rx_Start = 0;
+  _Done_Seen = false;
+  _Done_Time = 0;
+  _Done_Callback = 0;
+  _Capture = false;
+  _Rssi = 0;
+  _Snr = 0;
+  _LBT_Enabled = false;
+  _LBT_Retries = 2;
+  _Cad_Count = 0;
+  memset(_Cad_Busy, 0, sizeof(_Cad_Busy));
+
+  memset(_Config, 0, sizeof(_Config));
+  _Config_Hash = 0;
+
+  _Rx_Continuous = false;
+  _Rx_Callback = 0;
+  _Modem_Valid = false;
+
   _spi.begin();
   _spi.setDataMode(SPI_MODE0);
   _spi.setBitOrder(MSBFIRST);
@@ -31,6 +237,8 @@ RFM95::RFM95(int DIO0, int NSS)
 */
 void RFM95::init()
 {
+  RFM_Stop_Continuous_Rx();
+
   // set pinmodes input/output
   pinMode(_NSS, OUTPUT);
   pinMode(_DIO0, INPUT);
@@ -38,12 +246,19 @@ void RFM95::init()
   // NSS for starting and stopping communication with the RFM95 module
   digitalWrite(_NSS, HIGH);
 
+  // TxDone and RxDone timestamps for the receive window timing
+  RFM_Start_Capture();
+
   //Switch RFM to sleep
   RFM_Write(0x01,0x00);
 
   //Set RFM in LoRa mode
   RFM_Write(0x01,0x80);
 
+  //Seed the channel selection from wideband RSSI noise so nodes don't pick
+  //the same sequence of channels
+  RFM_Seed_Channels();
+
   //Set RFM in Standby mode wait on mode ready
   RFM_Write(0x01,0x81);
   /*
@@ -53,47 +268,168 @@ void RFM95::init()
   */
   delay(10);
 
-  //Set carrair frequency
-  // 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
-  RFM_Write(0x06,0xD9);
-  RFM_Write(0x07,0x06);
-  RFM_Write(0x08,0x8B);
+  //Carrier, modem, Rx timeout, preamble, sync word, IQ and FIFO base addresses,
+  //see RFM_Init_Settings. Seven bursts instead of fifteen single writes.
+  RFM_Write_Sequence(RFM_Init_Sequence.Data);
+  memcpy(_Config, RFM_Init_Config, sizeof(_Config));
+  _Config_Hash = RFM_Config_Hash();
+  memcpy(_Modem, RFM_Modem_Config[2], sizeof(_Modem));
+  _Modem_Valid = true;
+
+  //PA output, PA DAC and over current protection
+  RFM_Set_Tx_Power(_Tx_Power, _PA_Boost);
+
+  //Switch RFM to sleep
+  RFM_Write(0x01,0x00);
+}
+
+
+/*
+*****************************************************************************************
+* Description: Function used after the MCU woke up from deep sleep, instead of a reset
+*              and init(). The RFM keeps its registers in sleep mode, so normally a few
+*              register reads are enough to confirm it is still configured:
+*              - RegVersion must read 0x12, otherwise the chip does not respond
+*              - the RAM copy of the configuration must match its hash, otherwise
+*                it can not be trusted and the RFM is fully initialized again
+*              - sync word, Rx timeout and PA config are compared with the RAM copy,
+*                when they all match nothing is written at all
+*              - otherwise all configuration registers are compared and only the
+*                ones that differ are written again
+*              The RFM is put to sleep first, whatever mode it was found in, and is
+*              left in LoRa standby ready for the next package.
+*
+* Returns    : false when the RFM does not respond, it needs a reset pulse and init()
+*****************************************************************************************
+*/
+bool RFM95::resume()
+{
+  unsigned char i;
+  unsigned char Value;
+
+  //The checks below use SPI, the receive interrupt must not
+  RFM_Stop_Continuous_Rx();
+
+  //Silicon revision of the SX1276
+  if(RFM_Read(0x42) != 0x12)
+  {
+    return false;
+  }
 
-  //PA pin (maximal power)
-  RFM_Write(0x09,0xFF);
+  //RAM copy damaged or never written
+  if(_Config_Hash == 0 || _Config_Hash != RFM_Config_Hash())
+  {
+    init();
+    return true;
+  }
 
-  //BW = 125 kHz, Coding rate 4/5, Explicit header mode
-  RFM_Write(0x1D,0x72);
+  //LongRangeMode only changes in sleep, a write in any other mode is ignored. So
+  //sleep in the bank the RFM is in first, and wait until it got there.
+  Value = RFM_Read(0x01);
+  RFM_Write(0x01,Value & 0x80);
+  for(i = 0; i < 100 && (RFM_Read(0x01) & 0x07) != 0; i++)
+  {
+    delayMicroseconds(10);
+  }
 
-  //Spreading factor 10, PayloadCRC On
-  RFM_Write(0x1E,0xA4);
+  //LoRa sleep, makes the LoRa register bank accessible again after FSK sleep
+  RFM_Write(0x01,0x80);
 
-  //Rx Timeout set to 37 symbols
-  RFM_Write(0x1F,0x25);
+  //Signature, these differ from the reset defaults
+  if(RFM_Read(0x39) == RFM_Config_Value(0x39) &&
+     RFM_Read(0x1F) == RFM_Config_Value(0x1F) &&
+     RFM_Read(0x09) == RFM_Config_Value(0x09))
+  {
+    //Standby
+    RFM_Write(0x01,0x81);
+    return true;
+  }
 
-  //Preamble length set to 8 symbols
-  //0x0008 + 4 = 12
-  RFM_Write(0x20,0x00);
-  RFM_Write(0x21,0x08);
+  //Delta reconfiguration, the modem registers are not trusted either
+  _Modem_Valid = false;
+  for(i = 0; i < RFM_CONFIG_SIZE; i++)
+  {
+    Value = RFM_Read(RFM_Config_Address[i]);
+    if(Value != _Config[i])
+    {
+      RFM_Write(RFM_Config_Address[i],_Config[i]);
+    }
+  }
 
-  //Low datarate optimization off AGC auto on
-  RFM_Write(0x26,0x0C);
+  //Standby
+  RFM_Write(0x01,0x81);
 
-  //Set LoRa sync word
-  RFM_Write(0x39,0x34);
+  return true;
+}
 
-  //Set IQ to normal values
-  RFM_Write(0x33,0x27);
-  RFM_Write(0x3B,0x1D);
+/*
+*****************************************************************************************
+* Description : Function that writes a configuration register and keeps a copy of it
+*               in RAM for resume()
+*
+* Arguments   : RFM_Address Address of register to be written, one of RFM_Config_Address
+*         RFM_Data    Data to be written
+*****************************************************************************************
+*/
 
-  //Set FIFO pointers
-  //TX base adress
-  RFM_Write(0x0E,0x80);
-  //Rx base adress
-  RFM_Write(0x0F,0x00);
+void RFM95::RFM_Write_Config(unsigned char RFM_Address, unsigned char RFM_Data)
+{
+  unsigned char i;
 
-  //Switch RFM to sleep
-  RFM_Write(0x01,0x00);
+  for(i = 0; i < RFM_CONFIG_SIZE; i++)
+  {
+    if(RFM_Config_Address[i] == RFM_Address)
+    {
+      _Config[i] = RFM_Data;
+      break;
+    }
+  }
+
+  RFM_Write(RFM_Address,RFM_Data);
+
+  _Config_Hash = RFM_Config_Hash();
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the RAM copy of a configuration register
+*****************************************************************************************
+*/
+
+unsigned char RFM95::RFM_Config_Value(unsigned char RFM_Address)
+{
+  unsigned char i;
+
+  for(i = 0; i < RFM_CONFIG_SIZE; i++)
+  {
+    if(RFM_Config_Address[i] == RFM_Address)
+    {
+      return _Config[i];
+    }
+  }
+  return 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that calculates a FNV-1a hash over the RAM copy of the
+*               configuration. Never returns 0, which marks "not configured".
+*****************************************************************************************
+*/
+
+unsigned long RFM95::RFM_Config_Hash()
+{
+  unsigned char i;
+  unsigned long Hash = 2166136261UL;
+
+  for(i = 0; i < RFM_CONFIG_SIZE; i++)
+  {
+    Hash ^= _Config[i];
+    Hash *= 16777619UL;
+  }
+  Hash &= 0xFFFFFFFFUL;
+
+  return Hash ? Hash : 1;
 }
 
 
@@ -120,6 +456,44 @@ void RFM95::RFM_Write(unsigned char RFM_Address, unsigned char RFM_Data)
   digitalWrite(_NSS,HIGH);
 }
 
+/*
+*****************************************************************************************
+* Description : Function that writes Length registers from RFM_Address on in one SPI
+*               transaction, the address increments after every byte
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Write_Burst(unsigned char RFM_Address, const unsigned char *RFM_Data, unsigned char Length)
+{
+  unsigned char i;
+
+  digitalWrite(_NSS,LOW);
+
+  _spi.transfer(RFM_Address | 0x80);
+  for(i = 0; i < Length; i++)
+  {
+    _spi.transfer(RFM_Data[i]);
+  }
+
+  digitalWrite(_NSS,HIGH);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that writes a sequence made by SX1276_Encode: bursts of
+*               address, count and data until address 0
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Write_Sequence(const unsigned char *Sequence)
+{
+  while(Sequence[0] != 0)
+  {
+    RFM_Write_Burst(Sequence[0], &Sequence[2], Sequence[1]);
+    Sequence += 2 + Sequence[1];
+  }
+}
+
 /*
 *****************************************************************************************
 * Description : Funtion that reads a register from the RFM and returns the value
@@ -149,21 +523,93 @@ unsigned char RFM95::RFM_Read(unsigned char RFM_Address)
   return RFM_Data;
 }
 
+/*
+*****************************************************************************************
+* Description : Funtion that reads Length bytes from one register in a single SPI
+*               transaction, the FIFO hands out the next byte on every read
+*
+* Arguments   : RFM_Address Address of register to be read
+*               *RFM_Data   Array the bytes are stored in
+*               Length      Number of bytes
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Burst_Read(unsigned char RFM_Address, unsigned char *RFM_Data, unsigned char Length)
+{
+  unsigned char i;
+
+  //Set NSS pin low to start SPI communication
+  digitalWrite(_NSS,LOW);
+
+  //Send Address
+  _spi.transfer(RFM_Address);
+  for(i = 0; i < Length; i++)
+  {
+    RFM_Data[i] = _spi.transfer(0x00);
+  }
+
+  //Set NSS high to end communication
+  digitalWrite(_NSS,HIGH);
+}
+
 /*
 *****************************************************************************************
 * Description : Function for sending a package with the RFM
 *
 * Arguments   : *RFM_Tx_Package Pointer to arry with data to be send
 *               Package_Length  Length of the package to send
+*
+* Returns     : false when listen before talk found all tried channels busy
+*****************************************************************************************
+*/
+
+bool RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+{
+  if(!RFM_Start_Package(RFM_Tx_Package, Package_Length))
+  {
+    return false;
+  }
+
+  //Wait for TxDone
+  while(RFM_Tx_Wait() != 0)
+  {
+  }
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that starts sending a package and returns while it is on air,
+*               RFM_Tx_Wait finishes it after TxDone
+*
+* Arguments   : *RFM_Tx_Package Pointer to arry with data to be send
+*               Package_Length  Length of the package to send
+*
+* Returns     : false when listen before talk found all tried channels busy
 *****************************************************************************************
 */
 
-void RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+bool RFM95::RFM_Start_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
 {
-  static unsigned char ch = 0;
   unsigned char i;
+  unsigned char Try;
+  uint16_t Tried = 0;
+  unsigned char SF = (_Datarate < 6) ? 12 - _Datarate : 7;
+  uint16_t Bandwidth = (_Datarate == 6) ? 250 : 125;
   // unsigned char RFM_Tx_Location = 0x00;
 
+  //DIO0 is TxDone from here on, the receive interrupt must not take it
+  RFM_Stop_Continuous_Rx();
+
+  //DR7 is FSK, has its own packet engine and channel. RX1 stays on it and ACKs
+  //do not score any of the LoRa channels.
+  if(_Datarate == 7)
+  {
+    _Current_Channel = CHANNEL_FSK;
+    return RFM_Start_FSK_Package(RFM_Tx_Package, Package_Length);
+  }
+
   //Set RFM in Standby mode wait on mode ready
 
   RFM_Write(0x01,0x81);
@@ -174,78 +620,32 @@ void RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Packag
   */
   delay(10);
 
-  //Switch DIO0 to TxDone
-  RFM_Write(0x40,0x40);
-  //Set carrier frequency
+  //Spreading factor and bandwidth of the data rate, needed before CAD as well
+  RFM_Set_LoRa_Datarate();
 
-  /*
-  fixed frequency
-  // 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
-  _rfm95.RFM_Write(0x06,0xD9);
-  _rfm95.RFM_Write(0x07,0x06);
-  _rfm95.RFM_Write(0x08,0x8B);
-  */
-
-  // TCNT0 is timer0 continous timer, kind of random selection of frequency
-
-  // EU863-870 specifications
-  switch (ch++ % 8)
-  {
-      case 0x00: //Channel 0 868.100 MHz / 61.035 Hz = 14222987 = 0xD9068B
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x06);
-          RFM_Write(0x08,0x8B);
-          break;
-        case 0x01: //Channel 1 868.300 MHz / 61.035 Hz = 14226264 = 0xD91358
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x13);
-          RFM_Write(0x08,0x58);
-          break;
-        case 0x02: //Channel 2 868.500 MHz / 61.035 Hz = 14229540 = 0xD92024
-          RFM_Write(0x06,0xD9);
-          RFM_Write(0x07,0x20);
-          RFM_Write(0x08,0x24);
-          break;
-        // added five more channels
-        case 0x03: // Channel 3 867.100 MHz / 61.035 Hz = 14206603 = 0xD8C68B
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xC6);
-          RFM_Write(0x08,0x8B);
-          break;
-        case 0x04: // Channel 4 867.300 MHz / 61.035 Hz = 14209880 = 0xD8D358
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xD3);
-          RFM_Write(0x08,0x58);
-          break;
-        case 0x05: // Channel 5 867.500 MHz / 61.035 Hz = 14213156 = 0xD8E024
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xE0);
-          RFM_Write(0x08,0x24);
-          break;
-        case 0x06: // Channel 6 867.700 MHz / 61.035 Hz = 14216433 = 0xD8ECF1
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xEC);
-          RFM_Write(0x08,0xF1);
-          break;
-        case 0x07: // Channel 7 867.900 MHz / 61.035 Hz = 14219710 = 0xD8F9BE
-          RFM_Write(0x06,0xD8);
-          RFM_Write(0x07,0xF9);
-          RFM_Write(0x08,0xBE);
-          break;
-        // FSK       868.800 Mhz => not used in this config
-        // 869.525 - SF9BW125 (RX2 downlink only) for package received
+  //Set carrier frequency, picked by the channel selector. With listen before
+  //talk move on to another channel right away when the current one is busy
+  for(Try = 0; ; Try++)
+  {
+    RFM_Set_Channel(_Channels.Select(Tried));
+    Tried |= (1 << _Current_Channel);
 
+    if(!_LBT_Enabled || !RFM_Channel_Busy())
+    {
+      break;
     }
+    _Channels.Report_Busy(_Current_Channel);
 
+    if(Try >= _LBT_Retries)
+    {
+      //All tries busy, a transmission now would most likely be lost
+      RFM_Write(0x01,0x00);
+      return false;
+    }
+  }
 
-  //SF7 BW 125 kHz
-  RFM_Write(0x1E,0xA4); //SF10 CRC On
-  RFM_Write(0x1D,0x72); //125 kHz 4/5 coding rate explicit header mode
-  RFM_Write(0x26,0x04); //Low datarate optimization off AGC auto on
-
-  //Set IQ to normal values
-  RFM_Write(0x33,0x27);
-  RFM_Write(0x3B,0x1D);
+  //Normal IQ, DIO0 on TxDone
+  RFM_Write_Sequence(RFM_Tx_Sequence.Data);
 
   //Set payload length to the right length
   RFM_Write(0x22,Package_Length);
@@ -264,14 +664,1021 @@ void RFM95::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Packag
     RFM_Tx_Package++;
   }
 
+  //Clear all interrupt flags, DIO0 has to rise on TxDone
+  RFM_Write(0x12,0xFF);
+
+  _Tx_Busy = true;
+  _Tx_Start = millis();
+  _Tx_Airtime = RxTiming::Airtime(Package_Length, SF, Bandwidth, true) / 1000 + 1;
+  RFM_Attach_Done();
+
   //Switch RFM to Tx
+  RFM_Clear_Edge();
   RFM_Write(0x01,0x83);
 
-  //Wait for TxDone
-  while( digitalRead(_DIO0) == LOW )
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that finishes a package started with RFM_Start_Package once
+*               TxDone came: the receive windows are timed from it and the RFM goes to
+*               sleep. With RFM_On_Done the DIO0 interrupt tells when to call it,
+*               otherwise poll it.
+*
+* Returns     : ms until TxDone is expected, at least 1 while it did not come, 0 once
+*               the package is sent
+*****************************************************************************************
+*/
+
+unsigned long RFM95::RFM_Tx_Wait()
+{
+  unsigned long Elapsed;
+
+  if(!_Tx_Busy)
+  {
+    return 0;
+  }
+
+  if(!_Done_Seen && digitalRead(_DIO0) == LOW)
   {
+    Elapsed = millis() - _Tx_Start;
+    return (Elapsed < _Tx_Airtime) ? _Tx_Airtime - Elapsed : 1;
   }
 
+  //Receive windows are timed from here
+  _Tx_Done_Time = _Done_Seen ? _Done_Time : RFM_Edge_Time();
+  RFM_Detach_Done();
+  _Tx_Busy = false;
+
   //Switch RFM to sleep
   RFM_Write(0x01,0x00);
+
+  return 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function for receiving a package in one of the receive windows after an
+*               uplink. Waits until the window opens, relative to the TxDone of the last
+*               package, and receives in RxSingle mode with inverted IQ until RxDone or
+*               RxTimeout. Start and RegSymbTimeout come from the receive window timing,
+*               which learns from every downlink received.
+*               Window 1 uses the channel of the uplink and its data rate less the
+*               RX1DROffset, window 2 uses 869.525 MHz at the data rate set with
+*               RFM_Set_Rx2_Datarate.
+*
+* Arguments   : *RFM_Rx_Package Pointer to array the package is stored in
+*               Max_Length      Size of the array
+*               Delay           Start of the window in ms after TxDone
+*               Window          1 or 2
+*
+* Returns     : Length of the package received, 0 on timeout or CRC error
+*****************************************************************************************
+*/
+
+unsigned char RFM95::RFM_Receive_Window(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned long Delay, unsigned char Window)
+{
+  unsigned char Length;
+
+  if(RFM_Open_Window(Delay, Window) == 0)
+  {
+    return 0;
+  }
+
+  //Wait for RxDone or RxTimeout
+  while(RFM_Rx_Wait(RFM_Rx_Package, Max_Length, &Length) != 0)
+  {
+  }
+
+  return Length;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that tells how long a scheduler can sleep before a receive
+*               window, RFM_Open_Window then waits out the rest
+*
+* Arguments   : Delay   Start of the window in ms after TxDone
+*               Window  1 or 2
+*
+* Returns     : us until the receiver has to be switched on, negative when late
+*****************************************************************************************
+*/
+
+signed long RFM95::RFM_Window_Wait(unsigned long Delay, unsigned char Window)
+{
+  unsigned char Datarate = RFM_Rx_Datarate(Window);
+  unsigned char SF = (Datarate < 6) ? 12 - Datarate : 7;
+  uint16_t Bandwidth = (Datarate == 6) ? 250 : 125;
+  Rx_Window Timing = _Rx_Timing.Window(Delay, SF, Bandwidth);
+
+  return Timing.Offset - (signed long)(micros() - _Tx_Done_Time);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that opens a receive window: waits until it starts and
+*               switches the receiver to RxSingle, RFM_Rx_Wait finishes it
+*
+* Arguments   : Delay   Start of the window in ms after TxDone
+*               Window  1 or 2
+*
+* Returns     : ms until RxTimeout, 0 when there is no window (FSK)
+*****************************************************************************************
+*/
+
+unsigned long RFM95::RFM_Open_Window(unsigned long Delay, unsigned char Window)
+{
+  unsigned char Datarate = RFM_Rx_Datarate(Window);
+  unsigned char SF = (Datarate < 6) ? 12 - Datarate : 7;
+  uint16_t Bandwidth = (Datarate == 6) ? 250 : 125;
+  Rx_Window Timing;
+
+  //No FSK downlinks
+  if(Datarate == 7)
+  {
+    return 0;
+  }
+
+  RFM_Stop_Continuous_Rx();
+  RFM_Prepare_Rx(Window);
+
+  //As short as the clock error allows, every symbol costs receive current
+  Timing = _Rx_Timing.Window(Delay, SF, Bandwidth);
+  RFM_Write_Config(0x1F,Timing.Symbols);
+
+  //Wait for the window, the receiver needs a moment to start
+  while((signed long)(micros() - _Tx_Done_Time) < Timing.Offset)
+  {
+  }
+
+  _Rx_Window = Window;
+  _Rx_Delay = Delay;
+  _Rx_Start = millis();
+  RFM_Attach_Done();
+
+  //Switch RFM to RxSingle
+  RFM_Clear_Edge();
+  RFM_Write(0x01,0x86);
+
+  //RxTimeout is on DIO1, which is not wired
+  return ((unsigned long)Timing.Symbols << SF) / Bandwidth + 1;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that finishes a receive window after RxDone or RxTimeout.
+*               Start and RegSymbTimeout came from the receive window timing, which
+*               learns from every downlink received here. With RFM_On_Done the DIO0
+*               interrupt tells when RxDone came, RxTimeout is polled.
+*
+* Arguments   : *RFM_Rx_Package Pointer to array the package is stored in
+*               Max_Length      Size of the array
+*               *Length         Length of the package received, 0 on timeout or CRC
+*                               error
+*
+* Returns     : ms until it should be called again, 0 once the window is closed
+*****************************************************************************************
+*/
+
+unsigned long RFM95::RFM_Rx_Wait(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned char *Length)
+{
+  unsigned char Irq_Flags;
+  unsigned char Rx_Length;
+  unsigned long Rx_Done_Time;
+  unsigned char Datarate = RFM_Rx_Datarate(_Rx_Window);
+  unsigned char SF = (Datarate < 6) ? 12 - Datarate : 7;
+  uint16_t Bandwidth = (Datarate == 6) ? 250 : 125;
+
+  *Length = 0;
+  if(_Rx_Window == 0)
+  {
+    return 0;
+  }
+
+  //Neither RxDone nor RxTimeout, a package may be coming in. Only DIO0 is wired
+  //so poll the flags, for 3 s at most.
+  Irq_Flags = RFM_Read(0x12);
+  if(!(Irq_Flags & 0xC0) && millis() - _Rx_Start < 3000)
+  {
+    return 10;
+  }
+
+  //RxDone without PayloadCrcError
+  if((Irq_Flags & 0x40) && !(Irq_Flags & 0x20))
+  {
+    Rx_Done_Time = _Done_Seen ? _Done_Time : RFM_Edge_Time();
+    Rx_Length = RFM_Read(0x13);
+
+    //The gateway started the preamble exactly Delay after TxDone
+    _Rx_Timing.Calibrate(_Rx_Delay * 1000 + RxTiming::Airtime(Rx_Length, SF, Bandwidth, false),
+      Rx_Done_Time - _Tx_Done_Time);
+
+    *Length = (Rx_Length > Max_Length) ? Max_Length : Rx_Length;
+
+    //Start of the package in the FiFo
+    RFM_Write(0x0D,RFM_Read(0x10));
+    RFM_Burst_Read(0x00, RFM_Rx_Package, *Length);
+
+    _Rssi = -157 + RFM_Read(0x1A);
+    _Snr = ((signed char)RFM_Read(0x19)) / 4;
+
+    if(_Rx_Window == 1)
+    {
+      _Channels.Report_Downlink(_Current_Channel, _Rssi, _Snr);
+    }
+  }
+
+  RFM_Detach_Done();
+  _Rx_Window = 0;
+
+  RFM_Write(0x12,0xFF);
+
+  //Switch RFM to sleep
+  RFM_Write(0x01,0x00);
+
+  return 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions that return RSSI (dBm) and SNR (dB) of the last package
+*               received
+*****************************************************************************************
+*/
+
+signed short RFM95::RFM_Get_Rssi()
+{
+  return _Rssi;
+}
+
+signed char RFM95::RFM_Get_Snr()
+{
+  return _Snr;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that sets up the receiver for a downlink: channel and data
+*               rate of the window, inverted IQ, DIO0 on RxDone, FIFO pointer at the
+*               Rx base. Leaves the RFM in standby.
+*
+* Arguments   : Window  1 for the uplink channel and data rate, 2 for RX2
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Prepare_Rx(unsigned char Window)
+{
+  unsigned char Uplink_Datarate = _Datarate;
+
+  _Datarate = RFM_Rx_Datarate(Window);
+
+  //LoRa sleep, the uplink may have left the RFM in FSK mode
+  RFM_Write(0x01,0x80);
+  //Standby
+  RFM_Write(0x01,0x81);
+
+  if(Window == 2)
+  {
+    //869.525 MHz
+    RFM_Write_Burst(0x06, RFM_Rx2_Frf, 3);
+  }
+  RFM_Set_LoRa_Datarate();
+  _Datarate = Uplink_Datarate;
+
+  //Invert IQ for downlinks, DIO0 on RxDone
+  RFM_Write_Sequence(RFM_Rx_Sequence.Data);
+
+  //Set SPI pointer to start of Rx part in FiFo
+  RFM_Write(0x0D,0x00);
+
+  //Clear all interrupt flags
+  RFM_Write(0x12,0xFF);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that starts class C reception: RX continuous on the RX2
+*               channel and data rate until the next uplink or receive window. Each
+*               RxDone interrupt copies the package into a ring, RFM_Get_Package
+*               takes them out. Call it again after every uplink.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Start_Continuous_Rx()
+{
+  RFM_Stop_Continuous_Rx();
+  RFM_Prepare_Rx(2);
+
+  _Rx_Radio = this;
+  _Rx_Continuous = true;
+  attachInterrupt(digitalPinToInterrupt(_DIO0), RFM_Rx_Interrupt, RISING);
+
+  //Switch RFM to RX continuous
+  RFM_Write(0x01,0x85);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that ends continuous reception, the interrupt is detached
+*               before anything else uses SPI. Packages in the ring stay there.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Stop_Continuous_Rx()
+{
+  if(!_Rx_Continuous)
+  {
+    return;
+  }
+
+  detachInterrupt(digitalPinToInterrupt(_DIO0));
+  _Rx_Continuous = false;
+
+  //Standby
+  RFM_Write(0x01,0x81);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the oldest package of continuous reception,
+*               RFM_Get_Rssi and RFM_Get_Snr then belong to it
+*
+* Returns     : Length of the package, 0 when there is none
+*****************************************************************************************
+*/
+
+unsigned char RFM95::RFM_Get_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length)
+{
+  Rx_Package *Package = _Rx_Ring.Front();
+  unsigned char Length;
+
+  if(Package == 0)
+  {
+    return 0;
+  }
+
+  Length = (Package->Length < Max_Length) ? Package->Length : Max_Length;
+  memcpy(RFM_Rx_Package, Package->Data, Length);
+  _Rssi = Package->Rssi;
+  _Snr = Package->Snr;
+
+  _Rx_Ring.Pop();
+  return Length;
+}
+
+// called from the RxDone interrupt after the package is in the ring, e.g. to post a task
+void RFM95::RFM_On_Receive(void (*Callback)())
+{
+  _Rx_Callback = Callback;
+}
+
+// packages lost because the ring was full
+unsigned int RFM95::RFM_Get_Rx_Dropped()
+{
+  return _Rx_Ring.Get_Dropped();
+}
+
+void RFM95::RFM_Rx_Interrupt()
+{
+  if(_Rx_Radio != 0)
+  {
+    _Rx_Radio->RFM_Rx_Done();
+  }
+}
+
+// called from the DIO0 interrupt at TxDone and at RxDone of a receive window, e.g. to
+// post the task that calls RFM_Tx_Wait and RFM_Rx_Wait
+void RFM95::RFM_On_Done(void (*Callback)())
+{
+  _Done_Callback = Callback;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions that hook the DIO0 interrupt up for the TxDone or RxDone that
+*               follows, only with RFM_On_Done. The interrupt timestamps the edge, so
+*               it does not matter how late the task runs.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Attach_Done()
+{
+  _Done_Seen = false;
+
+  if(_Done_Callback != 0)
+  {
+    _Rx_Radio = this;
+    attachInterrupt(digitalPinToInterrupt(_DIO0), RFM_Done_Interrupt, RISING);
+  }
+}
+
+void RFM95::RFM_Detach_Done()
+{
+  if(_Done_Callback != 0)
+  {
+    detachInterrupt(digitalPinToInterrupt(_DIO0));
+  }
+}
+
+void RFM95::RFM_Done_Interrupt()
+{
+  if(_Rx_Radio != 0)
+  {
+    _Rx_Radio->_Done_Time = _Rx_Radio->RFM_Edge_Time();
+    _Rx_Radio->_Done_Seen = true;
+
+    if(_Rx_Radio->_Done_Callback != 0)
+    {
+      _Rx_Radio->_Done_Callback();
+    }
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : RxDone interrupt of continuous reception. Reads the package from the
+*               FIFO in one burst into the next free slot of the ring, nothing else:
+*               MIC and decryption are left to the main loop.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Rx_Done()
+{
+  Rx_Package *Package;
+  unsigned char Irq_Flags;
+
+  if(!_Rx_Continuous)
+  {
+    return;
+  }
+
+  Irq_Flags = RFM_Read(0x12);
+
+  //RxDone without PayloadCrcError
+  if((Irq_Flags & 0x40) && !(Irq_Flags & 0x20))
+  {
+    Package = _Rx_Ring.Slot();
+    if(Package != 0)
+    {
+      Package->Length = RFM_Read(0x13);
+      if(Package->Length > PACKET_RING_SIZE)
+      {
+        Package->Length = PACKET_RING_SIZE;
+      }
+
+      //Start of the package in the FiFo
+      RFM_Write(0x0D,RFM_Read(0x10));
+      RFM_Burst_Read(0x00, Package->Data, Package->Length);
+
+      Package->Rssi = -157 + RFM_Read(0x1A);
+      Package->Snr = ((signed char)RFM_Read(0x19)) / 4;
+
+      _Rx_Ring.Push();
+    }
+  }
+
+  RFM_Write(0x12,0xFF);
+
+  if(_Rx_Callback != 0)
+  {
+    _Rx_Callback();
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function that sets the data rate of receive window 2, DR0 by default,
+*               the network can change it with the join accept or RXParamSetupReq
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_Rx2_Datarate(unsigned char Datarate)
+{
+  if(Datarate > 6)
+  {
+    return;
+  }
+  _Rx2_Datarate = Datarate;
+}
+
+unsigned char RFM95::RFM_Get_Rx2_Datarate()
+{
+  return _Rx2_Datarate;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that sets the RX1DROffset of the join accept, EU863-870
+*               allows 0 .. 5
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_Rx1_Offset(unsigned char Offset)
+{
+  if(Offset > 5)
+  {
+    return;
+  }
+  _Rx1_Offset = Offset;
+}
+
+unsigned char RFM95::RFM_Get_Rx1_Offset()
+{
+  return _Rx1_Offset;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the data rate of a receive window, RX1 is the
+*               uplink data rate less the offset but not below DR0
+*****************************************************************************************
+*/
+
+unsigned char RFM95::RFM_Rx_Datarate(unsigned char Window)
+{
+  if(Window == 2)
+  {
+    return _Rx2_Datarate;
+  }
+  return (_Datarate > _Rx1_Offset) ? _Datarate - _Rx1_Offset : 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that selects the EU863-870 data rate for the next packages
+*
+* Arguments   : Datarate  DR0 .. DR5 = SF12 .. SF7 BW125, DR6 = SF7 BW250,
+*                         DR7 = FSK 50 kbps
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_Datarate(unsigned char Datarate)
+{
+  if(Datarate > 7)
+  {
+    return;
+  }
+  _Datarate = Datarate;
+}
+
+unsigned char RFM95::RFM_Get_Datarate()
+{
+  return _Datarate;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that writes the modem config for a LoRa data rate
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_LoRa_Datarate()
+{
+  //Bandwidth and SF with the low data rate optimization the datasheet demands,
+  //checked at compile time, see RFM_Modem_Config
+  const unsigned char *Config = RFM_Modem_Config[(_Datarate < 7) ? _Datarate : 0];
+
+  //Only what differs from the last data rate, RegModemConfig1 and 2 in one burst
+  if(!_Modem_Valid || Config[0] != _Modem[0] || Config[1] != _Modem[1])
+  {
+    RFM_Write_Burst(0x1D, Config, 2);
+  }
+  if(!_Modem_Valid || Config[2] != _Modem[2])
+  {
+    RFM_Write(0x26,Config[2]);
+  }
+
+  memcpy(_Modem, Config, sizeof(_Modem));
+  _Modem_Valid = true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that starts a package with FSK at 50 kbps (DR7). The RFM is
+*               switched to FSK mode for the package and RFM_Tx_Wait leaves it in sleep
+*               afterwards, the LoRa registers are kept in their own bank meanwhile.
+*               Variable length packet: length byte, payload, CRC-16 (CCITT), data
+*               whitening, 5 byte preamble, sync word C1 94 C1, GFSK BT 1.0.
+*
+* Arguments   : *RFM_Tx_Package Pointer to arry with data to be send
+*               Package_Length  Length of the package to send, 63 bytes max.
+*
+* Returns     : false when the package does not fit the FIFO
+*****************************************************************************************
+*/
+
+bool RFM95::RFM_Start_FSK_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+{
+  unsigned char i;
+
+  //FIFO is 64 bytes including the length byte
+  if(Package_Length > 63)
+  {
+    return false;
+  }
+
+  //Switch RFM to sleep, FSK mode can only be entered from sleep
+  RFM_Write(SX1276_Mode.Address,SX1276_Put(SX1276_Long_Range_Mode, 0) | SX1276_Put(SX1276_Mode, SX1276_SLEEP));
+  //FSK standby
+  RFM_Write(SX1276_Mode.Address,SX1276_Put(SX1276_Long_Range_Mode, 0) | SX1276_Put(SX1276_Mode, SX1276_STANDBY));
+  delay(1);
+
+  //Bit rate, deviation, channel, packet format and DIO0 on PacketSent
+  RFM_Write_Sequence(RFM_FSK_Sequence.Data);
+
+  //Registers 0x0D .. 0x3F mean something else in FSK mode, the LoRa modem
+  //config is written in full with the next LoRa package
+  _Modem_Valid = false;
+
+  //Write length and payload to FiFo
+  RFM_Write(0x00,Package_Length);
+  for (i = 0;i < Package_Length; i++)
+  {
+    RFM_Write(0x00,*RFM_Tx_Package);
+    RFM_Tx_Package++;
+  }
+
+  //Preamble, sync word, length, payload and CRC at 50 kbps. PacketSent ends it like
+  //TxDone a LoRa package, RFM_Tx_Wait then puts the RFM to sleep.
+  _Tx_Busy = true;
+  _Tx_Start = millis();
+  _Tx_Airtime = (Package_Length + 11) * 8 / 50 + 1;
+  RFM_Attach_Done();
+
+  //Switch RFM to FSK Tx
+  RFM_Clear_Edge();
+  RFM_Write(SX1276_Mode.Address,SX1276_Put(SX1276_Long_Range_Mode, 0) | SX1276_Put(SX1276_Mode, SX1276_TX));
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that sets the carrier frequency to one of the EU863-870
+*               uplink channels
+*
+* Arguments   : Channel  Channel number 0 .. 7
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_Channel(unsigned char Channel)
+{
+  if(Channel > 7)
+  {
+    return;
+  }
+  _Current_Channel = Channel;
+
+  //EU863-870: 868.1, 868.3, 868.5 MHz and 867.1 .. 867.9 MHz, RegFrf in one burst.
+  //FSK uses 868.8 MHz, RX2 869.525 MHz at the RX2 data rate (DR0 by default).
+  RFM_Write_Burst(0x06, RFM_Channel_Frf[Channel], 3);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the channel used for the last package, needed to
+*               feed ACK and downlink results back into the channel selector
+*****************************************************************************************
+*/
+
+unsigned char RFM95::RFM_Get_Channel()
+{
+  return _Current_Channel;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the channel selector, e.g. to set the channel
+*               mask of the regional plan or report ACK outcomes
+*****************************************************************************************
+*/
+
+ChannelSelector &RFM95::RFM_Channels()
+{
+  return _Channels;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the receive window timing, e.g. to report the
+*               drift learned
+*****************************************************************************************
+*/
+
+RxTiming &RFM95::RFM_Timing()
+{
+  return _Rx_Timing;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that starts TIM2 at 1 MHz with input capture of DIO0 when it
+*               is wired to PA1 (TIM2_CH2). TxDone and RxDone are then timestamped by
+*               the edge instead of when the polling loop sees it. Other pins and
+*               cores other than STM32 fall back to micros() at the poll.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Start_Capture()
+{
+#ifdef ARDUINO_ARCH_STM32
+  TIM_IC_InitTypeDef Capture = {};
+
+  if(_DIO0 != PA1 || _Capture)
+  {
+    return;
+  }
+
+  __HAL_RCC_TIM2_CLK_ENABLE();
+
+  RFM_Capture_Tim.Instance = TIM2;
+  RFM_Capture_Tim.Init.Prescaler = SystemCoreClock / 1000000 - 1;
+  RFM_Capture_Tim.Init.CounterMode = TIM_COUNTERMODE_UP;
+  RFM_Capture_Tim.Init.Period = 0xFFFF;
+  RFM_Capture_Tim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  RFM_Capture_Tim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if(HAL_TIM_IC_Init(&RFM_Capture_Tim) != HAL_OK)
+  {
+    return;
+  }
+
+  Capture.ICPolarity = TIM_ICPOLARITY_RISING;
+  Capture.ICSelection = TIM_ICSELECTION_DIRECTTI;
+  Capture.ICPrescaler = TIM_ICPSC_DIV1;
+  Capture.ICFilter = 0;
+  if(HAL_TIM_IC_ConfigChannel(&RFM_Capture_Tim, &Capture, TIM_CHANNEL_2) != HAL_OK ||
+     HAL_TIM_IC_Start(&RFM_Capture_Tim, TIM_CHANNEL_2) != HAL_OK)
+  {
+    return;
+  }
+
+  _Capture = true;
+  _Rx_Timing.Set_Jitter(RX_TIMING_CAPTURE_JITTER);
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function that forgets the last DIO0 edge, called before the command
+*               whose DIO0 edge is timestamped
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Clear_Edge()
+{
+#ifdef ARDUINO_ARCH_STM32
+  if(_Capture)
+  {
+    __HAL_TIM_CLEAR_FLAG(&RFM_Capture_Tim, TIM_FLAG_CC2);
+  }
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the micros() time of the last rising edge of DIO0.
+*               The 16 bit capture is only good for 65 ms, so call it right after the
+*               edge was seen.
+*****************************************************************************************
+*/
+
+unsigned long RFM95::RFM_Edge_Time()
+{
+#ifdef ARDUINO_ARCH_STM32
+  unsigned long Now;
+  uint16_t Count;
+  uint16_t Edge;
+
+  if(!_Capture || !__HAL_TIM_GET_FLAG(&RFM_Capture_Tim, TIM_FLAG_CC2))
+  {
+    return micros();
+  }
+
+  //Both run from the same clock, read them together
+  noInterrupts();
+  Now = micros();
+  Count = __HAL_TIM_GET_COUNTER(&RFM_Capture_Tim);
+  interrupts();
+  Edge = HAL_TIM_ReadCapturedValue(&RFM_Capture_Tim, TIM_CHANNEL_2);
+
+  return Now - (uint16_t)(Count - Edge);
+#else
+  return micros();
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function that seeds the channel selector with noise. The LSB of
+*               RegRssiWideband is random while the receiver is running. Leaves the
+*               RFM in standby.
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Seed_Channels()
+{
+  unsigned char i;
+  uint32_t Seed = 0;
+
+  //Receiver continuous to get noise into the RSSI
+  RFM_Write(0x01,0x85);
+  delay(1);
+
+  for(i = 0; i < 32; i++)
+  {
+    Seed = (Seed << 1) | (RFM_Read(0x2C) & 0x01);
+    delayMicroseconds(100);
+  }
+
+  RFM_Write(0x01,0x81);
+
+  _Channels.Seed(Seed);
+}
+
+/*
+*****************************************************************************************
+* Description : Function that runs a Channel Activity Detection on the current carrier
+*               frequency and spreading factor. DIO0 is mapped to CadDone and DIO1 to
+*               CadDetected, the result is taken from RegIrqFlags since only DIO0 is
+*               wired. Expects the RFM in standby and leaves it there.
+*
+* Returns     : true when a LoRa preamble was detected
+*****************************************************************************************
+*/
+
+bool RFM95::RFM_Channel_Busy()
+{
+  unsigned char Irq_Flags;
+  unsigned long Start;
+
+  //DIO0 CadDone, DIO1 CadDetected
+  RFM_Write(0x40,RFM_Cad_Image.Value[0x40]);
+
+  //Clear all interrupt flags
+  RFM_Write(0x12,0xFF);
+
+  //Switch RFM to CAD
+  RFM_Write(0x01,0x87);
+
+  //Wait for CadDone, takes about 2 symbols (16 ms at SF10)
+  Start = millis();
+  while( digitalRead(_DIO0) == LOW )
+  {
+    if(millis() - Start > 100)
+    {
+      break;
+    }
+  }
+
+  Irq_Flags = RFM_Read(0x12);
+  RFM_Write(0x12,0xFF);
+
+  //Back to standby, CAD returns there by itself but not on a timeout
+  RFM_Write(0x01,0x81);
+
+  _Cad_Count++;
+  if(Irq_Flags & 0x01)
+  {
+    _Cad_Busy[_Current_Channel]++;
+    return true;
+  }
+  return false;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that enables Channel Activity Detection before each uplink
+*
+* Arguments   : Enable   true to check the channel before transmitting
+*               Retries  number of alternate channels tried when a channel is busy
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_LBT(bool Enable, unsigned char Retries)
+{
+  _LBT_Enabled = Enable;
+  _LBT_Retries = Retries;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions that return the CAD statistics
+*
+* Arguments   : Channel  Channel number 0 .. 7
+*
+* Returns     : Number of CADs that found the channel busy, total number of CADs
+*****************************************************************************************
+*/
+
+unsigned int RFM95::RFM_Get_Busy_Count(unsigned char Channel)
+{
+  return _Cad_Busy[Channel % 8];
+}
+
+unsigned int RFM95::RFM_Get_CAD_Count()
+{
+  return _Cad_Count;
+}
+
+
+/*
+*****************************************************************************************
+* Description : Function that sets the output power of the power amplifier. Writes
+*               RegPaConfig, RegPaDac and RegOcp so the full range of the SX1276 is
+*               usable:
+*                 RFO      -4 .. 14 dBm (MaxPower 0 below 0 dBm, 7 otherwise)
+*                 PA_BOOST  2 .. 17 dBm
+*                 PA_BOOST 18 .. 20 dBm with the high power PA DAC (1% duty cycle max)
+*               The over current protection is raised for the high power settings
+*               and lowered for the others, so a low power frame never draws the
+*               current allowed for 20 dBm.
+*
+* Arguments   : Power     Requested output power in dBm, clamped to the valid range
+*               PA_Boost  true to use the PA_BOOST pin (RFM95W), false for RFO
+*****************************************************************************************
+*/
+
+void RFM95::RFM_Set_Tx_Power(signed char Power, bool PA_Boost)
+{
+  unsigned char Pa_Config;
+  unsigned char Pa_Dac = SX1276_PA_DAC_DEFAULT;
+  unsigned char Ocp_Trim;
+
+  if(PA_Boost)
+  {
+    if(Power < 2)
+    {
+      Power = 2;
+    }
+    if(Power > 20)
+    {
+      Power = 20;
+    }
+
+    if(Power > 17)
+    {
+      //+20 dBm option, Pout = 5 + OutputPower
+      Pa_Dac = SX1276_PA_DAC_20_DBM;
+      Pa_Config = SX1276_Put(SX1276_Pa_Select, 1) | SX1276_Put(SX1276_Max_Power, 7) |
+        SX1276_Put(SX1276_Output_Power, Power - 5);
+      //Imax = -30 + 10 * OcpTrim = 140 mA
+      Ocp_Trim = 17;
+    }
+    else
+    {
+      //Pout = 17 - (15 - OutputPower)
+      Pa_Config = SX1276_Put(SX1276_Pa_Select, 1) | SX1276_Put(SX1276_Max_Power, 7) |
+        SX1276_Put(SX1276_Output_Power, Power - 2);
+      //Imax = 45 + 5 * OcpTrim: 100 mA above 14 dBm, 80 mA up to 14 dBm
+      Ocp_Trim = (Power > 14) ? 11 : 7;
+    }
+  }
+  else
+  {
+    if(Power < -4)
+    {
+      Power = -4;
+    }
+    if(Power > 14)
+    {
+      Power = 14;
+    }
+
+    if(Power < 0)
+    {
+      //MaxPower 0 => Pmax = 10.8 dBm, Pout = Pmax - (15 - OutputPower)
+      Pa_Config = SX1276_Put(SX1276_Max_Power, 0) | SX1276_Put(SX1276_Output_Power, Power + 4);
+    }
+    else
+    {
+      //MaxPower 7 => Pmax = 15 dBm, Pout = OutputPower
+      Pa_Config = SX1276_Put(SX1276_Max_Power, 7) | SX1276_Put(SX1276_Output_Power, Power);
+    }
+    //Imax = 45 + 5 * OcpTrim = 80 mA
+    Ocp_Trim = 7;
+  }
+
+  RFM_Write_Config(SX1276_Pa_Select.Address,Pa_Config);
+  //The upper bits of RegPaDac are reserved, they keep their reset value
+  RFM_Write_Config(SX1276_Pa_Dac.Address,(SX1276_Default(SX1276_Pa_Dac.Address) & ~SX1276_Put(SX1276_Pa_Dac, 0xFF)) |
+    SX1276_Put(SX1276_Pa_Dac, Pa_Dac));
+  RFM_Write_Config(SX1276_Ocp_On.Address,SX1276_Put(SX1276_Ocp_On, 1) | SX1276_Put(SX1276_Ocp_Trim, Ocp_Trim));
+
+  _Tx_Power = Power;
+  _PA_Boost = PA_Boost;
+}
+
+/*
+*****************************************************************************************
+* Description : Function that returns the output power set with RFM_Set_Tx_Power
+*
+* Returns     : Output power in dBm
+*****************************************************************************************
+*/
+
+signed char RFM95::RFM_Get_Tx_Power()
+{
+  return _Tx_Power;
 }
@@ -8,22 +8,128 @@
 */
 
 #ifndef RFM95_h
-#define RMF95_h
+#define RFM95_h
 
 #include "Arduino.h"
 #include "SPI.h"
+#include "ChannelSelector.h"
+#include "PacketRing.h"
+#include "RxTiming.h"
+
+// number of registers kept in RAM for a warm resume
+#define RFM_CONFIG_SIZE 9
 
 class RFM95
 {
   public:
     RFM95(int DIO0, int NSS);
     void init();
+    bool resume();
     void RFM_Write(unsigned char RFM_Address, unsigned char RFM_Data);
     unsigned char RFM_Read(unsigned char RFM_Address);
-    void RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    bool RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    void RFM_Set_Tx_Power(signed char Power, bool PA_Boost = true);
+    signed char RFM_Get_Tx_Power();
+    unsigned char RFM_Receive_Window(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned long Delay, unsigned char Window);
+    // the same in steps for a scheduler, DIO0 calls RFM_On_Done in between
+    bool RFM_Start_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    unsigned long RFM_Tx_Wait();
+    signed long RFM_Window_Wait(unsigned long Delay, unsigned char Window);
+    unsigned long RFM_Open_Window(unsigned long Delay, unsigned char Window);
+    unsigned long RFM_Rx_Wait(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned char *Length);
+    void RFM_On_Done(void (*Callback)());
+    signed short RFM_Get_Rssi();
+    signed char RFM_Get_Snr();
+    void RFM_Set_Rx2_Datarate(unsigned char Datarate);
+    unsigned char RFM_Get_Rx2_Datarate();
+    void RFM_Set_Rx1_Offset(unsigned char Offset);
+    unsigned char RFM_Get_Rx1_Offset();
+    // data rate, DR7 is FSK
+    void RFM_Set_Datarate(unsigned char Datarate);
+    unsigned char RFM_Get_Datarate();
+    // listen before talk
+    void RFM_Set_LBT(bool Enable, unsigned char Retries);
+    bool RFM_Channel_Busy();
+    unsigned int RFM_Get_Busy_Count(unsigned char Channel);
+    unsigned int RFM_Get_CAD_Count();
+    // channel selection
+    unsigned char RFM_Get_Channel();
+    ChannelSelector &RFM_Channels();
+    // class C, receive continuously on the RX2 channel between uplinks
+    void RFM_Start_Continuous_Rx();
+    void RFM_Stop_Continuous_Rx();
+    unsigned char RFM_Get_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length);
+    void RFM_On_Receive(void (*Callback)());
+    unsigned int RFM_Get_Rx_Dropped();
+    // receive window timing, learned from the downlinks
+    RxTiming &RFM_Timing();
   private:
     int _DIO0;
     int _NSS;
+    signed char _Tx_Power;
+    bool _PA_Boost;
+    unsigned char _Datarate;
+    unsigned char _Rx2_Datarate;
+    // RX1DROffset, window 1 receives this many data rates below the uplink
+    unsigned char _Rx1_Offset;
+    // micros() of the last TxDone
+    unsigned long _Tx_Done_Time;
+    // package on air: millis() at the start and its time on air in ms
+    bool _Tx_Busy;
+    unsigned long _Tx_Start;
+    unsigned long _Tx_Airtime;
+    // receive window open: 1 or 2, 0 for none, its delay and millis() at the start
+    unsigned char _Rx_Window;
+    unsigned long _Rx_Delay;
+    unsigned long _Rx_Start;
+    // TxDone or RxDone of a scheduled uplink, seen by the DIO0 interrupt
+    volatile bool _Done_Seen;
+    volatile unsigned long _Done_Time;
+    void (*_Done_Callback)();
+    RxTiming _Rx_Timing;
+    // DIO0 edges timestamped by TIM2 input capture
+    bool _Capture;
+    signed short _Rssi;
+    signed char _Snr;
+    ChannelSelector _Channels;
+    // channel set right now
+    unsigned char _Current_Channel;
+    bool _LBT_Enabled;
+    unsigned char _LBT_Retries;
+    unsigned int _Cad_Count;
+    unsigned int _Cad_Busy[8];
+    // RAM copy of the configuration registers and its hash
+    unsigned char _Config[RFM_CONFIG_SIZE];
+    unsigned long _Config_Hash;
+    // RegModemConfig1 .. 3 as last written, LoRa packages only rewrite what changed
+    unsigned char _Modem[3];
+    bool _Modem_Valid;
+    // filled by the RxDone interrupt in continuous receive
+    PacketRing _Rx_Ring;
+    volatile bool _Rx_Continuous;
+    void (*_Rx_Callback)();
+    static RFM95 *_Rx_Radio;
+
+    void RFM_Set_Channel(unsigned char Channel);
+    void RFM_Write_Config(unsigned char RFM_Address, unsigned char RFM_Data);
+    unsigned char RFM_Config_Value(unsigned char RFM_Address);
+    unsigned long RFM_Config_Hash();
+    void RFM_Seed_Channels();
+    void RFM_Set_LoRa_Datarate();
+    bool RFM_Start_FSK_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    void RFM_Prepare_Rx(unsigned char Window);
+    unsigned char RFM_Rx_Datarate(unsigned char Window);
+    void RFM_Write_Burst(unsigned char RFM_Address, const unsigned char *RFM_Data, unsigned char Length);
+    void RFM_Write_Sequence(const unsigned char *Sequence);
+    void RFM_Burst_Read(unsigned char RFM_Address, unsigned char *RFM_Data, unsigned char Length);
+    void RFM_Rx_Done();
+    void RFM_Start_Capture();
+    void RFM_Clear_Edge();
+    unsigned long RFM_Edge_Time();
+    static void RFM_Rx_Interrupt();
+    void RFM_Attach_Done();
+    void RFM_Detach_Done();
+    static void RFM_Done_Interrupt();
     SPIClass _spi;
 };
 
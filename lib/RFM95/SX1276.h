@@ -0,0 +1,302 @@
+/*
+  SX1276.h - Typed register map of the SX1276 LoRa modem, configurations built at
+  compile time
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  A configuration is a list of field settings:
+
+    constexpr SX1276_Setting Settings[] = {
+      { SX1276_Spreading_Factor, 10 },
+      { SX1276_Bandwidth, SX1276_BW_125 },
+      ...
+    };
+
+  SX1276_Build turns it into the register values, starting from the reset
+  defaults so bits outside the fields keep their value. SX1276_Encode turns those
+  into the shortest write sequence: the registers set by the configuration in
+  address order, neighbours merged into one burst (the SPI address increments).
+
+    Address | Count | Data x Count | ... | 0
+
+  Address 0 is the FIFO and never configured, it ends the sequence. Everything
+  is evaluated by the compiler, a wrong combination is a static_assert and only
+  the sequence ends up in flash.
+*/
+
+#ifndef SX1276_h
+#define SX1276_h
+
+#define SX1276_REGISTERS 0x80
+// crystal 32 MHz, Frf step 32 MHz / 2^19 = 61.03515625 Hz
+#define SX1276_FXOSC 32000000ULL
+
+struct SX1276_Field
+{
+  unsigned char Address;
+  unsigned char Shift;
+  unsigned char Width;
+};
+
+struct SX1276_Setting
+{
+  SX1276_Field Field;
+  unsigned char Value;
+};
+
+// LoRa register bank, RegOpMode LongRangeMode = 1
+constexpr SX1276_Field SX1276_Long_Range_Mode = { 0x01, 7, 1 };
+constexpr SX1276_Field SX1276_Mode = { 0x01, 0, 3 };
+constexpr SX1276_Field SX1276_Frf_Msb = { 0x06, 0, 8 };
+constexpr SX1276_Field SX1276_Frf_Mid = { 0x07, 0, 8 };
+constexpr SX1276_Field SX1276_Frf_Lsb = { 0x08, 0, 8 };
+constexpr SX1276_Field SX1276_Pa_Select = { 0x09, 7, 1 };
+constexpr SX1276_Field SX1276_Max_Power = { 0x09, 4, 3 };
+constexpr SX1276_Field SX1276_Output_Power = { 0x09, 0, 4 };
+constexpr SX1276_Field SX1276_Ocp_On = { 0x0B, 5, 1 };
+constexpr SX1276_Field SX1276_Ocp_Trim = { 0x0B, 0, 5 };
+constexpr SX1276_Field SX1276_Fifo_Tx_Base = { 0x0E, 0, 8 };
+constexpr SX1276_Field SX1276_Fifo_Rx_Base = { 0x0F, 0, 8 };
+constexpr SX1276_Field SX1276_Bandwidth = { 0x1D, 4, 4 };
+constexpr SX1276_Field SX1276_Coding_Rate = { 0x1D, 1, 3 };
+constexpr SX1276_Field SX1276_Implicit_Header = { 0x1D, 0, 1 };
+constexpr SX1276_Field SX1276_Spreading_Factor = { 0x1E, 4, 4 };
+constexpr SX1276_Field SX1276_Rx_Payload_Crc = { 0x1E, 2, 1 };
+constexpr SX1276_Field SX1276_Symb_Timeout_Msb = { 0x1E, 0, 2 };
+constexpr SX1276_Field SX1276_Symb_Timeout_Lsb = { 0x1F, 0, 8 };
+constexpr SX1276_Field SX1276_Preamble_Msb = { 0x20, 0, 8 };
+constexpr SX1276_Field SX1276_Preamble_Lsb = { 0x21, 0, 8 };
+constexpr SX1276_Field SX1276_Low_Data_Rate_Optimize = { 0x26, 3, 1 };
+constexpr SX1276_Field SX1276_Agc_Auto_On = { 0x26, 2, 1 };
+// RegInvertIQ: bit 6 inverts the receiver, bit 0 cleared inverts the transmitter
+constexpr SX1276_Field SX1276_Invert_IQ_Rx = { 0x33, 6, 1 };
+constexpr SX1276_Field SX1276_Invert_IQ_Tx_Off = { 0x33, 0, 1 };
+// RegInvertIQ2, 0x1D normal and 0x19 with inverted IQ
+constexpr SX1276_Field SX1276_Invert_IQ2 = { 0x3B, 0, 8 };
+constexpr SX1276_Field SX1276_Sync_Word = { 0x39, 0, 8 };
+constexpr SX1276_Field SX1276_Dio0_Mapping = { 0x40, 6, 2 };
+constexpr SX1276_Field SX1276_Dio1_Mapping = { 0x40, 4, 2 };
+constexpr SX1276_Field SX1276_Pa_Dac = { 0x4D, 0, 3 };
+
+// FSK/OOK register bank, RegOpMode LongRangeMode = 0. RegOpMode, RegFrf and the PA
+// fields are shared, the rest of 0x02 .. 0x3F means something else than for LoRa.
+constexpr SX1276_Field SX1276_Fsk_Bitrate_Msb = { 0x02, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Bitrate_Lsb = { 0x03, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Fdev_Msb = { 0x04, 0, 6 };
+constexpr SX1276_Field SX1276_Fsk_Fdev_Lsb = { 0x05, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Modulation_Shaping = { 0x0A, 5, 2 };
+constexpr SX1276_Field SX1276_Fsk_Pa_Ramp = { 0x0A, 0, 4 };
+constexpr SX1276_Field SX1276_Fsk_Preamble_Msb = { 0x25, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Preamble_Lsb = { 0x26, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Sync_On = { 0x27, 4, 1 };
+// number of sync bytes less one
+constexpr SX1276_Field SX1276_Fsk_Sync_Size = { 0x27, 0, 3 };
+constexpr SX1276_Field SX1276_Fsk_Sync_Value1 = { 0x28, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Sync_Value2 = { 0x29, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Sync_Value3 = { 0x2A, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Variable_Length = { 0x30, 7, 1 };
+constexpr SX1276_Field SX1276_Fsk_Dc_Free = { 0x30, 5, 2 };
+constexpr SX1276_Field SX1276_Fsk_Crc_On = { 0x30, 4, 1 };
+constexpr SX1276_Field SX1276_Fsk_Packet_Mode = { 0x31, 6, 1 };
+constexpr SX1276_Field SX1276_Fsk_Payload_Length = { 0x32, 0, 8 };
+constexpr SX1276_Field SX1276_Fsk_Tx_Start_Condition = { 0x35, 7, 1 };
+constexpr SX1276_Field SX1276_Fsk_Fifo_Threshold = { 0x35, 0, 6 };
+
+// RegOpMode Mode
+#define SX1276_SLEEP 0
+#define SX1276_STANDBY 1
+#define SX1276_TX 3
+#define SX1276_RX_CONTINUOUS 5
+#define SX1276_RX_SINGLE 6
+#define SX1276_CAD 7
+
+// RegPaDac PaDac
+#define SX1276_PA_DAC_DEFAULT 4
+#define SX1276_PA_DAC_20_DBM 7
+
+// RegPaRamp in FSK mode
+#define SX1276_FSK_BT_1_0 1
+#define SX1276_FSK_RAMP_40_US 9
+
+// RegPacketConfig1 DcFree
+#define SX1276_FSK_WHITENING 2
+
+// RegDioMapping1 Dio0Mapping in FSK packet mode while transmitting
+#define SX1276_DIO0_PACKET_SENT 0
+
+// RegModemConfig1 Bandwidth
+#define SX1276_BW_125 7
+#define SX1276_BW_250 8
+#define SX1276_BW_500 9
+
+// RegDioMapping1 Dio0Mapping in LoRa mode
+#define SX1276_DIO0_RX_DONE 0
+#define SX1276_DIO0_TX_DONE 1
+#define SX1276_DIO0_CAD_DONE 2
+#define SX1276_DIO1_CAD_DETECTED 2
+
+// reset values of the registers with fields that do not fill them
+constexpr unsigned char SX1276_Default(unsigned char Address)
+{
+  return Address == 0x01 ? 0x09 :
+         Address == 0x09 ? 0x4F :
+         Address == 0x0B ? 0x2B :
+         Address == 0x1D ? 0x72 :
+         Address == 0x1E ? 0x70 :
+         Address == 0x26 ? 0x04 :
+         Address == 0x33 ? 0x27 :
+         Address == 0x4D ? 0x84 : 0x00;
+}
+
+// bandwidth in Hz of a RegModemConfig1 Bandwidth value
+constexpr unsigned long SX1276_Bandwidth_Hz(unsigned char Bandwidth)
+{
+  return Bandwidth == 0 ? 7800 : Bandwidth == 1 ? 10400 : Bandwidth == 2 ? 15600 :
+         Bandwidth == 3 ? 20800 : Bandwidth == 4 ? 31250 : Bandwidth == 5 ? 41700 :
+         Bandwidth == 6 ? 62500 : Bandwidth == 7 ? 125000 : Bandwidth == 8 ? 250000 : 500000;
+}
+
+// RegFrf of a carrier frequency in Hz, rounded
+constexpr unsigned long SX1276_Frf(unsigned long Frequency)
+{
+  return (unsigned long)((((unsigned long long)Frequency << 19) + SX1276_FXOSC / 2) / SX1276_FXOSC);
+}
+
+struct SX1276_Image
+{
+  unsigned char Value[SX1276_REGISTERS];
+  // bits set by the configuration
+  unsigned char Mask[SX1276_REGISTERS];
+  // every value fits its field, no bit is set twice with different values
+  bool Valid;
+};
+
+template <unsigned N>
+constexpr SX1276_Image SX1276_Build(const SX1276_Setting (&Settings)[N])
+{
+  SX1276_Image Image = { { 0 }, { 0 }, true };
+  unsigned char Field_Mask = 0;
+  unsigned char Value = 0;
+  unsigned i = 0;
+
+  for(i = 0; i < SX1276_REGISTERS; i++)
+  {
+    Image.Value[i] = SX1276_Default(i);
+  }
+
+  for(i = 0; i < N; i++)
+  {
+    const SX1276_Field &Field = Settings[i].Field;
+
+    Field_Mask = (unsigned char)(((1U << Field.Width) - 1) << Field.Shift);
+    Value = (unsigned char)(Settings[i].Value << Field.Shift);
+
+    if(Field.Address == 0 || Field.Address >= SX1276_REGISTERS ||
+       Settings[i].Value >= (1U << Field.Width) ||
+       ((Image.Mask[Field.Address] & Field_Mask) != 0 && ((Image.Value[Field.Address] ^ Value) & Field_Mask) != 0))
+    {
+      Image.Valid = false;
+      continue;
+    }
+
+    Image.Value[Field.Address] = (Image.Value[Field.Address] & ~Field_Mask) | Value;
+    Image.Mask[Field.Address] |= Field_Mask;
+  }
+
+  return Image;
+}
+
+constexpr unsigned char SX1276_Get(const SX1276_Image &Image, SX1276_Field Field)
+{
+  return (Image.Value[Field.Address] >> Field.Shift) & ((1U << Field.Width) - 1);
+}
+
+// a field value in place, to be ORed into a register at run time
+constexpr unsigned char SX1276_Put(SX1276_Field Field, unsigned char Value)
+{
+  return (unsigned char)((Value & ((1U << Field.Width) - 1)) << Field.Shift);
+}
+
+constexpr bool SX1276_Has(const SX1276_Image &Image, SX1276_Field Field)
+{
+  return ((Image.Mask[Field.Address] >> Field.Shift) & ((1U << Field.Width) - 1)) == ((1U << Field.Width) - 1);
+}
+
+/*
+  LoRa modem rules of the datasheet, for the fields the configuration sets:
+  SF6 .. SF12, SF6 only with implicit header, coding rate 4/5 .. 4/8, and low
+  data rate optimization exactly when a symbol takes longer than 16 ms (a wrong
+  setting does not show on the node, the gateway just cannot decode it).
+*/
+constexpr bool SX1276_LoRa_Valid(const SX1276_Image &Image)
+{
+  return Image.Valid &&
+    (!SX1276_Has(Image, SX1276_Spreading_Factor) ||
+      (SX1276_Get(Image, SX1276_Spreading_Factor) >= 6 && SX1276_Get(Image, SX1276_Spreading_Factor) <= 12)) &&
+    (!SX1276_Has(Image, SX1276_Bandwidth) || SX1276_Get(Image, SX1276_Bandwidth) <= SX1276_BW_500) &&
+    (!SX1276_Has(Image, SX1276_Coding_Rate) ||
+      (SX1276_Get(Image, SX1276_Coding_Rate) >= 1 && SX1276_Get(Image, SX1276_Coding_Rate) <= 4)) &&
+    (!SX1276_Has(Image, SX1276_Spreading_Factor) || SX1276_Get(Image, SX1276_Spreading_Factor) != 6 ||
+      SX1276_Get(Image, SX1276_Implicit_Header) == 1) &&
+    (!SX1276_Has(Image, SX1276_Low_Data_Rate_Optimize) ||
+      SX1276_Get(Image, SX1276_Low_Data_Rate_Optimize) ==
+        ((1000UL << SX1276_Get(Image, SX1276_Spreading_Factor)) > 16 * SX1276_Bandwidth_Hz(SX1276_Get(Image, SX1276_Bandwidth)) ? 1 : 0));
+}
+
+// bytes of the write sequence of an image, the end mark included
+constexpr unsigned SX1276_Sequence_Size(const SX1276_Image &Image)
+{
+  unsigned Size = 1;
+  unsigned i = 0;
+
+  for(i = 1; i < SX1276_REGISTERS; i++)
+  {
+    if(Image.Mask[i] == 0)
+    {
+      continue;
+    }
+    //A new burst needs address and count
+    if(Image.Mask[i - 1] == 0)
+    {
+      Size += 2;
+    }
+    Size++;
+  }
+  return Size;
+}
+
+template <unsigned N>
+struct SX1276_Sequence
+{
+  unsigned char Data[N];
+};
+
+template <unsigned N>
+constexpr SX1276_Sequence<N> SX1276_Encode(const SX1276_Image &Image)
+{
+  SX1276_Sequence<N> Sequence = { { 0 } };
+  unsigned Count = 0;
+  unsigned Size = 0;
+  unsigned i = 0;
+
+  for(i = 1; i < SX1276_REGISTERS; i++)
+  {
+    if(Image.Mask[i] == 0)
+    {
+      continue;
+    }
+    if(Image.Mask[i - 1] == 0)
+    {
+      Sequence.Data[Size++] = i;
+      Count = Size++;
+      Sequence.Data[Count] = 0;
+    }
+    Sequence.Data[Size++] = Image.Value[i];
+    Sequence.Data[Count]++;
+  }
+  Sequence.Data[Size] = 0;
+
+  return Sequence;
+}
+
+#endif
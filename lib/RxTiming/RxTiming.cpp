@@ -0,0 +1,172 @@
+/*
+  RxTiming.cpp - Receive window timing learned from the downlinks that arrive
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include "RxTiming.h"
+
+// constructor
+RxTiming::RxTiming()
+{
+  _Drift = 0;
+  // three deviations make up the initial error
+  _Deviation = RX_TIMING_INITIAL_PPM * 16 / 3;
+  _Jitter = RX_TIMING_POLL_JITTER;
+  _Count = 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the jitter of the TxDone and RxDone timestamps in us,
+*               RX_TIMING_CAPTURE_JITTER with the capture timer
+*****************************************************************************************
+*/
+void RxTiming::Set_Jitter(uint32_t Jitter)
+{
+  _Jitter = Jitter;
+}
+
+/*
+*****************************************************************************************
+* Description : Function computes the receive window for a downlink
+*
+* Arguments   : Delay      nominal start of the downlink in ms after TxDone
+*               SF         spreading factor of the downlink
+*               Bandwidth  bandwidth in kHz
+*
+* Returns     : when to switch the receiver on and for how many symbols
+*****************************************************************************************
+*/
+Rx_Window RxTiming::Window(uint32_t Delay, unsigned char SF, uint16_t Bandwidth)
+{
+  Rx_Window Result;
+  uint32_t Symbol = ((uint32_t)1 << SF) * 1000 / Bandwidth;
+  uint32_t Error = Delay * Get_Error() / 1000 + _Jitter;
+  uint32_t Symbols;
+  int32_t Nominal;
+
+  //Minimum detection time plus the error on either side, in whole symbols
+  Symbols = ((2 * RX_TIMING_MIN_SYMBOLS - 8) * Symbol + 2 * Error + Symbol - 1) / Symbol;
+  if(Symbols < RX_TIMING_MIN_SYMBOLS)
+  {
+    Symbols = RX_TIMING_MIN_SYMBOLS;
+  }
+  if(Symbols > RX_TIMING_MAX_SYMBOLS)
+  {
+    Symbols = RX_TIMING_MAX_SYMBOLS;
+  }
+
+  //Start of the preamble on the local clock
+  Nominal = (int32_t)(Delay * 1000) + (int32_t)Delay * _Drift / 16000;
+
+  //Window centered on the middle of the preamble
+  Result.Offset = Nominal + 4 * (int32_t)Symbol - (int32_t)(Symbols * Symbol / 2) - RX_TIMING_WAKEUP;
+  Result.Symbols = Symbols;
+
+  return Result;
+}
+
+/*
+*****************************************************************************************
+* Description : Function learns the clock drift from a downlink received
+*
+* Arguments   : Expected  us from TxDone to RxDone by the gateway clock, the delay of
+*                         the window plus Airtime()
+*               Measured  the same by the local clock
+*
+* Returns     : false when the measurement was rejected as an outlier
+*****************************************************************************************
+*/
+bool RxTiming::Calibrate(uint32_t Expected, uint32_t Measured)
+{
+  int32_t Error;
+  int32_t Residual;
+
+  if(Expected == 0)
+  {
+    return false;
+  }
+
+  Error = (int32_t)(((int64_t)Measured - (int64_t)Expected) * 16000000 / Expected);
+  if(Error > RX_TIMING_MAX_PPM * 16 || Error < -RX_TIMING_MAX_PPM * 16)
+  {
+    return false;
+  }
+
+  //The first measurement replaces the guess of zero drift
+  if(_Count == 0)
+  {
+    _Drift = Error;
+  }
+  else
+  {
+    Residual = Error - _Drift;
+    _Drift += Residual / 4;
+    if(Residual < 0)
+    {
+      Residual = -Residual;
+    }
+    _Deviation = _Deviation - _Deviation / 4 + (uint32_t)Residual / 4;
+  }
+
+  if(_Count < 0xFFFF)
+  {
+    _Count++;
+  }
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function computes the time from the start of the preamble to RxDone of
+*               a package with 8 preamble symbols, explicit header and coding rate 4/5
+*
+* Arguments   : Length     payload length
+*               SF         spreading factor
+*               Bandwidth  bandwidth in kHz
+*               Crc        payload CRC, downlinks have none
+*
+* Returns     : airtime in us
+*****************************************************************************************
+*/
+uint32_t RxTiming::Airtime(unsigned char Length, unsigned char SF, uint16_t Bandwidth, bool Crc)
+{
+  uint32_t Symbol = ((uint32_t)1 << SF) * 1000 / Bandwidth;
+  //Low data rate optimization for symbols longer than 16 ms
+  int32_t Bits = 8 * Length - 4 * SF + 28 + (Crc ? 16 : 0);
+  int32_t Per_Block = 4 * (SF - ((Symbol > 16000) ? 2 : 0));
+  uint32_t Payload = 8;
+
+  if(Bits > 0)
+  {
+    Payload += (Bits + Per_Block - 1) / Per_Block * 5;
+  }
+
+  //Preamble of 8 + 4.25 symbols
+  return 49 * Symbol / 4 + Payload * Symbol;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions return the drift (ppm x 16), the clock error the windows are
+*               sized for (ppm) and the number of downlinks it was learned from
+*****************************************************************************************
+*/
+int32_t RxTiming::Get_Drift()
+{
+  return _Drift;
+}
+
+uint32_t RxTiming::Get_Error()
+{
+  uint32_t Error = (3 * _Deviation + 15) / 16;
+
+  return (Error < RX_TIMING_MIN_PPM) ? RX_TIMING_MIN_PPM : Error;
+}
+
+uint16_t RxTiming::Get_Count()
+{
+  return _Count;
+}
@@ -0,0 +1,78 @@
+/*
+  RxTiming.h - Receive window timing learned from the downlinks that arrive
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  The gateway starts the preamble of a downlink exactly RECEIVE_DELAY after the
+  end of the uplink. The node measures that delay with its own clock, so the
+  receiver has to open early and listen long enough to cover the clock error:
+
+    Error = Delay x clock error (ppm) + timestamp jitter
+
+  The window is centered on the middle of the 8 symbol preamble and lasts
+  (2 x RX_TIMING_MIN_SYMBOLS - 8) symbols plus twice the error, at least
+  RX_TIMING_MIN_SYMBOLS (the same rule as the Semtech reference stack).
+
+  Each downlink received tells how far off the local clock was: the RxDone
+  timestamp minus the airtime of the package against the nominal delay. The
+  average of that is the drift, corrected in the next windows, its mean
+  deviation the remaining clock error. A node that starts at
+  RX_TIMING_INITIAL_PPM ends up a few ppm after a handful of downlinks, SF12
+  windows shrink from tens of symbols to the minimum.
+
+  All times in us, delays in ms. Does not depend on Arduino, so it can be used in
+  host builds as well.
+*/
+
+#ifndef RxTiming_h
+#define RxTiming_h
+
+#include <stdint.h>
+
+// preamble symbols the receiver needs to detect a downlink
+#define RX_TIMING_MIN_SYMBOLS   6
+// RegSymbTimeout, only the LSB is used
+#define RX_TIMING_MAX_SYMBOLS   255
+// us from the RxSingle command to a receiver that listens
+#define RX_TIMING_WAKEUP        300
+// clock error assumed before the first downlink
+#define RX_TIMING_INITIAL_PPM   100
+// clock error never assumed to be smaller than this
+#define RX_TIMING_MIN_PPM       5
+// measurements further off than this are not a downlink of our gateway
+#define RX_TIMING_MAX_PPM       500
+// TxDone timestamp jitter in us, by polling millis() or by the capture timer
+#define RX_TIMING_POLL_JITTER   1000
+#define RX_TIMING_CAPTURE_JITTER 20
+
+typedef struct
+{
+  // us after TxDone to switch the receiver on, may be earlier than the delay
+  int32_t Offset;
+  // RegSymbTimeout
+  uint16_t Symbols;
+} Rx_Window;
+
+class RxTiming
+{
+  public:
+    RxTiming();
+    void Set_Jitter(uint32_t Jitter);
+    Rx_Window Window(uint32_t Delay, unsigned char SF, uint16_t Bandwidth);
+    bool Calibrate(uint32_t Expected, uint32_t Measured);
+    static uint32_t Airtime(unsigned char Length, unsigned char SF, uint16_t Bandwidth, bool Crc);
+
+    int32_t Get_Drift();
+    uint32_t Get_Error();
+    uint16_t Get_Count();
+
+  private:
+    // ppm x 16, positive when the local clock runs fast
+    int32_t _Drift;
+    // mean absolute deviation from the drift, ppm x 16
+    uint32_t _Deviation;
+    uint32_t _Jitter;
+    uint16_t _Count;
+};
+
+#endif
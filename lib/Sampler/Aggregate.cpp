@@ -0,0 +1,191 @@
+/*
+  Aggregate.cpp - Streaming summary of ADC samples for the uplink
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include "Aggregate.h"
+
+// samples per partial sum, 256 squares of 4095 still fit in 32 bits
+#define AGGREGATE_CHUNK 256
+
+// constructor
+Aggregate::Aggregate()
+{
+  //No threshold until one is set
+  _High = 0xFFFF;
+  _Low = 0xFFFF;
+  Reset();
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the threshold, a crossing is counted when the signal
+*               reaches High after it was at or below Low
+*****************************************************************************************
+*/
+void Aggregate::Set_Threshold(unsigned short High, unsigned short Low)
+{
+  _High = High;
+  _Low = (Low < High) ? Low : High;
+}
+
+// starts a new summary, the threshold stays
+void Aggregate::Reset()
+{
+  _Count = 0;
+  _Min = 0xFFFF;
+  _Max = 0;
+  _Sum = 0;
+  _Sum_Squares = 0;
+  _Above = false;
+  _Crossings = 0;
+}
+
+void Aggregate::Add(unsigned short Sample)
+{
+  Add_Block(&Sample, 1);
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a block of samples, e.g. half of the DMA buffer. Sums
+*               are kept in 32 bit registers per chunk and added to the 64 bit totals
+*               once per chunk.
+*****************************************************************************************
+*/
+void Aggregate::Add_Block(const unsigned short *Samples, unsigned short Count)
+{
+  unsigned short Chunk;
+  unsigned short Min = _Min;
+  unsigned short Max = _Max;
+  unsigned short Sample;
+  uint32_t Sum;
+  uint32_t Sum_Squares;
+  unsigned short i;
+
+  if(_Count + Count > AGGREGATE_MAX_COUNT)
+  {
+    Count = AGGREGATE_MAX_COUNT - _Count;
+  }
+  _Count += Count;
+
+  while(Count > 0)
+  {
+    Chunk = (Count < AGGREGATE_CHUNK) ? Count : AGGREGATE_CHUNK;
+    Sum = 0;
+    Sum_Squares = 0;
+
+    for(i = 0; i < Chunk; i++)
+    {
+      Sample = Samples[i] & 0x0FFF;
+      Sum += Sample;
+      Sum_Squares += (uint32_t)Sample * Sample;
+
+      if(Sample < Min)
+      {
+        Min = Sample;
+      }
+      if(Sample > Max)
+      {
+        Max = Sample;
+      }
+
+      if(_Above)
+      {
+        _Above = Sample > _Low;
+      }
+      else if(Sample >= _High)
+      {
+        _Above = true;
+        _Crossings++;
+      }
+    }
+
+    _Sum += Sum;
+    _Sum_Squares += Sum_Squares;
+    Samples += Chunk;
+    Count -= Chunk;
+  }
+
+  _Min = Min;
+  _Max = Max;
+}
+
+unsigned long Aggregate::Get_Count()
+{
+  return _Count;
+}
+
+unsigned short Aggregate::Get_Min()
+{
+  return _Count ? _Min : 0;
+}
+
+unsigned short Aggregate::Get_Max()
+{
+  return _Max;
+}
+
+// mean in 1/16 LSB, rounded
+unsigned short Aggregate::Get_Mean16()
+{
+  if(_Count == 0)
+  {
+    return 0;
+  }
+  return (_Sum * 16 + _Count / 2) / _Count;
+}
+
+// population variance in LSB^2
+unsigned long Aggregate::Get_Variance()
+{
+  if(_Count == 0)
+  {
+    return 0;
+  }
+  return (_Sum_Squares - (_Sum * _Sum) / _Count) / _Count;
+}
+
+unsigned short Aggregate::Get_Crossings()
+{
+  return _Crossings;
+}
+
+/*
+*****************************************************************************************
+* Description : Function writes the summary for the uplink
+*
+* Arguments   : *Data  AGGREGATE_PAYLOAD bytes
+*
+* Returns     : AGGREGATE_PAYLOAD
+*****************************************************************************************
+*/
+unsigned char Aggregate::Pack(unsigned char *Data)
+{
+  unsigned long Count = (_Count > 0xFFFF) ? 0xFFFF : _Count;
+  unsigned short Min = Get_Min();
+  unsigned short Mean = Get_Mean16();
+  unsigned long Variance = Get_Variance();
+
+  if(Variance > 0xFFFFFF)
+  {
+    Variance = 0xFFFFFF;
+  }
+
+  Data[0] = Count & 0xFF;
+  Data[1] = Count >> 8;
+  Data[2] = Min & 0xFF;
+  Data[3] = Min >> 8;
+  Data[4] = _Max & 0xFF;
+  Data[5] = _Max >> 8;
+  Data[6] = Mean & 0xFF;
+  Data[7] = Mean >> 8;
+  Data[8] = Variance & 0xFF;
+  Data[9] = (Variance >> 8) & 0xFF;
+  Data[10] = (Variance >> 16) & 0xFF;
+  Data[11] = _Crossings & 0xFF;
+  Data[12] = _Crossings >> 8;
+
+  return AGGREGATE_PAYLOAD;
+}
@@ -0,0 +1,56 @@
+/*
+  Aggregate.h - Streaming summary of ADC samples for the uplink
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Folds 12 bit samples into count, min, max, sum and sum of squares as they come,
+  and counts crossings of a threshold with hysteresis. Mean and variance are only
+  worked out by Pack(), so the per sample cost stays a few integer operations
+  (the Cortex-M3 has no FPU).
+
+  Payload of Pack(), lsb first:
+
+    Count (2) | Min (2) | Max (2) | Mean x 16 (2) | Variance (3) | Crossings (2)
+
+  Count and variance saturate.
+*/
+
+#ifndef Aggregate_h
+#define Aggregate_h
+
+#include <stdint.h>
+
+#define AGGREGATE_PAYLOAD 13
+// the sum of 12 bit samples stays below 2^32 up to here, later samples are ignored
+#define AGGREGATE_MAX_COUNT 0x100000UL
+
+class Aggregate
+{
+  public:
+    Aggregate();
+    void Set_Threshold(unsigned short High, unsigned short Low);
+    void Reset();
+    void Add(unsigned short Sample);
+    void Add_Block(const unsigned short *Samples, unsigned short Count);
+    unsigned long Get_Count();
+    unsigned short Get_Min();
+    unsigned short Get_Max();
+    unsigned short Get_Mean16();
+    unsigned long Get_Variance();
+    unsigned short Get_Crossings();
+    unsigned char Pack(unsigned char *Data);
+
+  private:
+    unsigned long _Count;
+    unsigned short _Min;
+    unsigned short _Max;
+    uint64_t _Sum;
+    uint64_t _Sum_Squares;
+    // crossing counted when rising to High, armed again at Low
+    unsigned short _High;
+    unsigned short _Low;
+    bool _Above;
+    unsigned short _Crossings;
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*
+  Sampler.cpp - ADC sampling by timer and DMA into a double buffer
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#endif
+
+#include "Sampler.h"
+
+#ifdef ARDUINO
+static ADC_HandleTypeDef Sampler_Adc;
+static DMA_HandleTypeDef Sampler_Dma;
+static TIM_HandleTypeDef Sampler_Tim;
+// the one sampler the HAL callbacks report to
+static Sampler *Sampler_Active = 0;
+#endif
+
+// constructor
+Sampler::Sampler()
+{
+  _Ready[0] = 0;
+  _Ready[1] = 0;
+  _Overruns = 0;
+  _Callback = 0;
+  _Running = false;
+}
+
+#ifdef ARDUINO
+/*
+*****************************************************************************************
+* Description : Function sets up timer, ADC and DMA, sampling starts with Start()
+*
+* Arguments   : Rate     samples per second, SAMPLER_MIN_RATE .. SAMPLER_MAX_RATE
+*               Channel  ADC channel, 0 .. 7 are PA0 .. PA7
+*
+* Returns     : false for a rate out of range or when the HAL refused
+*****************************************************************************************
+*/
+bool Sampler::begin(unsigned long Rate, unsigned char Channel)
+{
+  GPIO_InitTypeDef Gpio = {};
+  ADC_ChannelConfTypeDef Adc_Channel = {};
+  TIM_MasterConfigTypeDef Master = {};
+  RCC_PeriphCLKInitTypeDef Clock = {};
+
+  if(Rate < SAMPLER_MIN_RATE || Rate > SAMPLER_MAX_RATE || Channel > 17)
+  {
+    return false;
+  }
+
+  Sampler_Active = this;
+
+  __HAL_RCC_ADC1_CLK_ENABLE();
+  __HAL_RCC_DMA1_CLK_ENABLE();
+  __HAL_RCC_TIM3_CLK_ENABLE();
+
+  //ADC clock 72 MHz / 6 = 12 MHz, at most 14 MHz on the F1
+  Clock.PeriphClockSelection = RCC_PERIPHCLK_ADC;
+  Clock.AdcClockSelection = RCC_ADCPCLK2_DIV6;
+  HAL_RCCEx_PeriphCLKConfig(&Clock);
+
+  if(Channel < 8)
+  {
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    Gpio.Pin = 1 << Channel;
+    Gpio.Mode = GPIO_MODE_ANALOG;
+    HAL_GPIO_Init(GPIOA, &Gpio);
+  }
+
+  //Update event of TIM3 at the sample rate triggers the conversions
+  Sampler_Tim.Instance = TIM3;
+  Sampler_Tim.Init.Prescaler = SystemCoreClock / 1000000 - 1;
+  Sampler_Tim.Init.CounterMode = TIM_COUNTERMODE_UP;
+  Sampler_Tim.Init.Period = 1000000 / Rate - 1;
+  Sampler_Tim.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  Sampler_Tim.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
+  if(HAL_TIM_Base_Init(&Sampler_Tim) != HAL_OK)
+  {
+    return false;
+  }
+  Master.MasterOutputTrigger = TIM_TRGO_UPDATE;
+  Master.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  HAL_TIMEx_MasterConfigSynchronization(&Sampler_Tim, &Master);
+
+  //One conversion per trigger
+  Sampler_Adc.Instance = ADC1;
+  Sampler_Adc.Init.ScanConvMode = ADC_SCAN_DISABLE;
+  Sampler_Adc.Init.ContinuousConvMode = DISABLE;
+  Sampler_Adc.Init.DiscontinuousConvMode = DISABLE;
+  Sampler_Adc.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T3_TRGO;
+  Sampler_Adc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  Sampler_Adc.Init.NbrOfConversion = 1;
+  if(HAL_ADC_Init(&Sampler_Adc) != HAL_OK)
+  {
+    return false;
+  }
+
+  Adc_Channel.Channel = Channel;
+  Adc_Channel.Rank = ADC_REGULAR_RANK_1;
+  Adc_Channel.SamplingTime = ADC_SAMPLETIME_55CYCLES_5;
+  HAL_ADC_ConfigChannel(&Sampler_Adc, &Adc_Channel);
+  HAL_ADCEx_Calibration_Start(&Sampler_Adc);
+
+  //Circular, half and full transfer interrupts mark the halves
+  Sampler_Dma.Instance = DMA1_Channel1;
+  Sampler_Dma.Init.Direction = DMA_PERIPH_TO_MEMORY;
+  Sampler_Dma.Init.PeriphInc = DMA_PINC_DISABLE;
+  Sampler_Dma.Init.MemInc = DMA_MINC_ENABLE;
+  Sampler_Dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  Sampler_Dma.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+  Sampler_Dma.Init.Mode = DMA_CIRCULAR;
+  Sampler_Dma.Init.Priority = DMA_PRIORITY_HIGH;
+  if(HAL_DMA_Init(&Sampler_Dma) != HAL_OK)
+  {
+    return false;
+  }
+  __HAL_LINKDMA(&Sampler_Adc, DMA_Handle, Sampler_Dma);
+
+  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 2, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions start and stop sampling. Halves that were ready stay for
+*               Process(), a half that was being written is dropped.
+*****************************************************************************************
+*/
+void Sampler::Start()
+{
+  if(_Running)
+  {
+    return;
+  }
+
+  _Ready[0] = 0;
+  _Ready[1] = 0;
+  _Running = true;
+  HAL_ADC_Start_DMA(&Sampler_Adc, (uint32_t *)_Buffer, 2 * SAMPLER_BLOCK);
+  HAL_TIM_Base_Start(&Sampler_Tim);
+}
+
+void Sampler::Stop()
+{
+  if(!_Running)
+  {
+    return;
+  }
+
+  HAL_TIM_Base_Stop(&Sampler_Tim);
+  HAL_ADC_Stop_DMA(&Sampler_Adc);
+  _Running = false;
+}
+
+extern "C" void DMA1_Channel1_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&Sampler_Dma);
+}
+
+extern "C" void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *Adc)
+{
+  if(Sampler_Active != 0)
+  {
+    Sampler_Active->Block_Done(0);
+  }
+}
+
+extern "C" void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *Adc)
+{
+  if(Sampler_Active != 0)
+  {
+    Sampler_Active->Block_Done(1);
+  }
+}
+#endif
+
+// called from the DMA interrupt, e.g. to post a task
+void Sampler::On_Block(void (*Callback)())
+{
+  _Callback = Callback;
+}
+
+void Sampler::Block_Done(unsigned char Half)
+{
+  if(_Ready[Half & 1])
+  {
+    _Overruns++;
+  }
+  _Ready[Half & 1] = 1;
+
+  if(_Callback != 0)
+  {
+    _Callback();
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function folds the halves the DMA finished into Summary. A half has
+*               to be taken before the DMA comes around to it again, that is
+*               SAMPLER_BLOCK samples later.
+*
+* Returns     : true when a half was added
+*****************************************************************************************
+*/
+bool Sampler::Process(Aggregate &Summary)
+{
+  bool Added = false;
+  unsigned char Half;
+
+  for(Half = 0; Half < 2; Half++)
+  {
+    if(_Ready[Half])
+    {
+      Summary.Add_Block(&_Buffer[Half * SAMPLER_BLOCK], SAMPLER_BLOCK);
+      _Ready[Half] = 0;
+      Added = true;
+    }
+  }
+
+  return Added;
+}
+
+unsigned int Sampler::Get_Overruns()
+{
+  return _Overruns;
+}
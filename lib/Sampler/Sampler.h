@@ -0,0 +1,50 @@
+/*
+  Sampler.h - ADC sampling by timer and DMA into a double buffer
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  TIM3 triggers ADC1 at the sample rate, DMA1 channel 1 writes the results into a
+  circular buffer of two halves. The CPU is not involved per sample and can wait
+  in sleep mode (WFI); stop mode halts the ADC, so the scheduler has to hold deep
+  sleep off while sampling. Each half transfer interrupt marks that half ready and
+  calls the block callback, Process() folds the ready halves into an Aggregate
+  outside the interrupt.
+
+  TIM3, ADC1 and DMA1 channel 1 are taken, no analogRead() or PWM on TIM3 pins
+  meanwhile.
+*/
+
+#ifndef Sampler_h
+#define Sampler_h
+
+#include "Aggregate.h"
+
+// samples per half of the DMA buffer
+#define SAMPLER_BLOCK 64
+// TIM3 counts at 1 MHz
+#define SAMPLER_MIN_RATE 16
+#define SAMPLER_MAX_RATE 100000
+
+class Sampler
+{
+  public:
+    Sampler();
+    bool begin(unsigned long Rate, unsigned char Channel);
+    void Start();
+    void Stop();
+    void On_Block(void (*Callback)());
+    bool Process(Aggregate &Summary);
+    unsigned int Get_Overruns();
+    // DMA interrupt: Half 0 or 1 is full
+    void Block_Done(unsigned char Half);
+
+  private:
+    unsigned short _Buffer[2 * SAMPLER_BLOCK];
+    volatile unsigned char _Ready[2];
+    // halves written again before Process() took them
+    volatile unsigned int _Overruns;
+    void (*_Callback)();
+    bool _Running;
+};
+
+#endif
@@ -0,0 +1,110 @@
+/*
+  LowPowerClock.cpp - Scheduler clock for the STM32 with STM32LowPower
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#ifdef ARDUINO
+
+#include "Arduino.h"
+#include "STM32LowPower.h"
+#include "STM32RTC.h"
+
+#include "Scheduler.h"
+#include "LowPowerClock.h"
+
+volatile bool LowPowerClock::_Alarm = false;
+
+// constructor
+LowPowerClock::LowPowerClock()
+{
+  _Offset = 0;
+}
+
+void LowPowerClock::begin()
+{
+  LowPower.begin();
+
+  //Tells the alarm apart from the other wake up sources
+  LowPower.enableWakeupFrom(&STM32RTC::getInstance(), Alarm);
+}
+
+//RTC alarm interrupt
+void LowPowerClock::Alarm(void *Data)
+{
+  (void)Data;
+  _Alarm = true;
+}
+
+unsigned long LowPowerClock::Now()
+{
+  return millis() + _Offset;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sleeps until Delay ms passed or an interrupt wakes it
+*
+* Arguments   : Delay  ms, SCHEDULER_FOREVER when only an interrupt can wake it
+*               Mode   SCHEDULER_IDLE or SCHEDULER_DEEP_SLEEP
+*****************************************************************************************
+*/
+void LowPowerClock::Sleep(unsigned long Delay, unsigned char Mode)
+{
+  STM32RTC &rtc = STM32RTC::getInstance();
+  unsigned long Before;
+  unsigned long Millis;
+  unsigned long Slept;
+  uint32_t Sub_Before = 0;
+  uint32_t Sub_After = 0;
+
+  if(Mode != SCHEDULER_DEEP_SLEEP)
+  {
+    //The SysTick wakes it within a ms
+    LowPower.idle();
+    return;
+  }
+
+  Millis = millis();
+  Before = rtc.getEpoch(&Sub_Before);
+  _Alarm = false;
+
+  if(Delay == SCHEDULER_FOREVER)
+  {
+    LowPower.deepSleep();
+  }
+  else
+  {
+    LowPower.deepSleep(Delay);
+  }
+
+  //Woken by the alarm the sleep took Delay. Otherwise the RTC measures it, in
+  //ms where the core reads sub seconds, in seconds on the F1 without them.
+  if(_Alarm && Delay != SCHEDULER_FOREVER)
+  {
+    Slept = Delay;
+  }
+  else
+  {
+    Slept = (rtc.getEpoch(&Sub_After) - Before) * 1000 + Sub_After - Sub_Before;
+
+    //An interrupt came first, the alarm must not wake the next sleep
+    if(Delay != SCHEDULER_FOREVER)
+    {
+      rtc.disableAlarm();
+      if(Slept >= Delay)
+      {
+        Slept = Delay - 1;
+      }
+    }
+  }
+
+  //Whatever millis() counted while stopping and starting is already in Now()
+  Millis = millis() - Millis;
+  if(Slept > Millis)
+  {
+    _Offset += Slept - Millis;
+  }
+}
+
+#endif
@@ -0,0 +1,30 @@
+/*
+  LowPowerClock.h - Scheduler clock for the STM32 with STM32LowPower
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Idle is sleep mode (WFI), the SysTick keeps running and wakes it every ms.
+  Deep sleep is stop mode with an RTC alarm, the SysTick stops so millis() falls
+  behind by the time asleep. Now() adds that time back: the whole Delay when
+  the RTC alarm woke it, the time the RTC measured when another interrupt did.
+*/
+
+#ifndef LowPowerClock_h
+#define LowPowerClock_h
+
+class LowPowerClock
+{
+  public:
+    LowPowerClock();
+    void begin();
+    unsigned long Now();
+    void Sleep(unsigned long Delay, unsigned char Mode);
+  private:
+    // ms spent in stop mode
+    unsigned long _Offset;
+    // set by the RTC alarm interrupt, the sleep took its full Delay
+    static volatile bool _Alarm;
+    static void Alarm(void *Data);
+};
+
+#endif
@@ -0,0 +1,364 @@
+/*
+  Scheduler.h - Cooperative scheduler with timers, events and tickless sleep
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Tasks are plain functions that run to completion. A task runs when its timer is
+  due (once or every period) or when an event was posted for it, e.g. from an
+  interrupt. Between tasks Run() sleeps until the next deadline: the deepest mode
+  unless it is held off or the deadline is too near to pay for the wakeup.
+
+  Scheduler<Clock> calls the clock directly, like LoRaWAN<Radio> calls the radio:
+
+      unsigned long Now()                               ms, may wrap
+      void Sleep(unsigned long Delay, unsigned char Mode)
+        return after Delay ms or on an interrupt, Delay is SCHEDULER_FOREVER
+        when no timer is set
+
+  LowPowerClock is the STM32 clock, host tools use a virtual one.
+*/
+
+#ifndef Scheduler_h
+#define Scheduler_h
+
+#include <type_traits>
+#include <utility>
+
+// send, radio, join, receive, three for sampling, two for the journal and one spare
+#define SCHEDULER_MAX_TASKS 10
+#define SCHEDULER_FOREVER 0xFFFFFFFFUL
+// below this the stop mode wakeup (clock restart) costs more than it saves, ms
+#ifndef SCHEDULER_DEEP_SLEEP_MIN
+#define SCHEDULER_DEEP_SLEEP_MIN 10
+#endif
+
+// sleep modes, also the index of Get_Time
+#define SCHEDULER_RUN 0
+#define SCHEDULER_IDLE 1
+#define SCHEDULER_DEEP_SLEEP 2
+
+typedef void (*Scheduler_Task)(void *Context);
+
+template <class...> struct Scheduler_Void
+{
+  typedef void type;
+};
+
+template <class Clock, class = void>
+struct Scheduler_Is_Clock : std::false_type
+{
+};
+
+template <class Clock>
+struct Scheduler_Is_Clock<Clock, typename Scheduler_Void<
+  decltype(std::declval<Clock &>().Sleep(0UL, (unsigned char)0))
+  >::type> : std::is_same<decltype(std::declval<Clock &>().Now()), unsigned long>
+{
+};
+
+struct Scheduler_Entry
+{
+  Scheduler_Task Task;
+  void *Context;
+  unsigned long Deadline;
+  // 0 for a single run
+  unsigned long Period;
+  bool Timed;
+};
+
+template <class Clock>
+class Scheduler
+{
+  static_assert(Scheduler_Is_Clock<Clock>::value,
+    "Clock needs unsigned long Now() and Sleep(unsigned long Delay, unsigned char Mode), see Scheduler.h");
+
+  public:
+    Scheduler(Clock &clock);
+    signed char Add(Scheduler_Task Task, void *Context = 0);
+    void Post(unsigned char Id);
+    void Run_After(unsigned char Id, unsigned long Delay);
+    void Run_Every(unsigned char Id, unsigned long Period, unsigned long First = 0);
+    void Cancel(unsigned char Id);
+    void Hold_Deep_Sleep();
+    void Release_Deep_Sleep();
+    void Run();
+    unsigned long Now();
+    unsigned long Get_Time(unsigned char Mode);
+    unsigned long Get_Max_Late();
+
+  private:
+    Clock *_Clock;
+    Scheduler_Entry _Entries[SCHEDULER_MAX_TASKS];
+    // set by Post, single bytes so an interrupt can set them without a lock
+    volatile unsigned char _Pending[SCHEDULER_MAX_TASKS];
+    unsigned char _Count;
+    unsigned char _Hold;
+    unsigned long _Time[3];
+    unsigned long _Last;
+    unsigned long _Max_Late;
+
+    bool Any_Pending();
+};
+
+// constructor
+template <class Clock>
+Scheduler<Clock>::Scheduler(Clock &clock)
+{
+  unsigned char i;
+
+  _Clock = &clock;
+  _Count = 0;
+  _Hold = 0;
+  _Max_Late = 0;
+  _Last = _Clock->Now();
+
+  for(i = 0; i < SCHEDULER_MAX_TASKS; i++)
+  {
+    _Entries[i].Task = 0;
+    _Entries[i].Timed = false;
+    _Pending[i] = 0;
+  }
+  for(i = 0; i < 3; i++)
+  {
+    _Time[i] = 0;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a task, it runs after Post, Run_After or Run_Every
+*
+* Arguments   : Task     function called with Context
+*
+* Returns     : id of the task, -1 when SCHEDULER_MAX_TASKS are used
+*****************************************************************************************
+*/
+template <class Clock>
+signed char Scheduler<Clock>::Add(Scheduler_Task Task, void *Context)
+{
+  if(_Count >= SCHEDULER_MAX_TASKS || Task == 0)
+  {
+    return -1;
+  }
+
+  _Entries[_Count].Task = Task;
+  _Entries[_Count].Context = Context;
+  _Entries[_Count].Timed = false;
+  _Pending[_Count] = 0;
+
+  return _Count++;
+}
+
+/*
+*****************************************************************************************
+* Description : Function lets a task run as soon as possible, safe to call from an
+*               interrupt. Events posted again before the task ran are merged.
+*****************************************************************************************
+*/
+template <class Clock>
+void Scheduler<Clock>::Post(unsigned char Id)
+{
+  if(Id < SCHEDULER_MAX_TASKS)
+  {
+    _Pending[Id] = 1;
+  }
+}
+
+template <class Clock>
+void Scheduler<Clock>::Run_After(unsigned char Id, unsigned long Delay)
+{
+  if(Id >= _Count)
+  {
+    return;
+  }
+
+  _Entries[Id].Deadline = _Clock->Now() + Delay;
+  _Entries[Id].Period = 0;
+  _Entries[Id].Timed = true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function runs a task every Period ms, the first time after First ms.
+*               Deadlines follow each other by Period, a late run does not shift
+*               the following ones.
+*****************************************************************************************
+*/
+template <class Clock>
+void Scheduler<Clock>::Run_Every(unsigned char Id, unsigned long Period, unsigned long First)
+{
+  if(Id >= _Count || Period == 0)
+  {
+    return;
+  }
+
+  _Entries[Id].Deadline = _Clock->Now() + First;
+  _Entries[Id].Period = Period;
+  _Entries[Id].Timed = true;
+}
+
+template <class Clock>
+void Scheduler<Clock>::Cancel(unsigned char Id)
+{
+  if(Id < _Count)
+  {
+    _Entries[Id].Timed = false;
+    _Pending[Id] = 0;
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Functions keep the scheduler out of deep sleep while a peripheral
+*               needs its clock (USB, a DMA transfer, an open receive window).
+*               Calls nest.
+*****************************************************************************************
+*/
+template <class Clock>
+void Scheduler<Clock>::Hold_Deep_Sleep()
+{
+  _Hold++;
+}
+
+template <class Clock>
+void Scheduler<Clock>::Release_Deep_Sleep()
+{
+  if(_Hold > 0)
+  {
+    _Hold--;
+  }
+}
+
+template <class Clock>
+bool Scheduler<Clock>::Any_Pending()
+{
+  unsigned char i;
+
+  for(i = 0; i < _Count; i++)
+  {
+    if(_Pending[i])
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+*****************************************************************************************
+* Description : Function runs all tasks that are due or have an event, then sleeps
+*               until the next deadline. Call it from loop().
+*               An event posted after the last check and before the sleep waits for
+*               the next wakeup, the clock wakes at the next deadline in any case.
+*****************************************************************************************
+*/
+template <class Clock>
+void Scheduler<Clock>::Run()
+{
+  unsigned long Now = _Clock->Now();
+  unsigned long Next = SCHEDULER_FOREVER;
+  unsigned long Left;
+  unsigned char Mode;
+  unsigned char i;
+  bool Ran = false;
+
+  for(i = 0; i < _Count; i++)
+  {
+    Scheduler_Entry &Entry = _Entries[i];
+
+    if(_Pending[i])
+    {
+      _Pending[i] = 0;
+      Entry.Task(Entry.Context);
+      Ran = true;
+      continue;
+    }
+
+    if(Entry.Timed && (long)(Now - Entry.Deadline) >= 0)
+    {
+      if(Now - Entry.Deadline > _Max_Late)
+      {
+        _Max_Late = Now - Entry.Deadline;
+      }
+
+      if(Entry.Period == 0)
+      {
+        Entry.Timed = false;
+      }
+      else
+      {
+        Entry.Deadline += Entry.Period;
+        //More than a period behind, skip the missed runs
+        if((long)(Now - Entry.Deadline) >= 0)
+        {
+          Entry.Deadline = Now + Entry.Period;
+        }
+      }
+
+      Entry.Task(Entry.Context);
+      Ran = true;
+    }
+  }
+
+  Now = _Clock->Now();
+  _Time[SCHEDULER_RUN] += Now - _Last;
+  _Last = Now;
+
+  //Tasks may have posted or set timers, look again first
+  if(Ran || Any_Pending())
+  {
+    return;
+  }
+
+  for(i = 0; i < _Count; i++)
+  {
+    if(!_Entries[i].Timed)
+    {
+      continue;
+    }
+    if((long)(_Entries[i].Deadline - Now) <= 0)
+    {
+      return;
+    }
+
+    Left = _Entries[i].Deadline - Now;
+    if(Left < Next)
+    {
+      Next = Left;
+    }
+  }
+
+  Mode = (_Hold > 0 || Next < SCHEDULER_DEEP_SLEEP_MIN) ? SCHEDULER_IDLE : SCHEDULER_DEEP_SLEEP;
+  _Clock->Sleep(Next, Mode);
+
+  Now = _Clock->Now();
+  _Time[Mode] += Now - _Last;
+  _Last = Now;
+}
+
+template <class Clock>
+unsigned long Scheduler<Clock>::Now()
+{
+  return _Clock->Now();
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the ms spent in a mode: SCHEDULER_RUN (tasks),
+*               SCHEDULER_IDLE or SCHEDULER_DEEP_SLEEP
+*****************************************************************************************
+*/
+template <class Clock>
+unsigned long Scheduler<Clock>::Get_Time(unsigned char Mode)
+{
+  return Mode < 3 ? _Time[Mode] : 0;
+}
+
+// largest delay of a timed task after its deadline, ms
+template <class Clock>
+unsigned long Scheduler<Clock>::Get_Max_Late()
+{
+  return _Max_Late;
+}
+
+#endif
@@ -0,0 +1,330 @@
+/*
+  SessionStore.cpp - Retained storage for a LoRaWAN session
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include "SessionStore.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+#include "EEPROM.h"
+#include "backup.h"
+
+// backup registers for the frame counter and DevNonce, DR1 and DR6 are used by the RTC
+#define SESSION_BKP_FCNT_LOW  LL_RTC_BKP_DR8
+#define SESSION_BKP_FCNT_HIGH LL_RTC_BKP_DR9
+#define SESSION_BKP_CHECK     LL_RTC_BKP_DR10
+#define SESSION_BKP_NONCE     LL_RTC_BKP_DR4
+#define SESSION_BKP_NONCE_CHECK LL_RTC_BKP_DR5
+#else
+#include <string.h>
+
+// host builds keep everything in the object
+#define SESSION_BKP_FCNT_LOW  0
+#define SESSION_BKP_FCNT_HIGH 1
+#define SESSION_BKP_CHECK     2
+#define SESSION_BKP_NONCE     3
+#define SESSION_BKP_NONCE_CHECK 4
+#endif
+
+// "LWS2", changes whenever LoRaWAN_Session changes
+#define SESSION_MAGIC 0x3253574CUL
+
+static uint32_t Session_CRC(unsigned char *Data, unsigned int Length);
+static unsigned short Session_Check(unsigned long Frame_Counter_Tx);
+static unsigned short Session_Nonce_Check(unsigned short DevNonce);
+
+
+// constructor
+SessionStore::SessionStore()
+{
+#ifndef ARDUINO
+  memset(_Flash, 0xFF, sizeof(_Flash));
+  memset(_Backup, 0, sizeof(_Backup));
+  _Flash_Writes = 0;
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function reads the session from flash and the frame counter from the
+*               backup registers
+*
+* Arguments   : *Session  filled with the stored session, DevNonce is valid even if
+*                         there is no joined session
+*
+* Returns     : true when a joined session was restored
+*****************************************************************************************
+*/
+bool SessionStore::Load(LoRaWAN_Session *Session)
+{
+  unsigned long Frame_Counter_Tx;
+  unsigned short DevNonce;
+  bool Nonce_Valid;
+
+  DevNonce = Read_Backup(SESSION_BKP_NONCE);
+  Nonce_Valid = Read_Backup(SESSION_BKP_NONCE_CHECK) == Session_Nonce_Check(DevNonce);
+
+  if(!Read_Session(Session))
+  {
+    memset(Session, 0, sizeof(LoRaWAN_Session));
+    if(Nonce_Valid)
+    {
+      Session->DevNonce = DevNonce;
+    }
+    return false;
+  }
+
+  //Exact DevNonce when the backup domain kept it, else past any the checkpoint can lag
+  if(Nonce_Valid && (unsigned short)(DevNonce - Session->DevNonce) < SESSION_NONCE_FLASH_INTERVAL)
+  {
+    Session->DevNonce = DevNonce;
+  }
+  else
+  {
+    Session->DevNonce += SESSION_NONCE_FLASH_INTERVAL;
+  }
+
+  if(!Session->Joined)
+  {
+    return false;
+  }
+
+  //Exact frame counter when the backup domain kept it
+  Frame_Counter_Tx = Read_Backup(SESSION_BKP_FCNT_LOW) | (Read_Backup(SESSION_BKP_FCNT_HIGH) << 16);
+
+  if(Read_Backup(SESSION_BKP_CHECK) == Session_Check(Frame_Counter_Tx) &&
+     Frame_Counter_Tx >= Session->Frame_Counter_Tx)
+  {
+    Session->Frame_Counter_Tx = Frame_Counter_Tx;
+  }
+  else
+  {
+    //Somewhere after the last checkpoint, skip ahead
+    Session->Frame_Counter_Tx += SESSION_FCNT_FLASH_INTERVAL;
+  }
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function writes the whole session to flash, one page erase
+*****************************************************************************************
+*/
+void SessionStore::Save(LoRaWAN_Session *Session)
+{
+  Write_Session(Session);
+
+  Save_Frame_Counter(Session->Frame_Counter_Tx);
+  Write_Backup(SESSION_BKP_NONCE, Session->DevNonce);
+  Write_Backup(SESSION_BKP_NONCE_CHECK, Session_Nonce_Check(Session->DevNonce));
+}
+
+/*
+*****************************************************************************************
+* Description : Function stores the frame counter after an uplink in the backup
+*               registers. The caller checkpoints the whole session with Save() every
+*               SESSION_FCNT_FLASH_INTERVAL frames.
+*****************************************************************************************
+*/
+void SessionStore::Save_Frame_Counter(unsigned long Frame_Counter_Tx)
+{
+  Write_Backup(SESSION_BKP_FCNT_LOW, Frame_Counter_Tx & 0xFFFF);
+  Write_Backup(SESSION_BKP_FCNT_HIGH, (Frame_Counter_Tx >> 16) & 0xFFFF);
+  Write_Backup(SESSION_BKP_CHECK, Session_Check(Frame_Counter_Tx));
+}
+
+/*
+*****************************************************************************************
+* Description : Function stores the DevNonce of a join request in the backup registers.
+*               Flash gets a checkpoint when it has none or lags
+*               SESSION_NONCE_FLASH_INTERVAL behind, so Load() never goes back to a
+*               DevNonce that was used. The rest of the stored session is kept.
+*****************************************************************************************
+*/
+void SessionStore::Save_DevNonce(unsigned short DevNonce)
+{
+  LoRaWAN_Session Session;
+
+  Write_Backup(SESSION_BKP_NONCE, DevNonce);
+  Write_Backup(SESSION_BKP_NONCE_CHECK, Session_Nonce_Check(DevNonce));
+
+  if(!Read_Session(&Session))
+  {
+    memset(&Session, 0, sizeof(LoRaWAN_Session));
+  }
+  else if((unsigned short)(DevNonce - Session.DevNonce) < SESSION_NONCE_FLASH_INTERVAL)
+  {
+    return;
+  }
+
+  Session.DevNonce = DevNonce;
+  Write_Session(&Session);
+}
+
+/*
+*****************************************************************************************
+* Description : Function forgets the joined session but keeps DevNonce, so the next
+*               join does not reuse one
+*****************************************************************************************
+*/
+void SessionStore::Erase()
+{
+  LoRaWAN_Session Session;
+
+  Load(&Session);
+  Session.Joined = 0;
+  Save(&Session);
+}
+
+#ifndef ARDUINO
+void SessionStore::Power_Loss()
+{
+  memset(_Backup, 0, sizeof(_Backup));
+}
+
+unsigned long SessionStore::Get_Flash_Writes()
+{
+  return _Flash_Writes;
+}
+#endif
+
+/*
+*****************************************************************************************
+* Description : Function reads the session record from flash
+*
+* Returns     : false when magic or CRC do not match, *Session is undefined then
+*****************************************************************************************
+*/
+bool SessionStore::Read_Session(LoRaWAN_Session *Session)
+{
+  unsigned char Record[SESSION_RECORD_SIZE];
+  uint32_t Magic;
+  uint32_t CRC;
+
+  Read_Record(Record);
+
+  memcpy(&Magic, &Record[0], 4);
+  memcpy(&CRC, &Record[4 + sizeof(LoRaWAN_Session)], 4);
+
+  if(Magic != SESSION_MAGIC || CRC != Session_CRC(Record, 4 + sizeof(LoRaWAN_Session)))
+  {
+    return false;
+  }
+
+  memcpy(Session, &Record[4], sizeof(LoRaWAN_Session));
+  return true;
+}
+
+void SessionStore::Write_Session(LoRaWAN_Session *Session)
+{
+  unsigned char Record[SESSION_RECORD_SIZE];
+  uint32_t Magic = SESSION_MAGIC;
+  uint32_t CRC;
+
+  memcpy(&Record[0], &Magic, 4);
+  memcpy(&Record[4], Session, sizeof(LoRaWAN_Session));
+  CRC = Session_CRC(Record, 4 + sizeof(LoRaWAN_Session));
+  memcpy(&Record[4 + sizeof(LoRaWAN_Session)], &CRC, 4);
+
+  Write_Record(Record);
+}
+
+/*
+*****************************************************************************************
+* Description : Storage access, emulated EEPROM and backup registers on the STM32,
+*               plain memory in host builds
+*****************************************************************************************
+*/
+void SessionStore::Read_Record(unsigned char *Record)
+{
+#ifdef ARDUINO
+  unsigned int i;
+
+  eeprom_buffer_fill();
+  for(i = 0; i < SESSION_RECORD_SIZE; i++)
+  {
+    Record[i] = eeprom_buffered_read_byte(i);
+  }
+#else
+  memcpy(Record, _Flash, SESSION_RECORD_SIZE);
+#endif
+}
+
+void SessionStore::Write_Record(unsigned char *Record)
+{
+#ifdef ARDUINO
+  unsigned int i;
+
+  eeprom_buffer_fill();
+  for(i = 0; i < SESSION_RECORD_SIZE; i++)
+  {
+    eeprom_buffered_write_byte(i, Record[i]);
+  }
+  eeprom_buffer_flush();
+#else
+  memcpy(_Flash, Record, SESSION_RECORD_SIZE);
+  _Flash_Writes++;
+#endif
+}
+
+unsigned long SessionStore::Read_Backup(unsigned long Index)
+{
+#ifdef ARDUINO
+  enableBackupDomain();
+  return getBackupRegister(Index);
+#else
+  return _Backup[Index];
+#endif
+}
+
+void SessionStore::Write_Backup(unsigned long Index, unsigned long Value)
+{
+#ifdef ARDUINO
+  enableBackupDomain();
+  setBackupRegister(Index, Value);
+#else
+  _Backup[Index] = Value;
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : CRC-32 (IEEE 802.3), bitwise to keep the flash footprint small
+*****************************************************************************************
+*/
+static uint32_t Session_CRC(unsigned char *Data, unsigned int Length)
+{
+  unsigned int i;
+  unsigned char j;
+  uint32_t CRC = 0xFFFFFFFFUL;
+
+  for(i = 0; i < Length; i++)
+  {
+    CRC ^= Data[i];
+    for(j = 0; j < 8; j++)
+    {
+      CRC = (CRC >> 1) ^ (0xEDB88320UL & (0 - (CRC & 1)));
+    }
+  }
+
+  return ~CRC;
+}
+
+/*
+*****************************************************************************************
+* Description : Check value stored next to the frame counter in the backup registers,
+*               backup registers read 0 after the backup domain lost power
+*****************************************************************************************
+*/
+static unsigned short Session_Check(unsigned long Frame_Counter_Tx)
+{
+  return ((Frame_Counter_Tx ^ (Frame_Counter_Tx >> 16)) ^ 0xA55A) & 0xFFFF;
+}
+
+static unsigned short Session_Nonce_Check(unsigned short DevNonce)
+{
+  return DevNonce ^ 0x3CC3;
+}
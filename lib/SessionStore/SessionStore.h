@@ -0,0 +1,78 @@
+/*
+  SessionStore.h - Retained storage for a LoRaWAN session
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Keeps the session derived by an OTAA join, so a reboot resumes it instead of
+  joining again. Two places are used on the STM32F103:
+  - the emulated EEPROM (one flash page) holds keys, DevAddr and DevNonce. It is
+    written on a join, every SESSION_NONCE_FLASH_INTERVAL join requests and every
+    SESSION_FCNT_FLASH_INTERVAL uplinks only, a flash page survives about 10k
+    erase cycles.
+  - three backup registers hold the uplink frame counter, two more DevNonce.
+    They are written on every uplink and join request and survive resets as
+    long as the supply (or VBAT) is there.
+  After a power loss frame counter and DevNonce are taken from flash and
+  advanced by SESSION_FCNT_FLASH_INTERVAL and SESSION_NONCE_FLASH_INTERVAL, so
+  they never go backwards.
+  Host builds (no ARDUINO) keep both in the object, one store per simulated node.
+*/
+
+#ifndef SessionStore_h
+#define SessionStore_h
+
+#include <stdint.h>
+
+#define SESSION_FCNT_FLASH_INTERVAL 1024
+// join requests between DevNonce checkpoints in flash
+#define SESSION_NONCE_FLASH_INTERVAL 16
+
+struct LoRaWAN_Session
+{
+  unsigned char DevAddr[4];
+  unsigned char NwkSkey[16];
+  unsigned char AppSkey[16];
+  // last DevNonce used, must never repeat for the AppKey
+  unsigned short DevNonce;
+  // receive window settings of the join accept, RxDelay in s
+  unsigned char Rx1_Offset;
+  unsigned char Rx2_Datarate;
+  unsigned char Rx_Delay;
+  // 1 when DevAddr and keys are valid
+  unsigned char Joined;
+  unsigned long Frame_Counter_Tx;
+};
+
+// magic, session, CRC
+#define SESSION_RECORD_SIZE (4 + sizeof(LoRaWAN_Session) + 4)
+
+class SessionStore
+{
+  public:
+    SessionStore();
+    bool Load(LoRaWAN_Session *Session);
+    void Save(LoRaWAN_Session *Session);
+    void Save_Frame_Counter(unsigned long Frame_Counter_Tx);
+    void Save_DevNonce(unsigned short DevNonce);
+    void Erase();
+#ifndef ARDUINO
+    // simulation: the backup domain loses its supply, flash page erases so far
+    void Power_Loss();
+    unsigned long Get_Flash_Writes();
+#endif
+
+  private:
+    bool Read_Session(LoRaWAN_Session *Session);
+    void Write_Session(LoRaWAN_Session *Session);
+    void Read_Record(unsigned char *Record);
+    void Write_Record(unsigned char *Record);
+    unsigned long Read_Backup(unsigned long Index);
+    void Write_Backup(unsigned long Index, unsigned long Value);
+#ifndef ARDUINO
+    unsigned char _Flash[SESSION_RECORD_SIZE];
+    unsigned long _Backup[5];
+    unsigned long _Flash_Writes;
+#endif
+};
+
+#endif
@@ -0,0 +1,433 @@
+/*
+  SimRadio.cpp - Simulated radio for host builds of the LoRaWAN stack
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <string.h>
+#include "SimRadio.h"
+
+// constructor
+SimRadio::SimRadio()
+{
+  _Now = 0;
+  _Tx_Done_Time = 0;
+  _Tx_Busy = false;
+  _Rx_Window = 0;
+  _Rx_End = 0;
+  _Tx_Power = 16;
+  _Datarate = 2;
+  _Rx2_Datarate = 0;
+  _Rx1_Offset = 0;
+  _Current_Channel = 0;
+  _Package_Count = 0;
+  _Downlink_Length = 0;
+  _Downlink_Window = 0;
+  _Snr = 0;
+  memset(&_Last, 0, sizeof(_Last));
+  _Rx_Continuous = false;
+  _Rx_Callback = 0;
+  _Uplink_Callback = 0;
+  _Uplink_Context = 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function "transmits" a package, it is kept as the last package and the
+*               virtual clock advances by its time on air
+*****************************************************************************************
+*/
+bool SimRadio::RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+{
+  if(!RFM_Start_Package(RFM_Tx_Package, Package_Length))
+  {
+    return false;
+  }
+
+  _Now = _Tx_Done_Time;
+  RFM_Tx_Wait();
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Functions for a scheduled uplink, like on the RFM95: start the
+*               package, wait for TxDone, wait for a receive window, open it and
+*               wait until it closes. Only RFM_Open_Window moves the clock, to the
+*               start of the window like the RFM95 waits for it. Each wait returns the
+*               ms until the radio is done and 0 once it is.
+*****************************************************************************************
+*/
+bool SimRadio::RFM_Start_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length)
+{
+  if(Package_Length > SIMRADIO_MAX_PACKAGE)
+  {
+    return false;
+  }
+
+  //Like the RFM95, transmitting ends continuous receive
+  _Rx_Continuous = false;
+
+  //FSK uses its own channel like on the RFM95
+  _Current_Channel = (_Datarate == 7) ? CHANNEL_FSK : _Channels.Select();
+
+  memcpy(_Last.Data, RFM_Tx_Package, Package_Length);
+  _Last.Length = Package_Length;
+  _Last.Channel = _Current_Channel;
+  _Last.Datarate = _Datarate;
+  _Last.Tx_Power = _Tx_Power;
+  _Last.Start = _Now;
+  _Last.Time_On_Air = Time_On_Air(_Datarate, Package_Length);
+
+  _Tx_Done_Time = _Now + _Last.Time_On_Air;
+  _Tx_Busy = true;
+  _Package_Count++;
+
+  return true;
+}
+
+unsigned long SimRadio::RFM_Tx_Wait()
+{
+  if(!_Tx_Busy)
+  {
+    return 0;
+  }
+
+  if(_Now < _Tx_Done_Time)
+  {
+    return (unsigned long)((_Tx_Done_Time - _Now + 999) / 1000);
+  }
+
+  _Tx_Busy = false;
+
+  //The network sees the package at TxDone
+  if(_Uplink_Callback != 0)
+  {
+    _Uplink_Callback(*this, _Uplink_Context);
+  }
+
+  return 0;
+}
+
+signed long SimRadio::RFM_Window_Wait(unsigned long Delay, unsigned char Window)
+{
+  (void)Window;
+
+  return (signed long)((int64_t)(_Tx_Done_Time + (uint64_t)Delay * 1000) - (int64_t)_Now);
+}
+
+unsigned long SimRadio::RFM_Open_Window(unsigned long Delay, unsigned char Window)
+{
+  unsigned char Datarate = (Window == 2) ? _Rx2_Datarate : ((_Datarate > _Rx1_Offset) ? _Datarate - _Rx1_Offset : 0);
+  uint64_t Start = _Tx_Done_Time + (uint64_t)Delay * 1000;
+
+  _Rx_Continuous = false;
+
+  //The radio waits for the window
+  if(_Now < Start)
+  {
+    _Now = Start;
+  }
+
+  if(_Downlink_Length != 0 && _Downlink_Window == Window)
+  {
+    _Rx_End = _Now + Time_On_Air(Datarate, _Downlink_Length);
+  }
+  else
+  {
+    _Rx_End = _Now + 8 * Symbol_Time(Datarate);
+  }
+  _Rx_Window = Window;
+
+  return (unsigned long)((_Rx_End - _Now + 999) / 1000);
+}
+
+unsigned long SimRadio::RFM_Rx_Wait(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned char *Length)
+{
+  *Length = 0;
+  if(_Rx_Window == 0)
+  {
+    return 0;
+  }
+
+  if(_Now < _Rx_End)
+  {
+    return (unsigned long)((_Rx_End - _Now + 999) / 1000);
+  }
+
+  if(_Downlink_Length != 0 && _Downlink_Window == _Rx_Window)
+  {
+    *Length = (_Downlink_Length < Max_Length) ? _Downlink_Length : Max_Length;
+    memcpy(RFM_Rx_Package, _Downlink, *Length);
+    _Downlink_Length = 0;
+  }
+  _Rx_Window = 0;
+
+  return 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function delivers a queued downlink when it was queued for this window,
+*               the clock advances to the start of the window plus the package, or the
+*               receive timeout of 8 symbols when there is nothing
+*****************************************************************************************
+*/
+unsigned char SimRadio::RFM_Receive_Window(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned long Delay, unsigned char Window)
+{
+  unsigned char Datarate = (Window == 2) ? _Rx2_Datarate : ((_Datarate > _Rx1_Offset) ? _Datarate - _Rx1_Offset : 0);
+  unsigned char Length = 0;
+
+  _Rx_Continuous = false;
+  _Now = _Tx_Done_Time + (uint64_t)Delay * 1000;
+
+  if(_Downlink_Length != 0 && _Downlink_Window == Window)
+  {
+    Length = (_Downlink_Length < Max_Length) ? _Downlink_Length : Max_Length;
+    memcpy(RFM_Rx_Package, _Downlink, Length);
+    _Downlink_Length = 0;
+    _Now += Time_On_Air(Datarate, Length);
+  }
+  else
+  {
+    _Now += 8 * Symbol_Time(Datarate);
+  }
+
+  return Length;
+}
+
+//SNR every downlink arrives with, see Set_Snr()
+signed char SimRadio::RFM_Get_Snr()
+{
+  return _Snr;
+}
+
+void SimRadio::RFM_Set_Tx_Power(signed char Power, bool PA_Boost)
+{
+  (void)PA_Boost;
+  _Tx_Power = Power;
+}
+
+signed char SimRadio::RFM_Get_Tx_Power()
+{
+  return _Tx_Power;
+}
+
+void SimRadio::RFM_Set_Datarate(unsigned char Datarate)
+{
+  if(Datarate <= 7)
+  {
+    _Datarate = Datarate;
+  }
+}
+
+unsigned char SimRadio::RFM_Get_Datarate()
+{
+  return _Datarate;
+}
+
+void SimRadio::RFM_Set_Rx2_Datarate(unsigned char Datarate)
+{
+  if(Datarate <= 6)
+  {
+    _Rx2_Datarate = Datarate;
+  }
+}
+
+unsigned char SimRadio::RFM_Get_Rx2_Datarate()
+{
+  return _Rx2_Datarate;
+}
+
+void SimRadio::RFM_Set_Rx1_Offset(unsigned char Offset)
+{
+  if(Offset <= 5)
+  {
+    _Rx1_Offset = Offset;
+  }
+}
+
+unsigned char SimRadio::RFM_Get_Rx1_Offset()
+{
+  return _Rx1_Offset;
+}
+
+unsigned char SimRadio::RFM_Get_Channel()
+{
+  return _Current_Channel;
+}
+
+ChannelSelector &SimRadio::RFM_Channels()
+{
+  return _Channels;
+}
+
+void SimRadio::RFM_Start_Continuous_Rx()
+{
+  _Rx_Continuous = true;
+}
+
+void SimRadio::RFM_Stop_Continuous_Rx()
+{
+  _Rx_Continuous = false;
+}
+
+unsigned char SimRadio::RFM_Get_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length)
+{
+  Rx_Package *Package = _Rx_Ring.Front();
+  unsigned char Length;
+
+  if(Package == 0)
+  {
+    return 0;
+  }
+
+  Length = (Package->Length < Max_Length) ? Package->Length : Max_Length;
+  memcpy(RFM_Rx_Package, Package->Data, Length);
+  _Rx_Ring.Pop();
+
+  return Length;
+}
+
+void SimRadio::RFM_On_Receive(void (*Callback)())
+{
+  _Rx_Callback = Callback;
+}
+
+unsigned int SimRadio::RFM_Get_Rx_Dropped()
+{
+  return _Rx_Ring.Get_Dropped();
+}
+
+/*
+*****************************************************************************************
+* Description : Function plays the RxDone interrupt of continuous receive: the package
+*               goes into the ring and the receive callback runs
+*
+* Returns     : false when the radio does not receive or the ring is full
+*****************************************************************************************
+*/
+bool SimRadio::Deliver(const unsigned char *Data, unsigned char Length)
+{
+  Rx_Package *Package;
+
+  if(!_Rx_Continuous)
+  {
+    return false;
+  }
+
+  Package = _Rx_Ring.Slot();
+  if(Package == 0)
+  {
+    return false;
+  }
+
+  Package->Length = (Length < PACKET_RING_SIZE) ? Length : PACKET_RING_SIZE;
+  memcpy(Package->Data, Data, Package->Length);
+  Package->Rssi = -80;
+  Package->Snr = 8;
+  _Rx_Ring.Push();
+
+  if(_Rx_Callback != 0)
+  {
+    _Rx_Callback();
+  }
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function sets the network side that sees every package sent, it can
+*               queue a downlink for the receive windows with Queue_Downlink()
+*****************************************************************************************
+*/
+void SimRadio::On_Uplink(void (*Callback)(SimRadio &Radio, void *Context), void *Context)
+{
+  _Uplink_Callback = Callback;
+  _Uplink_Context = Context;
+}
+
+void SimRadio::Set_Time(uint64_t Now)
+{
+  _Now = Now;
+}
+
+uint64_t SimRadio::Get_Time()
+{
+  return _Now;
+}
+
+SimRadio_Package &SimRadio::Last_Package()
+{
+  return _Last;
+}
+
+unsigned long SimRadio::Get_Package_Count()
+{
+  return _Package_Count;
+}
+
+void SimRadio::Queue_Downlink(const unsigned char *Data, unsigned char Length, unsigned char Window)
+{
+  if(Length > SIMRADIO_MAX_PACKAGE)
+  {
+    Length = SIMRADIO_MAX_PACKAGE;
+  }
+  memcpy(_Downlink, Data, Length);
+  _Downlink_Length = Length;
+  _Downlink_Window = Window;
+}
+
+void SimRadio::Set_Snr(signed char Snr)
+{
+  _Snr = Snr;
+}
+
+/*
+*****************************************************************************************
+* Description : Time on air in us for the EU863-870 data rates, LoRa with 8 preamble
+*               symbols, explicit header, CRC on, coding rate 4/5. DR7 is FSK 50 kbps
+*               with 5 preamble bytes, 3 sync bytes, length byte and CRC-16.
+*****************************************************************************************
+*/
+uint64_t SimRadio::Time_On_Air(unsigned char Datarate, unsigned char Length)
+{
+  int SF;
+  int DE;
+  int Numerator;
+  int Payload_Symbols;
+
+  if(Datarate == 7)
+  {
+    return (uint64_t)(5 + 3 + 1 + Length + 2) * 8 * 20;
+  }
+
+  SF = (Datarate < 6) ? 12 - Datarate : 7;
+  DE = (SF >= 11 && Datarate != 6) ? 1 : 0;
+
+  Numerator = 8 * Length - 4 * SF + 28 + 16;
+  Payload_Symbols = 8;
+  if(Numerator > 0)
+  {
+    Payload_Symbols += ((Numerator + 4 * (SF - 2 * DE) - 1) / (4 * (SF - 2 * DE))) * 5;
+  }
+
+  //12.25 preamble symbols
+  return (Symbol_Time(Datarate) * (49 + 4 * Payload_Symbols)) / 4;
+}
+
+uint64_t SimRadio::Symbol_Time(unsigned char Datarate)
+{
+  int SF;
+
+  if(Datarate == 7)
+  {
+    return 20;
+  }
+
+  SF = (Datarate < 6) ? 12 - Datarate : 7;
+
+  //2^SF / BW
+  return (Datarate == 6) ? ((uint64_t)1000000 << SF) / 250000 : ((uint64_t)1000000 << SF) / 125000;
+}
@@ -0,0 +1,112 @@
+/*
+  SimRadio.h - Simulated radio for host builds of the LoRaWAN stack
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Models the LoRaWAN radio concept (see LoRaWAN_Radio.h) without hardware. Each
+  instance has its own virtual clock in microseconds: a transmission advances it
+  by the time on air, a receive window advances it to the end of the window.
+  Scheduled uplinks (RFM_Start_Package and the waits that follow) leave the clock
+  to the caller and tell how long to wait instead.
+  Sent packages are kept with channel, data rate, power and timing, downlinks can
+  be queued for the next receive window. In continuous receive (class C)
+  Deliver() plays the RxDone interrupt and queues a package in the ring.
+  On_Uplink() hands every package to a simulated network right after TxDone, in
+  time to queue a downlink for the receive windows that follow.
+*/
+
+#ifndef SimRadio_h
+#define SimRadio_h
+
+#include <stdint.h>
+#include "ChannelSelector.h"
+#include "PacketRing.h"
+
+#define SIMRADIO_MAX_PACKAGE 64
+
+struct SimRadio_Package
+{
+  unsigned char Data[SIMRADIO_MAX_PACKAGE];
+  unsigned char Length;
+  unsigned char Channel;
+  unsigned char Datarate;
+  signed char Tx_Power;
+  // virtual time in us
+  uint64_t Start;
+  uint64_t Time_On_Air;
+};
+
+class SimRadio
+{
+  public:
+    SimRadio();
+
+    // LoRaWAN radio concept
+    bool RFM_Send_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    unsigned char RFM_Receive_Window(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned long Delay, unsigned char Window);
+    signed char RFM_Get_Snr();
+    void RFM_Set_Tx_Power(signed char Power, bool PA_Boost = true);
+    signed char RFM_Get_Tx_Power();
+    void RFM_Set_Datarate(unsigned char Datarate);
+    unsigned char RFM_Get_Datarate();
+    void RFM_Set_Rx2_Datarate(unsigned char Datarate);
+    unsigned char RFM_Get_Rx2_Datarate();
+    void RFM_Set_Rx1_Offset(unsigned char Offset);
+    unsigned char RFM_Get_Rx1_Offset();
+    unsigned char RFM_Get_Channel();
+    ChannelSelector &RFM_Channels();
+    void RFM_Start_Continuous_Rx();
+    void RFM_Stop_Continuous_Rx();
+    unsigned char RFM_Get_Package(unsigned char *RFM_Rx_Package, unsigned char Max_Length);
+    void RFM_On_Receive(void (*Callback)());
+    unsigned int RFM_Get_Rx_Dropped();
+    // scheduled uplinks, the clock moves on with the scheduler in between
+    bool RFM_Start_Package(unsigned char *RFM_Tx_Package, unsigned char Package_Length);
+    unsigned long RFM_Tx_Wait();
+    signed long RFM_Window_Wait(unsigned long Delay, unsigned char Window);
+    unsigned long RFM_Open_Window(unsigned long Delay, unsigned char Window);
+    unsigned long RFM_Rx_Wait(unsigned char *RFM_Rx_Package, unsigned char Max_Length, unsigned char *Length);
+
+    // simulation
+    void Set_Time(uint64_t Now);
+    uint64_t Get_Time();
+    SimRadio_Package &Last_Package();
+    unsigned long Get_Package_Count();
+    void Queue_Downlink(const unsigned char *Data, unsigned char Length, unsigned char Window);
+    void Set_Snr(signed char Snr);
+    bool Deliver(const unsigned char *Data, unsigned char Length);
+    void On_Uplink(void (*Callback)(SimRadio &Radio, void *Context), void *Context);
+
+    static uint64_t Time_On_Air(unsigned char Datarate, unsigned char Length);
+    static uint64_t Symbol_Time(unsigned char Datarate);
+
+  private:
+    uint64_t _Now;
+    uint64_t _Tx_Done_Time;
+    // scheduled uplink on air, receive window open (1 or 2) until _Rx_End
+    bool _Tx_Busy;
+    unsigned char _Rx_Window;
+    uint64_t _Rx_End;
+    signed char _Tx_Power;
+    unsigned char _Datarate;
+    unsigned char _Rx2_Datarate;
+    unsigned char _Rx1_Offset;
+    unsigned char _Current_Channel;
+    ChannelSelector _Channels;
+    SimRadio_Package _Last;
+    unsigned long _Package_Count;
+    // one pending downlink
+    unsigned char _Downlink[SIMRADIO_MAX_PACKAGE];
+    unsigned char _Downlink_Length;
+    unsigned char _Downlink_Window;
+    signed char _Snr;
+    // continuous receive
+    PacketRing _Rx_Ring;
+    bool _Rx_Continuous;
+    void (*_Rx_Callback)();
+    // network side
+    void (*_Uplink_Callback)(SimRadio &Radio, void *Context);
+    void *_Uplink_Context;
+};
+
+#endif
@@ -0,0 +1,585 @@
+/*
+  UplinkJournal.cpp - Store and forward journal of uplinks in flash
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+*/
+
+#include <string.h>
+
+#include "UplinkJournal.h"
+
+#ifdef ARDUINO
+#include "Arduino.h"
+
+// load address and size of the initialized data, the image ends after it
+extern "C" char _sidata, _sdata, _edata;
+#endif
+
+// "ULJ1"
+#define JOURNAL_MAGIC      0x314A4C55UL
+#define JOURNAL_DELIVERED  0x0000
+#define JOURNAL_FREE       0xFFFF
+
+// offsets in a slot
+#define JOURNAL_CRC        2
+#define JOURNAL_LENGTH     6
+#define JOURNAL_PORT       7
+#define JOURNAL_PRIORITY   8
+#define JOURNAL_DATA       10
+
+static uint32_t Journal_CRC(const unsigned char *Data, unsigned int Length);
+static unsigned char Journal_Bits(uint16_t Mask);
+
+
+// constructor
+UplinkJournal::UplinkJournal()
+{
+  memset(_Pending, 0, sizeof(_Pending));
+  _Head_Page = 0;
+  _Head_Slot = JOURNAL_SLOTS;
+  _Sequence = 0;
+  _Count = 0;
+  _Dropped = 0;
+  _Batch_Count = 0;
+  _Peek_Page = -1;
+#ifndef ARDUINO
+  memset(_Flash, 0xFF, sizeof(_Flash));
+  memset(_Erases, 0, sizeof(_Erases));
+  _Violations = 0;
+  _Fail_After = -1;
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : Function finds head and tail of the journal after a reset and rebuilds
+*               the index of waiting records. Records still in RAM are lost.
+*
+* Returns     : false when the program image reaches into the journal pages
+*****************************************************************************************
+*/
+bool UplinkJournal::begin()
+{
+  unsigned char Page;
+  unsigned char Slot;
+  unsigned char Low;
+  unsigned char High;
+  unsigned char Record[JOURNAL_SLOT_SIZE];
+  uint32_t Header[2];
+  uint16_t State;
+  bool Found = false;
+
+#ifdef ARDUINO
+  if((uint32_t)&_sidata + (uint32_t)(&_edata - &_sdata) > JOURNAL_BASE)
+  {
+    return false;
+  }
+#else
+  //Power is back
+  _Fail_After = -1;
+#endif
+
+  memset(_Pending, 0, sizeof(_Pending));
+  _Count = 0;
+  _Batch_Count = 0;
+  _Peek_Page = -1;
+
+  //Head is the page written last
+  for(Page = 0; Page < JOURNAL_PAGES; Page++)
+  {
+    Read(Page * JOURNAL_PAGE_SIZE, (unsigned char *)Header, sizeof(Header));
+    if(Header[0] == JOURNAL_MAGIC && (!Found || Header[1] > _Sequence))
+    {
+      _Head_Page = Page;
+      _Sequence = Header[1];
+      Found = true;
+    }
+  }
+
+  if(!Found)
+  {
+    //Blank or foreign flash
+    _Head_Page = 0;
+    _Sequence = 1;
+    _Head_Slot = 0;
+    Format_Page(0, _Sequence);
+    return true;
+  }
+
+  //Written slots come first in a page, the first free one is the head
+  Low = 0;
+  High = JOURNAL_SLOTS;
+  while(Low < High)
+  {
+    Slot = (Low + High) / 2;
+    if(Read_State(_Head_Page, Slot) == JOURNAL_FREE)
+    {
+      High = Slot;
+    }
+    else
+    {
+      Low = Slot + 1;
+    }
+  }
+  _Head_Slot = Low;
+
+  //A record cut short by the reset, close it so the order above holds
+  if(_Head_Slot < JOURNAL_SLOTS)
+  {
+    Read(Slot_Address(_Head_Page, _Head_Slot), Record, JOURNAL_SLOT_SIZE);
+    for(Slot = 2; Slot < JOURNAL_SLOT_SIZE; Slot++)
+    {
+      if(Record[Slot] != 0xFF)
+      {
+        State = JOURNAL_DELIVERED;
+        Program(Slot_Address(_Head_Page, _Head_Slot), (unsigned char *)&State, 2);
+        _Head_Slot++;
+        break;
+      }
+    }
+  }
+
+  for(Page = 0; Page < JOURNAL_PAGES; Page++)
+  {
+    Read(Page * JOURNAL_PAGE_SIZE, (unsigned char *)Header, sizeof(Header));
+    if(Header[0] != JOURNAL_MAGIC)
+    {
+      continue;
+    }
+
+    for(Slot = 0; Slot < ((Page == _Head_Page) ? _Head_Slot : JOURNAL_SLOTS); Slot++)
+    {
+      if(Read_State(Page, Slot) != JOURNAL_VALID)
+      {
+        continue;
+      }
+      Read(Slot_Address(Page, Slot) + JOURNAL_PRIORITY, Record, 1);
+      if(Record[0] < JOURNAL_PRIORITIES)
+      {
+        _Pending[Page][Record[0]] |= 1 << Slot;
+        _Count++;
+      }
+    }
+  }
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function adds a record, in RAM until the next Flush(). A full batch is
+*               written right away.
+*
+* Arguments   : *Data, Length  frame payload, up to JOURNAL_MAX_DATA bytes
+*               Port  FPort to send it on
+*               Priority  0 .. JOURNAL_PRIORITIES - 1, higher is sent first
+*
+* Returns     : false when the record does not fit
+*****************************************************************************************
+*/
+bool UplinkJournal::Append(const unsigned char *Data, unsigned char Length, unsigned char Port, unsigned char Priority)
+{
+  unsigned char *Record;
+  uint32_t CRC;
+
+  if(Length > JOURNAL_MAX_DATA)
+  {
+    return false;
+  }
+
+  if(Priority >= JOURNAL_PRIORITIES)
+  {
+    Priority = JOURNAL_PRIORITIES - 1;
+  }
+
+  if(_Batch_Count == JOURNAL_BATCH)
+  {
+    Flush();
+  }
+
+  Record = _Batch[_Batch_Count];
+  memset(Record, 0xFF, JOURNAL_SLOT_SIZE);
+  Record[JOURNAL_LENGTH] = Length;
+  Record[JOURNAL_PORT] = Port;
+  Record[JOURNAL_PRIORITY] = Priority;
+  memcpy(&Record[JOURNAL_DATA], Data, Length);
+  CRC = Journal_CRC(&Record[JOURNAL_LENGTH], JOURNAL_DATA - JOURNAL_LENGTH + Length);
+  memcpy(&Record[JOURNAL_CRC], &CRC, 4);
+  //State last
+  Record[0] = JOURNAL_VALID & 0xFF;
+  Record[1] = JOURNAL_VALID >> 8;
+
+  _Batch_Count++;
+  _Count++;
+
+  return true;
+}
+
+/*
+*****************************************************************************************
+* Description : Function writes the records in RAM to flash and erases the next page
+*               once the head page is full
+*****************************************************************************************
+*/
+void UplinkJournal::Flush()
+{
+  unsigned char i;
+  unsigned char *Record;
+  uint32_t Address;
+
+  for(i = 0; i < _Batch_Count; i++)
+  {
+    if(_Head_Slot >= JOURNAL_SLOTS)
+    {
+      Advance();
+    }
+
+    Record = _Batch[i];
+    Address = Slot_Address(_Head_Page, _Head_Slot);
+    //Everything but the State, whole halfwords
+    Program(Address + 2, &Record[2], ((JOURNAL_DATA + Record[JOURNAL_LENGTH] + 1) & ~1) - 2);
+    Program(Address, Record, 2);
+
+    _Pending[_Head_Page][Record[JOURNAL_PRIORITY]] |= 1 << _Head_Slot;
+    _Head_Slot++;
+  }
+  _Batch_Count = 0;
+
+  //The next Flush() starts on an erased page
+  if(_Head_Slot >= JOURNAL_SLOTS)
+  {
+    Advance();
+  }
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the next record to send: highest priority first, the
+*               oldest first within a priority. It stays in the journal until Pop().
+*
+* Arguments   : *Data  room for JOURNAL_MAX_DATA bytes
+*               *Length, *Port  of the record
+*
+* Returns     : false when the journal is empty
+*****************************************************************************************
+*/
+bool UplinkJournal::Peek(unsigned char *Data, unsigned char *Length, unsigned char *Port)
+{
+  unsigned char Record[JOURNAL_SLOT_SIZE];
+  unsigned char Priority;
+  unsigned char Page;
+  unsigned char Slot;
+  unsigned char i;
+  uint32_t CRC;
+  uint16_t State;
+
+  if(_Batch_Count > 0)
+  {
+    Flush();
+  }
+
+  for(Priority = JOURNAL_PRIORITIES; Priority-- > 0; )
+  {
+    //Oldest page right after the head
+    for(i = 1; i <= JOURNAL_PAGES; i++)
+    {
+      Page = (_Head_Page + i) % JOURNAL_PAGES;
+
+      while(_Pending[Page][Priority] != 0)
+      {
+        for(Slot = 0; (_Pending[Page][Priority] & (1 << Slot)) == 0; Slot++)
+        {
+        }
+
+        Read(Slot_Address(Page, Slot), Record, JOURNAL_SLOT_SIZE);
+        memcpy(&CRC, &Record[JOURNAL_CRC], 4);
+
+        if(Record[JOURNAL_LENGTH] <= JOURNAL_MAX_DATA &&
+           CRC == Journal_CRC(&Record[JOURNAL_LENGTH], JOURNAL_DATA - JOURNAL_LENGTH + Record[JOURNAL_LENGTH]))
+        {
+          *Length = Record[JOURNAL_LENGTH];
+          *Port = Record[JOURNAL_PORT];
+          memcpy(Data, &Record[JOURNAL_DATA], *Length);
+          _Peek_Page = Page;
+          _Peek_Slot = Slot;
+          _Peek_Priority = Priority;
+          return true;
+        }
+
+        //Corrupt, never send it
+        State = JOURNAL_DELIVERED;
+        Program(Slot_Address(Page, Slot), (unsigned char *)&State, 2);
+        _Pending[Page][Priority] &= ~(1 << Slot);
+        _Count--;
+        _Dropped++;
+      }
+    }
+  }
+
+  return false;
+}
+
+/*
+*****************************************************************************************
+* Description : Function marks the record of the last Peek() as delivered
+*****************************************************************************************
+*/
+void UplinkJournal::Pop()
+{
+  uint16_t State = JOURNAL_DELIVERED;
+
+  if(_Peek_Page < 0)
+  {
+    return;
+  }
+
+  Program(Slot_Address(_Peek_Page, _Peek_Slot), (unsigned char *)&State, 2);
+  _Pending[_Peek_Page][_Peek_Priority] &= ~(1 << _Peek_Slot);
+  _Count--;
+  _Peek_Page = -1;
+}
+
+unsigned int UplinkJournal::Get_Count()
+{
+  return _Count;
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the records lost to a full journal or a bad CRC
+*****************************************************************************************
+*/
+unsigned long UplinkJournal::Get_Dropped()
+{
+  return _Dropped;
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the records the journal holds at least before it
+*               drops the oldest page, the head page is kept erased ahead
+*****************************************************************************************
+*/
+unsigned int UplinkJournal::Get_Capacity()
+{
+  return (JOURNAL_PAGES - 1) * JOURNAL_SLOTS;
+}
+
+#ifndef ARDUINO
+unsigned long UplinkJournal::Get_Erases(unsigned char Page)
+{
+  return _Erases[Page];
+}
+
+/*
+*****************************************************************************************
+* Description : Function returns the halfwords programmed over something else than
+*               0xFFFF with a value other than 0x0000, the F1 refuses those
+*****************************************************************************************
+*/
+unsigned long UplinkJournal::Get_Violations()
+{
+  return _Violations;
+}
+
+/*
+*****************************************************************************************
+* Description : Function cuts the power after the given number of flash operations
+*               (halfword programs and page erases), later ones are lost until begin()
+*
+* Arguments   : Operations  -1 never
+*****************************************************************************************
+*/
+void UplinkJournal::Fail_After(long Operations)
+{
+  _Fail_After = Operations;
+}
+#endif
+
+/*
+*****************************************************************************************
+* Description : Function moves the head to the next page, the oldest records on it are
+*               dropped
+*****************************************************************************************
+*/
+void UplinkJournal::Advance()
+{
+  unsigned char Next = (_Head_Page + 1) % JOURNAL_PAGES;
+  unsigned char Priority;
+  unsigned char Lost;
+
+  for(Priority = 0; Priority < JOURNAL_PRIORITIES; Priority++)
+  {
+    Lost = Journal_Bits(_Pending[Next][Priority]);
+    _Count -= Lost;
+    _Dropped += Lost;
+    _Pending[Next][Priority] = 0;
+  }
+
+  if(_Peek_Page == Next)
+  {
+    _Peek_Page = -1;
+  }
+
+  _Sequence++;
+  Format_Page(Next, _Sequence);
+  _Head_Page = Next;
+  _Head_Slot = 0;
+}
+
+/*
+*****************************************************************************************
+* Description : Function erases a page and writes its header, Magic last so a header
+*               with Magic has its Sequence
+*****************************************************************************************
+*/
+void UplinkJournal::Format_Page(unsigned char Page, uint32_t Sequence)
+{
+  uint32_t Magic = JOURNAL_MAGIC;
+
+  Erase(Page);
+  Program(Page * JOURNAL_PAGE_SIZE + 4, (unsigned char *)&Sequence, 4);
+  Program(Page * JOURNAL_PAGE_SIZE, (unsigned char *)&Magic, 4);
+}
+
+uint32_t UplinkJournal::Slot_Address(unsigned char Page, unsigned char Slot)
+{
+  return Page * JOURNAL_PAGE_SIZE + JOURNAL_HEADER + Slot * JOURNAL_SLOT_SIZE;
+}
+
+uint16_t UplinkJournal::Read_State(unsigned char Page, unsigned char Slot)
+{
+  uint16_t State;
+
+  Read(Slot_Address(Page, Slot), (unsigned char *)&State, 2);
+  return State;
+}
+
+/*
+*****************************************************************************************
+* Description : Flash access, Address from the start of the journal. The STM32 reads
+*               flash like memory and programs halfwords, host builds check the same
+*               rules on their copy.
+*****************************************************************************************
+*/
+void UplinkJournal::Read(uint32_t Address, unsigned char *Data, unsigned int Length)
+{
+#ifdef ARDUINO
+  memcpy(Data, (const void *)(JOURNAL_BASE + Address), Length);
+#else
+  memcpy(Data, &_Flash[Address], Length);
+#endif
+}
+
+void UplinkJournal::Program(uint32_t Address, const unsigned char *Data, unsigned int Length)
+{
+  unsigned int i;
+  uint16_t Value;
+
+#ifdef ARDUINO
+  HAL_FLASH_Unlock();
+  for(i = 0; i < Length; i += 2)
+  {
+    Value = Data[i] | (Data[i + 1] << 8);
+    //Nothing to program, keeps the erased halfwords of short records
+    if(Value != JOURNAL_FREE)
+    {
+      HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, JOURNAL_BASE + Address + i, Value);
+    }
+  }
+  HAL_FLASH_Lock();
+#else
+  uint16_t Current;
+
+  for(i = 0; i < Length; i += 2)
+  {
+    Value = Data[i] | (Data[i + 1] << 8);
+    if(Value == JOURNAL_FREE)
+    {
+      continue;
+    }
+    if(_Fail_After == 0)
+    {
+      return;
+    }
+    if(_Fail_After > 0)
+    {
+      _Fail_After--;
+    }
+
+    Current = _Flash[Address + i] | (_Flash[Address + i + 1] << 8);
+    if(Current != JOURNAL_FREE && Value != JOURNAL_DELIVERED)
+    {
+      _Violations++;
+      continue;
+    }
+    _Flash[Address + i] = Value & 0xFF;
+    _Flash[Address + i + 1] = Value >> 8;
+  }
+#endif
+}
+
+void UplinkJournal::Erase(unsigned char Page)
+{
+#ifdef ARDUINO
+  FLASH_EraseInitTypeDef Init;
+  uint32_t Error;
+
+  Init.TypeErase = FLASH_TYPEERASE_PAGES;
+  Init.Banks = 0;
+  Init.PageAddress = JOURNAL_BASE + Page * JOURNAL_PAGE_SIZE;
+  Init.NbPages = 1;
+
+  HAL_FLASH_Unlock();
+  HAL_FLASHEx_Erase(&Init, &Error);
+  HAL_FLASH_Lock();
+#else
+  if(_Fail_After == 0)
+  {
+    return;
+  }
+  if(_Fail_After > 0)
+  {
+    _Fail_After--;
+  }
+
+  memset(&_Flash[Page * JOURNAL_PAGE_SIZE], 0xFF, JOURNAL_PAGE_SIZE);
+  _Erases[Page]++;
+#endif
+}
+
+/*
+*****************************************************************************************
+* Description : CRC-32 (IEEE 802.3), bitwise like the session store
+*****************************************************************************************
+*/
+static uint32_t Journal_CRC(const unsigned char *Data, unsigned int Length)
+{
+  unsigned int i;
+  unsigned char j;
+  uint32_t CRC = 0xFFFFFFFFUL;
+
+  for(i = 0; i < Length; i++)
+  {
+    CRC ^= Data[i];
+    for(j = 0; j < 8; j++)
+    {
+      CRC = (CRC >> 1) ^ (0xEDB88320UL & (0 - (CRC & 1)));
+    }
+  }
+
+  return ~CRC;
+}
+
+static unsigned char Journal_Bits(uint16_t Mask)
+{
+  unsigned char Bits = 0;
+
+  while(Mask != 0)
+  {
+    Mask &= Mask - 1;
+    Bits++;
+  }
+
+  return Bits;
+}
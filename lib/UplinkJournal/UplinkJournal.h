@@ -0,0 +1,113 @@
+/*
+  UplinkJournal.h - Store and forward journal of uplinks in flash
+  Released into the public domain.
+  @license Attribution-NonCommercial-ShareAlike 4.0 International (CC BY-NC-SA 4.0)
+
+  Uplinks that could not be delivered (no ACK, all channels busy) are kept in
+  JOURNAL_PAGES flash pages below the emulated EEPROM page and sent again once
+  the network acknowledges frames again, highest priority first, oldest first
+  within a priority.
+
+  Flash layout, used as a ring of pages:
+
+    page    Magic | Sequence | slot 0 .. JOURNAL_SLOTS - 1
+    slot    State | CRC-32 | Length | Port | Priority | - | Data | -
+             2       4        1       1       1        1   51     3
+
+  The CRC covers Length to the end of Data.
+
+  State is written last: 0xFFFF free, JOURNAL_VALID waiting, 0x0000 delivered.
+  The F1 flash can program a halfword once after an erase, except for 0x0000
+  which always goes, so delivering a record is a single halfword write. A record
+  cut short by a reset never got its State and is skipped.
+
+  Recovery at boot reads the page headers (the page with the highest Sequence is
+  the head, the ring order gives the tail), a binary search finds the first free
+  slot of the head page and State and Priority of each slot fill the RAM index
+  of waiting records. A record is read and its CRC checked when it is sent.
+
+  Append() only copies into RAM, Flush() writes JOURNAL_BATCH records at once
+  and erases the next page as soon as the head page is full, so neither waits
+  on the radio path: call Flush() from a background task. The F103 has a single
+  flash bank, the CPU stalls while it programs (about 50 us a halfword) or
+  erases (about 20 ms a page). A full journal erases its oldest page, those
+  records count as dropped. The pages take turns, one erase per JOURNAL_SLOTS
+  records: 10k erase cycles last 1.2 million records.
+
+  Host builds (no ARDUINO) keep the flash in the object with the same program
+  rules, and can cut the power after a number of flash operations.
+*/
+
+#ifndef UplinkJournal_h
+#define UplinkJournal_h
+
+#include <stdint.h>
+
+#define JOURNAL_PAGES      8
+#define JOURNAL_PAGE_SIZE  1024
+#define JOURNAL_HEADER     8
+#define JOURNAL_SLOT_SIZE  64
+#define JOURNAL_SLOTS      ((JOURNAL_PAGE_SIZE - JOURNAL_HEADER) / JOURNAL_SLOT_SIZE)
+#define JOURNAL_MAX_DATA   51
+#define JOURNAL_PRIORITIES 4
+// records kept in RAM until Flush()
+#define JOURNAL_BATCH      4
+// end of the flash used, the emulated EEPROM page is right below it
+#ifndef JOURNAL_FLASH_END
+#define JOURNAL_FLASH_END  0x08010000UL
+#endif
+#define JOURNAL_BASE       (JOURNAL_FLASH_END - (JOURNAL_PAGES + 1) * JOURNAL_PAGE_SIZE)
+
+#define JOURNAL_VALID      0x5AA5
+
+class UplinkJournal
+{
+  public:
+    UplinkJournal();
+    bool begin();
+    bool Append(const unsigned char *Data, unsigned char Length, unsigned char Port, unsigned char Priority = 0);
+    void Flush();
+    bool Peek(unsigned char *Data, unsigned char *Length, unsigned char *Port);
+    void Pop();
+
+    unsigned int Get_Count();
+    unsigned long Get_Dropped();
+    unsigned int Get_Capacity();
+#ifndef ARDUINO
+    // simulation of the flash
+    unsigned long Get_Erases(unsigned char Page);
+    unsigned long Get_Violations();
+    void Fail_After(long Operations);
+#endif
+
+  private:
+    unsigned char _Head_Page;
+    unsigned char _Head_Slot;
+    uint32_t _Sequence;
+    // waiting records, one bit per slot
+    uint16_t _Pending[JOURNAL_PAGES][JOURNAL_PRIORITIES];
+    unsigned int _Count;
+    unsigned long _Dropped;
+    unsigned char _Batch[JOURNAL_BATCH][JOURNAL_SLOT_SIZE];
+    unsigned char _Batch_Count;
+    // record returned by Peek(), for Pop()
+    signed char _Peek_Page;
+    unsigned char _Peek_Slot;
+    unsigned char _Peek_Priority;
+#ifndef ARDUINO
+    unsigned char _Flash[JOURNAL_PAGES * JOURNAL_PAGE_SIZE];
+    unsigned long _Erases[JOURNAL_PAGES];
+    unsigned long _Violations;
+    long _Fail_After;
+#endif
+
+    void Advance();
+    void Format_Page(unsigned char Page, uint32_t Sequence);
+    uint32_t Slot_Address(unsigned char Page, unsigned char Slot);
+    uint16_t Read_State(unsigned char Page, unsigned char Slot);
+    void Read(uint32_t Address, unsigned char *Data, unsigned int Length);
+    void Program(uint32_t Address, const unsigned char *Data, unsigned int Length);
+    void Erase(unsigned char Page);
+};
+
+#endif
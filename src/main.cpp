@@ -12,9 +12,14 @@
 
 #include <Arduino.h>
 
-#include "STM32LowPower.h"
-
+#include "RFM95.h"
 #include "LoRaWAN.h"
+#include "MemoryMonitor.h"
+#include "Scheduler.h"
+#include "LowPowerClock.h"
+#include "Sampler.h"
+#include "UplinkJournal.h"
+#include "RxTiming.h"
 #include "secconfig.h" // remember to rename secconfig_example.h to secconfig.h and to modify this file
 
 
@@ -25,7 +30,69 @@
 RFM95 rfm(DIO0, NSS);
 
 // define LoRaWAN layer
-LoRaWAN lora = LoRaWAN(rfm);
+LoRaWAN<RFM95> lora(rfm);
+SessionStore session;
+
+// stack high water mark and RAM map
+MemoryMonitor memory;
+
+// tasks, the scheduler sleeps as deep as it can in between
+LowPowerClock sleepClock;
+Scheduler<LowPowerClock> scheduler(sleepClock);
+signed char sendTaskId;
+signed char joinTaskId;
+// takes an uplink through TxDone, RX1 and RX2, posted by DIO0 in between
+signed char radioTaskId;
+
+// ms between uplinks
+#define SEND_PERIOD 20000
+// ms between join requests, well below the 1% duty cycle of a SF10 join request,
+// doubled after every failed one up to JOIN_PERIOD_MAX
+#define JOIN_PERIOD 60000
+#define JOIN_PERIOD_MAX 3600000
+unsigned long joinPeriod = JOIN_PERIOD;
+
+// sensor on PA0, sampled in windows and sent as a summary with each uplink
+#define SAMPLE_CHANNEL 0
+#define SAMPLE_RATE 1000
+#define SAMPLE_PERIOD 5000
+#define SAMPLE_WINDOW 500
+// crossings of the alarm level are counted, hysteresis down to the second value
+#define SAMPLE_ALARM_HIGH 3000
+#define SAMPLE_ALARM_LOW 2800
+Sampler sampler;
+Aggregate summary;
+signed char sampleTaskId;
+signed char sampleEndTaskId;
+signed char blockTaskId;
+
+// actuator nodes on mains power: receive downlinks between uplinks, not only after them
+//#define CLASS_C
+#ifdef CLASS_C
+signed char receiveTaskId;
+#endif
+
+// uplinks the network did not acknowledge wait in flash and are sent again once it
+// does, every uplink is confirmed then and costs a downlink
+//#define STORE_AND_FORWARD
+#ifdef STORE_AND_FORWARD
+#define SEND_PORT 1
+// frame around the payload: MHDR, FHDR without FOpts, FPort, MIC
+#define SEND_OVERHEAD 13
+UplinkJournal journal;
+// the journal pages are clear of the program image
+bool journaling = false;
+signed char drainTaskId;
+signed char flushTaskId;
+unsigned long lastUplink;
+// ms off air after the last uplink for the 1% duty cycle
+unsigned long uplinkWait;
+// the uplink on air, from the journal or journaled when it is not acknowledged
+bool uplinkJournaled;
+unsigned char uplinkData[JOURNAL_MAX_DATA];
+unsigned char uplinkLength;
+unsigned char uplinkPriority;
+#endif
 
 
 void setPinModes() {
@@ -33,17 +100,307 @@ void setPinModes() {
   pinMode(RESET, OUTPUT);
 }
 
+void resetRFM() {
+  digitalWrite(RESET, LOW);
+  delay(10);
+  digitalWrite(RESET, HIGH);
+  //POR of the SX1276 takes 5 ms
+  delay(10);
+}
+
+void printMemory() {
+  Memory_Map Map;
+
+  memory.Get_Map(&Map);
+  SerialUSB.print("RAM data ");
+  SerialUSB.print(Map.Data);
+  SerialUSB.print(" bss ");
+  SerialUSB.print(Map.Bss);
+  SerialUSB.print(" heap ");
+  SerialUSB.print(Map.Heap);
+  SerialUSB.print(" stack max ");
+  SerialUSB.print(Map.Stack);
+  SerialUSB.print(" never used ");
+  SerialUSB.print(Map.Stack_Free);
+  SerialUSB.print(" of ");
+  SerialUSB.println(Map.Total);
+}
+
+/*
+  Starts an uplink, radioTask takes it through its receive windows. The MCU sleeps
+  in between, but not in stop mode: the RTC alarm can not wake it in time for RX1.
+*/
+bool startUplink(unsigned char *Data, unsigned char Data_Length) {
+  if(!lora.Start_Data(Data, Data_Length))
+  {
+    return false;
+  }
+
+  scheduler.Hold_Deep_Sleep();
+  scheduler.Post(radioTaskId);
+  return true;
+}
+
+//DIO0 interrupt, TxDone or RxDone of a receive window
+void onRadio() {
+  scheduler.Post(radioTaskId);
+}
+
+#ifdef STORE_AND_FORWARD
+/*
+  Starts one frame confirmed and works out how long the radio has to stay off air:
+  99 times the time on air for 1%
+*/
+bool startConfirmed(unsigned char *Data, unsigned char Data_Length, unsigned char Port) {
+  unsigned char Datarate = rfm.RFM_Get_Datarate();
+  unsigned char SF = (Datarate < 6) ? 12 - Datarate : 7;
+  uint16_t Bandwidth = (Datarate == 6) ? 250 : 125;
+
+  lora.setPort(Port);
+  if(!startUplink(Data, Data_Length))
+  {
+    return false;
+  }
+  lastUplink = millis();
+  uplinkWait = RxTiming::Airtime(Data_Length + SEND_OVERHEAD, SF, Bandwidth, true) * 99 / 1000;
+
+  return true;
+}
+
+//Sends the backlog, as fast as the duty cycle allows while the network answers
+void drainTask(void *Context) {
+  unsigned char Port;
+  unsigned long Waited = millis() - lastUplink;
+
+  //The uplink on air drains on when it is acknowledged
+  if(lora.isBusy())
+  {
+    return;
+  }
+
+  if(Waited < uplinkWait)
+  {
+    scheduler.Run_After(drainTaskId, uplinkWait - Waited);
+    return;
+  }
+
+  if(!journal.Peek(uplinkData, &uplinkLength, &Port))
+  {
+    return;
+  }
+
+  if(!rfm.resume())
+  {
+    resetRFM();
+    rfm.init();
+  }
+
+  uplinkJournaled = true;
+  startConfirmed(uplinkData, uplinkLength, Port);
+}
+
+//Journal or send a reading, the backlog keeps its order
+void forward(unsigned char *Data, unsigned char Data_Length, unsigned char Priority) {
+  //Behind the backlog, too early for the duty cycle or the radio is busy
+  if(journal.Get_Count() > 0 || millis() - lastUplink < uplinkWait || lora.isBusy())
+  {
+    journal.Append(Data, Data_Length, SEND_PORT, Priority);
+    scheduler.Post(flushTaskId);
+    scheduler.Post(drainTaskId);
+    return;
+  }
+
+  uplinkJournaled = false;
+  memcpy(uplinkData, Data, Data_Length);
+  uplinkLength = Data_Length;
+  uplinkPriority = Priority;
+
+  if(!startConfirmed(uplinkData, uplinkLength, SEND_PORT))
+  {
+    journal.Append(Data, Data_Length, SEND_PORT, Priority);
+    scheduler.Post(flushTaskId);
+  }
+}
+
+//The receive windows are over, the record is delivered or goes into the journal
+void forwardDone() {
+  if(!lora.isAcked())
+  {
+    //Out of coverage the next reading tries again, once per SEND_PERIOD
+    if(!uplinkJournaled)
+    {
+      journal.Append(uplinkData, uplinkLength, SEND_PORT, uplinkPriority);
+    }
+  }
+  else if(uplinkJournaled)
+  {
+    journal.Pop();
+  }
+
+  if(lora.isAcked() && journal.Get_Count() > 0)
+  {
+    scheduler.Run_After(drainTaskId, uplinkWait);
+  }
+  scheduler.Post(flushTaskId);
+}
+
+//Flash writes and page erases stall the CPU, not on the radio path
+void flushTask(void *Context) {
+  //Posted again when the receive windows are over
+  if(lora.isBusy())
+  {
+    return;
+  }
+
+  journal.Flush();
+}
+#endif
+
+void radioTask(void *Context) {
+  unsigned long Wait;
+
+  //DIO0 of the join request, it waits for its windows itself
+  if(!lora.isBusy())
+  {
+    return;
+  }
+
+  Wait = lora.Run_Data();
+
+  if(Wait != LORAWAN_STEP_DONE)
+  {
+    scheduler.Run_After(radioTaskId, Wait);
+    return;
+  }
+
+  //A DIO0 post of the last step is no step anymore
+  scheduler.Cancel(radioTaskId);
+  scheduler.Release_Deep_Sleep();
+
+#ifdef STORE_AND_FORWARD
+  if(journaling)
+  {
+    forwardDone();
+  }
+#endif
+  printMemory();
+}
+
+void sendTask(void *Context) {
+  //The receive windows of the last uplink are not over, the samples wait for the
+  //next one
+  if(lora.isBusy())
+  {
+    return;
+  }
+
+  digitalWrite(LED_BUILTIN, HIGH);
+
+  //The RFM kept its configuration through deep sleep, only check it. A full
+  //reset is only needed when it does not respond anymore.
+  if(!rfm.resume())
+  {
+    resetRFM();
+    rfm.init();
+  }
+  
+  
+  SerialUSB.println("Sending PKG");
+  // summary of the samples since the last uplink
+  uint8_t Data[AGGREGATE_PAYLOAD];
+  uint8_t Data_Length;
+
+  sampler.Process(summary);
+  Data_Length = summary.Pack(Data);
+#ifdef STORE_AND_FORWARD
+  //Alarms go before the backlog
+  unsigned char Priority = summary.Get_Crossings() ? 1 : 0;
+#endif
+  summary.Reset();
+
+#ifdef STORE_AND_FORWARD
+  if(journaling)
+  {
+    forward(Data, Data_Length, Priority);
+    return;
+  }
+#endif
+
+  if(!startUplink(Data, Data_Length))
+  {
+    SerialUSB.println("Not sent");
+  }
+}
+
+//DMA interrupt, half of the buffer is full
+void onSamples() {
+  scheduler.Post(blockTaskId);
+}
+
+void blockTask(void *Context) {
+  sampler.Process(summary);
+}
+
+void sampleTask(void *Context) {
+  //The ADC and DMA stop in stop mode
+  scheduler.Hold_Deep_Sleep();
+  sampler.Start();
+  scheduler.Run_After(sampleEndTaskId, SAMPLE_WINDOW);
+}
+
+void sampleEndTask(void *Context) {
+  sampler.Stop();
+  sampler.Process(summary);
+  scheduler.Release_Deep_Sleep();
+}
+
+#ifdef CLASS_C
+//RxDone interrupt, the package is already in the ring
+void onReceive() {
+  scheduler.Post(receiveTaskId);
+}
+
+void receiveTask(void *Context) {
+  unsigned char Data[LORAWAN_MAX_PAYLOAD];
+  unsigned char Data_Length;
+  unsigned char Port;
+
+  while(lora.Receive(Data, &Data_Length, &Port))
+  {
+    SerialUSB.print("Downlink on port ");
+    SerialUSB.print(Port);
+    SerialUSB.print(", bytes ");
+    SerialUSB.println(Data_Length);
+  }
+}
+#endif
+
+#ifdef OTAA
+void joinTask(void *Context) {
+  SerialUSB.println("Joining ...");
+  if(!lora.Join())
+  {
+    //A quarter at random, nodes that lost the network together do not retry together
+    scheduler.Run_After(joinTaskId, joinPeriod + random(joinPeriod / 4));
+    joinPeriod = (joinPeriod < JOIN_PERIOD_MAX / 2) ? joinPeriod * 2 : JOIN_PERIOD_MAX;
+    return;
+  }
+  joinPeriod = JOIN_PERIOD;
+  scheduler.Run_Every(sendTaskId, SEND_PERIOD);
+}
+#endif
+
 void setup()
 {
+  //Before anything else, so all later stack use is seen
+  memory.Paint();
+
   SerialUSB.begin(115200);
   SerialUSB.println("Starting ...");
 
   setPinModes();
   
-  //reset RFM
-  digitalWrite(RESET, LOW);
-  delay(10);
-  digitalWrite(RESET, HIGH);
+  resetRFM();
   delay(2000);
 
 
@@ -51,35 +408,72 @@ void setup()
   //Initialize RFM module
   rfm.init();
 
-  lora.setKeys(NwkSkey, AppSkey, DevAddr);
-
-  LowPower.begin();
+  //Check the channel with CAD before each uplink, try up to 2 other channels
+  //rfm.RFM_Set_LBT(true, 2);
 
-}
+  //RX1 and RX2 after every uplink, ACKs, MAC commands and the downlink SNR for the
+  //transmit power only come in there
+  lora.setReceiveWindows(true);
 
-void loop()
-{
-  digitalWrite(LED_BUILTIN, HIGH);
-  
-  
-  SerialUSB.println("Sending PKG");
-  // define bytebuffer
-  uint8_t Data_Length = 0x06;
-  uint8_t Data[Data_Length];
+  sleepClock.begin();
+  sendTaskId = scheduler.Add(sendTask);
+  radioTaskId = scheduler.Add(radioTask);
+  rfm.RFM_On_Done(onRadio);
 
-  Data[0] = 0;
-  Data[1] = 1;
+#ifdef STORE_AND_FORWARD
+  //Records of the last power cycle go first
+  journaling = journal.begin();
+  if(journaling)
+  {
+    lora.setConfirmed(true);
+    drainTaskId = scheduler.Add(drainTask);
+    flushTaskId = scheduler.Add(flushTask);
+    SerialUSB.print("Journal ");
+    SerialUSB.println(journal.Get_Count());
+  }
+  else
+  {
+    SerialUSB.println("Journal overlaps the program");
+  }
+#endif
 
-  // move into bytebuffer
-  Data[2] = 12;
-  Data[3] = 13;
+  summary.Set_Threshold(SAMPLE_ALARM_HIGH, SAMPLE_ALARM_LOW);
+  if(sampler.begin(SAMPLE_RATE, SAMPLE_CHANNEL))
+  {
+    sampler.On_Block(onSamples);
+    blockTaskId = scheduler.Add(blockTask);
+    sampleTaskId = scheduler.Add(sampleTask);
+    sampleEndTaskId = scheduler.Add(sampleEndTask);
+    scheduler.Run_Every(sampleTaskId, SAMPLE_PERIOD);
+  }
 
-  Data[4] = 14;
-  Data[5] = 15;
+#ifdef CLASS_C
+  //Receiving starts with the join or the first uplink
+  receiveTaskId = scheduler.Add(receiveTask);
+  rfm.RFM_On_Receive(onReceive);
+  lora.setClassC(true);
+#endif
 
-  lora.Send_Data(Data, Data_Length, 0);
+#ifdef OTAA
+  lora.setJoinKeys(AppEUI, DevEUI, AppKey);
+  lora.setSessionStore(session);
 
-  LowPower.deepSleep(20000);
+  //Join once per device lifetime, not per power cycle
+  if(!lora.Restore_Session())
+  {
+    joinTaskId = scheduler.Add(joinTask);
+    scheduler.Post(joinTaskId);
+    return;
+  }
+#else
+  lora.setKeys(NwkSkey, AppSkey, DevAddr);
+#endif
 
+  scheduler.Run_Every(sendTaskId, SEND_PERIOD);
 }
 
+void loop()
+{
+  //Runs what is due, then sleeps until the next deadline
+  scheduler.Run();
+}
@@ -0,0 +1,226 @@
+# footprint.py - flash and RAM usage per library from the linker map, and the
+# stack of the deepest functions from the -fstack-usage (.su) files
+#
+# As PlatformIO extra script (platformio.ini: extra_scripts = post:tools/footprint.py)
+# it links with a map file and writes footprint.txt to the build directory
+# (.pio/build/<env>/) after every firmware build. The report names the commit it
+# was built from, compare two of them to see what a change costs.
+#
+# Builds of a clean checkout add one line to tools/footprint.log, which is kept in
+# git, so the size of every commit stays on record. The build fails when flash or
+# RAM exceed custom_flash_budget / custom_ram_budget of the environment.
+#
+# Stand alone: python tools/footprint.py .pio/build/bluepill/firmware.map [build dir]
+#
+# Sizes are taken after --gc-sections, from the input sections the linker kept.
+# Flash is .text, .rodata and the load image of .data, RAM is .data and .bss.
+
+import os
+import re
+import subprocess
+import sys
+
+FLASH_SIZE = 64 * 1024
+RAM_SIZE = 20 * 1024
+
+# libraries listed first, everything else of the project is "src". Filled with the
+# directories in lib/ of the project.
+LIBRARIES = ()
+
+# functions listed with their stack frame
+STACK_FUNCTIONS = 20
+
+SECTION = re.compile(r"^ (\.\S+|COMMON)(?:\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*))?$")
+CONTINUED = re.compile(r"^\s+(0x[0-9a-f]+)\s+(0x[0-9a-f]+)\s+(\S.*)$")
+
+
+def find_libraries(project):
+    lib = os.path.join(project, "lib")
+    if not os.path.isdir(lib):
+        return ()
+    return tuple(sorted(name for name in os.listdir(lib) if os.path.isdir(os.path.join(lib, name))))
+
+
+def group(path):
+    archive = re.search(r"lib([^/\\]+)\.a\(", path)
+    if archive:
+        name = archive.group(1)
+        if name in LIBRARIES:
+            return name
+    for name in LIBRARIES:
+        if re.search(r"[/\\]" + name + r"[/\\]", path):
+            return name
+    if re.search(r"[/\\]src[/\\]", path) and "framework" not in path:
+        return "src"
+    return "framework"
+
+
+def parse(map_file):
+    usage = {}
+    pending = None
+    in_map = False
+
+    with open(map_file) as f:
+        for line in f:
+            if line.startswith("Linker script and memory map"):
+                in_map = True
+                continue
+            if not in_map:
+                continue
+            if line.startswith("/DISCARD/"):
+                break
+
+            match = SECTION.match(line)
+            if match:
+                if match.group(2) is None:
+                    # long names continue on the next line
+                    pending = match.group(1)
+                    continue
+                section, size, path = match.group(1), int(match.group(3), 16), match.group(4)
+            else:
+                match = CONTINUED.match(line)
+                if pending is None or not match:
+                    pending = None
+                    continue
+                section, size, path = pending, int(match.group(2), 16), match.group(3)
+            pending = None
+
+            flash = section.startswith((".text", ".rodata", ".data", ".ARM", ".init_array", ".isr_vector"))
+            ram = section.startswith((".data", ".bss", "COMMON"))
+            if size == 0 or not (flash or ram):
+                continue
+
+            entry = usage.setdefault(group(path.strip()), [0, 0])
+            if flash:
+                entry[0] += size
+            if ram:
+                entry[1] += size
+    return usage
+
+
+def stack_usage(build_dir):
+    functions = []
+    for root, dirs, files in os.walk(build_dir):
+        for name in files:
+            if not name.endswith(".su"):
+                continue
+            with open(os.path.join(root, name)) as f:
+                for line in f:
+                    fields = line.rstrip("\n").split("\t")
+                    if len(fields) != 3:
+                        continue
+                    location, size, kind = fields
+                    # file:line:column:function, the function may contain colons
+                    parts = location.split(":", 3)
+                    function = parts[3] if len(parts) == 4 else location
+                    # static initializers are listed without a name
+                    if function.endswith("cpp)"):
+                        continue
+                    functions.append((int(size), kind, group(location), function))
+    functions.sort(key=lambda entry: -entry[0])
+    return functions
+
+
+def report(usage, commit, functions=None):
+    lines = ["footprint of %s" % commit, ""]
+    lines.append("%-16s %8s %8s" % ("", "flash", "RAM"))
+    names = [name for name in LIBRARIES if name in usage]
+    names += sorted(name for name in usage if name not in LIBRARIES)
+    for name in names:
+        lines.append("%-16s %8d %8d" % (name, usage[name][0], usage[name][1]))
+    flash = sum(entry[0] for entry in usage.values())
+    ram = sum(entry[1] for entry in usage.values())
+    lines.append("%-16s %8d %8d" % ("total", flash, ram))
+    lines.append("%-16s %7.1f%% %7.1f%%" % ("of F103C8", 100.0 * flash / FLASH_SIZE, 100.0 * ram / RAM_SIZE))
+
+    if functions:
+        # frame sizes of single functions, a call chain adds them up
+        lines.append("")
+        lines.append("stack per call of the project functions")
+        listed = 0
+        for size, kind, name, function in functions:
+            if name == "framework":
+                continue
+            lines.append("%6d %-16s %-8s %s" % (size, name, kind, function))
+            listed += 1
+            if listed == STACK_FUNCTIONS:
+                break
+    return "\n".join(lines) + "\n"
+
+
+def log_line(usage, commit):
+    flash = sum(entry[0] for entry in usage.values())
+    ram = sum(entry[1] for entry in usage.values())
+    fields = ["%s flash %d RAM %d" % (commit, flash, ram)]
+    for name in ("LoRaWAN", "RFM95"):
+        if name in usage:
+            fields.append("%s %d %d" % (name, usage[name][0], usage[name][1]))
+    return "  ".join(fields) + "\n"
+
+
+def append_log(path, usage, commit):
+    # one line per commit, builds with local changes are not on record
+    if commit == "unknown" or commit.endswith("-dirty"):
+        return
+    if os.path.exists(path):
+        with open(path) as f:
+            if any(line.split(" ", 1)[0] == commit for line in f):
+                return
+    with open(path, "a") as f:
+        f.write(log_line(usage, commit))
+
+
+def over_budget(usage, flash_budget, ram_budget):
+    flash = sum(entry[0] for entry in usage.values())
+    ram = sum(entry[1] for entry in usage.values())
+    errors = []
+    if flash_budget and flash > flash_budget:
+        errors.append("flash %d bytes, budget %d" % (flash, flash_budget))
+    if ram_budget and ram > ram_budget:
+        errors.append("RAM %d bytes, budget %d" % (ram, ram_budget))
+    return errors
+
+
+def git_commit(directory):
+    try:
+        return subprocess.check_output(["git", "describe", "--always", "--dirty"], cwd=directory,
+                                       stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+if __name__ == "__main__":
+    if len(sys.argv) not in (2, 3):
+        sys.exit("footprint.py firmware.map [build dir]")
+    build_dir = sys.argv[2] if len(sys.argv) == 3 else os.path.dirname(os.path.abspath(sys.argv[1]))
+    LIBRARIES = find_libraries(os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+    sys.stdout.write(report(parse(sys.argv[1]), git_commit(build_dir), stack_usage(build_dir)))
+else:
+    Import("env")  # noqa: F821
+
+    map_file = os.path.join(env.subst("$BUILD_DIR"), "firmware.map")  # noqa: F821
+    LIBRARIES = find_libraries(env.subst("$PROJECT_DIR"))  # noqa: F821
+    env.Append(LINKFLAGS=["-Wl,-Map," + map_file])  # noqa: F821
+
+    def write_report(source, target, env):
+        build_dir = env.subst("$BUILD_DIR")
+        project = env.subst("$PROJECT_DIR")
+        usage = parse(map_file)
+        commit = git_commit(project)
+        text = report(usage, commit, stack_usage(build_dir))
+        with open(os.path.join(build_dir, "footprint.txt"), "w") as f:
+            f.write(text)
+        sys.stdout.write(text)
+
+        errors = over_budget(usage, int(env.GetProjectOption("custom_flash_budget", "0")),
+                             int(env.GetProjectOption("custom_ram_budget", "0")))
+        for error in errors:
+            sys.stderr.write("footprint over budget: %s\n" % error)
+        if errors:
+            # a non zero result fails the build
+            return 1
+
+        append_log(os.path.join(project, "tools", "footprint.log"), usage, commit)
+        return 0
+
+    env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", write_report)  # noqa: F821